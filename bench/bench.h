@@ -0,0 +1,57 @@
+#ifndef STREAMLIKE_BENCH_BENCH_H
+#define STREAMLIKE_BENCH_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static inline double bench_mb_per_sec(size_t bytes, uint64_t ns)
+{
+    return ns ? (bytes / (1024.0 * 1024.0)) / (ns / 1e9) : 0.0;
+}
+
+static inline size_t bench_arg_size(int argc, char **argv, int idx,
+                                    size_t default_value)
+{
+    return argc > idx ? strtoull(argv[idx], NULL, 10) : default_value;
+}
+
+/* Fills a temporary file with log-like text and rewinds it. */
+static inline FILE* bench_text_file(size_t len)
+{
+    static const char *lines[] = {
+        "2018-06-01 12:00:00.000 INFO  [worker-1] request served in 12ms\n",
+        "2018-06-01 12:00:00.013 DEBUG [worker-3] cache miss for key 8812\n",
+        "2018-06-01 12:00:00.027 WARN  [worker-2] slow upstream: 250ms\n",
+        "2018-06-01 12:00:00.031 INFO  [worker-1] request served in 3ms\n",
+    };
+    unsigned int seed = 0;
+    size_t written = 0;
+    FILE *fp = tmpfile();
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    while (written < len) {
+        const char *line = lines[rand_r(&seed) % 4];
+        int n = fprintf(fp, "%s", line);
+        if (n < 0) {
+            fclose(fp);
+            return NULL;
+        }
+        written += n;
+    }
+    fflush(fp);
+    rewind(fp);
+    return fp;
+}
+
+#endif /* STREAMLIKE_BENCH_BENCH_H */
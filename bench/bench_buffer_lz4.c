@@ -0,0 +1,113 @@
+/*
+ * Compares plain and LZ4 compressed streamlike buffer modes over a log-like
+ * text file: sequential read throughput and how much data the same amount of
+ * buffer memory holds ahead of the consumer.
+ *
+ * Usage: bench_buffer_lz4 [data_mb] [buffer_size] [block_size]
+ */
+#include <string.h>
+#include <unistd.h>
+
+#include "streamlike/buffer.h"
+#include "streamlike/file.h"
+#include "bench.h"
+
+#define READ_CHUNK (64 * 1024)
+
+typedef struct counting_s
+{
+    streamlike_t *inner;
+    volatile size_t count;
+} counting_t;
+
+static
+size_t counting_read_cb(void *context, void *buffer, size_t size)
+{
+    counting_t *counting = context;
+    size_t read = sl_read(counting->inner, buffer, size);
+    counting->count += read;
+    return read;
+}
+
+static
+int counting_seek_cb(void *context, off_t offset, int whence)
+{
+    counting_t *counting = context;
+    return sl_seek(counting->inner, offset, whence);
+}
+
+static
+void run(const char *name, FILE *fp, size_t data_len, size_t buffer_size,
+         size_t block_size, int lz4)
+{
+    streamlike_t *file_stream;
+    streamlike_t *buffer_stream;
+    streamlike_t counting_stream = { 0 };
+    counting_t counting;
+    char *chunk = malloc(READ_CHUNK);
+    size_t total = 0;
+    size_t read;
+    size_t ahead;
+    uint64_t start;
+
+    rewind(fp);
+    file_stream = sl_fopen2(fp);
+    counting.inner = file_stream;
+    counting.count = 0;
+    counting_stream.context = &counting;
+    counting_stream.read = counting_read_cb;
+    counting_stream.seek = counting_seek_cb;
+
+    buffer_stream = lz4
+        ? sl_buffer_create_lz4(&counting_stream, buffer_size, block_size)
+        : sl_buffer_create2(&counting_stream, buffer_size, block_size);
+    if (chunk == NULL || file_stream == NULL || buffer_stream == NULL) {
+        fprintf(stderr, "%s: couldn't create streams.\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Let the filler run ahead of an idle consumer until buffer is full. */
+    sl_buffer_threaded_fill_buffer(buffer_stream);
+    usleep(500 * 1000);
+    ahead = counting.count;
+
+    start = bench_now_ns();
+    while ((read = sl_read(buffer_stream, chunk, READ_CHUNK)) > 0) {
+        total += read;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    printf("%-6s read %zu/%zu bytes in %8.2f ms (%8.2f MB/s), "
+           "read-ahead %zu bytes in %zu byte buffer (%.2fx)\n",
+           name, total, data_len, elapsed / 1e6,
+           bench_mb_per_sec(total, elapsed), ahead, buffer_size,
+           (double)ahead / buffer_size);
+
+    sl_buffer_destroy(buffer_stream);
+    sl_fclose2(file_stream);
+    free(chunk);
+}
+
+int main(int argc, char **argv)
+{
+    size_t data_len    = bench_arg_size(argc, argv, 1, 64) * 1024 * 1024;
+    size_t buffer_size = bench_arg_size(argc, argv, 2, 4 * 1024 * 1024);
+    size_t block_size  = bench_arg_size(argc, argv, 3, 64 * 1024);
+    FILE *fp;
+
+    fp = bench_text_file(data_len);
+    if (fp == NULL) {
+        fprintf(stderr, "Couldn't create test data.\n");
+        return EXIT_FAILURE;
+    }
+
+    run("plain", fp, data_len, buffer_size, block_size, 0);
+#ifdef SL_BUFFER_LZ4
+    run("lz4", fp, data_len, buffer_size, block_size, 1);
+#else
+    printf("lz4    skipped, library is built without LZ4 support.\n");
+#endif
+
+    fclose(fp);
+    return EXIT_SUCCESS;
+}
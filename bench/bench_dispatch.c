@@ -0,0 +1,171 @@
+/*
+ * Measures per-call overhead of small reads through indirect callbacks, the
+ * capability check and direct dispatch, over an in-memory stream defined here
+ * over a file stream, and over a file stream behind a read buffer.
+ *
+ * Usage: bench_dispatch [read_size] [calls_millions]
+ */
+#include <string.h>
+
+#include "streamlike/file.h"
+#include "streamlike/readbuf.h"
+#include "bench.h"
+
+#define MEM_SIZE (64 * 1024)
+
+typedef struct mem_s
+{
+    char data[MEM_SIZE];
+    size_t pos;
+} mem_t;
+
+static
+size_t mem_read_cb(void *context, void *buffer, size_t size)
+{
+    mem_t *mem = context;
+    /* Wraps around, so that reads never end. */
+    if (mem->pos + size > MEM_SIZE) {
+        mem->pos = 0;
+    }
+    memcpy(buffer, mem->data + mem->pos, size);
+    mem->pos += size;
+    return size;
+}
+
+/* Keeps the compiler from seeing which callback the stream has. */
+static __attribute__((noinline))
+streamlike_t* opaque(streamlike_t *stream)
+{
+    __asm__ volatile("" : : "r"(stream) : "memory");
+    return stream;
+}
+
+static
+void report(const char *name, size_t calls, size_t total, uint64_t ns)
+{
+    printf("%-28s %6.2f ns/call (%zu bytes)\n", name, (double)ns / calls,
+           total);
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = bench_arg_size(argc, argv, 1, 16);
+    size_t calls = bench_arg_size(argc, argv, 2, 50) * 1000000;
+    streamlike_t mem_stream = { 0 };
+    streamlike_t *stream;
+    streamlike_t *file_stream;
+    streamlike_t *readbuf_stream;
+    const void *data;
+    FILE *fp;
+    mem_t *mem = malloc(sizeof(mem_t));
+    char *buffer = malloc(size);
+    size_t total;
+    size_t i;
+    uint64_t start;
+
+    if (mem == NULL || buffer == NULL || size == 0 || size > MEM_SIZE) {
+        fprintf(stderr, "Invalid read size.\n");
+        return EXIT_FAILURE;
+    }
+    memset(mem->data, 'x', MEM_SIZE);
+    mem->pos = 0;
+    mem_stream.context = mem;
+    mem_stream.read = mem_read_cb;
+    mem_stream.caps = sl_probe_caps(&mem_stream);
+    stream = opaque(&mem_stream);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        total += sl_read(stream, buffer, size);
+    }
+    report("memory sl_read", calls, total, bench_now_ns() - start);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (stream->read) {
+            total += sl_read(stream, buffer, size);
+        }
+    }
+    report("memory NULL check+sl_read", calls, total, bench_now_ns() - start);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (sl_has_caps(stream, SL_CAP_READ)) {
+            total += sl_read(stream, buffer, size);
+        }
+    }
+    report("memory caps check+sl_read", calls, total, bench_now_ns() - start);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        total += sl_read_via(stream, mem_read_cb, buffer, size);
+    }
+    report("memory sl_read_via", calls, total, bench_now_ns() - start);
+
+    fp = bench_text_file(MEM_SIZE);
+    file_stream = (fp ? sl_fopen2(fp) : NULL);
+    if (file_stream == NULL) {
+        fprintf(stderr, "Couldn't create file stream.\n");
+        return EXIT_FAILURE;
+    }
+    stream = opaque(file_stream);
+    calls /= 10;
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (sl_read(stream, buffer, size) < size) {
+            sl_seek(stream, 0, SL_SEEK_SET);
+        }
+        total += size;
+    }
+    report("file sl_read", calls, total, bench_now_ns() - start);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (sl_read_via(stream, sl_fread_cb, buffer, size) < size) {
+            sl_seek_via(stream, sl_fseek_cb, 0, SL_SEEK_SET);
+        }
+        total += size;
+    }
+    report("file sl_read_via", calls, total, bench_now_ns() - start);
+
+    sl_seek(file_stream, 0, SL_SEEK_SET);
+    readbuf_stream = sl_readbuf_create(file_stream);
+    if (readbuf_stream == NULL) {
+        fprintf(stderr, "Couldn't create read buffer stream.\n");
+        return EXIT_FAILURE;
+    }
+    stream = opaque(readbuf_stream);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (sl_read(stream, buffer, size) < size) {
+            sl_seek(stream, 0, SL_SEEK_SET);
+        }
+        total += size;
+    }
+    report("readbuf sl_read", calls, total, bench_now_ns() - start);
+
+    total = 0;
+    start = bench_now_ns();
+    for (i = 0; i < calls; i++) {
+        if (sl_input(stream, &data, size) < size) {
+            sl_seek(stream, 0, SL_SEEK_SET);
+        }
+        total += size;
+    }
+    report("readbuf sl_input", calls, total, bench_now_ns() - start);
+
+    sl_readbuf_destroy(readbuf_stream);
+    sl_fclose(file_stream);
+    free(buffer);
+    free(mem);
+    return EXIT_SUCCESS;
+}
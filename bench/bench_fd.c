@@ -0,0 +1,146 @@
+/*
+ * Compares the FILE*, file descriptor, io_uring and O_DIRECT backends over a
+ * text file: sequential read throughput at a few read sizes, and positional
+ * reads from several threads at once. File is cached, except for O_DIRECT,
+ * which reads from the device unless the file system ignores it.
+ *
+ * Usage: bench_fd [data_mb] [threads]
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "streamlike/direct.h"
+#include "streamlike/fd.h"
+#include "streamlike/file.h"
+#include "streamlike/iouring.h"
+#include "bench.h"
+
+#define READ_AT_SIZE  (4096)
+#define READ_AT_COUNT (100000)
+
+typedef struct worker_s
+{
+    streamlike_t *stream;
+    size_t data_len;
+    unsigned int seed;
+    size_t total;
+} worker_t;
+
+static
+void run_sequential(const char *name, streamlike_t *stream, size_t read_size)
+{
+    char *buffer = malloc(read_size);
+    size_t total = 0;
+    size_t read;
+    uint64_t start;
+
+    sl_seek(stream, 0, SL_SEEK_SET);
+    start = bench_now_ns();
+    while ((read = sl_read(stream, buffer, read_size)) > 0) {
+        total += read;
+    }
+    printf("%-6s sequential %8zu B reads: %9.1f MB/s\n", name, read_size,
+           bench_mb_per_sec(total, bench_now_ns() - start));
+    free(buffer);
+}
+
+static
+void* read_at_worker(void *arg)
+{
+    worker_t *worker = arg;
+    char buffer[READ_AT_SIZE];
+    off_t offset;
+    int i;
+
+    for (i = 0; i < READ_AT_COUNT; i++) {
+        offset = rand_r(&worker->seed) % (worker->data_len - READ_AT_SIZE);
+        worker->total += sl_read_at(worker->stream, buffer, READ_AT_SIZE,
+                                    offset);
+    }
+    return NULL;
+}
+
+static
+void run_read_at(const char *name, streamlike_t *stream, size_t data_len,
+                 int threads)
+{
+    pthread_t tids[threads];
+    worker_t workers[threads];
+    size_t total = 0;
+    uint64_t start;
+    int i;
+
+    start = bench_now_ns();
+    for (i = 0; i < threads; i++) {
+        workers[i].stream = stream;
+        workers[i].data_len = data_len;
+        workers[i].seed = i;
+        workers[i].total = 0;
+        pthread_create(&tids[i], NULL, read_at_worker, &workers[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += workers[i].total;
+    }
+    printf("%-6s read_at %d threads x %d B:  %9.1f MB/s\n", name, threads,
+           READ_AT_SIZE, bench_mb_per_sec(total, bench_now_ns() - start));
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t read_sizes[] = { 64, 4096, 1024 * 1024 };
+    size_t data_len = bench_arg_size(argc, argv, 1, 256) * 1024 * 1024;
+    int threads = bench_arg_size(argc, argv, 2, 4);
+    streamlike_t *file_stream;
+    streamlike_t *fd_stream;
+    streamlike_t *uring_stream;
+    streamlike_t *direct_stream;
+    char path[64];
+    FILE *fp;
+    size_t i;
+
+    if (data_len <= READ_AT_SIZE || threads <= 0) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return EXIT_FAILURE;
+    }
+    fp = bench_text_file(data_len);
+    file_stream = (fp ? sl_fopen2(fp) : NULL);
+    fd_stream = (fp ? sl_fd_open2(fileno(fp)) : NULL);
+    uring_stream = (fp ? sl_iouring_open2(fileno(fp), 0, 0, 0) : NULL);
+    if (fp) {
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fileno(fp));
+    }
+    direct_stream = (fp ? sl_direct_open(path, O_RDONLY) : NULL);
+    if (file_stream == NULL || fd_stream == NULL || uring_stream == NULL) {
+        fprintf(stderr, "Couldn't create streams.\n");
+        return EXIT_FAILURE;
+    }
+    if (direct_stream == NULL) {
+        fprintf(stderr, "File system doesn't support O_DIRECT, skipping.\n");
+    }
+
+    /* Warm up page cache, so that buffered backends read from memory. */
+    run_sequential("FILE*", file_stream, 1024 * 1024);
+
+    for (i = 0; i < sizeof(read_sizes) / sizeof(read_sizes[0]); i++) {
+        run_sequential("FILE*", file_stream, read_sizes[i]);
+        run_sequential("fd", fd_stream, read_sizes[i]);
+        run_sequential("uring", uring_stream, read_sizes[i]);
+        if (direct_stream) {
+            run_sequential("direct", direct_stream, read_sizes[i]);
+        }
+    }
+    run_read_at("FILE*", file_stream, data_len, threads);
+    run_read_at("fd", fd_stream, data_len, threads);
+    run_read_at("uring", uring_stream, data_len, threads);
+    if (direct_stream) {
+        run_read_at("direct", direct_stream, data_len, threads);
+        sl_direct_close(direct_stream);
+    }
+
+    sl_iouring_close2(uring_stream);
+    sl_fd_close2(fd_stream);
+    sl_fclose(file_stream);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#include "streamlike.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SL_READ_MULTI_IOV_COUNT (64)
+#define SL_READ_MULTI_DISCARD_SIZE (4096)
+
+#define SL_COPY_BUFFER_SIZE (1024 * 1024)
+#define SL_COPY_RANGES (64)
+
+static
+int compare_extents_(const void *lhs, const void *rhs)
+{
+    const sl_extent_t *l = *(const sl_extent_t* const*)lhs;
+    const sl_extent_t *r = *(const sl_extent_t* const*)rhs;
+    return (l->offset > r->offset) - (l->offset < r->offset);
+}
+
+/* Reads into given buffers, then credits bytes read to their extents. Gaps
+ * have no extent. Returns nonzero if read is short. */
+static
+int read_run_(const streamlike_t *stream, const struct iovec *iov,
+              sl_extent_t **owners, int iovcnt)
+{
+    size_t read = sl_readv(stream, iov, iovcnt);
+    size_t consumed;
+    int short_read = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        consumed = (read < iov[i].iov_len ? read : iov[i].iov_len);
+        if (owners[i]) {
+            owners[i]->read += consumed;
+        }
+        read -= consumed;
+        if (consumed < iov[i].iov_len) {
+            short_read = 1;
+        }
+    }
+    return short_read;
+}
+
+int sl_generic_read_multi(const streamlike_t *stream, sl_extent_t *extents,
+                          int count)
+{
+    char discard[SL_READ_MULTI_DISCARD_SIZE];
+    struct iovec iov[SL_READ_MULTI_IOV_COUNT];
+    sl_extent_t *owners[SL_READ_MULTI_IOV_COUNT];
+    sl_extent_t **sorted;
+    sl_extent_t *extent;
+    off_t pos;
+    off_t gap;
+    int incomplete = 0;
+    int short_read;
+    int iovcnt;
+    int i;
+    int j;
+
+    if (count <= 0) {
+        return 0;
+    }
+    sorted = malloc(sizeof(sl_extent_t*) * count);
+    if (!sorted) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        extents[i].read = 0;
+        sorted[i] = &extents[i];
+    }
+    qsort(sorted, count, sizeof(sl_extent_t*), compare_extents_);
+
+    for (i = 0; i < count; i = j) {
+        pos = sorted[i]->offset;
+        if (sl_seek(stream, pos, SL_SEEK_SET) != 0) {
+            incomplete = 1;
+            j = i + 1;
+            continue;
+        }
+
+        /* Merge following extents unless they overlap or are too far. Discarded
+         * gaps are read into the same scratch buffer. Gap data is never used. */
+        iovcnt = 0;
+        short_read = 0;
+        for (j = i; j < count && !short_read; j++) {
+            extent = sorted[j];
+            gap = extent->offset - pos;
+            if (gap < 0 || (j > i && gap > SL_READ_MULTI_MAX_GAP)) {
+                break;
+            }
+            if (iovcnt + gap / SL_READ_MULTI_DISCARD_SIZE + 2
+                    > SL_READ_MULTI_IOV_COUNT) {
+                short_read = read_run_(stream, iov, owners, iovcnt);
+                iovcnt = 0;
+                if (short_read) {
+                    break;
+                }
+            }
+            while (gap > 0) {
+                iov[iovcnt].iov_base = discard;
+                iov[iovcnt].iov_len  = (gap < SL_READ_MULTI_DISCARD_SIZE ?
+                                        (size_t)gap :
+                                        SL_READ_MULTI_DISCARD_SIZE);
+                owners[iovcnt] = NULL;
+                gap -= iov[iovcnt].iov_len;
+                iovcnt++;
+            }
+            iov[iovcnt].iov_base = extent->buffer;
+            iov[iovcnt].iov_len  = extent->length;
+            owners[iovcnt] = extent;
+            iovcnt++;
+            pos = extent->offset + extent->length;
+        }
+        if (iovcnt > 0 && !short_read) {
+            read_run_(stream, iov, owners, iovcnt);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    free(sorted);
+    return incomplete;
+}
+
+/* Copies up to length bytes, or till end-of-file if length is negative.
+ * Returns bytes copied, or -1 if writing fails. */
+static
+off_t copy_data_(const streamlike_t *src, const streamlike_t *dst,
+                 off_t length, char *buffer)
+{
+    off_t total = 0;
+    size_t part;
+    size_t read;
+
+    while (length < 0 || total < length) {
+        part = (length < 0 || length - total > SL_COPY_BUFFER_SIZE ?
+                SL_COPY_BUFFER_SIZE : (size_t)(length - total));
+        read = sl_read(src, buffer, part);
+        if (read > 0 && sl_write(dst, buffer, read) < read) {
+            return -1;
+        }
+        total += read;
+        if (read < part) {
+            break;
+        }
+    }
+    return total;
+}
+
+/* Moves destination over a hole. Writes zeros if it can't seek, or the last
+ * byte only if the hole ends the copy, so that length comes out right. */
+static
+int skip_hole_(const streamlike_t *dst, off_t hole, int last, char *buffer)
+{
+    size_t part;
+
+    if (dst->seek && sl_seek(dst, hole - (last ? 1 : 0), SL_SEEK_CUR) == 0) {
+        buffer[0] = 0;
+        return (!last || sl_write(dst, buffer, 1) == 1 ? 0 : -1);
+    }
+    memset(buffer, 0, SL_COPY_BUFFER_SIZE);
+    while (hole > 0) {
+        part = (hole < SL_COPY_BUFFER_SIZE ? (size_t)hole : SL_COPY_BUFFER_SIZE);
+        if (sl_write(dst, buffer, part) < part) {
+            return -1;
+        }
+        hole -= part;
+    }
+    return 0;
+}
+
+off_t sl_copy_sparse(const streamlike_t *src, const streamlike_t *dst,
+                     off_t length)
+{
+    sl_range_t ranges[SL_COPY_RANGES];
+    char *buffer;
+    off_t start;
+    off_t pos;
+    off_t end;
+    off_t copied;
+    int count;
+    int i;
+
+    SL_ASSERT(src);
+    SL_ASSERT(dst);
+
+    buffer = malloc(SL_COPY_BUFFER_SIZE);
+    if (!buffer) {
+        return -1;
+    }
+    start = sl_tell(src);
+    end = (src->length ? sl_length(src) : -1);
+    if (length > 0 && end > start + length) {
+        end = start + length;
+    }
+    count = (start >= 0 && end >= 0 ? sl_data_map(src, start, end - start,
+                                                  ranges, SL_COPY_RANGES)
+                                    : -1);
+    if (count < 0) {
+        copied = copy_data_(src, dst, (length > 0 ? length : -1), buffer);
+        free(buffer);
+        return copied;
+    }
+
+    pos = start;
+    while (pos < end) {
+        for (i = 0; i < count; i++) {
+            if (ranges[i].offset > pos
+                    && (sl_seek(src, ranges[i].offset, SL_SEEK_SET) != 0
+                        || skip_hole_(dst, ranges[i].offset - pos, 0,
+                                      buffer) != 0)) {
+                goto fail;
+            }
+            pos = ranges[i].offset;
+            copied = copy_data_(src, dst, ranges[i].length, buffer);
+            if (copied < 0) {
+                goto fail;
+            }
+            pos += copied;
+            if (copied < ranges[i].length) {
+                /* Source got shorter. */
+                end = pos;
+                break;
+            }
+        }
+        if (count < SL_COPY_RANGES || pos >= end) {
+            break;
+        }
+        count = sl_data_map(src, pos, end - pos, ranges, SL_COPY_RANGES);
+        if (count < 0) {
+            goto fail;
+        }
+    }
+    if (pos < end) {
+        if (sl_seek(src, end, SL_SEEK_SET) != 0
+                || skip_hole_(dst, end - pos, 1, buffer) != 0) {
+            goto fail;
+        }
+        pos = end;
+    }
+    free(buffer);
+    return pos - start;
+
+fail:
+    free(buffer);
+    return -1;
+}
+
+unsigned sl_probe_caps(const streamlike_t *stream)
+{
+    unsigned caps = 0;
+
+    caps |= (stream->read       ? SL_CAP_READ        : 0);
+    caps |= (stream->input      ? SL_CAP_INPUT       : 0);
+    caps |= (stream->write      ? SL_CAP_WRITE       : 0);
+    caps |= (stream->flush      ? SL_CAP_FLUSH       : 0);
+    caps |= (stream->seek       ? SL_CAP_SEEK        : 0);
+    caps |= (stream->tell       ? SL_CAP_TELL        : 0);
+    caps |= (stream->eof        ? SL_CAP_EOF         : 0);
+    caps |= (stream->error      ? SL_CAP_ERROR       : 0);
+    caps |= (stream->length     ? SL_CAP_LENGTH      : 0);
+    caps |= (stream->seekable   ? SL_CAP_SEEKABLE    : 0);
+    caps |= (stream->ckp_count  ? SL_CAP_CHECKPOINTS : 0);
+    caps |= (stream->read_at    ? SL_CAP_READ_AT     : 0);
+    caps |= (stream->readv      ? SL_CAP_READV       : 0);
+    caps |= (stream->writev     ? SL_CAP_WRITEV      : 0);
+    caps |= (stream->read_multi ? SL_CAP_READ_MULTI  : 0);
+    caps |= (stream->aio_submit ? SL_CAP_AIO         : 0);
+    caps |= (stream->advise     ? SL_CAP_ADVISE      : 0);
+    caps |= (stream->seek_cost  ? SL_CAP_SEEK_COST   : 0);
+    caps |= (stream->clone      ? SL_CAP_CLONE       : 0);
+    caps |= (stream->data_map   ? SL_CAP_DATA_MAP    : 0);
+    caps |= (stream->descriptor ? SL_CAP_DESCRIPTOR  : 0);
+    return caps;
+}
@@ -23,8 +23,12 @@
  * @{
  */
 
+/* For NULL. */
+#include <stddef.h>
 /* For off_t and size_t. */
 #include <sys/types.h>
+/* For struct iovec. */
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +48,84 @@ extern "C" {
 #define SL_SEEK_CUR (1)
 #define SL_SEEK_END (2)
 /** @} */ // Seek Whence Definitions
+
+/**
+ * Largest gap in bytes read and discarded to merge neighbouring extents in
+ * sl_generic_read_multi().
+ */
+#define SL_READ_MULTI_MAX_GAP (64 * 1024)
+
+/**
+ * \name Error Definitions
+ *
+ * Definitions for specific errors returned by sl_error().
+ *
+ * \see sl_error_cb_t()
+ *
+ * @{
+ */
+#define SL_ERROR_TIMEDOUT (-1) /**< Previous read returned short since its
+                                 deadline passed. Stream can be read further. */
+/** @} */ // Error Definitions
+
+/**
+ * \name Advice Definitions
+ *
+ * Definitions of access pattern advice given to sl_advise(). These are similar
+ * to `POSIX_FADV_*` definitions used by `posix_fadvise()`.
+ *
+ * \see sl_advise_cb_t()
+ *
+ * @{
+ */
+#define SL_ADVICE_NORMAL     (0) /**< No particular access pattern. */
+#define SL_ADVICE_SEQUENTIAL (1) /**< Stream will be read sequentially. */
+#define SL_ADVICE_RANDOM     (2) /**< Stream will be read in random order. */
+#define SL_ADVICE_WILLNEED   (3) /**< Range will be read soon. */
+#define SL_ADVICE_DONTNEED   (4) /**< Range won't be read soon. */
+#define SL_ADVICE_NOREUSE    (5) /**< Range will be read only once. */
+/** @} */ // Advice Definitions
+
+/**
+ * \name Capability Definitions
+ *
+ * Bits of the capabilities word of a stream. Lower bits tell which callbacks
+ * are supported, higher bits give hints about their performance.
+ *
+ * \see sl_caps(), sl_probe_caps()
+ *
+ * @{
+ */
+#define SL_CAP_READ        (1u << 0)  /**< Supports sl_read(). */
+#define SL_CAP_INPUT       (1u << 1)  /**< Supports sl_input(). */
+#define SL_CAP_WRITE       (1u << 2)  /**< Supports sl_write(). */
+#define SL_CAP_FLUSH       (1u << 3)  /**< Supports sl_flush(). */
+#define SL_CAP_SEEK        (1u << 4)  /**< Supports sl_seek(). */
+#define SL_CAP_TELL        (1u << 5)  /**< Supports sl_tell(). */
+#define SL_CAP_EOF         (1u << 6)  /**< Supports sl_eof(). */
+#define SL_CAP_ERROR       (1u << 7)  /**< Supports sl_error(). */
+#define SL_CAP_LENGTH      (1u << 8)  /**< Supports sl_length(). */
+#define SL_CAP_SEEKABLE    (1u << 9)  /**< Supports sl_seekable(). */
+#define SL_CAP_CHECKPOINTS (1u << 10) /**< Supports checkpoint callbacks. */
+#define SL_CAP_READ_AT     (1u << 11) /**< Supports sl_read_at(). */
+#define SL_CAP_READV       (1u << 12) /**< Supports readv callback natively. */
+#define SL_CAP_WRITEV      (1u << 13) /**< Supports writev callback natively. */
+#define SL_CAP_READ_MULTI  (1u << 14) /**< Supports read_multi callback
+                                        natively. */
+#define SL_CAP_AIO         (1u << 15) /**< Takes some asynchronous requests
+                                        natively. */
+#define SL_CAP_ADVISE      (1u << 16) /**< Supports sl_advise(). */
+#define SL_CAP_SEEK_COST   (1u << 17) /**< Supports sl_seek_cost(). */
+#define SL_CAP_CLONE       (1u << 18) /**< Supports sl_clone(). */
+#define SL_CAP_DATA_MAP    (1u << 19) /**< Supports sl_data_map(). */
+#define SL_CAP_DESCRIPTOR  (1u << 20) /**< Supports sl_descriptor(). */
+
+#define SL_CAP_ZERO_COPY   (1u << 24) /**< sl_input() points into data held by
+                                        the stream without copying it. */
+#define SL_CAP_CHEAP_SEEK  (1u << 25) /**< Seeking costs about as much as a
+                                        read call. It neither makes a request
+                                        nor discards buffered data. */
+/** @} */ // Capability Definitions
 /** @} */ // MacroDefinitions
 
 /**
@@ -76,6 +158,95 @@ typedef enum sl_seekable_e
  */
 typedef struct sl_ckp_s sl_ckp_t;
 
+/**
+ * Extent of a stream to be read into a buffer in a batch.
+ *
+ * \see sl_read_multi_cb_t()
+ */
+typedef struct sl_extent_s
+{
+    off_t  offset; /**< Offset in the stream to read from. */
+    size_t length; /**< Number of bytes to read. */
+    void  *buffer; /**< Buffer to read into. */
+    size_t read;   /**< Output for number of bytes read. */
+} sl_extent_t;
+
+/**
+ * Range of a stream, e.g. one holding data in a sparse file.
+ *
+ * \see sl_data_map_cb_t()
+ */
+typedef struct sl_range_s
+{
+    off_t offset; /**< Offset in the stream where the range starts. */
+    off_t length; /**< Number of bytes in the range. */
+} sl_range_t;
+
+/**
+ * Enumeration to denote how sl_copy() moved data.
+ */
+typedef enum sl_copy_path_e
+{
+    SL_COPY_FILE_RANGE = 0, /**< Copied in kernel by `copy_file_range()`,
+                              which may share extents between files (Value:
+                              `0`). */
+    SL_COPY_SENDFILE   = 1, /**< Copied in kernel by `sendfile()` (Value:
+                              `1`). */
+    SL_COPY_SPLICE     = 2, /**< Copied in kernel by `splice()` through a pipe
+                              (Value: `2`). */
+    SL_COPY_PUMP       = 3  /**< Read and written through buffers in user
+                              space (Value: `3`). */
+} sl_copy_path_t;
+
+/**
+ * Opaque type for an asynchronous completion queue.
+ *
+ * \see sl_aio_create()
+ */
+typedef struct sl_aio_s sl_aio_t;
+
+/**
+ * Enumeration to denote asynchronous operations.
+ */
+typedef enum sl_aio_op_e
+{
+    SL_AIO_READ    = 0, /**< Read from current offset like sl_read() (Value:
+                          `0`). */
+    SL_AIO_READ_AT = 1, /**< Read from given offset like sl_read_at() (Value:
+                          `1`). */
+    SL_AIO_SEEK    = 2  /**< Seek like sl_seek() (Value: `2`). */
+} sl_aio_op_t;
+
+/**
+ * Request submitted to an asynchronous completion queue.
+ *
+ * \see sl_aio_submit(), sl_aio_submit_cb_t()
+ */
+typedef struct sl_aio_request_s
+{
+    sl_aio_op_t op; /**< Operation to perform. */
+    void  *buffer;  /**< Buffer to read into. Used by reads. */
+    size_t size;    /**< Number of bytes to read. Used by reads. */
+    off_t  offset;  /**< Offset to read from or to seek. Used by
+                      #SL_AIO_READ_AT and #SL_AIO_SEEK. */
+    int    whence;  /**< Whence to seek. Used by #SL_AIO_SEEK. */
+    void  *tag;     /**< User data passed back with the completion. */
+} sl_aio_request_t;
+
+/**
+ * Completion of a request taken from an asynchronous completion queue.
+ *
+ * \see sl_aio_wait()
+ */
+typedef struct sl_aio_completion_s
+{
+    void *tag;      /**< Tag of the request. */
+    sl_aio_op_t op; /**< Operation of the request. */
+    ssize_t result; /**< Number of bytes read for reads, which is short on
+                      end-of-file or error, or -1 if the read fails before
+                      any data. Return value of sl_seek() for seeks. */
+} sl_aio_completion_t;
+
 /** @} */ // DataStructures
 
 /**
@@ -314,6 +485,293 @@ size_t (*sl_ckp_metadata_cb_t)(void *context, const sl_ckp_t* ckp,
                                const void** result);
 
 /** @} */ // Random-Access Callback Definitions
+
+/**
+ * \name Positional Access Callback Definitions
+ *
+ * Callbacks accessing a given offset of a stream without using its current
+ * offset. Unlike basic access callbacks, these are safe to call concurrently on
+ * the same stream, so that several threads can share one stream object.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to read from given offset of a stream. This function behaves
+ * like `pread(fd, buffer, size, offset)`, except that it reads until buffer is
+ * full unless end-of-file is reached or there is an error.
+ *
+ * It neither uses nor modifies current offset, end-of-file or error status of
+ * the stream.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param buffer  Buffer to be read into.
+ * \param size    Number of bytes to read.
+ * \param offset  Offset in the stream to read from.
+ *
+ * \return Number of bytes read. If it's less than `size`, this means
+ *         end-of-file reached or there is some error.
+ *
+ * \see sl_read_at(), sl_read_cb_t()
+ */
+typedef
+size_t (*sl_read_at_cb_t)(void *context, void *buffer, size_t size,
+                          off_t offset);
+
+/** @} */ // Positional Access Callback Definitions
+
+/**
+ * \name Vectored Access Callback Definitions
+ *
+ * Callbacks reading into or writing from several buffers in one call, so that
+ * a backend can do it in one go (e.g. in one system call).
+ *
+ * @{
+ */
+
+/**
+ * Callback type to read from a stream into several buffers. This function
+ * behaves like `readv(fd, iov, iovcnt)`, except that it reads until all
+ * buffers are full unless end-of-file is reached or there is an error.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param iov     Buffers to be filled in order.
+ * \param iovcnt  Number of buffers.
+ *
+ * \return Total number of bytes read. If it's less than total length of
+ *         buffers, this means end-of-file reached or there is some error.
+ *
+ * \see sl_readv(), sl_read_cb_t()
+ */
+typedef
+size_t (*sl_readv_cb_t)(void *context, const struct iovec *iov, int iovcnt);
+
+/**
+ * Callback type to write to a stream from several buffers. This function
+ * behaves like `writev(fd, iov, iovcnt)`, except that it writes all buffers
+ * unless there is an error.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param iov     Buffers to be written in order.
+ * \param iovcnt  Number of buffers.
+ *
+ * \return Total number of bytes written. If it's less than total length of
+ *         buffers, this means there is some error.
+ *
+ * \see sl_writev(), sl_write_cb_t()
+ */
+typedef
+size_t (*sl_writev_cb_t)(void *context, const struct iovec *iov, int iovcnt);
+
+/** @} */ // Vectored Access Callback Definitions
+
+/**
+ * \name Batched Access Callback Definitions
+ *
+ * Callbacks reading several extents of a stream known up front, so that a
+ * backend can merge, reorder or parallelize them.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to read several extents of a stream in a batch.
+ *
+ * Extents may be given in any order and may overlap. Sets `read` field of each
+ * extent to the number of bytes read into its buffer. It neither uses nor
+ * modifies current offset, end-of-file or error status of the stream.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param extents Extents to read.
+ * \param count   Number of extents.
+ *
+ * \return Zero if all extents are read completely. Nonzero if some of them
+ *         are short because end-of-file is reached or there is some error.
+ *
+ * \see sl_read_multi(), sl_read_at_cb_t()
+ */
+typedef
+int (*sl_read_multi_cb_t)(void *context, sl_extent_t *extents, int count);
+
+/** @} */ // Batched Access Callback Definitions
+
+/**
+ * \name Asynchronous Access Callback Definitions
+ *
+ * Callbacks letting a backend perform asynchronous requests natively instead of
+ * on the thread pool of the completion queue.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to take an asynchronous request.
+ *
+ * The backend should post the result through sl_aio_complete() once the
+ * request is done, possibly from another thread. The request stays valid until
+ * then. A backend taking #SL_AIO_READ or #SL_AIO_SEEK requests should take all
+ * of them, so that they are performed in the order of submission.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param aio     Completion queue the request is submitted to.
+ * \param request Request to perform.
+ *
+ * \return Zero if the request is taken. Nonzero to let the completion queue
+ *         perform it on its thread pool.
+ *
+ * \see sl_aio_submit(), sl_aio_complete()
+ */
+typedef
+int (*sl_aio_submit_cb_t)(void *context, sl_aio_t *aio,
+                          const sl_aio_request_t *request);
+
+/** @} */ // Asynchronous Access Callback Definitions
+
+/**
+ * \name Advisory Callback Definitions
+ *
+ * Callbacks letting an application tell how it will access a stream, so that
+ * a backend can tune read-ahead, request sizes or caching.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to advise access pattern of a stream. This function behaves
+ * like `posix_fadvise(fd, offset, length, advice)`.
+ *
+ * Advice is only a hint. It doesn't change data read from the stream.
+ * #SL_ADVICE_NORMAL, #SL_ADVICE_SEQUENTIAL and #SL_ADVICE_RANDOM may apply to
+ * the whole stream regardless of the range.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param offset  Offset of the range advised.
+ * \param length  Number of bytes in the range. Zero means till end-of-file.
+ * \param advice  One of advice definitions, e.g. #SL_ADVICE_RANDOM.
+ *
+ * \return Zero on success. Nonzero if the advice is unknown or there is some
+ *         error.
+ *
+ * \see sl_advise()
+ */
+typedef
+int (*sl_advise_cb_t)(void *context, off_t offset, off_t length, int advice);
+
+/**
+ * Callback type to estimate cost of seeking to an offset from the current
+ * position of a stream.
+ *
+ * Cost is given in bytes-equivalent: number of bytes which could be read
+ * sequentially in the time seeking takes. A reader can compare it with the
+ * distance to the offset to choose between reading through and seeking.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param offset  Absolute offset to seek to.
+ *
+ * \return Estimated cost in bytes. Zero if seeking there is almost free.
+ *         Negative if the cost is unknown.
+ *
+ * \see sl_seek_cost()
+ */
+typedef
+off_t (*sl_seek_cost_cb_t)(void *context, off_t offset);
+
+/** @} */ // Advisory Callback Definitions
+
+/**
+ * \name Cloning Callback Definitions
+ *
+ * Callbacks to open more cursors over the same source cheaply, e.g. to read it
+ * from several threads.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to clone a stream.
+ *
+ * Clone is an independent stream over the same source, starting at the current
+ * offset of the stream. Seeking or reading one doesn't move the other. It
+ * shares what is already known about the source, e.g. its length, so cloning
+ * doesn't do any I/O. Each is closed on its own, in any order. Which function
+ * closes a clone is documented by the backend.
+ *
+ * \param context Pointer to user-defined stream data.
+ *
+ * \return Clone of the stream. NULL on failure.
+ *
+ * \see sl_clone()
+ */
+typedef
+struct streamlike_s* (*sl_clone_cb_t)(void *context);
+
+/** @} */ // Cloning Callback Definitions
+
+/**
+ * \name Sparse Data Callback Definitions
+ *
+ * Callbacks telling holes apart from data, so that a reader can skip them
+ * instead of reading zeros.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to map ranges holding data in a part of a stream. The rest of
+ * the part is holes, reading as zeros. This function behaves like walking the
+ * part with `lseek(fd, offset, SEEK_DATA)` and `lseek(fd, offset, SEEK_HOLE)`.
+ *
+ * Ranges are given in order, and clipped to the part. Holes are only reported
+ * as far as the backend knows them, e.g. at file system block granularity, so
+ * ranges may hold zeros too. A stream without holes has the whole part mapped
+ * as one range.
+ *
+ * \param context Pointer to user-defined stream data.
+ * \param offset  Offset of the part to map.
+ * \param length  Number of bytes in the part. Zero means till end-of-file.
+ * \param ranges  Output for ranges holding data.
+ * \param max     Most ranges to give.
+ *
+ * \return Number of ranges given. If it is \p max, there may be more ranges
+ *         after the last one. Negative on error.
+ *
+ * \see sl_data_map()
+ */
+typedef
+int (*sl_data_map_cb_t)(void *context, off_t offset, off_t length,
+                        sl_range_t *ranges, int max);
+
+/** @} */ // Sparse Data Callback Definitions
+
+/**
+ * \name Descriptor Callback Definitions
+ *
+ * Callbacks exposing the file descriptor under a stream, so that data can be
+ * moved by the kernel without copying it through user space.
+ *
+ * @{
+ */
+
+/**
+ * Callback type to get the file descriptor holding data of a stream.
+ *
+ * Data buffered by the stream is flushed, and anything it caches about the
+ * descriptor is forgotten first, since the caller may transfer data through
+ * it. Transfers start at sl_tell(), and the stream is moved past transferred
+ * data with sl_seek() afterwards, so descriptor offset may be moved meanwhile.
+ * Descriptors that can't seek, e.g. pipes, are used through their own offset
+ * instead, and the stream isn't told about data moved through them.
+ *
+ * \param context Pointer to user-defined stream data.
+ *
+ * \return File descriptor, which stays owned by the stream. Negative on error.
+ *
+ * \see sl_descriptor()
+ */
+typedef
+int (*sl_descriptor_cb_t)(void *context);
+
+/** @} */ // Descriptor Callback Definitions
 /** @} */ // Callbacks
 
 /**
@@ -345,6 +803,36 @@ typedef struct streamlike_s
     sl_ckp_cb_t       ckp;       /**< Get a checkpoint from the stream. */
     sl_ckp_offset_cb_t   ckp_offset;   /**< Get offset of the checkpoint. */
     sl_ckp_metadata_cb_t ckp_metadata; /**< Get metadata of the checkpoint. */
+
+    /* Positional access. */
+    sl_read_at_cb_t read_at; /**< Read from given offset of the stream. */
+
+    /* Vectored access. */
+    sl_readv_cb_t  readv;  /**< Read into several buffers. */
+    sl_writev_cb_t writev; /**< Write from several buffers. */
+
+    /* Batched access. */
+    sl_read_multi_cb_t read_multi; /**< Read several extents in a batch. */
+
+    /* Asynchronous access. */
+    sl_aio_submit_cb_t aio_submit; /**< Take an asynchronous request. */
+
+    /* Access pattern advice. */
+    sl_advise_cb_t advise; /**< Advise access pattern of the stream. */
+    sl_seek_cost_cb_t seek_cost; /**< Estimate cost of seeking. */
+
+    /* Cloning. */
+    sl_clone_cb_t clone; /**< Open an independent cursor over the source. */
+
+    /* Sparse data. */
+    sl_data_map_cb_t data_map; /**< Map ranges holding data. */
+
+    /* Kernel transfers. */
+    sl_descriptor_cb_t descriptor; /**< Get underlying file descriptor. */
+
+    /* Capabilities. */
+    unsigned caps; /**< Capability bits, e.g. #SL_CAP_READ. Filled when the
+                     stream is opened. */
 } streamlike_t;
 
 /**
@@ -572,8 +1060,610 @@ inline int sl_seek_to_ckp(const streamlike_t *stream, const sl_ckp_t* ckp)
 }
 
 /** @} */ // Random-Access Wrapper Functions
+
+/**
+ * \name Positional Access Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use positional access
+ * callbacks.
+ *
+ * \note This functions will cause segmentation fault if provided `stream` or
+ * the requested capability is `NULL`. Compiling with `SL_DEBUG` will activate
+ * necessary assertions.
+ *
+ * @{
+ */
+
+/**
+ * Wraps positional reading callback of a streamlike object.
+ *
+ * \see sl_read_at_cb_t()
+ */
+inline size_t sl_read_at(const streamlike_t *stream, void *buffer, size_t size,
+                         off_t offset)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->read_at);
+    return stream->read_at(stream->context, buffer, size, offset);
+}
+
+/** @} */ // Positional Access Wrapper Functions
+
+/**
+ * \name Vectored Access Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use vectored access
+ * callbacks.
+ *
+ * \note Unlike other wrappers, these fall back to calling basic access
+ * callbacks for each buffer if the stream doesn't support vectored access.
+ *
+ * @{
+ */
+
+/**
+ * Wraps vectored reading callback of a streamlike object. Reads each buffer
+ * through sl_read() if the stream doesn't support vectored reading.
+ *
+ * \see sl_readv_cb_t()
+ */
+inline size_t sl_readv(const streamlike_t *stream, const struct iovec *iov,
+                       int iovcnt)
+{
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    SL_ASSERT(stream);
+    if (stream->readv) {
+        return stream->readv(stream->context, iov, iovcnt);
+    }
+    SL_ASSERT(stream->read);
+    for (i = 0; i < iovcnt; i++) {
+        read = stream->read(stream->context, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * Wraps vectored writing callback of a streamlike object. Writes each buffer
+ * through sl_write() if the stream doesn't support vectored writing.
+ *
+ * \see sl_writev_cb_t()
+ */
+inline size_t sl_writev(const streamlike_t *stream, const struct iovec *iov,
+                        int iovcnt)
+{
+    size_t total = 0;
+    size_t written;
+    int i;
+
+    SL_ASSERT(stream);
+    if (stream->writev) {
+        return stream->writev(stream->context, iov, iovcnt);
+    }
+    SL_ASSERT(stream->write);
+    for (i = 0; i < iovcnt; i++) {
+        written = stream->write(stream->context, iov[i].iov_base,
+                                iov[i].iov_len);
+        total += written;
+        if (written < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/** @} */ // Vectored Access Wrapper Functions
+
+/**
+ * \name Batched Access Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use batched access
+ * callbacks.
+ *
+ * @{
+ */
+
+/**
+ * Reads several extents of a stream through seeking and vectored reading.
+ *
+ * Extents are sorted by offset and neighbouring ones are read in one
+ * sl_readv() call, discarding gaps up to #SL_READ_MULTI_MAX_GAP bytes between
+ * them. Unlike sl_read_multi_cb_t(), this moves current offset of the stream.
+ * Requires seeking and reading callbacks to be valid.
+ *
+ * \see sl_read_multi_cb_t(), sl_read_multi()
+ */
+int sl_generic_read_multi(const streamlike_t *stream, sl_extent_t *extents,
+                          int count);
+
+/**
+ * Wraps batched reading callback of a streamlike object. Falls back to
+ * sl_generic_read_multi() if the stream doesn't support batched reading.
+ *
+ * \see sl_read_multi_cb_t()
+ */
+inline int sl_read_multi(const streamlike_t *stream, sl_extent_t *extents,
+                         int count)
+{
+    SL_ASSERT(stream);
+    if (stream->read_multi) {
+        return stream->read_multi(stream->context, extents, count);
+    }
+    return sl_generic_read_multi(stream, extents, count);
+}
+
+/** @} */ // Batched Access Wrapper Functions
+
+/**
+ * \name Advisory Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use advisory callbacks.
+ *
+ * \note Unlike other wrappers, these can be called on any stream. Advice is
+ * ignored if the stream doesn't support it.
+ *
+ * @{
+ */
+
+/**
+ * Wraps advisory callback of a streamlike object.
+ *
+ * \return Return value of underlying sl_advise_cb_t() call. Nonzero if the
+ *         stream doesn't support advice.
+ *
+ * \see sl_advise_cb_t()
+ */
+inline int sl_advise(const streamlike_t *stream, off_t offset, off_t length,
+                     int advice)
+{
+    SL_ASSERT(stream);
+    if (!stream->advise) {
+        return -1;
+    }
+    return stream->advise(stream->context, offset, length, advice);
+}
+
+/**
+ * Wraps seek cost callback of a streamlike object.
+ *
+ * \return Return value of underlying sl_seek_cost_cb_t() call. Negative if
+ *         the stream doesn't estimate seek costs.
+ *
+ * \see sl_seek_cost_cb_t()
+ */
+inline off_t sl_seek_cost(const streamlike_t *stream, off_t offset)
+{
+    SL_ASSERT(stream);
+    if (!stream->seek_cost) {
+        return -1;
+    }
+    return stream->seek_cost(stream->context, offset);
+}
+
+/** @} */ // Advisory Wrapper Functions
+
+/**
+ * \name Cloning Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use cloning callbacks.
+ *
+ * @{
+ */
+
+/**
+ * Wraps cloning callback of a streamlike object.
+ *
+ * \return Return value of underlying sl_clone_cb_t() call. NULL if the stream
+ *         can't be cloned.
+ *
+ * \see sl_clone_cb_t()
+ */
+inline streamlike_t* sl_clone(const streamlike_t *stream)
+{
+    SL_ASSERT(stream);
+    if (!stream->clone) {
+        return NULL;
+    }
+    return stream->clone(stream->context);
+}
+
+/** @} */ // Cloning Wrapper Functions
+
+/**
+ * \name Sparse Data Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use sparse data callbacks.
+ *
+ * @{
+ */
+
+/**
+ * Wraps data mapping callback of a streamlike object.
+ *
+ * \return Return value of underlying sl_data_map_cb_t() call. Negative if the
+ *         stream doesn't map its data.
+ *
+ * \see sl_data_map_cb_t()
+ */
+inline int sl_data_map(const streamlike_t *stream, off_t offset, off_t length,
+                       sl_range_t *ranges, int max)
+{
+    SL_ASSERT(stream);
+    if (!stream->data_map) {
+        return -1;
+    }
+    return stream->data_map(stream->context, offset, length, ranges, max);
+}
+
+/**
+ * Copies from current offset of one stream to current offset of another,
+ * keeping holes.
+ *
+ * Only ranges mapped by sl_data_map() are read and written. Holes are skipped
+ * by seeking both streams forward, so that they stay holes if the destination
+ * is a file. A hole at the end is kept by writing its last byte only. If the
+ * source doesn't map its data, all of it is copied. If the destination can't
+ * seek, zeros are written for holes.
+ *
+ * \param src    Stream to copy from. Requires reading, seeking and telling
+ *               callbacks.
+ * \param dst    Stream to copy to. Requires writing callback.
+ * \param length Number of bytes to copy. Zero means till end-of-file.
+ *
+ * \return Number of bytes copied, including holes. Negative on error.
+ */
+off_t sl_copy_sparse(const streamlike_t *src, const streamlike_t *dst,
+                     off_t length);
+
+/** @} */ // Sparse Data Wrapper Functions
+
+/**
+ * \name Descriptor Wrapper Functions
+ *
+ * Short hand functions provided for convenience to use descriptor callbacks.
+ *
+ * @{
+ */
+
+/**
+ * Wraps descriptor callback of a streamlike object.
+ *
+ * \return Return value of underlying sl_descriptor_cb_t() call. Negative if
+ *         the stream doesn't expose a descriptor.
+ *
+ * \see sl_descriptor_cb_t()
+ */
+inline int sl_descriptor(const streamlike_t *stream)
+{
+    SL_ASSERT(stream);
+    if (!stream->descriptor) {
+        return -1;
+    }
+    return stream->descriptor(stream->context);
+}
+
+/**
+ * Copies from current offset of one stream to current offset of another.
+ *
+ * If both streams expose descriptors through sl_descriptor(), data is moved
+ * in kernel, trying `copy_file_range()` between regular files, then
+ * `sendfile()` from a regular file, then `splice()` if either is a pipe.
+ * Otherwise, or if the kernel refuses before anything is moved, data goes
+ * through two aligned blocks in user space, one being written by a thread
+ * while the other is read. Both streams end up past the data copied.
+ *
+ * \param src    Stream to copy from. Requires reading callback.
+ * \param dst    Stream to copy to. Requires writing callback.
+ * \param length Number of bytes to copy. Zero means till end-of-file.
+ * \param path   Output for how data was moved. May be `NULL`.
+ *
+ * \return Number of bytes copied, which is short if an error stopped the
+ *         copy after data moved. The error is then on sl_error() of the
+ *         stream that failed, or in `errno` for in kernel copies. Negative if
+ *         nothing could be copied.
+ */
+off_t sl_copy(const streamlike_t *src, const streamlike_t *dst, off_t length,
+              sl_copy_path_t *path);
+
+/** @} */ // Descriptor Wrapper Functions
+
+/**
+ * \name Capability Functions
+ *
+ * Functions to query capabilities of a stream without checking each callback.
+ *
+ * @{
+ */
+
+/**
+ * Gives capability bits of callbacks set in a stream, without hints.
+ *
+ * Backends fill capabilities of streams they open with this, adding hints and
+ * dropping callbacks that are set but not supported in the mode they are
+ * opened. Streams built by hand should do the same.
+ *
+ * \param stream Streamlike stream.
+ *
+ * \return Capability bits.
+ */
+unsigned sl_probe_caps(const streamlike_t *stream);
+
+/**
+ * Gives capabilities of a stream.
+ *
+ * \see #SL_CAP_READ and other capability definitions.
+ */
+inline unsigned sl_caps(const streamlike_t *stream)
+{
+    SL_ASSERT(stream);
+    return stream->caps;
+}
+
+/**
+ * Checks if a stream has all of given capabilities.
+ *
+ * \return Nonzero if all bits of \p caps are set for the stream.
+ */
+inline int sl_has_caps(const streamlike_t *stream, unsigned caps)
+{
+    SL_ASSERT(stream);
+    return (stream->caps & caps) == caps;
+}
+
+/** @} */ // Capability Functions
+
+/**
+ * \name Direct Dispatch Functions
+ *
+ * Wrappers calling the callback expected by the caller directly if the stream
+ * uses it. The call is indirect otherwise. With the expected callback known at
+ * compile time, the call can be inlined where its definition is visible, e.g.
+ * in the same translation unit or with link-time optimization:
+ *
+ *     sl_read_via(stream, sl_fread_cb, buffer, size);
+ *
+ * @{
+ */
+
+/**
+ * Reads from a stream through given callback if it is the one of the stream.
+ *
+ * \see sl_read()
+ */
+static inline size_t sl_read_via(const streamlike_t *stream, sl_read_cb_t cb,
+                                 void *buffer, size_t size)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->read);
+    if (stream->read == cb) {
+        return cb(stream->context, buffer, size);
+    }
+    return stream->read(stream->context, buffer, size);
+}
+
+/**
+ * Gets input from a stream through given callback if it is the one of the
+ * stream.
+ *
+ * \see sl_input()
+ */
+static inline size_t sl_input_via(const streamlike_t *stream, sl_input_cb_t cb,
+                                  const void **buffer, size_t size)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->input);
+    if (stream->input == cb) {
+        return cb(stream->context, buffer, size);
+    }
+    return stream->input(stream->context, buffer, size);
+}
+
+/**
+ * Writes to a stream through given callback if it is the one of the stream.
+ *
+ * \see sl_write()
+ */
+static inline size_t sl_write_via(const streamlike_t *stream, sl_write_cb_t cb,
+                                  const void *buffer, size_t size)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->write);
+    if (stream->write == cb) {
+        return cb(stream->context, buffer, size);
+    }
+    return stream->write(stream->context, buffer, size);
+}
+
+/**
+ * Seeks a stream through given callback if it is the one of the stream.
+ *
+ * \see sl_seek()
+ */
+static inline int sl_seek_via(const streamlike_t *stream, sl_seek_cb_t cb,
+                              off_t offset, int whence)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->seek);
+    if (stream->seek == cb) {
+        return cb(stream->context, offset, whence);
+    }
+    return stream->seek(stream->context, offset, whence);
+}
+
+/**
+ * Reads from given offset of a stream through given callback if it is the one
+ * of the stream.
+ *
+ * \see sl_read_at()
+ */
+static inline size_t sl_read_at_via(const streamlike_t *stream,
+                                    sl_read_at_cb_t cb, void *buffer,
+                                    size_t size, off_t offset)
+{
+    SL_ASSERT(stream);
+    SL_ASSERT(stream->read_at);
+    if (stream->read_at == cb) {
+        return cb(stream->context, buffer, size, offset);
+    }
+    return stream->read_at(stream->context, buffer, size, offset);
+}
+
+/** @} */ // Direct Dispatch Functions
 /** @} */ // Wrapper Functions
 
+/**
+ * \defgroup AsyncFunctions Asynchronous Access
+ *
+ * Completion queue to submit requests to streams without blocking, and to poll
+ * or wait for their completions.
+ *
+ * Requests are performed natively by the stream if it takes them through
+ * sl_aio_submit_cb_t(), or on the thread pool of the completion queue
+ * otherwise. On the thread pool, #SL_AIO_READ and #SL_AIO_SEEK requests to the
+ * same stream are performed one at a time in the order of submission, while
+ * #SL_AIO_READ_AT requests are performed concurrently.
+ *
+ * @{
+ */
+
+/**
+ * Creates a completion queue.
+ *
+ * \param threads Number of threads in the pool performing requests not taken
+ *                by streams. Should be positive.
+ *
+ * \return Pointer to the completion queue. `NULL` on error.
+ *
+ * \see sl_aio_destroy()
+ */
+sl_aio_t* sl_aio_create(int threads);
+
+/**
+ * Waits for all submitted requests to complete, then releases all sources
+ * used by the completion queue. Completions not taken are discarded.
+ *
+ * \param aio Completion queue.
+ *
+ * \see sl_aio_create()
+ */
+void sl_aio_destroy(sl_aio_t *aio);
+
+/**
+ * Submits a request to a stream.
+ *
+ * Buffer of a read should stay valid until its completion is taken. The stream
+ * should stay valid until all of its requests complete.
+ *
+ * \param aio     Completion queue.
+ * \param stream  Stream to perform the request on.
+ * \param request Request to submit. It is copied.
+ *
+ * \return Zero on success. Nonzero if the stream doesn't support the operation
+ *         or there is some error.
+ *
+ * \see sl_aio_poll(), sl_aio_wait()
+ */
+int sl_aio_submit(sl_aio_t *aio, const streamlike_t *stream,
+                  const sl_aio_request_t *request);
+
+/**
+ * Takes completions without blocking.
+ *
+ * \param aio         Completion queue.
+ * \param completions Output array for completions.
+ * \param max         Size of the output array.
+ *
+ * \return Number of completions taken.
+ *
+ * \see sl_aio_wait()
+ */
+int sl_aio_poll(sl_aio_t *aio, sl_aio_completion_t *completions, int max);
+
+/**
+ * Takes completions, blocking until there is at least one.
+ *
+ * Returns immediately if there are no requests outstanding.
+ *
+ * \param aio         Completion queue.
+ * \param completions Output array for completions.
+ * \param max         Size of the output array.
+ * \param timeout_ms  Most milliseconds to block. Blocks without a timeout if
+ *                    negative.
+ *
+ * \return Number of completions taken. Zero if timed out.
+ *
+ * \see sl_aio_poll()
+ */
+int sl_aio_wait(sl_aio_t *aio, sl_aio_completion_t *completions, int max,
+                long timeout_ms);
+
+/**
+ * \name Backend Functions
+ *
+ * Functions used by backends performing requests natively. An engine is some
+ * state shared by all requests of a backend on the same completion queue, such
+ * as an io_uring or a curl multi handle. Each engine is driven by a thread of
+ * its own, calling its poll function while it has requests in flight.
+ *
+ * @{
+ */
+
+/**
+ * Description of a native engine.
+ *
+ * \see sl_aio_engine()
+ */
+typedef struct sl_aio_engine_s
+{
+    /** Creates engine state. Returns `NULL` on error. */
+    void* (*create)(sl_aio_t *aio);
+    /** Progresses requests, blocking up to given milliseconds for some of
+     * them to complete. Returns number of requests still in flight. */
+    int (*poll)(void *state, int timeout_ms);
+    /** Interrupts a blocking poll. May be `NULL`. */
+    void (*wake)(void *state);
+    /** Releases engine state. Called once no requests are in flight. */
+    void (*destroy)(void *state);
+} sl_aio_engine_t;
+
+/**
+ * Gets state of an engine on a completion queue, creating it and its driver
+ * thread on first use.
+ *
+ * \param aio    Completion queue.
+ * \param engine Engine description. Its address identifies the engine.
+ *
+ * \return Engine state. `NULL` if the engine couldn't be created.
+ */
+void* sl_aio_engine(sl_aio_t *aio, const sl_aio_engine_t *engine);
+
+/**
+ * Wakes the driver thread of an engine after a request is put in flight.
+ *
+ * \param aio    Completion queue.
+ * \param engine Engine description.
+ */
+void sl_aio_kick(sl_aio_t *aio, const sl_aio_engine_t *engine);
+
+/**
+ * Posts the result of a request taken by a stream.
+ *
+ * \param aio     Completion queue.
+ * \param request Request given to sl_aio_submit_cb_t().
+ * \param result  Result of the request as described in #sl_aio_completion_t.
+ */
+void sl_aio_complete(sl_aio_t *aio, const sl_aio_request_t *request,
+                     ssize_t result);
+
+/** @} */ // Backend Functions
+/** @} */ // AsyncFunctions
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -18,9 +18,12 @@ extern "C" {
     } sl_seekable_t;
     typedef struct streamlike_s streamlike_t;
     typedef struct sl_ckp_s sl_ckp_t;
+    typedef struct sl_extent_s sl_extent_t;
 }
 #endif
 
+struct iovec;
+
 namespace streamlike {
 
 class Streamlike {
@@ -43,6 +46,12 @@ class Streamlike {
         off_t ckp_offset(const sl_ckp_t* ckp) const;
         size_t ckp_metadata(const sl_ckp_t* ckp, const void** result) const;
 
+        size_t read_at(void *buffer, size_t size, off_t offset) const;
+        size_t readv(const struct iovec *iov, int iovcnt);
+        size_t writev(const struct iovec *iov, int iovcnt);
+        int read_multi(sl_extent_t *extents, int count);
+        off_t seek_cost(off_t offset) const;
+
         bool hasRead() const;
         bool hasInput() const;
         bool hasWrite() const;
@@ -52,6 +61,13 @@ class Streamlike {
         bool hasEof() const;
         bool hasError() const;
         bool hasLength() const;
+        bool hasReadAt() const;
+        bool hasReadv() const;
+        bool hasWritev() const;
+        bool hasReadMulti() const;
+
+        unsigned caps() const;
+        bool hasCaps(unsigned caps) const;
 
         Streamlike(Streamlike&& old);
         Streamlike& operator=(Streamlike&& old);
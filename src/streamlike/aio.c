@@ -0,0 +1,490 @@
+#include "../streamlike.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Most milliseconds an engine blocks in one poll. */
+#define SL_AIO_POLL_TIMEOUT_MS (100)
+
+typedef struct sl_aio_node_s
+{
+    /* First member, so that requests given to backends can be cast back. */
+    sl_aio_request_t request;
+    const streamlike_t *stream;
+    ssize_t result;
+    struct sl_aio_node_s *next;
+} sl_aio_node_t;
+
+typedef struct sl_aio_driver_s
+{
+    sl_aio_t *aio;
+    const sl_aio_engine_t *engine;
+    void *state;
+    pthread_t thread;
+    int kicked;
+    struct sl_aio_driver_s *next;
+} sl_aio_driver_t;
+
+struct sl_aio_s
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  done_cond;
+    pthread_cond_t  drive_cond;
+    sl_aio_node_t *queue_head;
+    sl_aio_node_t *queue_tail;
+    sl_aio_node_t *done_head;
+    sl_aio_node_t *done_tail;
+    size_t outstanding;
+    int stopping;
+    int thread_count;
+    pthread_t *threads;
+    /* Stream each pool thread is reading or seeking. NULL if none. */
+    const streamlike_t **busy;
+    sl_aio_driver_t *drivers;
+};
+
+static
+int is_cursor_op_(const sl_aio_node_t *node)
+{
+    return node->request.op != SL_AIO_READ_AT;
+}
+
+/* Unlinks the first queued request which can run now. Reads and seeks wait for
+ * earlier ones on the same stream. Must be called with the lock held. */
+static
+sl_aio_node_t* take_runnable_(sl_aio_t *aio)
+{
+    sl_aio_node_t *prev = NULL;
+    sl_aio_node_t *node;
+    sl_aio_node_t *earlier;
+    int runnable;
+    int i;
+
+    for (node = aio->queue_head; node; prev = node, node = node->next) {
+        runnable = 1;
+        if (is_cursor_op_(node)) {
+            for (i = 0; i < aio->thread_count && runnable; i++) {
+                runnable = (aio->busy[i] != node->stream);
+            }
+            for (earlier = aio->queue_head; earlier != node && runnable;
+                    earlier = earlier->next) {
+                runnable = (!is_cursor_op_(earlier)
+                            || earlier->stream != node->stream);
+            }
+        }
+        if (runnable) {
+            if (prev) {
+                prev->next = node->next;
+            } else {
+                aio->queue_head = node->next;
+            }
+            if (aio->queue_tail == node) {
+                aio->queue_tail = prev;
+            }
+            node->next = NULL;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with the lock held. */
+static
+void push_done_(sl_aio_t *aio, sl_aio_node_t *node)
+{
+    node->next = NULL;
+    if (aio->done_tail) {
+        aio->done_tail->next = node;
+    } else {
+        aio->done_head = node;
+    }
+    aio->done_tail = node;
+    aio->outstanding--;
+    pthread_cond_broadcast(&aio->done_cond);
+}
+
+/* Read failing before any data gives -1, as for native engines. */
+static
+ssize_t read_result_(const streamlike_t *stream, size_t size, size_t read)
+{
+    if (read == 0 && size > 0 && stream->error && sl_error(stream)) {
+        return -1;
+    }
+    return read;
+}
+
+static
+ssize_t perform_(sl_aio_node_t *node)
+{
+    const sl_aio_request_t *req = &node->request;
+
+    switch (req->op) {
+    case SL_AIO_READ:
+        return read_result_(node->stream, req->size,
+                            sl_read(node->stream, req->buffer, req->size));
+    case SL_AIO_READ_AT:
+        return read_result_(node->stream, req->size,
+                            sl_read_at(node->stream, req->buffer, req->size,
+                                       req->offset));
+    case SL_AIO_SEEK:
+        return sl_seek(node->stream, req->offset, req->whence);
+    }
+    return -1;
+}
+
+static
+void* worker_main_(void *arg)
+{
+    sl_aio_t *aio = arg;
+    sl_aio_node_t *node;
+    int idx;
+
+    pthread_mutex_lock(&aio->lock);
+    for (idx = 0; !pthread_equal(aio->threads[idx], pthread_self()); idx++);
+    while (1) {
+        node = take_runnable_(aio);
+        if (!node) {
+            if (aio->stopping) {
+                break;
+            }
+            pthread_cond_wait(&aio->work_cond, &aio->lock);
+            continue;
+        }
+        if (is_cursor_op_(node)) {
+            aio->busy[idx] = node->stream;
+        }
+        pthread_mutex_unlock(&aio->lock);
+
+        node->result = perform_(node);
+
+        pthread_mutex_lock(&aio->lock);
+        if (aio->busy[idx]) {
+            /* Requests of this stream may be runnable now. */
+            aio->busy[idx] = NULL;
+            pthread_cond_broadcast(&aio->work_cond);
+        }
+        push_done_(aio, node);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+static
+void* driver_main_(void *arg)
+{
+    sl_aio_driver_t *driver = arg;
+    sl_aio_t *aio = driver->aio;
+    int pending = 0;
+
+    pthread_mutex_lock(&aio->lock);
+    while (1) {
+        while (!pending && !driver->kicked && !aio->stopping) {
+            pthread_cond_wait(&aio->drive_cond, &aio->lock);
+        }
+        if (!pending && !driver->kicked) {
+            break;
+        }
+        driver->kicked = 0;
+        pthread_mutex_unlock(&aio->lock);
+        pending = driver->engine->poll(driver->state, SL_AIO_POLL_TIMEOUT_MS);
+        pthread_mutex_lock(&aio->lock);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+sl_aio_t* sl_aio_create(int threads)
+{
+    sl_aio_t *aio;
+    pthread_condattr_t attr;
+    int i;
+
+    if (threads <= 0) {
+        return NULL;
+    }
+    aio = malloc(sizeof(sl_aio_t));
+    if (!aio) {
+        return NULL;
+    }
+    aio->threads = malloc(sizeof(pthread_t) * threads);
+    aio->busy = calloc(threads, sizeof(const streamlike_t*));
+    if (!aio->threads || !aio->busy) {
+        goto fail;
+    }
+    if (pthread_mutex_init(&aio->lock, NULL) != 0) {
+        goto fail;
+    }
+    /* Waiters for completions time out by monotonic clock. */
+    if (pthread_condattr_init(&attr) != 0) {
+        goto fail_lock;
+    }
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0
+            || pthread_cond_init(&aio->done_cond, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        goto fail_lock;
+    }
+    pthread_condattr_destroy(&attr);
+    if (pthread_cond_init(&aio->work_cond, NULL) != 0) {
+        goto fail_done_cond;
+    }
+    if (pthread_cond_init(&aio->drive_cond, NULL) != 0) {
+        goto fail_work_cond;
+    }
+    aio->queue_head   = NULL;
+    aio->queue_tail   = NULL;
+    aio->done_head    = NULL;
+    aio->done_tail    = NULL;
+    aio->outstanding  = 0;
+    aio->stopping     = 0;
+    aio->thread_count = 0;
+    aio->drivers      = NULL;
+
+    /* Workers look themselves up in threads, so lock until all are there. */
+    pthread_mutex_lock(&aio->lock);
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&aio->threads[i], NULL, worker_main_, aio) != 0) {
+            break;
+        }
+        aio->thread_count++;
+    }
+    pthread_mutex_unlock(&aio->lock);
+    if (aio->thread_count < threads) {
+        sl_aio_destroy(aio);
+        return NULL;
+    }
+    return aio;
+
+fail_work_cond:
+    pthread_cond_destroy(&aio->work_cond);
+fail_done_cond:
+    pthread_cond_destroy(&aio->done_cond);
+fail_lock:
+    pthread_mutex_destroy(&aio->lock);
+fail:
+    free(aio->busy);
+    free(aio->threads);
+    free(aio);
+    return NULL;
+}
+
+void sl_aio_destroy(sl_aio_t *aio)
+{
+    sl_aio_driver_t *driver;
+    sl_aio_node_t *node;
+    int i;
+
+    pthread_mutex_lock(&aio->lock);
+    while (aio->outstanding > 0) {
+        pthread_cond_wait(&aio->done_cond, &aio->lock);
+    }
+    aio->stopping = 1;
+    pthread_cond_broadcast(&aio->work_cond);
+    pthread_cond_broadcast(&aio->drive_cond);
+    pthread_mutex_unlock(&aio->lock);
+
+    for (i = 0; i < aio->thread_count; i++) {
+        pthread_join(aio->threads[i], NULL);
+    }
+    while ((driver = aio->drivers)) {
+        aio->drivers = driver->next;
+        if (driver->state) {
+            pthread_join(driver->thread, NULL);
+            driver->engine->destroy(driver->state);
+        }
+        free(driver);
+    }
+    while ((node = aio->done_head)) {
+        aio->done_head = node->next;
+        free(node);
+    }
+
+    pthread_cond_destroy(&aio->drive_cond);
+    pthread_cond_destroy(&aio->work_cond);
+    pthread_cond_destroy(&aio->done_cond);
+    pthread_mutex_destroy(&aio->lock);
+    free(aio->busy);
+    free(aio->threads);
+    free(aio);
+}
+
+int sl_aio_submit(sl_aio_t *aio, const streamlike_t *stream,
+                  const sl_aio_request_t *request)
+{
+    sl_aio_node_t *node;
+
+    switch (request->op) {
+    case SL_AIO_READ:
+        if (!stream->read) {
+            return -1;
+        }
+        break;
+    case SL_AIO_READ_AT:
+        if (!stream->read_at) {
+            return -1;
+        }
+        break;
+    case SL_AIO_SEEK:
+        if (!stream->seek) {
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    node = malloc(sizeof(sl_aio_node_t));
+    if (!node) {
+        return -1;
+    }
+    node->request = *request;
+    node->stream  = stream;
+    node->result  = -1;
+    node->next    = NULL;
+
+    pthread_mutex_lock(&aio->lock);
+    aio->outstanding++;
+    pthread_mutex_unlock(&aio->lock);
+
+    if (stream->aio_submit
+            && stream->aio_submit(stream->context, aio, &node->request) == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&aio->lock);
+    if (aio->queue_tail) {
+        aio->queue_tail->next = node;
+    } else {
+        aio->queue_head = node;
+    }
+    aio->queue_tail = node;
+    pthread_cond_signal(&aio->work_cond);
+    pthread_mutex_unlock(&aio->lock);
+    return 0;
+}
+
+int sl_aio_poll(sl_aio_t *aio, sl_aio_completion_t *completions, int max)
+{
+    return sl_aio_wait(aio, completions, max, 0);
+}
+
+int sl_aio_wait(sl_aio_t *aio, sl_aio_completion_t *completions, int max,
+                long timeout_ms)
+{
+    struct timespec deadline;
+    sl_aio_node_t *taken = NULL;
+    sl_aio_node_t *node;
+    int ret = 0;
+    int count = 0;
+
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&aio->lock);
+    while (!aio->done_head && aio->outstanding > 0 && timeout_ms != 0
+            && ret != ETIMEDOUT) {
+        if (timeout_ms > 0) {
+            ret = pthread_cond_timedwait(&aio->done_cond, &aio->lock,
+                                         &deadline);
+        } else {
+            pthread_cond_wait(&aio->done_cond, &aio->lock);
+        }
+    }
+    if (max > 0 && aio->done_head) {
+        taken = aio->done_head;
+        for (node = taken; count < max - 1 && node->next; node = node->next) {
+            count++;
+        }
+        count++;
+        aio->done_head = node->next;
+        if (!aio->done_head) {
+            aio->done_tail = NULL;
+        }
+        node->next = NULL;
+    }
+    pthread_mutex_unlock(&aio->lock);
+
+    for (count = 0; (node = taken); count++) {
+        taken = node->next;
+        completions[count].tag    = node->request.tag;
+        completions[count].op     = node->request.op;
+        completions[count].result = node->result;
+        free(node);
+    }
+    return count;
+}
+
+void* sl_aio_engine(sl_aio_t *aio, const sl_aio_engine_t *engine)
+{
+    sl_aio_driver_t *driver;
+    void *state = NULL;
+
+    pthread_mutex_lock(&aio->lock);
+    for (driver = aio->drivers; driver; driver = driver->next) {
+        if (driver->engine == engine) {
+            state = driver->state;
+            goto done;
+        }
+    }
+    driver = malloc(sizeof(sl_aio_driver_t));
+    if (!driver) {
+        goto done;
+    }
+    driver->aio    = aio;
+    driver->engine = engine;
+    driver->kicked = 0;
+    driver->state  = engine->create(aio);
+    if (driver->state
+            && pthread_create(&driver->thread, NULL, driver_main_,
+                              driver) != 0) {
+        engine->destroy(driver->state);
+        driver->state = NULL;
+    }
+    /* Failed engines are kept too, so that they aren't retried. */
+    driver->next = aio->drivers;
+    aio->drivers = driver;
+    state = driver->state;
+
+done:
+    pthread_mutex_unlock(&aio->lock);
+    return state;
+}
+
+void sl_aio_kick(sl_aio_t *aio, const sl_aio_engine_t *engine)
+{
+    sl_aio_driver_t *driver;
+    void *state = NULL;
+
+    pthread_mutex_lock(&aio->lock);
+    for (driver = aio->drivers; driver; driver = driver->next) {
+        if (driver->engine == engine) {
+            driver->kicked = 1;
+            state = driver->state;
+            pthread_cond_broadcast(&aio->drive_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&aio->lock);
+    if (state && engine->wake) {
+        engine->wake(state);
+    }
+}
+
+void sl_aio_complete(sl_aio_t *aio, const sl_aio_request_t *request,
+                     ssize_t result)
+{
+    sl_aio_node_t *node = (sl_aio_node_t*)request;
+
+    node->result = result;
+    pthread_mutex_lock(&aio->lock);
+    push_done_(aio, node);
+    pthread_mutex_unlock(&aio->lock);
+}
@@ -18,33 +18,445 @@
 #endif
 #include "buffer.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
 
+#ifdef SL_BUFFER_LZ4
+# include <lz4.h>
+#endif
+
+#include "util/blockq.h"
 #include "util/circbuf.h"
 
+typedef enum sl_buffer_mode_e
+{
+    SL_BUFFER_MODE_PLAIN,
+    SL_BUFFER_MODE_LZ4,
+    SL_BUFFER_MODE_BLOCKS
+} sl_buffer_mode_t;
+
+/* Header preceding each block in the circular buffer in LZ4 mode. Zero lz4_len
+ * means the block is stored as is, since it didn't compress. */
+typedef struct sl_buffer_lz4_hdr_s
+{
+    uint32_t raw_len;
+    uint32_t lz4_len;
+} sl_buffer_lz4_hdr_t;
+
+/* Scratch size for data skipped while seeking forward by reading through. */
+#define SL_BUFFER_SKIP_SIZE (4096)
+
+/* Filler backs off from a sink pushing back, waiting twice as long each time
+ * up to the most, unless woken up by a seek or destroy. */
+#define SL_BUFFER_SINK_BACKOFF_MIN_US (100)
+#define SL_BUFFER_SINK_BACKOFF_MAX_US (50 * 1000)
+
+/* Most advice waiting to be forwarded by the filler. More is dropped. */
+#define SL_BUFFER_ADVICE_QUEUE (4)
+
+typedef struct sl_buffer_advice_s
+{
+    off_t offset;
+    off_t length;
+    int advice;
+} sl_buffer_advice_t;
+
 typedef struct sl_buffer_s
 {
     streamlike_t* inner_stream;
     circbuf_t* cbuf;
+    blockq_t* bq;
     pthread_t* filler;
     int filler_started;
     off_t pos;
     size_t step_size;
+    sl_buffer_mode_t mode;
     /* TODO: Seperate eof from failure. */
     int eof;
+    int error;
+    /* LZ4 mode only. Raw and compressed blocks used by the producer... */
+    char *lz4_fill_raw;
+    char *lz4_fill_buf;
+    /* ...and by the consumer, which serves reads from decompressed block. */
+    char *lz4_read_buf;
+    char *lz4_read_raw;
+    size_t lz4_read_off;
+    size_t lz4_read_len;
+    /* Block mode only. Block currently owned by the consumer. */
+    const char *block;
+    size_t block_off;
+    size_t block_len;
+    int block_held;
+    /* Push mode only. Filler drains the buffer into the sink itself. */
+    sl_buffer_sink_cb_t sink;
+    void *sink_context;
+    int sink_eof;
+    long sink_backoff_us;
+    /* Deadline of the current consumer call, if there is a read timeout. */
+    long read_timeout_ms;
+    struct timespec deadline;
+    int deadline_set;
+    char timed_out;
+    /* Counters only grow. Reset takes a snapshot to subtract. Occupancy and
+     * inner reads are counted by the filler, seeks by the consumer. */
+    size_t capacity;
+    sl_buffer_stats_t stats;
+    sl_buffer_stats_t stats_base;
     pthread_mutex_t* seek_lock;
     pthread_cond_t* seek_cond;
+    /* Advice is forwarded to inner stream by the filler, since it shouldn't
+     * be touched by two threads. Guarded by seek_lock. */
+    sl_buffer_advice_t advice[SL_BUFFER_ADVICE_QUEUE];
+    int advice_count;
     int seek_requested;
     off_t seek_off;
     int seek_whence;
     int seek_result;
 } sl_buffer_t;
 
+static
+uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Counters are updated by both threads and read by any, so they are accessed
+ * atomically. */
+static
+void stat_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static
+uint64_t stat_get(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static
+size_t inner_read(sl_buffer_t *context, void *buf, size_t len)
+{
+    uint64_t start = now_ns();
+    size_t read = sl_read(context->inner_stream, buf, len);
+    stat_add(&context->stats.inner_read_ns, now_ns() - start);
+    stat_add(&context->stats.inner_read_count, 1);
+    return read;
+}
+
 static
 size_t filler_cb(void *context, void *buf, size_t len)
 {
-    return sl_read(context, buf, len);
+    return inner_read(context, buf, len);
+}
+
+static
+void forward_advice(sl_buffer_t *context)
+{
+    sl_buffer_advice_t advice[SL_BUFFER_ADVICE_QUEUE];
+    int count;
+    int i;
+
+    pthread_mutex_lock(context->seek_lock);
+    count = context->advice_count;
+    memcpy(advice, context->advice, sizeof(sl_buffer_advice_t) * count);
+    context->advice_count = 0;
+    pthread_mutex_unlock(context->seek_lock);
+
+    for (i = 0; i < count; i++) {
+        sl_advise(context->inner_stream, advice[i].offset, advice[i].length,
+                  advice[i].advice);
+    }
+}
+
+/* Inner stream timing out isn't the end of it. Filling goes on. */
+static
+int inner_timed_out(sl_buffer_t *context)
+{
+    return context->inner_stream->error
+        && sl_error(context->inner_stream) == SL_ERROR_TIMEDOUT;
+}
+
+#ifdef SL_BUFFER_LZ4
+static
+size_t fill_lz4_block(sl_buffer_t *context)
+{
+    sl_buffer_lz4_hdr_t hdr;
+    size_t raw_len = 0;
+    size_t read;
+    const char *payload;
+    size_t payload_len;
+    int lz4_len;
+
+    /* Collect a whole block, so that block boundaries are the same whatever
+     * chunks inner stream returns. */
+    do {
+        read = inner_read(context, context->lz4_fill_raw + raw_len,
+                          context->step_size - raw_len);
+        raw_len += read;
+    } while (read > 0 && raw_len < context->step_size);
+
+    if (raw_len == 0) {
+        return 0;
+    }
+
+    lz4_len = LZ4_compress_default(context->lz4_fill_raw,
+                                   context->lz4_fill_buf, raw_len,
+                                   LZ4_compressBound(context->step_size));
+    if (lz4_len > 0 && (size_t)lz4_len < raw_len) {
+        hdr.lz4_len = lz4_len;
+        payload     = context->lz4_fill_buf;
+        payload_len = lz4_len;
+    } else {
+        hdr.lz4_len = 0;
+        payload     = context->lz4_fill_raw;
+        payload_len = raw_len;
+    }
+    hdr.raw_len = raw_len;
+    SL_BUFFER_LOG("Compressed block of %zu bytes into %zu bytes.", raw_len,
+                  payload_len);
+
+    /* Short write means reading is closed. Half-written block will be dropped
+     * along with the rest of circbuf. */
+    if (circbuf_write(context->cbuf, &hdr, sizeof(hdr)) < sizeof(hdr)
+            || circbuf_write(context->cbuf, payload, payload_len)
+                < payload_len) {
+        return 0;
+    }
+    return raw_len;
+}
+
+static
+int read_lz4_block(sl_buffer_t *stream)
+{
+    sl_buffer_lz4_hdr_t hdr;
+
+    stream->lz4_read_off = 0;
+    stream->lz4_read_len = 0;
+
+    if (circbuf_read(stream->cbuf, &hdr, sizeof(hdr)) < sizeof(hdr)) {
+        return -1;
+    }
+    if (hdr.raw_len > stream->step_size) {
+        SL_BUFFER_LOG("ERROR: Block of %zu bytes is larger than step size.",
+                      (size_t)hdr.raw_len);
+        stream->error = 1;
+        return -1;
+    }
+    if (hdr.lz4_len == 0) {
+        if (circbuf_read(stream->cbuf, stream->lz4_read_raw, hdr.raw_len)
+                < hdr.raw_len) {
+            return -1;
+        }
+    } else {
+        if (hdr.lz4_len > (uint32_t)LZ4_compressBound(stream->step_size)
+                || circbuf_read(stream->cbuf, stream->lz4_read_buf,
+                                hdr.lz4_len) < hdr.lz4_len) {
+            return -1;
+        }
+        if (LZ4_decompress_safe(stream->lz4_read_buf, stream->lz4_read_raw,
+                                hdr.lz4_len, stream->step_size)
+                != (int)hdr.raw_len) {
+            SL_BUFFER_LOG("ERROR: Couldn't decompress block.");
+            stream->error = 1;
+            return -1;
+        }
+    }
+    stream->lz4_read_len = hdr.raw_len;
+    return 0;
+}
+#endif
+
+static
+size_t fill_block(sl_buffer_t *context)
+{
+    char *block;
+    size_t len = 0;
+    size_t read;
+
+    block = blockq_acquire(context->bq);
+    if (block == NULL) {
+        return 0;
+    }
+    /* Fill the whole block so that block boundaries are deterministic. */
+    do {
+        read = inner_read(context, block + len, context->step_size - len);
+        len += read;
+    } while (read > 0 && len < context->step_size);
+
+    if (len > 0) {
+        blockq_commit(context->bq, len);
+    }
+    return len;
+}
+
+static
+int ring_is_read_closed(sl_buffer_t *context);
+
+static
+void sink_backoff(sl_buffer_t *context)
+{
+    struct timespec ts;
+
+    context->sink_backoff_us = (context->sink_backoff_us == 0 ?
+                                SL_BUFFER_SINK_BACKOFF_MIN_US :
+                                context->sink_backoff_us * 2);
+    if (context->sink_backoff_us > SL_BUFFER_SINK_BACKOFF_MAX_US) {
+        context->sink_backoff_us = SL_BUFFER_SINK_BACKOFF_MAX_US;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += context->sink_backoff_us * 1000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(context->seek_lock);
+    if (!ring_is_read_closed(context) && !context->seek_requested) {
+        pthread_cond_timedwait(context->seek_cond, context->seek_lock, &ts);
+    }
+    pthread_mutex_unlock(context->seek_lock);
+}
+
+static
+size_t sink_step(sl_buffer_t *context)
+{
+    const void *data;
+    size_t written = 0;
+    size_t consumed = 0;
+    size_t avail;
+    size_t used;
+    char eof = 0;
+
+    /* Read ahead only as much as fits without blocking, since nobody else
+     * drains the buffer. */
+    if (!context->sink_eof) {
+        written = circbuf_write_some2(context->cbuf, filler_cb, context,
+                                      context->step_size, &eof);
+        context->sink_eof = eof && !inner_timed_out(context);
+    }
+
+    /* Offer buffered data until the sink takes less than offered. */
+    while ((avail = circbuf_input_some(context->cbuf, &data, SIZE_MAX)) > 0) {
+        used = context->sink(context->sink_context, data, avail);
+        if (used == SL_BUFFER_SINK_STOP) {
+            SL_BUFFER_LOG("Sink stopped.");
+            return 0;
+        }
+        if (used > avail) {
+            used = avail;
+        }
+        circbuf_dispose_some(context->cbuf, used);
+        consumed += used;
+        if (used < avail) {
+            break;
+        }
+    }
+
+    if (context->sink_eof && circbuf_get_length(context->cbuf) == 0) {
+        SL_BUFFER_LOG("Signaling end of stream to sink.");
+        context->sink(context->sink_context, NULL, 0);
+        return 0;
+    }
+
+    /* Sink pushes back while the buffer is full. Let it catch up. */
+    if (written == 0 && consumed == 0) {
+        sink_backoff(context);
+    } else {
+        context->sink_backoff_us = 0;
+    }
+    return context->step_size;
+}
+
+static
+size_t fill_step(sl_buffer_t *context)
+{
+    if (context->sink) {
+        return sink_step(context);
+    }
+#ifdef SL_BUFFER_LZ4
+    if (context->mode == SL_BUFFER_MODE_LZ4) {
+        return fill_lz4_block(context);
+    }
+#endif
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        return fill_block(context);
+    }
+    return circbuf_write2(context->cbuf, filler_cb, context,
+                          context->step_size);
+}
+
+/* Wrappers dispatching to the circular buffer or to the block queue. */
+
+static
+int ring_is_read_closed(sl_buffer_t *context)
+{
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        return blockq_is_read_closed(context->bq);
+    }
+    return circbuf_is_read_closed(context->cbuf);
+}
+
+static
+void ring_close_read(sl_buffer_t *context)
+{
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        blockq_close_read(context->bq);
+    } else {
+        circbuf_close_read(context->cbuf);
+    }
+}
+
+static
+void ring_close_write(sl_buffer_t *context)
+{
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        blockq_close_write(context->bq);
+    } else {
+        circbuf_close_write(context->cbuf);
+    }
+}
+
+static
+void record_occupancy(sl_buffer_t *context)
+{
+    size_t len;
+    size_t bucket;
+
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        len = blockq_get_length(context->bq);
+    } else {
+        len = circbuf_get_length(context->cbuf);
+    }
+    bucket = len * SL_BUFFER_STATS_BUCKETS / context->capacity;
+    if (bucket >= SL_BUFFER_STATS_BUCKETS) {
+        bucket = SL_BUFFER_STATS_BUCKETS - 1;
+    }
+    stat_add(&context->stats.occupancy[bucket], 1);
+}
+
+static
+void ring_get_wait_ns(sl_buffer_t *context, uint64_t *read_wait_ns,
+                      uint64_t *write_wait_ns)
+{
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        blockq_get_wait_ns(context->bq, read_wait_ns, write_wait_ns);
+    } else {
+        circbuf_get_wait_ns(context->cbuf, read_wait_ns, write_wait_ns);
+    }
+}
+
+static
+void ring_reset(sl_buffer_t *context)
+{
+    if (context->mode == SL_BUFFER_MODE_BLOCKS) {
+        blockq_reset(context->bq);
+    } else {
+        circbuf_reset(context->cbuf);
+    }
 }
 
 static
@@ -61,8 +473,12 @@ void* fill_buffer(void *arg)
     pthread_mutex_unlock(context->seek_lock);
 
     /* Loop until read is closed and there is no outstanding seek request. */
-    while (!circbuf_is_read_closed(context->cbuf)
-            || context->seek_requested) {
+    while (!ring_is_read_closed(context) || context->seek_requested) {
+
+        /* Advice given before a seek applies to the seek too. */
+        if (context->advice_count > 0) {
+            forward_advice(context);
+        }
 
         /* Handle seek if requested. */
         if (context->seek_requested) {
@@ -80,7 +496,8 @@ void* fill_buffer(void *arg)
                 /* TODO: Could be handled more efficiently without requiring
                  * rebuffering some data after seek. Let's keep it simple for
                  * now. */
-                circbuf_reset(context->cbuf);
+                ring_reset(context);
+                context->sink_eof = 0;
             }
 
             /* Clear the seek request flag. */
@@ -98,26 +515,35 @@ void* fill_buffer(void *arg)
 
         SL_BUFFER_LOG("Writing to circbuf.");
         /* Write to buffer from stream. */
-        written = circbuf_write2(context->cbuf, filler_cb,
-                                 context->inner_stream,
-                                 context->step_size);
+        record_occupancy(context);
+        written = fill_step(context);
         SL_BUFFER_LOG("Wrote %zd bytes to circbuf.", written);
 
         /* If there is an error or eof is reached... */
-        if (written < context->step_size) {
+        if (written < context->step_size && !inner_timed_out(context)) {
 
             /* LOCK SEEK OPERATONS */
             pthread_mutex_lock(context->seek_lock);
 
+            /* There is no consumer to close reading in push mode. Return,
+             * and let seeking be done by consumer from now on. */
+            if (context->sink) {
+                ring_close_write(context);
+                context->filler_started = 0;
+                pthread_mutex_unlock(context->seek_lock);
+                SL_BUFFER_LOG("Sink is done.");
+                break;
+            }
+
             /* Signal consumer that writing is closed so that reading does not
              * block at the end of file.. */
-            circbuf_close_write(context->cbuf);
+            ring_close_write(context);
             SL_BUFFER_LOG("Closed writing.");
 
             /* If buffer not closed, wait until it is closed by either
              * sl_buffer_destroy() or sl_buffer_seek_cb(). */
             SL_BUFFER_LOG("Waiting on condition variable.");
-            while (!circbuf_is_read_closed(context->cbuf)) {
+            while (!ring_is_read_closed(context)) {
                 pthread_cond_wait(context->seek_cond, context->seek_lock);
                 SL_BUFFER_LOG("Woke up...");
             }
@@ -137,16 +563,19 @@ streamlike_t* sl_buffer_create(streamlike_t* inner_stream)
                              SL_BUFFER_DEFAULT_STEP_SIZE);
 }
 
-streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
-                                size_t step_size)
+static
+streamlike_t* sl_buffer_create_(streamlike_t* inner_stream, size_t buffer_size,
+                                size_t step_size, sl_buffer_mode_t mode)
 {
     streamlike_t* stream = NULL;
     sl_buffer_t* context = NULL;
     circbuf_t *cbuf      = NULL;
+    blockq_t *bq         = NULL;
     pthread_mutex_t* eof_lock  = NULL;
     pthread_cond_t* eof_cond   = NULL;
     pthread_mutex_t* seek_lock = NULL;
     pthread_cond_t* seek_cond  = NULL;
+    pthread_condattr_t seek_cond_attr;
 
     if (inner_stream == NULL) {
         SL_BUFFER_LOG("ERROR: Inner stream can't be NULL.");
@@ -171,11 +600,46 @@ streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
         goto fail;
     }
 
-    cbuf = circbuf_init(buffer_size);
-    if (cbuf == NULL) {
-        SL_BUFFER_LOG("ERROR: Couldn't initialize circular buffer of size %zu."
-                      "\n", buffer_size);
-        goto fail;
+    context->lz4_fill_raw = NULL;
+    context->lz4_fill_buf = NULL;
+    context->lz4_read_buf = NULL;
+    context->lz4_read_raw = NULL;
+
+#ifdef SL_BUFFER_LZ4
+    if (mode == SL_BUFFER_MODE_LZ4) {
+        if (step_size > LZ4_MAX_INPUT_SIZE) {
+            SL_BUFFER_LOG("ERROR: Block size %zu is too large for LZ4.",
+                          step_size);
+            goto fail;
+        }
+        context->lz4_fill_raw = malloc(step_size);
+        context->lz4_fill_buf = malloc(LZ4_compressBound(step_size));
+        context->lz4_read_buf = malloc(LZ4_compressBound(step_size));
+        context->lz4_read_raw = malloc(step_size);
+        if (context->lz4_fill_raw == NULL || context->lz4_fill_buf == NULL
+                || context->lz4_read_buf == NULL
+                || context->lz4_read_raw == NULL) {
+            SL_BUFFER_LOG("ERROR: Couldn't allocate LZ4 blocks.\n");
+            goto fail;
+        }
+    }
+#endif
+
+    if (mode == SL_BUFFER_MODE_BLOCKS) {
+        bq = blockq_init(step_size, buffer_size / step_size,
+                         SL_BUFFER_BLOCK_ALIGNMENT);
+        if (bq == NULL) {
+            SL_BUFFER_LOG("ERROR: Couldn't initialize %zu blocks of size %zu."
+                          "\n", buffer_size / step_size, step_size);
+            goto fail;
+        }
+    } else {
+        cbuf = circbuf_init(buffer_size);
+        if (cbuf == NULL) {
+            SL_BUFFER_LOG("ERROR: Couldn't initialize circular buffer of size "
+                          "%zu.\n", buffer_size);
+            goto fail;
+        }
     }
 
     stream = malloc(sizeof(streamlike_t));
@@ -203,24 +667,63 @@ streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
         goto fail;
     }
 
+    /* Filler backs off from the sink on it until a monotonic deadline. */
     seek_cond = malloc(sizeof(pthread_cond_t));
-    if (seek_cond == NULL || pthread_cond_init(seek_cond, NULL) != 0) {
+    if (seek_cond == NULL || pthread_condattr_init(&seek_cond_attr) != 0) {
         SL_BUFFER_LOG("ERROR: Couldn't initialize seek condition variable.\n");
+        free(seek_cond);
+        seek_cond = NULL;
+        goto fail;
+    }
+    if (pthread_condattr_setclock(&seek_cond_attr, CLOCK_MONOTONIC) != 0
+            || pthread_cond_init(seek_cond, &seek_cond_attr) != 0) {
+        SL_BUFFER_LOG("ERROR: Couldn't initialize seek condition variable.\n");
+        pthread_condattr_destroy(&seek_cond_attr);
+        free(seek_cond);
+        seek_cond = NULL;
         goto fail;
     }
+    pthread_condattr_destroy(&seek_cond_attr);
 
     context->inner_stream   = inner_stream;
     context->cbuf           = cbuf;
+    context->bq             = bq;
     context->filler         = NULL;
     context->filler_started = 0;
     context->pos            = 0;
     context->step_size      = step_size;
+    context->mode           = mode;
 
-    context->eof = 0;
+    context->eof   = 0;
+    context->error = 0;
+
+    context->lz4_read_off = 0;
+    context->lz4_read_len = 0;
+
+    context->block      = NULL;
+    context->block_off  = 0;
+    context->block_len  = 0;
+    context->block_held = 0;
+
+    context->sink         = NULL;
+    context->sink_context = NULL;
+    context->sink_eof     = 0;
+    context->sink_backoff_us = 0;
+
+    context->read_timeout_ms = 0;
+    context->deadline_set    = 0;
+    context->timed_out       = 0;
+
+    context->capacity = (mode == SL_BUFFER_MODE_BLOCKS ? buffer_size / step_size
+                                                       : buffer_size);
+    memset(&context->stats, 0, sizeof(context->stats));
+    memset(&context->stats_base, 0, sizeof(context->stats_base));
 
     context->seek_lock = seek_lock;
     context->seek_cond = seek_cond;
 
+    context->advice_count = 0;
+
     context->seek_requested = 0;
     context->seek_off       = 0;
     context->seek_whence    = 0;
@@ -230,6 +733,8 @@ streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
 
     stream->read   = sl_buffer_read_cb;
     stream->input  = sl_buffer_input_cb;
+    stream->write  = NULL;
+    stream->flush  = NULL;
     stream->seek   = sl_buffer_seek_cb;
     stream->tell   = sl_buffer_tell_cb;
     stream->eof    = sl_buffer_eof_cb;
@@ -242,12 +747,57 @@ streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
     stream->ckp_offset   = sl_buffer_ckp_offset_cb;
     stream->ckp_metadata = sl_buffer_ckp_metadata_cb;
 
+    /* Positional reads don't go through buffer. */
+    stream->read_at = (inner_stream->read_at ? sl_buffer_read_at_cb : NULL);
+
+    stream->readv  = sl_buffer_readv_cb;
+    stream->writev = NULL;
+
+    /* Falls back to reading through buffer otherwise. */
+    stream->read_multi = (inner_stream->read_multi ? sl_buffer_read_multi_cb
+                                                   : NULL);
+
+    /* Positional reads may be taken by inner stream. */
+    stream->aio_submit = (inner_stream->aio_submit ? sl_buffer_aio_submit_cb
+                                                   : NULL);
+
+    stream->advise = (inner_stream->advise ? sl_buffer_advise_cb : NULL);
+
+    stream->seek_cost = (inner_stream->seek_cost ? sl_buffer_seek_cost_cb
+                                                 : NULL);
+
+    /* A clone would need a filler and an inner stream of its own. */
+    stream->clone = NULL;
+
+    /* Filler moves inner stream offset meanwhile. */
+    stream->data_map = NULL;
+
+    stream->descriptor = NULL;
+
+    /* Input is only supported with blocks, which are handed over without
+     * copying. Seeking restarts the filler, so it isn't cheap. */
+    stream->caps = sl_probe_caps(stream);
+    if (mode == SL_BUFFER_MODE_BLOCKS) {
+        stream->caps |= SL_CAP_ZERO_COPY;
+    } else {
+        stream->caps &= ~SL_CAP_INPUT;
+    }
+
     return stream;
 
 fail:
     free(stream);
+    if (context) {
+        free(context->lz4_fill_raw);
+        free(context->lz4_fill_buf);
+        free(context->lz4_read_buf);
+        free(context->lz4_read_raw);
+    }
     free(context);
     free(cbuf);
+    if (bq) {
+        blockq_destroy(bq);
+    }
     if (eof_lock) {
         pthread_mutex_destroy(eof_lock);
         free(eof_lock);
@@ -267,6 +817,36 @@ fail:
     return NULL;
 }
 
+streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
+                                size_t step_size)
+{
+    return sl_buffer_create_(inner_stream, buffer_size, step_size,
+                             SL_BUFFER_MODE_PLAIN);
+}
+
+streamlike_t* sl_buffer_create_lz4(streamlike_t* inner_stream,
+                                   size_t buffer_size, size_t block_size)
+{
+#ifdef SL_BUFFER_LZ4
+    return sl_buffer_create_(inner_stream, buffer_size, block_size,
+                             SL_BUFFER_MODE_LZ4);
+#else
+    SL_BUFFER_LOG("ERROR: Library is built without LZ4 support.");
+    return NULL;
+#endif
+}
+
+streamlike_t* sl_buffer_create_blocks(streamlike_t* inner_stream,
+                                      size_t block_size, size_t block_count)
+{
+    if (block_size == 0 || block_count > SIZE_MAX / block_size) {
+        SL_BUFFER_LOG("ERROR: Invalid block size or count.");
+        return NULL;
+    }
+    return sl_buffer_create_(inner_stream, block_size * block_count,
+                             block_size, SL_BUFFER_MODE_BLOCKS);
+}
+
 int sl_buffer_destroy(streamlike_t *buffer_stream)
 {
     sl_buffer_t* context;
@@ -290,7 +870,7 @@ int sl_buffer_destroy(streamlike_t *buffer_stream)
             pthread_mutex_lock(context->seek_lock);
 
             /* Close reading on circular buffer. */
-            circbuf_close_read(context->cbuf);
+            ring_close_read(context);
 
             /* Note: There shouldn't be any outstanding seek request since
              * there is only one consumer, the only possible caller of both
@@ -321,6 +901,11 @@ int sl_buffer_destroy(streamlike_t *buffer_stream)
             context->cbuf = NULL;
         }
 
+        if (context->bq != NULL) {
+            blockq_destroy(context->bq);
+            context->bq = NULL;
+        }
+
         /* Destroy eof/seek locks and condition variables. */
         if (context->seek_lock == NULL) {
             SL_BUFFER_LOG("Skipping deallocating seek mutex since it's NULL."
@@ -349,6 +934,11 @@ int sl_buffer_destroy(streamlike_t *buffer_stream)
             free(context->seek_cond);
             context->seek_cond = NULL;
         }
+
+        free(context->lz4_fill_raw);
+        free(context->lz4_fill_buf);
+        free(context->lz4_read_buf);
+        free(context->lz4_read_raw);
         free(context);
     }
     free(buffer_stream);
@@ -372,7 +962,7 @@ int sl_buffer_threaded_fill_buffer(streamlike_t *buffer_stream)
         return -2;
     }
 
-    if (context->cbuf == NULL) {
+    if (context->cbuf == NULL && context->bq == NULL) {
         SL_BUFFER_LOG("ERROR: Circular buffer is NULL.");
         return -3;
     }
@@ -415,31 +1005,460 @@ int sl_buffer_blocking_fill_buffer(streamlike_t *buffer_stream)
     return 0;
 }
 
+int sl_buffer_set_sink(streamlike_t *buffer_stream, sl_buffer_sink_cb_t sink,
+                       void *sink_context)
+{
+    sl_buffer_t* context;
+
+    if (buffer_stream == NULL) {
+        SL_BUFFER_LOG("ERROR: Buffer stream is NULL.");
+        return -1;
+    }
+
+    context = (sl_buffer_t*)buffer_stream->context;
+
+    if (context == NULL) {
+        SL_BUFFER_LOG("ERROR: Context is NULL.");
+        return -2;
+    }
+
+    if (context->mode != SL_BUFFER_MODE_PLAIN) {
+        SL_BUFFER_LOG("ERROR: Sink is supported only in plain mode.");
+        return -3;
+    }
+
+    if (context->filler != NULL) {
+        SL_BUFFER_LOG("ERROR: There is already a filler thread running.");
+        return -4;
+    }
+
+    context->sink         = sink;
+    context->sink_context = sink_context;
+    return 0;
+}
+
+int sl_buffer_set_read_timeout(streamlike_t *buffer_stream, long timeout_ms)
+{
+    sl_buffer_t* context;
+
+    if (buffer_stream == NULL) {
+        SL_BUFFER_LOG("ERROR: Buffer stream is NULL.");
+        return -1;
+    }
+
+    context = (sl_buffer_t*)buffer_stream->context;
+
+    if (context == NULL) {
+        SL_BUFFER_LOG("ERROR: Context is NULL.");
+        return -2;
+    }
+
+    /* Compressed blocks are decoded as a whole. */
+    if (context->mode == SL_BUFFER_MODE_LZ4) {
+        SL_BUFFER_LOG("ERROR: Read timeout isn't supported in LZ4 mode.");
+        return -3;
+    }
+
+    context->read_timeout_ms = (timeout_ms > 0 ? timeout_ms : 0);
+    return 0;
+}
+
+static
+void get_stats(sl_buffer_t *context, sl_buffer_stats_t *stats)
+{
+    const sl_buffer_stats_t *counters = &context->stats;
+    int i;
+
+    ring_get_wait_ns(context, &stats->consumer_wait_ns,
+                     &stats->producer_wait_ns);
+    for (i = 0; i < SL_BUFFER_STATS_BUCKETS; i++) {
+        stats->occupancy[i] = stat_get(&counters->occupancy[i]);
+    }
+    stats->seek_count       = stat_get(&counters->seek_count);
+    stats->seek_ns          = stat_get(&counters->seek_ns);
+    stats->skip_count       = stat_get(&counters->skip_count);
+    stats->inner_read_count = stat_get(&counters->inner_read_count);
+    stats->inner_read_ns    = stat_get(&counters->inner_read_ns);
+}
+
+int sl_buffer_get_stats(streamlike_t *buffer_stream, sl_buffer_stats_t *stats)
+{
+    sl_buffer_t* context;
+    const sl_buffer_stats_t *base;
+    int i;
+
+    if (buffer_stream == NULL) {
+        SL_BUFFER_LOG("ERROR: Buffer stream is NULL.");
+        return -1;
+    }
+
+    context = (sl_buffer_t*)buffer_stream->context;
+
+    if (context == NULL) {
+        SL_BUFFER_LOG("ERROR: Context is NULL.");
+        return -2;
+    }
+
+    get_stats(context, stats);
+    base = &context->stats_base;
+    stats->consumer_wait_ns -= base->consumer_wait_ns;
+    stats->producer_wait_ns -= base->producer_wait_ns;
+    for (i = 0; i < SL_BUFFER_STATS_BUCKETS; i++) {
+        stats->occupancy[i] -= base->occupancy[i];
+    }
+    stats->seek_count       -= base->seek_count;
+    stats->seek_ns          -= base->seek_ns;
+    stats->skip_count       -= base->skip_count;
+    stats->inner_read_count -= base->inner_read_count;
+    stats->inner_read_ns    -= base->inner_read_ns;
+    return 0;
+}
+
+int sl_buffer_reset_stats(streamlike_t *buffer_stream)
+{
+    sl_buffer_t* context;
+
+    if (buffer_stream == NULL) {
+        SL_BUFFER_LOG("ERROR: Buffer stream is NULL.");
+        return -1;
+    }
+
+    context = (sl_buffer_t*)buffer_stream->context;
+
+    if (context == NULL) {
+        SL_BUFFER_LOG("ERROR: Context is NULL.");
+        return -2;
+    }
+
+    get_stats(context, &context->stats_base);
+    return 0;
+}
+
 int sl_buffer_close_buffer(streamlike_t *buffer_stream)
 {
     /* TODO: I don't remember why I defined this function. :) */
     return 0;
 }
 
+static
+void begin_read(sl_buffer_t *stream)
+{
+    stream->timed_out    = 0;
+    stream->deadline_set = 0;
+    if (stream->error == SL_ERROR_TIMEDOUT) {
+        stream->error = 0;
+    }
+    if (stream->read_timeout_ms > 0
+            && clock_gettime(CLOCK_MONOTONIC, &stream->deadline) == 0) {
+        stream->deadline.tv_sec  += stream->read_timeout_ms / 1000;
+        stream->deadline.tv_nsec += (stream->read_timeout_ms % 1000) * 1000000;
+        if (stream->deadline.tv_nsec >= 1000000000) {
+            stream->deadline.tv_sec++;
+            stream->deadline.tv_nsec -= 1000000000;
+        }
+        stream->deadline_set = 1;
+    }
+}
+
+/* Returns nonzero if the deadline passed, rather than end of file reached. */
+static
+int end_read(sl_buffer_t *stream)
+{
+    if (stream->timed_out) {
+        SL_BUFFER_LOG("Read timed out.");
+        stream->error = SL_ERROR_TIMEDOUT;
+        return 1;
+    }
+    return 0;
+}
+
+static
+const struct timespec* read_deadline(sl_buffer_t *stream)
+{
+    return stream->deadline_set ? &stream->deadline : NULL;
+}
+
+#ifdef SL_BUFFER_LZ4
+static
+size_t read_lz4(sl_buffer_t *stream, void *buffer, size_t len)
+{
+    size_t read = 0;
+    size_t avail;
+
+    while (read < len) {
+        if (stream->lz4_read_off == stream->lz4_read_len
+                && read_lz4_block(stream) != 0) {
+            break;
+        }
+        avail = stream->lz4_read_len - stream->lz4_read_off;
+        if (avail > len - read) {
+            avail = len - read;
+        }
+        memcpy((char*)buffer + read,
+               stream->lz4_read_raw + stream->lz4_read_off, avail);
+        stream->lz4_read_off += avail;
+        read += avail;
+    }
+    return read;
+}
+#endif
+
+/* Releases the block held by the consumer, if any, and gets the next one. */
+static
+int read_block(sl_buffer_t *stream)
+{
+    const void *block;
+
+    if (stream->block_held) {
+        blockq_release(stream->bq);
+        stream->block_held = 0;
+    }
+    stream->block_off = 0;
+    stream->block_len = blockq_read_timed(stream->bq, &block,
+                                          read_deadline(stream),
+                                          &stream->timed_out);
+    if (stream->block_len == 0) {
+        return -1;
+    }
+    stream->block      = block;
+    stream->block_held = 1;
+    return 0;
+}
+
+static
+size_t read_blocks(sl_buffer_t *stream, void *buffer, size_t len)
+{
+    size_t read = 0;
+    size_t avail;
+
+    while (read < len) {
+        if (stream->block_off == stream->block_len
+                && read_block(stream) != 0) {
+            break;
+        }
+        avail = stream->block_len - stream->block_off;
+        if (avail > len - read) {
+            avail = len - read;
+        }
+        memcpy((char*)buffer + read, stream->block + stream->block_off, avail);
+        stream->block_off += avail;
+        read += avail;
+    }
+    return read;
+}
+
+static
+size_t read_step(sl_buffer_t *stream, void *buffer, size_t len)
+{
+#ifdef SL_BUFFER_LZ4
+    if (stream->mode == SL_BUFFER_MODE_LZ4) {
+        return read_lz4(stream, buffer, len);
+    }
+#endif
+    if (stream->mode == SL_BUFFER_MODE_BLOCKS) {
+        return read_blocks(stream, buffer, len);
+    }
+    return circbuf_read_timed(stream->cbuf, buffer, len, read_deadline(stream),
+                              &stream->timed_out);
+}
+
+size_t sl_buffer_next_block(streamlike_t *buffer_stream, const void **block)
+{
+    SL_BUFFER_ASSERT(buffer_stream);
+    sl_buffer_t *stream = buffer_stream->context;
+    size_t len;
+
+    SL_BUFFER_ASSERT(stream->mode == SL_BUFFER_MODE_BLOCKS);
+    begin_read(stream);
+    if (stream->block_off == stream->block_len && read_block(stream) != 0) {
+        if (!end_read(stream)) {
+            stream->eof = 1;
+        }
+        return 0;
+    }
+    /* Hand over what is left of the current block. */
+    *block = stream->block + stream->block_off;
+    len = stream->block_len - stream->block_off;
+    stream->block_off = stream->block_len;
+    stream->pos += len;
+    return len;
+}
+
 size_t sl_buffer_read_cb(void *context, void *buffer, size_t len)
 {
     SL_BUFFER_ASSERT(context);
     sl_buffer_t *stream = context;
 
-    size_t read = circbuf_read(stream->cbuf, buffer, len);
-    if (read < len) {
+    begin_read(stream);
+    size_t read = read_step(stream, buffer, len);
+    if (!end_read(stream) && read < len) {
         stream->eof = 1;
     }
     stream->pos += read;
     return read;
 }
 
+size_t sl_buffer_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    size_t total = 0;
+    size_t read = 0;
+    int i;
+
+    /* One deadline and one eof check for all buffers. */
+    begin_read(stream);
+    for (i = 0; i < iovcnt; i++) {
+        read = read_step(stream, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    if (!end_read(stream) && i < iovcnt) {
+        stream->eof = 1;
+    }
+    stream->pos += total;
+    return total;
+}
+
+int sl_buffer_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    return sl_read_multi(stream->inner_stream, extents, count);
+}
+
+size_t sl_buffer_read_at_cb(void *context, void *buffer, size_t len,
+                            off_t offset)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    return sl_read_at(stream->inner_stream, buffer, len, offset);
+}
+
+int sl_buffer_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    int ret = 0;
+
+    pthread_mutex_lock(stream->seek_lock);
+    if (!stream->filler_started) {
+        /* No filler to race with. */
+        ret = sl_advise(stream->inner_stream, offset, length, advice);
+    } else if (stream->advice_count < SL_BUFFER_ADVICE_QUEUE) {
+        stream->advice[stream->advice_count].offset = offset;
+        stream->advice[stream->advice_count].length = length;
+        stream->advice[stream->advice_count].advice = advice;
+        stream->advice_count++;
+    } else {
+        ret = -1;
+    }
+    pthread_mutex_unlock(stream->seek_lock);
+    return ret;
+}
+
+int sl_buffer_aio_submit_cb(void *context, sl_aio_t *aio,
+                            const sl_aio_request_t *request)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    if (request->op != SL_AIO_READ_AT) {
+        return 1;
+    }
+    return stream->inner_stream->aio_submit(stream->inner_stream->context, aio,
+                                            request);
+}
+
 size_t sl_buffer_input_cb(void *context, const void **buffer, size_t size)
 {
-    /* TODO */
     SL_BUFFER_ASSERT(context);
     sl_buffer_t *stream = context;
-    return 0;
+    size_t avail;
+
+    /* TODO: Other modes. */
+    if (stream->mode != SL_BUFFER_MODE_BLOCKS) {
+        return 0;
+    }
+    begin_read(stream);
+    if (stream->block_off == stream->block_len && read_block(stream) != 0) {
+        if (!end_read(stream)) {
+            stream->eof = 1;
+        }
+        return 0;
+    }
+    avail = stream->block_len - stream->block_off;
+    if (avail > size) {
+        avail = size;
+    }
+    *buffer = stream->block + stream->block_off;
+    stream->block_off += avail;
+    stream->pos += avail;
+    return avail;
+}
+
+/* Bytes buffered ahead of the consumer. Compressed blocks are counted by their
+ * compressed length, and the last block by its full size. */
+static
+size_t buffered_length(sl_buffer_t *stream)
+{
+    if (stream->mode == SL_BUFFER_MODE_BLOCKS) {
+        return stream->block_len - stream->block_off
+               + blockq_get_length(stream->bq) * stream->step_size;
+    }
+    return stream->lz4_read_len - stream->lz4_read_off
+           + circbuf_get_length(stream->cbuf);
+}
+
+/* Whether seeking to offset should be done by reading through. Buffered data is
+ * free to skip. Reading more is worth it until it costs as much as seeking the
+ * inner stream. Its cost is estimated while filler may be using it, which is
+ * fine for an estimate. */
+static
+int should_read_through(sl_buffer_t *stream, off_t offset)
+{
+    off_t gap = offset - stream->pos;
+    off_t cost;
+    int filling;
+
+    pthread_mutex_lock(stream->seek_lock);
+    filling = stream->filler_started;
+    pthread_mutex_unlock(stream->seek_lock);
+
+    /* Reading blocks unless the filler runs, and the sink drains the buffer
+     * itself. */
+    if (gap <= 0 || !filling || stream->sink) {
+        return 0;
+    }
+    if ((size_t)gap <= buffered_length(stream)) {
+        return 1;
+    }
+    cost = sl_seek_cost(stream->inner_stream, offset);
+    return cost > 0 && gap <= (off_t)buffered_length(stream) + cost;
+}
+
+/* Reads and discards gap bytes. Returns nonzero if it ends short, e.g. at
+ * end-of-file or on timeout. Then seeking should be done as usual. */
+static
+int read_through(sl_buffer_t *stream, off_t gap)
+{
+    char discard[SL_BUFFER_SKIP_SIZE];
+    size_t len;
+    size_t read;
+
+    begin_read(stream);
+    while (gap > 0) {
+        len = (gap < SL_BUFFER_SKIP_SIZE ? (size_t)gap : SL_BUFFER_SKIP_SIZE);
+        read = read_step(stream, discard, len);
+        stream->pos += read;
+        gap -= read;
+        if (read < len) {
+            break;
+        }
+    }
+    stream->timed_out = 0;
+    return gap > 0;
 }
 
 int sl_buffer_seek_cb(void *context, off_t offset, int whence)
@@ -448,6 +1467,17 @@ int sl_buffer_seek_cb(void *context, off_t offset, int whence)
     SL_BUFFER_ASSERT(whence == SL_SEEK_SET); /* TODO: Other whences are to be
                                                 implemened. */
     sl_buffer_t *stream = context;
+    uint64_t start = now_ns();
+
+    /* Keep buffered data and the filler going if it is cheaper. */
+    if (should_read_through(stream, offset)
+            && read_through(stream, offset - stream->pos) == 0) {
+        SL_BUFFER_LOG("Seeked by reading through to %jd.", (intmax_t)offset);
+        stat_add(&stream->stats.seek_ns, now_ns() - start);
+        stat_add(&stream->stats.seek_count, 1);
+        stat_add(&stream->stats.skip_count, 1);
+        return 0;
+    }
 
     /* Set seek parameters. */
     stream->seek_off = offset;
@@ -462,7 +1492,7 @@ int sl_buffer_seek_cb(void *context, off_t offset, int whence)
         /* Signal that reading is closed, so that writing to circular buffer
          * ceases blocking if it is doing so. Circbuf will be already reset
          * after seeking is done in fill_buffer(). */
-        circbuf_close_read(stream->cbuf);
+        ring_close_read(stream);
 
         /* Signal producer if it's waiting on EOF. */
         SL_BUFFER_LOG("Signaling producer...");
@@ -483,10 +1513,19 @@ int sl_buffer_seek_cb(void *context, off_t offset, int whence)
 
     pthread_mutex_unlock(stream->seek_lock);
 
+    stat_add(&stream->stats.seek_ns, now_ns() - start);
+    stat_add(&stream->stats.seek_count, 1);
+
     /* If successful, update offset, clear eof and return success. */
     if (stream->seek_result == 0) {
         stream->pos = offset;
         stream->eof = 0;
+        /* Drop decompressed or held block along with the buffered ones. */
+        stream->lz4_read_off = 0;
+        stream->lz4_read_len = 0;
+        stream->block_off  = 0;
+        stream->block_len  = 0;
+        stream->block_held = 0;
         return 0;
     }
 
@@ -511,7 +1550,9 @@ int sl_buffer_eof_cb(void *context)
 }
 int sl_buffer_error_cb(void *context)
 {
-    return 0;
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+    return stream->error;
 }
 
 off_t sl_buffer_length_cb(void *context)
@@ -520,6 +1561,18 @@ off_t sl_buffer_length_cb(void *context)
 }
 
 
+off_t sl_buffer_seek_cost_cb(void *context, off_t offset)
+{
+    SL_BUFFER_ASSERT(context);
+    sl_buffer_t *stream = context;
+
+    if (offset >= stream->pos
+            && (size_t)(offset - stream->pos) <= buffered_length(stream)) {
+        return 0;
+    }
+    return sl_seek_cost(stream->inner_stream, offset);
+}
+
 sl_seekable_t sl_buffer_seekable_cb(void *context)
 {
     return 0;
@@ -2,21 +2,89 @@
 #define STREAMLIKE_BUFFER_H
 
 #include "../streamlike.h"
+#include <stdint.h>
 #define SL_BUFFER_DEFAULT_BUFFER_SIZE (1024 * 1024 * 1024)
 #define SL_BUFFER_DEFAULT_STEP_SIZE   (16 * 1024)
+#define SL_BUFFER_BLOCK_ALIGNMENT     (4096)
+#define SL_BUFFER_SINK_STOP           ((size_t)-1)
+#define SL_BUFFER_STATS_BUCKETS       (8)
+
+/* Called by the filler with data freshly read into the buffer. Returns number
+ * of bytes consumed. The rest is offered again later, and reading ahead stops
+ * once the buffer is full. Returning SL_BUFFER_SINK_STOP stops filling. A final
+ * call with zero length signals end of stream. */
+typedef
+size_t (*sl_buffer_sink_cb_t)(void *sink_context, const void *data,
+                              size_t len);
+
+/* Counters since creation or the last reset. Times are in nanoseconds. */
+typedef struct sl_buffer_stats_s
+{
+    uint64_t consumer_wait_ns; /* Consumer blocked on an empty buffer. */
+    uint64_t producer_wait_ns; /* Filler blocked on a full buffer. */
+    /* Fill steps by buffer occupancy before the step, in equal shares of
+     * buffer size. The last bucket includes full buffer. */
+    uint64_t occupancy[SL_BUFFER_STATS_BUCKETS];
+    uint64_t seek_count;
+    uint64_t seek_ns;
+    uint64_t skip_count; /* Seeks served by reading through the buffer. */
+    uint64_t inner_read_count;
+    uint64_t inner_read_ns;
+} sl_buffer_stats_t;
 
 streamlike_t* sl_buffer_create(streamlike_t* inner_stream);
 streamlike_t* sl_buffer_create2(streamlike_t* inner_stream, size_t buffer_size,
                                 size_t step_size);
+/* Keeps read-ahead LZ4-compressed in blocks of block_size bytes. Returns NULL
+ * if the library is built without LZ4 support. */
+streamlike_t* sl_buffer_create_lz4(streamlike_t* inner_stream,
+                                   size_t buffer_size, size_t block_size);
+/* Hands over whole blocks of block_size bytes, each aligned to
+ * SL_BUFFER_BLOCK_ALIGNMENT, between the filler and the consumer. Block
+ * boundaries are relative to the last seek offset. sl_input() gives at most the
+ * rest of the current block. */
+streamlike_t* sl_buffer_create_blocks(streamlike_t* inner_stream,
+                                      size_t block_size, size_t block_count);
 int sl_buffer_destroy(streamlike_t *buffer_stream);
 
 int sl_buffer_threaded_fill_buffer(streamlike_t *buffer_stream);
 int sl_buffer_blocking_fill_buffer(streamlike_t *buffer_stream);
 int sl_buffer_close_buffer(streamlike_t *buffer_stream);
 
+/* Plain mode only. Should be set before filling starts. Filling returns at the
+ * end of stream or when the sink stops it, instead of waiting for reads. */
+int sl_buffer_set_sink(streamlike_t *buffer_stream, sl_buffer_sink_cb_t sink,
+                       void *sink_context);
+
+/* Reads return short once timeout passes, and sl_error() gives
+ * SL_ERROR_TIMEDOUT until the next read. Zero disables it. Not supported in LZ4
+ * mode. */
+int sl_buffer_set_read_timeout(streamlike_t *buffer_stream, long timeout_ms);
+
+/* Safe to call while filling and reading. */
+int sl_buffer_get_stats(streamlike_t *buffer_stream, sl_buffer_stats_t *stats);
+int sl_buffer_reset_stats(streamlike_t *buffer_stream);
+
+/* Block mode only. Gives the rest of the current block, or the next block
+ * without copying. The block stays valid until the next read, input, seek or
+ * sl_buffer_next_block() call. Returns zero at end of stream. */
+size_t sl_buffer_next_block(streamlike_t *buffer_stream, const void **block);
+
 size_t sl_buffer_read_cb(void *context, void *buffer, size_t len);
+size_t sl_buffer_readv_cb(void *context, const struct iovec *iov, int iovcnt);
+int sl_buffer_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_buffer_read_at_cb(void *context, void *buffer, size_t len,
+                            off_t offset);
+int sl_buffer_advise_cb(void *context, off_t offset, off_t length, int advice);
+int sl_buffer_aio_submit_cb(void *context, sl_aio_t *aio,
+                            const sl_aio_request_t *request);
 size_t sl_buffer_input_cb(void *context, const void **buffer, size_t size);
+/* Seeks forward by reading through the buffer when it is cheaper than seeking
+ * inner stream, as estimated by its seek cost callback. */
 int sl_buffer_seek_cb(void *context, off_t offset, int whence);
+/* Seeking forward within buffered data is free. Otherwise it costs as much as
+ * seeking the inner stream. */
+off_t sl_buffer_seek_cost_cb(void *context, off_t offset);
 off_t sl_buffer_tell_cb(void *context);
 int sl_buffer_eof_cb(void *context);
 int sl_buffer_error_cb(void *context);
@@ -0,0 +1,305 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* copy_file_range() and splice() */
+#endif
+#include "../streamlike.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+/* Blocks of the user space pump. Aligned, so that backends bypassing page
+ * cache can transfer them directly. */
+#define SL_COPY_BLOCK_SIZE (1024 * 1024)
+#define SL_COPY_ALIGNMENT  (4096)
+/* Most bytes asked from the kernel at once. */
+#define SL_COPY_CHUNK_SIZE (64 * 1024 * 1024)
+
+typedef struct sl_copy_pump_s
+{
+    const streamlike_t *dst;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *blocks[2];
+    size_t lens[2];
+    /* Block is read and waits for the writer, if full is set. */
+    int full[2];
+    int done;
+    int failed;
+    off_t written;
+} sl_copy_pump_t;
+
+static
+int copy_usable_(sl_copy_path_t path, const struct stat *in,
+                 const struct stat *out)
+{
+    switch (path) {
+        case SL_COPY_FILE_RANGE:
+            return S_ISREG(in->st_mode) && S_ISREG(out->st_mode);
+        case SL_COPY_SENDFILE:
+            /* Source is mapped by the kernel. */
+            return S_ISREG(in->st_mode);
+        case SL_COPY_SPLICE:
+            return S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode);
+        default:
+            return 0;
+    }
+}
+
+/* Moves up to length bytes, or till end-of-file if length is negative, using
+ * offsets given instead of descriptor offsets. Returns bytes moved, or -1 if
+ * nothing could be moved. Sets failed to errno if it stopped early on an
+ * error, or to zero. */
+static
+off_t copy_kernel_(sl_copy_path_t path, int in, off_t *in_off, int out,
+                   off_t *out_off, off_t length, int *failed)
+{
+    off_t total = 0;
+    off_t end;
+    size_t chunk;
+    ssize_t moved;
+    int flags;
+
+    /* Sendfile writes at descriptor offset, which is the end of file for
+     * appending descriptors. */
+    if (path == SL_COPY_SENDFILE && out_off) {
+        flags = fcntl(out, F_GETFL);
+        if (flags < 0 || (!(flags & O_APPEND)
+                          && lseek(out, *out_off, SEEK_SET) < 0)) {
+            return -1;
+        }
+    }
+    *failed = 0;
+    while (length < 0 || total < length) {
+        chunk = (length < 0 || length - total > SL_COPY_CHUNK_SIZE ?
+                 SL_COPY_CHUNK_SIZE : (size_t)(length - total));
+        switch (path) {
+            case SL_COPY_FILE_RANGE:
+                moved = copy_file_range(in, in_off, out, out_off, chunk, 0);
+                break;
+            case SL_COPY_SENDFILE:
+                moved = sendfile(out, in, in_off, chunk);
+                break;
+            case SL_COPY_SPLICE:
+                moved = splice(in, in_off, out, out_off, chunk,
+                               SPLICE_F_MOVE);
+                break;
+            default:
+                return -1;
+        }
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved < 0 && total == 0) {
+            return -1;
+        }
+        if (moved < 0) {
+            *failed = errno;
+            break;
+        }
+        if (moved == 0) {
+            break;
+        }
+        total += moved;
+    }
+    if (path == SL_COPY_SENDFILE && out_off) {
+        end = lseek(out, 0, SEEK_CUR);
+        if (end < 0) {
+            *failed = (*failed ? *failed : errno);
+        } else {
+            *out_off = end;
+        }
+    }
+    return total;
+}
+
+static
+void* copy_writer_(void *arg)
+{
+    sl_copy_pump_t *pump = arg;
+    size_t written;
+    int i = 0;
+
+    pthread_mutex_lock(&pump->mutex);
+    for (;;) {
+        while (!pump->full[i] && !pump->done) {
+            pthread_cond_wait(&pump->cond, &pump->mutex);
+        }
+        if (!pump->full[i]) {
+            break;
+        }
+        pthread_mutex_unlock(&pump->mutex);
+        written = sl_write(pump->dst, pump->blocks[i], pump->lens[i]);
+        pthread_mutex_lock(&pump->mutex);
+        pump->written += written;
+        if (written < pump->lens[i]) {
+            pump->failed = 1;
+            pthread_cond_signal(&pump->cond);
+            break;
+        }
+        pump->full[i] = 0;
+        pthread_cond_signal(&pump->cond);
+        i ^= 1;
+    }
+    pthread_mutex_unlock(&pump->mutex);
+    return NULL;
+}
+
+/* Reads one block while the writer thread writes the other. Without a
+ * thread, blocks are written in turn. Returns bytes written, or -1 if writing
+ * failed before any. */
+static
+off_t copy_pump_(const streamlike_t *src, const streamlike_t *dst,
+                 off_t length)
+{
+    sl_copy_pump_t pump;
+    pthread_t writer;
+    off_t total = 0;
+    size_t part;
+    size_t read;
+    size_t written;
+    int threaded;
+    int failed = 0;
+    int i = 0;
+
+    pump.blocks[0] = NULL;
+    pump.blocks[1] = NULL;
+    if (posix_memalign((void**)&pump.blocks[0], SL_COPY_ALIGNMENT,
+                       SL_COPY_BLOCK_SIZE) != 0
+            || posix_memalign((void**)&pump.blocks[1], SL_COPY_ALIGNMENT,
+                              SL_COPY_BLOCK_SIZE) != 0) {
+        free(pump.blocks[0]);
+        return -1;
+    }
+    pump.dst = dst;
+    pump.full[0] = 0;
+    pump.full[1] = 0;
+    pump.done = 0;
+    pump.failed = 0;
+    pump.written = 0;
+    pthread_mutex_init(&pump.mutex, NULL);
+    pthread_cond_init(&pump.cond, NULL);
+    threaded = (pthread_create(&writer, NULL, copy_writer_, &pump) == 0);
+
+    while (length < 0 || total < length) {
+        if (threaded) {
+            pthread_mutex_lock(&pump.mutex);
+            while (pump.full[i] && !pump.failed) {
+                pthread_cond_wait(&pump.cond, &pump.mutex);
+            }
+            failed = pump.failed;
+            pthread_mutex_unlock(&pump.mutex);
+            if (failed) {
+                break;
+            }
+        }
+        part = (length < 0 || length - total > SL_COPY_BLOCK_SIZE ?
+                SL_COPY_BLOCK_SIZE : (size_t)(length - total));
+        read = sl_read(src, pump.blocks[i], part);
+        if (read > 0 && threaded) {
+            pthread_mutex_lock(&pump.mutex);
+            pump.lens[i] = read;
+            pump.full[i] = 1;
+            pthread_cond_signal(&pump.cond);
+            pthread_mutex_unlock(&pump.mutex);
+        } else if (read > 0) {
+            written = sl_write(dst, pump.blocks[i], read);
+            pump.written += written;
+            if (written < read) {
+                failed = 1;
+                break;
+            }
+        }
+        total += read;
+        if (read < part) {
+            break;
+        }
+        i ^= 1;
+    }
+
+    if (threaded) {
+        pthread_mutex_lock(&pump.mutex);
+        pump.done = 1;
+        pthread_cond_signal(&pump.cond);
+        pthread_mutex_unlock(&pump.mutex);
+        pthread_join(writer, NULL);
+        failed = pump.failed;
+    }
+    pthread_cond_destroy(&pump.cond);
+    pthread_mutex_destroy(&pump.mutex);
+    free(pump.blocks[0]);
+    free(pump.blocks[1]);
+    return (failed && pump.written == 0 ? -1 : pump.written);
+}
+
+off_t sl_copy(const streamlike_t *src, const streamlike_t *dst, off_t length,
+              sl_copy_path_t *path)
+{
+    static const sl_copy_path_t paths[] = {
+        SL_COPY_FILE_RANGE, SL_COPY_SENDFILE, SL_COPY_SPLICE
+    };
+    struct stat in_stat;
+    struct stat out_stat;
+    off_t in_start = 0;
+    off_t out_start = 0;
+    off_t in_off;
+    off_t out_off;
+    off_t copied;
+    int in_seek;
+    int out_seek;
+    int failed;
+    int in;
+    int out;
+    size_t i;
+
+    SL_ASSERT(src);
+    SL_ASSERT(dst);
+
+    in = sl_descriptor(src);
+    out = (in >= 0 ? sl_descriptor(dst) : -1);
+    if (out < 0 || fstat(in, &in_stat) < 0 || fstat(out, &out_stat) < 0) {
+        goto pump;
+    }
+    /* Pipes and sockets are used through their own offset. */
+    in_seek = S_ISREG(in_stat.st_mode) || S_ISBLK(in_stat.st_mode);
+    out_seek = S_ISREG(out_stat.st_mode) || S_ISBLK(out_stat.st_mode);
+    if ((in_seek && (in_start = sl_tell(src)) < 0)
+            || (out_seek && (out_start = sl_tell(dst)) < 0)) {
+        goto pump;
+    }
+    for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        if (!copy_usable_(paths[i], &in_stat, &out_stat)) {
+            continue;
+        }
+        in_off = in_start;
+        out_off = out_start;
+        copied = copy_kernel_(paths[i], in, (in_seek ? &in_off : NULL), out,
+                              (out_seek ? &out_off : NULL),
+                              (length > 0 ? length : -1), &failed);
+        if (copied < 0) {
+            continue;
+        }
+        if ((in_seek && sl_seek(src, in_off, SL_SEEK_SET) != 0)
+                || (out_seek && sl_seek(dst, out_off, SL_SEEK_SET) != 0)) {
+            return -1;
+        }
+        if (path) {
+            *path = paths[i];
+        }
+        /* Data moved is reported, with errno telling why it stopped. */
+        if (failed) {
+            errno = failed;
+            return (copied > 0 ? copied : -1);
+        }
+        return copied;
+    }
+
+pump:
+    if (path) {
+        *path = SL_COPY_PUMP;
+    }
+    return copy_pump_(src, dst, (length > 0 ? length : -1));
+}
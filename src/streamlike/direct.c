@@ -0,0 +1,669 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* O_DIRECT */
+#endif
+#ifdef SL_DEBUG
+#include "debug.h"
+#endif
+
+#ifndef SL_DIRECT_ASSERT
+# ifdef SL_ASSERT
+#  define SL_DIRECT_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_DIRECT_ASSERT(...) ((void)0)
+# endif
+#endif
+#include "direct.h"
+#include "util/holes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+typedef struct sl_direct_s
+{
+    int fd;
+    /* Flags to give back to the descriptor on close, if O_DIRECT was set by
+     * the stream. Negative otherwise. */
+    int fd_flags;
+    size_t block_size;
+    char *block;
+    /* Block holds block_len bytes from block_off, or nothing if block_off is
+     * negative. Rest of it is zeroed. */
+    off_t block_off;
+    size_t block_len;
+    /* Bytes written into block but not to file, if dirty_end is nonzero. */
+    size_t dirty_start;
+    size_t dirty_end;
+    off_t length;
+    off_t pos;
+    int eof;
+    int error;
+} sl_direct_t;
+
+streamlike_t* sl_direct_open(const char *path, int flags)
+{
+    streamlike_t *stream;
+    int fd;
+
+    SL_DIRECT_ASSERT(path != NULL);
+
+    fd = open(path, flags | O_DIRECT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+    stream = sl_direct_open2(fd, SL_DIRECT_DEFAULT_BLOCK_SIZE);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+streamlike_t* sl_direct_open2(int fd, size_t block_size)
+{
+    streamlike_t *stream;
+    sl_direct_t *file;
+    struct stat s;
+    int flags;
+
+    SL_DIRECT_ASSERT(fd >= 0);
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fstat(fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+        return NULL;
+    }
+    if (!(flags & O_DIRECT) && fcntl(fd, F_SETFL, flags | O_DIRECT) < 0) {
+        return NULL;
+    }
+    block_size = (block_size > 0 ? block_size : SL_DIRECT_DEFAULT_BLOCK_SIZE);
+    block_size = (block_size + SL_DIRECT_ALIGNMENT - 1)
+                 / SL_DIRECT_ALIGNMENT * SL_DIRECT_ALIGNMENT;
+
+    file = malloc(sizeof(sl_direct_t));
+    stream = malloc(sizeof(streamlike_t));
+    if (!file || !stream || posix_memalign((void**)&file->block,
+                                           SL_DIRECT_ALIGNMENT,
+                                           block_size) != 0) {
+        if (!(flags & O_DIRECT)) {
+            fcntl(fd, F_SETFL, flags);
+        }
+        free(stream);
+        free(file);
+        return NULL;
+    }
+
+    file->fd          = fd;
+    file->fd_flags    = (flags & O_DIRECT ? -1 : flags);
+    file->block_size  = block_size;
+    file->block_off   = -1;
+    file->block_len   = 0;
+    file->dirty_start = 0;
+    file->dirty_end   = 0;
+    file->length      = s.st_size;
+    file->pos         = lseek(fd, 0, SEEK_CUR);
+    file->pos         = (file->pos > 0 ? file->pos : 0);
+    file->eof         = 0;
+    file->error       = 0;
+
+    stream->context = file;
+    stream->read    = sl_direct_read_cb;
+    stream->input   = sl_direct_input_cb;
+    stream->write   = sl_direct_write_cb;
+    stream->flush   = sl_direct_flush_cb;
+    stream->seek    = sl_direct_seek_cb;
+    stream->tell    = sl_direct_tell_cb;
+    stream->eof     = sl_direct_eof_cb;
+    stream->error   = sl_direct_error_cb;
+    stream->length  = sl_direct_length_cb;
+
+    stream->seekable     = sl_direct_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = sl_direct_read_at_cb;
+
+    stream->readv  = sl_direct_readv_cb;
+    stream->writev = sl_direct_writev_cb;
+
+    stream->read_multi = sl_direct_read_multi_cb;
+
+    stream->aio_submit = NULL;
+
+    /* Page cache isn't used, so there is nothing to advise. */
+    stream->advise    = NULL;
+    stream->seek_cost = sl_direct_seek_cost_cb;
+
+    stream->clone = sl_direct_clone_cb;
+
+    stream->data_map = sl_direct_data_map_cb;
+
+    /* Block and length would go stale under kernel transfers. */
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY | SL_CAP_CHEAP_SEEK;
+
+    return stream;
+}
+
+int sl_direct_close(streamlike_t *stream)
+{
+    int fd;
+    int ret;
+
+    SL_DIRECT_ASSERT(stream != NULL);
+    SL_DIRECT_ASSERT(stream->context != NULL);
+
+    fd = ((sl_direct_t*)stream->context)->fd;
+    ret = sl_direct_close2(stream);
+    return (close(fd) < 0 ? -1 : ret);
+}
+
+int sl_direct_close2(streamlike_t *stream)
+{
+    sl_direct_t *file;
+    int ret;
+
+    SL_DIRECT_ASSERT(stream != NULL);
+    file = stream->context;
+    ret = sl_direct_flush_cb(file);
+    if (file->fd_flags >= 0 && fcntl(file->fd, F_SETFL, file->fd_flags) < 0) {
+        ret = -1;
+    }
+    free(file->block);
+    free(file);
+    free(stream);
+    return ret;
+}
+
+/* Transfers until done, end-of-file or an error. Buffer, size and offset
+ * should be aligned, except for size of reads reaching end-of-file. */
+static
+size_t sl_direct_transfer_(int fd, void *buffer, size_t size, off_t offset,
+                           int writing, int *error)
+{
+    size_t total = 0;
+    ssize_t ret;
+
+    while (total < size) {
+        ret = (writing ? pwrite(fd, (char*)buffer + total, size - total,
+                                offset + total)
+                       : pread(fd, (char*)buffer + total, size - total,
+                               offset + total));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            *error = 1;
+            break;
+        }
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+static inline
+int sl_direct_aligned_(const void *buffer, off_t offset)
+{
+    return (uintptr_t)buffer % SL_DIRECT_ALIGNMENT == 0
+           && offset % SL_DIRECT_ALIGNMENT == 0;
+}
+
+/* Whether block is loaded, and offset falls in it. */
+static inline
+int sl_direct_in_block_(sl_direct_t *file, off_t offset)
+{
+    return file->block_off >= 0 && offset >= file->block_off
+           && offset < file->block_off + (off_t)file->block_size;
+}
+
+static inline
+int sl_direct_overlaps_(sl_direct_t *file, off_t offset, size_t size)
+{
+    return file->block_off >= 0
+           && offset < file->block_off + (off_t)file->block_size
+           && file->block_off < offset + (off_t)size;
+}
+
+/* Writes aligned range around dirty bytes. Bytes past end-of-file are zeroes
+ * written in the last aligned range, which are truncated afterwards. */
+static
+int sl_direct_write_back_(sl_direct_t *file)
+{
+    size_t start;
+    size_t end;
+
+    if (file->dirty_end == 0) {
+        return 0;
+    }
+    start = file->dirty_start - file->dirty_start % SL_DIRECT_ALIGNMENT;
+    end = (file->dirty_end + SL_DIRECT_ALIGNMENT - 1)
+          / SL_DIRECT_ALIGNMENT * SL_DIRECT_ALIGNMENT;
+    if (sl_direct_transfer_(file->fd, file->block + start, end - start,
+                            file->block_off + start, 1, &file->error)
+            < end - start) {
+        file->error = 1;
+        return -1;
+    }
+    if (file->block_off + (off_t)end > file->length
+            && ftruncate(file->fd, file->length) < 0) {
+        file->error = 1;
+        return -1;
+    }
+    file->dirty_start = 0;
+    file->dirty_end = 0;
+    return 0;
+}
+
+/* Writes block back and forgets it, so that the range can be transferred
+ * directly. */
+static
+int sl_direct_drop_(sl_direct_t *file)
+{
+    if (sl_direct_write_back_(file) != 0) {
+        return -1;
+    }
+    file->block_off = -1;
+    file->block_len = 0;
+    return 0;
+}
+
+/* Loads block holding current offset. Its data is read only if fill is set,
+ * since blocks overwritten as a whole needn't be. */
+static
+int sl_direct_load_(sl_direct_t *file, int fill)
+{
+    if (sl_direct_drop_(file) != 0) {
+        return -1;
+    }
+    file->block_off = file->pos - file->pos % SL_DIRECT_ALIGNMENT;
+    file->block_len = (fill ? sl_direct_transfer_(file->fd, file->block,
+                                                  file->block_size,
+                                                  file->block_off, 0,
+                                                  &file->error)
+                            : 0);
+    if (file->error) {
+        file->block_off = -1;
+        file->block_len = 0;
+        return -1;
+    }
+    memset(file->block + file->block_len, 0,
+           file->block_size - file->block_len);
+    return 0;
+}
+
+/* Makes sure block has data at current offset. Fails at end-of-file, or on an
+ * error. */
+static
+int sl_direct_cover_(sl_direct_t *file)
+{
+    if (file->pos >= file->length) {
+        file->eof = 1;
+        return -1;
+    }
+    if (sl_direct_in_block_(file, file->pos)
+            && file->pos < file->block_off + (off_t)file->block_len) {
+        return 0;
+    }
+    if (sl_direct_load_(file, 1) != 0) {
+        return -1;
+    }
+    if (file->pos >= file->block_off + (off_t)file->block_len) {
+        /* File was truncated. */
+        file->eof = 1;
+        return -1;
+    }
+    return 0;
+}
+
+size_t sl_direct_read_cb(void *context, void *buffer, size_t size)
+{
+    sl_direct_t *file = context;
+    size_t read = 0;
+    size_t part;
+    size_t done;
+
+    while (read < size) {
+        part = size - read;
+        if (!sl_direct_in_block_(file, file->pos) && file->pos < file->length
+                && part >= SL_DIRECT_ALIGNMENT
+                && sl_direct_aligned_((char*)buffer + read, file->pos)) {
+            /* Straight into caller memory. */
+            part -= part % SL_DIRECT_ALIGNMENT;
+            if (sl_direct_overlaps_(file, file->pos, part)
+                    && sl_direct_drop_(file) != 0) {
+                break;
+            }
+            done = sl_direct_transfer_(file->fd, (char*)buffer + read, part,
+                                       file->pos, 0, &file->error);
+            file->pos += done;
+            read += done;
+            if (done < part) {
+                file->eof = !file->error;
+                break;
+            }
+            continue;
+        }
+        if (sl_direct_cover_(file) != 0) {
+            break;
+        }
+        done = file->block_off + file->block_len - file->pos;
+        part = (part < done ? part : done);
+        memcpy((char*)buffer + read,
+               file->block + (file->pos - file->block_off), part);
+        file->pos += part;
+        read += part;
+    }
+    return read;
+}
+
+size_t sl_direct_input_cb(void *context, const void **buffer, size_t size)
+{
+    sl_direct_t *file = context;
+    size_t part;
+
+    if (size == 0 || sl_direct_cover_(file) != 0) {
+        return 0;
+    }
+    part = file->block_off + file->block_len - file->pos;
+    part = (part < size ? part : size);
+    *buffer = file->block + (file->pos - file->block_off);
+    file->pos += part;
+    return part;
+}
+
+size_t sl_direct_read_at_cb(void *context, void *buffer, size_t size,
+                            off_t offset)
+{
+    sl_direct_t *file = context;
+    char *bounce = NULL;
+    size_t total = 0;
+    size_t bounce_size;
+    size_t skip;
+    size_t want;
+    size_t done;
+    off_t start;
+    off_t end;
+    int error = 0;
+
+    bounce_size = (size + 2 * SL_DIRECT_ALIGNMENT - 1)
+                  / SL_DIRECT_ALIGNMENT * SL_DIRECT_ALIGNMENT;
+    bounce_size = (bounce_size < file->block_size ? bounce_size
+                                                  : file->block_size);
+    while (total < size) {
+        want = size - total;
+        if (want >= SL_DIRECT_ALIGNMENT
+                && sl_direct_aligned_((char*)buffer + total, offset + total)) {
+            want -= want % SL_DIRECT_ALIGNMENT;
+            done = sl_direct_transfer_(file->fd, (char*)buffer + total, want,
+                                       offset + total, 0, &error);
+            total += done;
+            if (done < want) {
+                break;
+            }
+            continue;
+        }
+        if (!bounce && posix_memalign((void**)&bounce, SL_DIRECT_ALIGNMENT,
+                                      bounce_size) != 0) {
+            bounce = NULL;
+            error = 1;
+            break;
+        }
+        skip = (offset + total) % SL_DIRECT_ALIGNMENT;
+        want = (skip + want + SL_DIRECT_ALIGNMENT - 1)
+               / SL_DIRECT_ALIGNMENT * SL_DIRECT_ALIGNMENT;
+        want = (want < bounce_size ? want : bounce_size);
+        done = sl_direct_transfer_(file->fd, bounce, want,
+                                   offset + total - skip, 0, &error);
+        if (done <= skip) {
+            break;
+        }
+        done -= skip;
+        done = (done < size - total ? done : size - total);
+        memcpy((char*)buffer + total, bounce + skip, done);
+        total += done;
+        if (skip + done < want && total < size) {
+            break;
+        }
+    }
+    free(bounce);
+
+    /* Bytes written into the block but not to file are newer. Reading stops
+     * short before them only at end-of-file, so the gap is zeroes. */
+    start = file->block_off + (off_t)file->dirty_start;
+    end = file->block_off + (off_t)file->dirty_end;
+    start = (start > offset ? start : offset);
+    end = (end < offset + (off_t)size ? end : offset + (off_t)size);
+    if (file->dirty_end > 0 && start < end && !error) {
+        if (start > offset + (off_t)total) {
+            memset((char*)buffer + total, 0, start - offset - total);
+        }
+        memcpy((char*)buffer + (start - offset),
+               file->block + (start - file->block_off), end - start);
+        if (end > offset + (off_t)total) {
+            total = end - offset;
+        }
+    }
+    return total;
+}
+
+size_t sl_direct_write_cb(void *context, const void *buffer, size_t size)
+{
+    sl_direct_t *file = context;
+    size_t written = 0;
+    size_t offset;
+    size_t part;
+    size_t done;
+
+    while (written < size) {
+        part = size - written;
+        if (!sl_direct_in_block_(file, file->pos)) {
+            if (part >= SL_DIRECT_ALIGNMENT
+                    && sl_direct_aligned_((char*)buffer + written,
+                                          file->pos)) {
+                /* Straight from caller memory. */
+                part -= part % SL_DIRECT_ALIGNMENT;
+                if (sl_direct_overlaps_(file, file->pos, part)
+                        && sl_direct_drop_(file) != 0) {
+                    break;
+                }
+                done = sl_direct_transfer_(file->fd, (char*)buffer + written,
+                                           part, file->pos, 1, &file->error);
+                file->pos += done;
+                written += done;
+                if (file->pos > file->length) {
+                    file->length = file->pos;
+                }
+                if (done < part) {
+                    file->error = 1;
+                    break;
+                }
+                continue;
+            }
+            if (sl_direct_load_(file, file->pos % SL_DIRECT_ALIGNMENT != 0
+                                      || part < file->block_size) != 0) {
+                break;
+            }
+        }
+        offset = file->pos - file->block_off;
+        part = (part < file->block_size - offset ? part
+                                                 : file->block_size - offset);
+        memcpy(file->block + offset, (const char*)buffer + written, part);
+        if (file->dirty_end == 0) {
+            file->dirty_start = offset;
+            file->dirty_end = offset + part;
+        } else {
+            file->dirty_start = (offset < file->dirty_start ? offset
+                                                            : file->dirty_start);
+            file->dirty_end = (offset + part > file->dirty_end ? offset + part
+                                                               : file->dirty_end);
+        }
+        if (offset + part > file->block_len) {
+            file->block_len = offset + part;
+        }
+        file->pos += part;
+        written += part;
+        if (file->pos > file->length) {
+            file->length = file->pos;
+        }
+    }
+    return written;
+}
+
+int sl_direct_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = sl_direct_read_at_cb(context, extents[i].buffer,
+                                               extents[i].length,
+                                               extents[i].offset);
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+size_t sl_direct_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        read = sl_direct_read_cb(context, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+size_t sl_direct_writev_cb(void *context, const struct iovec *iov,
+                           int iovcnt)
+{
+    size_t total = 0;
+    size_t written;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        written = sl_direct_write_cb(context, iov[i].iov_base,
+                                     iov[i].iov_len);
+        total += written;
+        if (written < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int sl_direct_flush_cb(void *context)
+{
+    return sl_direct_write_back_(context);
+}
+
+int sl_direct_seek_cb(void *context, off_t offset, int whence)
+{
+    sl_direct_t *file = context;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += file->pos;
+            break;
+        case SL_SEEK_END:
+            offset += file->length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    file->pos = offset;
+    file->eof = 0;
+    return 0;
+}
+
+off_t sl_direct_tell_cb(void *context)
+{
+    return ((sl_direct_t*)context)->pos;
+}
+
+int sl_direct_eof_cb(void *context)
+{
+    return ((sl_direct_t*)context)->eof;
+}
+
+int sl_direct_error_cb(void *context)
+{
+    return ((sl_direct_t*)context)->error;
+}
+
+off_t sl_direct_length_cb(void *context)
+{
+    return ((sl_direct_t*)context)->length;
+}
+
+int sl_direct_data_map_cb(void *context, off_t offset, off_t length,
+                          sl_range_t *ranges, int max)
+{
+    sl_direct_t *file = context;
+
+    if (sl_direct_write_back_(file) != 0) {
+        return -1;
+    }
+    return holes_data_map(file->fd, offset, length, ranges, max);
+}
+
+off_t sl_direct_seek_cost_cb(void *context, off_t offset)
+{
+    /* Free in the block. Elsewhere the next transfer goes to the device. */
+    sl_direct_t *file = context;
+
+    return (sl_direct_in_block_(file, offset) ? 0 : file->block_size);
+}
+
+streamlike_t* sl_direct_clone_cb(void *context)
+{
+    sl_direct_t *file = context;
+    streamlike_t *clone;
+    char path[64];
+    int clone_fd;
+    int flags;
+
+    flags = fcntl(file->fd, F_GETFL);
+    if (flags < 0 || sl_direct_write_back_(file) != 0) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", file->fd);
+    clone_fd = open(path, (flags & O_ACCMODE) | O_DIRECT | O_CLOEXEC);
+    if (clone_fd < 0) {
+        return NULL;
+    }
+    clone = sl_direct_open2(clone_fd, file->block_size);
+    if (!clone) {
+        close(clone_fd);
+        return NULL;
+    }
+    ((sl_direct_t*)clone->context)->pos = file->pos;
+    return clone;
+}
+
+sl_seekable_t sl_direct_seekable_cb(void *context)
+{
+    return SL_SEEKING_SUPPORTED;
+}
@@ -0,0 +1,55 @@
+#ifndef STREAMLIKE_DIRECT_H
+#define STREAMLIKE_DIRECT_H
+
+#include "../streamlike.h"
+
+#define SL_DIRECT_DEFAULT_BLOCK_SIZE (1024 * 1024)
+/* Offsets, sizes and buffers given to the kernel are multiples of this, which
+ * covers logical block sizes of common devices. */
+#define SL_DIRECT_ALIGNMENT          (4096)
+
+/* File stream with O_DIRECT, bypassing page cache, so that streaming large
+ * files leaves cache to others. Data goes through an aligned bounce block of
+ * block_size bytes, so that offsets and sizes given by caller needn't be
+ * aligned. Reads and writes of aligned memory at aligned offsets go straight
+ * to the device instead. Written data is held in the block until it moves
+ * elsewhere, or sl_flush() is called. The whole aligned tail is written at
+ * end-of-file, and the file is truncated back to its length afterwards.
+ * Descriptors given to sl_direct_open2() get O_DIRECT set if needed, until the
+ * stream is closed. Opening fails if the file system doesn't support it. */
+streamlike_t* sl_direct_open(const char *path, int flags);
+streamlike_t* sl_direct_open2(int fd, size_t block_size);
+/* Flush before closing. sl_direct_close() closes the descriptor, while
+ * sl_direct_close2() leaves it open with its flags as they were before. */
+int sl_direct_close(streamlike_t *stream);
+int sl_direct_close2(streamlike_t *stream);
+
+size_t sl_direct_read_cb(void *context, void *buffer, size_t size);
+/* Points into the block, which stays valid until the next call. */
+size_t sl_direct_input_cb(void *context, const void **buffer, size_t size);
+/* Reads through a bounce buffer of its own, so it is thread-safe as long as
+ * nothing writes meanwhile. Sees data written but not flushed yet. */
+size_t sl_direct_read_at_cb(void *context, void *buffer, size_t size,
+                            off_t offset);
+size_t sl_direct_write_cb(void *context, const void *buffer, size_t size);
+int sl_direct_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_direct_readv_cb(void *context, const struct iovec *iov, int iovcnt);
+size_t sl_direct_writev_cb(void *context, const struct iovec *iov,
+                           int iovcnt);
+int sl_direct_flush_cb(void *context);
+/* Lazy. Block is kept if the next transfer falls in it. */
+int sl_direct_seek_cb(void *context, off_t offset, int whence);
+off_t sl_direct_tell_cb(void *context);
+int sl_direct_eof_cb(void *context);
+int sl_direct_error_cb(void *context);
+off_t sl_direct_length_cb(void *context);
+off_t sl_direct_seek_cost_cb(void *context, off_t offset);
+/* Writes block back first, so that its data is mapped. */
+int sl_direct_data_map_cb(void *context, off_t offset, off_t length,
+                          sl_range_t *ranges, int max);
+/* Linux only. Flushes, and the clone reopens the file, so it is closed by
+ * sl_direct_close(). */
+streamlike_t* sl_direct_clone_cb(void *context);
+sl_seekable_t sl_direct_seekable_cb(void *context);
+
+#endif /* STREAMLIKE_DIRECT_H */
@@ -0,0 +1,482 @@
+#ifdef SL_DEBUG
+#include "debug.h"
+#endif
+
+#ifndef SL_FD_ASSERT
+# ifdef SL_ASSERT
+#  define SL_FD_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_FD_ASSERT(...) ((void)0)
+# endif
+#endif
+#include "fd.h"
+#include "util/holes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* Buffers per vectored system call. Linux limit, unless known. */
+#ifdef IOV_MAX
+# define SL_FD_IOV_MAX IOV_MAX
+#else
+# define SL_FD_IOV_MAX (1024)
+#endif
+
+typedef struct sl_fd_s
+{
+    int fd;
+    /* Whether pread() and pwrite() work, i.e. descriptor is seekable. */
+    int positional;
+    int append;
+    off_t pos;
+    /* Cached length, or -1 until queried. */
+    off_t length;
+    int eof;
+    int error;
+} sl_fd_t;
+
+streamlike_t* sl_fd_open(const char *path, int flags)
+{
+    streamlike_t *stream;
+    int fd;
+
+    SL_FD_ASSERT(path != NULL);
+
+    fd = open(path, flags | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+    stream = sl_fd_open2(fd);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+streamlike_t* sl_fd_open2(int fd)
+{
+    streamlike_t *stream;
+    sl_fd_t *file;
+    int flags;
+
+    SL_FD_ASSERT(fd >= 0);
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return NULL;
+    }
+    file = malloc(sizeof(sl_fd_t));
+    if (!file) {
+        return NULL;
+    }
+    stream = malloc(sizeof(streamlike_t));
+    if (!stream) {
+        free(file);
+        return NULL;
+    }
+
+    file->fd         = fd;
+    file->pos        = lseek(fd, 0, SEEK_CUR);
+    file->positional = (file->pos >= 0);
+    file->pos        = (file->positional ? file->pos : 0);
+    file->append     = ((flags & O_APPEND) != 0);
+    file->length     = -1;
+    file->eof        = 0;
+    file->error      = 0;
+
+    stream->context = file;
+    stream->read    = sl_fd_read_cb;
+    stream->input   = NULL;
+    stream->write   = sl_fd_write_cb;
+    stream->flush   = sl_fd_flush_cb;
+    stream->seek    = sl_fd_seek_cb;
+    stream->tell    = sl_fd_tell_cb;
+    stream->eof     = sl_fd_eof_cb;
+    stream->error   = sl_fd_error_cb;
+    stream->length  = sl_fd_length_cb;
+
+    stream->seekable     = sl_fd_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = (file->positional ? sl_fd_read_at_cb : NULL);
+
+    stream->readv  = sl_fd_readv_cb;
+    stream->writev = sl_fd_writev_cb;
+
+    stream->read_multi = (file->positional ? sl_fd_read_multi_cb : NULL);
+
+    /* Positional reads are lock-free, so the thread pool runs them in
+     * parallel. */
+    stream->aio_submit = NULL;
+
+    stream->advise    = sl_fd_advise_cb;
+    stream->seek_cost = sl_fd_seek_cost_cb;
+
+    stream->clone = (file->positional ? sl_fd_clone_cb : NULL);
+
+    stream->data_map = (file->positional ? sl_fd_data_map_cb : NULL);
+
+    stream->descriptor = sl_fd_descriptor_cb;
+
+    /* Seeking only moves the offset kept by the stream. */
+    stream->caps = sl_probe_caps(stream)
+                 | (file->positional ? SL_CAP_CHEAP_SEEK : 0);
+
+    return stream;
+}
+
+int sl_fd_close(streamlike_t *stream)
+{
+    SL_FD_ASSERT(stream != NULL);
+    SL_FD_ASSERT(stream->context != NULL);
+
+    if (close(((sl_fd_t*)stream->context)->fd) < 0) {
+        return -1;
+    }
+    return sl_fd_close2(stream);
+}
+
+int sl_fd_close2(streamlike_t *stream)
+{
+    SL_FD_ASSERT(stream != NULL);
+    free(stream->context);
+    free(stream);
+    return 0;
+}
+
+void sl_fd_invalidate(streamlike_t *stream)
+{
+    SL_FD_ASSERT(stream != NULL);
+    ((sl_fd_t*)stream->context)->length = -1;
+}
+
+/* Transfers one buffer until done, end-of-file or an error. Positional
+ * transfers start at offset, others use descriptor offset. */
+static
+size_t sl_fd_transfer_(int fd, void *buffer, size_t size, off_t offset,
+                       int positional, int writing, int *error)
+{
+    size_t total = 0;
+    ssize_t ret;
+
+    while (total < size) {
+        if (writing) {
+            ret = (positional ? pwrite(fd, (char*)buffer + total, size - total,
+                                       offset + total)
+                              : (ssize_t)write(fd, (char*)buffer + total,
+                                               size - total));
+        } else {
+            ret = (positional ? pread(fd, (char*)buffer + total, size - total,
+                                      offset + total)
+                              : read(fd, (char*)buffer + total, size - total));
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            *error = 1;
+            break;
+        }
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+/* Moves stream offset past data transferred, and grows cached length. */
+static
+void sl_fd_advance_(sl_fd_t *file, size_t size, int writing)
+{
+    if (writing && file->append && file->positional) {
+        /* Appended at the end, wherever it is now. */
+        file->pos = lseek(file->fd, 0, SEEK_CUR);
+        file->length = -1;
+        return;
+    }
+    file->pos += size;
+    if (writing && file->length >= 0 && file->pos > file->length) {
+        file->length = file->pos;
+    }
+}
+
+static
+size_t sl_fd_rw_(sl_fd_t *file, void *buffer, size_t size, int writing)
+{
+    int positional = file->positional && !(writing && file->append);
+    size_t total;
+
+    total = sl_fd_transfer_(file->fd, buffer, size, file->pos, positional,
+                            writing, &file->error);
+    sl_fd_advance_(file, total, writing);
+    if (!writing && total < size && !file->error) {
+        file->eof = 1;
+    }
+    return total;
+}
+
+static
+size_t sl_fd_rwv_(sl_fd_t *file, const struct iovec *iov, int iovcnt,
+                  int writing)
+{
+    int positional = file->positional && !(writing && file->append);
+    size_t total = 0;
+    size_t done;
+    size_t part;
+    ssize_t ret;
+    int count;
+
+    while (iovcnt > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        count = (iovcnt < SL_FD_IOV_MAX ? iovcnt : SL_FD_IOV_MAX);
+        if (writing) {
+            ret = (positional ? pwritev(file->fd, iov, count, file->pos)
+                              : writev(file->fd, iov, count));
+        } else {
+            ret = (positional ? preadv(file->fd, iov, count, file->pos)
+                              : readv(file->fd, iov, count));
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            file->error = 1;
+            break;
+        }
+        if (ret == 0) {
+            if (!writing) {
+                file->eof = 1;
+            }
+            break;
+        }
+        total += ret;
+        sl_fd_advance_(file, ret, writing);
+
+        /* Skip buffers done, and finish a partly done one on its own. */
+        done = ret;
+        while (iovcnt > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (done > 0) {
+            part = iov->iov_len - done;
+            ret = sl_fd_rw_(file, (char*)iov->iov_base + done, part, writing);
+            total += ret;
+            if ((size_t)ret < part) {
+                break;
+            }
+            iov++;
+            iovcnt--;
+        }
+    }
+    return total;
+}
+
+size_t sl_fd_read_cb(void *context, void *buffer, size_t size)
+{
+    return sl_fd_rw_(context, buffer, size, 0);
+}
+
+size_t sl_fd_read_at_cb(void *context, void *buffer, size_t size, off_t offset)
+{
+    sl_fd_t *file = context;
+    int error = 0;
+
+    return sl_fd_transfer_(file->fd, buffer, size, offset, 1, 0, &error);
+}
+
+size_t sl_fd_write_cb(void *context, const void *buffer, size_t size)
+{
+    return sl_fd_rw_(context, (void*)buffer, size, 1);
+}
+
+int sl_fd_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = sl_fd_read_at_cb(context, extents[i].buffer,
+                                           extents[i].length,
+                                           extents[i].offset);
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+size_t sl_fd_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    return sl_fd_rwv_(context, iov, iovcnt, 0);
+}
+
+size_t sl_fd_writev_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    return sl_fd_rwv_(context, iov, iovcnt, 1);
+}
+
+int sl_fd_flush_cb(void *context)
+{
+    /* Nothing is buffered in user space. */
+    return 0;
+}
+
+int sl_fd_seek_cb(void *context, off_t offset, int whence)
+{
+    sl_fd_t *file = context;
+    off_t length;
+
+    if (!file->positional) {
+        return -1;
+    }
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += file->pos;
+            break;
+        case SL_SEEK_END:
+            length = sl_fd_length_cb(context);
+            if (length < 0) {
+                return -1;
+            }
+            offset += length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    file->pos = offset;
+    file->eof = 0;
+    return 0;
+}
+
+off_t sl_fd_tell_cb(void *context)
+{
+    return ((sl_fd_t*)context)->pos;
+}
+
+int sl_fd_eof_cb(void *context)
+{
+    return ((sl_fd_t*)context)->eof;
+}
+
+int sl_fd_error_cb(void *context)
+{
+    return ((sl_fd_t*)context)->error;
+}
+
+off_t sl_fd_length_cb(void *context)
+{
+    sl_fd_t *file = context;
+    struct stat s;
+
+    if (file->length >= 0) {
+        return file->length;
+    }
+    if (fstat(file->fd, &s) < 0) {
+        return -2;
+    }
+    if (!S_ISREG(s.st_mode)) {
+        return -1;
+    }
+    file->length = s.st_size;
+    return file->length;
+}
+
+int sl_fd_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    int fd = ((sl_fd_t*)context)->fd;
+
+    switch (advice) {
+        case SL_ADVICE_NORMAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NORMAL);
+        case SL_ADVICE_SEQUENTIAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+        case SL_ADVICE_RANDOM:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_RANDOM);
+        case SL_ADVICE_WILLNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+        case SL_ADVICE_DONTNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        case SL_ADVICE_NOREUSE:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NOREUSE);
+    }
+    return -1;
+}
+
+int sl_fd_data_map_cb(void *context, off_t offset, off_t length,
+                      sl_range_t *ranges, int max)
+{
+    return holes_data_map(((sl_fd_t*)context)->fd, offset, length, ranges, max);
+}
+
+int sl_fd_descriptor_cb(void *context)
+{
+    sl_fd_t *file = context;
+
+    /* Length may change behind the stream. */
+    file->length = -1;
+    return file->fd;
+}
+
+off_t sl_fd_seek_cost_cb(void *context, off_t offset)
+{
+    /* Free without a system call, or impossible. */
+    return (((sl_fd_t*)context)->positional ? 0 : -1);
+}
+
+streamlike_t* sl_fd_clone_cb(void *context)
+{
+    /* Offset is kept by the stream, but reopening still gives the clone its
+     * own descriptor, so that either can be closed first. */
+    sl_fd_t *file = context;
+    sl_fd_t *clone_file;
+    streamlike_t *clone;
+    char path[64];
+    int clone_fd;
+    int flags;
+
+    flags = fcntl(file->fd, F_GETFL);
+    if (flags < 0) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", file->fd);
+    clone_fd = open(path, (flags & (O_ACCMODE | O_APPEND)) | O_CLOEXEC);
+    if (clone_fd < 0) {
+        return NULL;
+    }
+    clone = sl_fd_open2(clone_fd);
+    if (!clone) {
+        close(clone_fd);
+        return NULL;
+    }
+    clone_file = clone->context;
+    clone_file->pos    = file->pos;
+    clone_file->length = file->length;
+    return clone;
+}
+
+sl_seekable_t sl_fd_seekable_cb(void *context)
+{
+    return (((sl_fd_t*)context)->positional ? SL_SEEKING_SUPPORTED
+                                            : SL_SEEKING_NOT_SUPPORTED);
+}
@@ -0,0 +1,43 @@
+#ifndef STREAMLIKE_FD_H
+#define STREAMLIKE_FD_H
+
+#include "../streamlike.h"
+
+/* Stream over a file descriptor, without stdio buffering or locking. Offset is
+ * kept by the stream and reads go straight into caller memory with pread(), so
+ * descriptor offset is left alone unless the file is opened for appending or
+ * doesn't support positional I/O like a pipe. Length is cached after first
+ * query, and grows with writes through the stream. It should be invalidated by
+ * sl_fd_invalidate() if the file is changed in other ways. */
+streamlike_t* sl_fd_open(const char *path, int flags);
+streamlike_t* sl_fd_open2(int fd);
+/* Closes the descriptor, while sl_fd_close2() leaves it open. */
+int sl_fd_close(streamlike_t *stream);
+int sl_fd_close2(streamlike_t *stream);
+void sl_fd_invalidate(streamlike_t *stream);
+
+size_t sl_fd_read_cb(void *context, void *buffer, size_t size);
+/* Doesn't lock or touch stream state, so it can be called from any thread. */
+size_t sl_fd_read_at_cb(void *context, void *buffer, size_t size,
+                        off_t offset);
+size_t sl_fd_write_cb(void *context, const void *buffer, size_t size);
+int sl_fd_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_fd_readv_cb(void *context, const struct iovec *iov, int iovcnt);
+size_t sl_fd_writev_cb(void *context, const struct iovec *iov, int iovcnt);
+int sl_fd_flush_cb(void *context);
+int sl_fd_seek_cb(void *context, off_t offset, int whence);
+off_t sl_fd_tell_cb(void *context);
+int sl_fd_eof_cb(void *context);
+int sl_fd_error_cb(void *context);
+off_t sl_fd_length_cb(void *context);
+int sl_fd_advise_cb(void *context, off_t offset, off_t length, int advice);
+off_t sl_fd_seek_cost_cb(void *context, off_t offset);
+/* Only for positional descriptors, as offset is moved while mapping. */
+int sl_fd_data_map_cb(void *context, off_t offset, off_t length,
+                      sl_range_t *ranges, int max);
+int sl_fd_descriptor_cb(void *context);
+/* Linux only. Clone owns its descriptor, so it is closed by sl_fd_close(). */
+streamlike_t* sl_fd_clone_cb(void *context);
+sl_seekable_t sl_fd_seekable_cb(void *context);
+
+#endif /* STREAMLIKE_FD_H */
@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* fallocate() and sync_file_range() */
+#endif
 #ifdef SL_DEBUG
 #include "debug.h"
 #endif
@@ -10,10 +13,94 @@
 # endif
 #endif
 #include "file.h"
+#include "util/holes.h"
+#include "util/uring.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
+/* Number of io_uring entries for asynchronous positional reads. */
+#define SL_FILE_AIO_ENTRIES (64)
+
+#define SL_FILE_OFF_MAX \
+    ((off_t)(((uintmax_t)1 << (sizeof(off_t) * CHAR_BIT - 1)) - 1))
+
+typedef struct sl_file_s
+{
+    FILE *file;
+    /* Offset tracked from reads, writes and seeks while a mode needs it, since
+     * asking stdio costs a system call. */
+    off_t pos;
+    /* Read once mode, off if window is zero. Cache is dropped before
+     * once_dropped and read ahead up to once_ahead. */
+    off_t once_window;
+    off_t once_dropped;
+    off_t once_ahead;
+    long page_size;
+    /* Skip holes mode. Data is known to go from data_off to data_end after a
+     * hole from current offset, unless data_end is negative. */
+    int skip_holes;
+    off_t data_off;
+    off_t data_end;
+    /* Preallocation, off if chunk is zero. Extents are reserved up to
+     * prealloc_end. */
+    off_t prealloc_chunk;
+    off_t prealloc_end;
+    /* Writeback, off if window is zero. Writing back was started from wb_prev
+     * to wb_start, and data written after it is left dirty. */
+    off_t wb_window;
+    off_t wb_prev;
+    off_t wb_start;
+    /* Group commit. Syncs requested are numbered, and those up to sync_done
+     * are on disk. A failed sync fails all later ones, since the kernel may
+     * have dropped dirty pages already. */
+    pthread_mutex_t sync_mutex;
+    pthread_cond_t sync_cond;
+    unsigned long sync_requested;
+    unsigned long sync_done;
+    int syncing;
+    int sync_failed;
+    /* Block for sl_finput_cb(), allocated on first use. Data from input_pos
+     * to input_len is read ahead of the caller, and given back to stdio
+     * before other calls. Input doesn't read ahead if stdio can't seek. */
+    char *input_block;
+    size_t input_pos;
+    size_t input_len;
+    int input_ahead;
+} sl_file_t;
+
+typedef struct sl_file_aio_s
+{
+    sl_aio_t *aio;
+    uring_t *ring;
+    pthread_mutex_t lock;
+    int pending;
+} sl_file_aio_t;
+
+typedef struct sl_file_aio_op_s
+{
+    const sl_aio_request_t *request;
+    sl_file_t *file;
+    int fd;
+    size_t done;
+} sl_file_aio_op_t;
+
+static void* sl_file_aio_create_(sl_aio_t *aio);
+static int sl_file_aio_poll_(void *state, int timeout_ms);
+static void sl_file_aio_destroy_(void *state);
+
+static const sl_aio_engine_t sl_file_aio_engine_ = {
+    sl_file_aio_create_, sl_file_aio_poll_, NULL, sl_file_aio_destroy_
+};
+
 streamlike_t* sl_fopen(const char *path, const char *mode)
 {
     FILE *file;
@@ -31,17 +118,48 @@ streamlike_t* sl_fopen(const char *path, const char *mode)
 streamlike_t* sl_fopen2(FILE *file)
 {
     streamlike_t *stream;
+    sl_file_t *context;
 
     SL_FILE_ASSERT(file != NULL);
 
+    context = malloc(sizeof(sl_file_t));
+    if (!context) {
+        return NULL;
+    }
     stream = malloc(sizeof(streamlike_t));
     if (!stream) {
+        free(context);
         return NULL;
     }
 
-    stream->context = file;
+    context->file         = file;
+    context->pos          = 0;
+    context->once_window  = 0;
+    context->once_dropped = 0;
+    context->once_ahead   = 0;
+    context->page_size    = sysconf(_SC_PAGESIZE);
+    context->skip_holes   = 0;
+    context->data_off     = 0;
+    context->data_end     = -1;
+    context->prealloc_chunk = 0;
+    context->prealloc_end   = 0;
+    context->wb_window      = 0;
+    context->wb_prev        = 0;
+    context->wb_start       = 0;
+    context->sync_requested = 0;
+    context->sync_done      = 0;
+    context->syncing        = 0;
+    context->sync_failed    = 0;
+    pthread_mutex_init(&context->sync_mutex, NULL);
+    pthread_cond_init(&context->sync_cond, NULL);
+    context->input_block    = NULL;
+    context->input_pos      = 0;
+    context->input_len      = 0;
+    context->input_ahead    = 0;
+
+    stream->context = context;
     stream->read    = sl_fread_cb;
-    stream->input   = NULL;
+    stream->input   = sl_finput_cb;
     stream->write   = sl_fwrite_cb;
     stream->flush   = sl_fflush_cb;
     stream->seek    = sl_fseek_cb;
@@ -56,18 +174,52 @@ streamlike_t* sl_fopen2(FILE *file)
     stream->ckp_offset   = NULL;
     stream->ckp_metadata = NULL;
 
+    stream->read_at = sl_fread_at_cb;
+
+    stream->readv  = sl_freadv_cb;
+    stream->writev = sl_fwritev_cb;
+
+    stream->read_multi = sl_fread_multi_cb;
+
+    stream->aio_submit = sl_faio_submit_cb;
+
+    stream->advise    = sl_fadvise_cb;
+    stream->seek_cost = sl_fseek_cost_cb;
+
+    stream->clone = sl_fclone_cb;
+
+    stream->data_map = sl_fdata_map_cb;
+
+    stream->descriptor = sl_fdescriptor_cb;
+
+    /* Seeking moves within stdio buffer or makes a system call at most. */
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                 | SL_CAP_CHEAP_SEEK;
+
     return stream;
 }
 
+static
+void sl_file_free_(streamlike_t *stream)
+{
+    sl_file_t *context = stream->context;
+
+    pthread_cond_destroy(&context->sync_cond);
+    pthread_mutex_destroy(&context->sync_mutex);
+    free(context->input_block);
+    free(context);
+    free(stream);
+}
+
 int sl_fclose(streamlike_t *stream)
 {
     SL_FILE_ASSERT(stream != NULL);
     SL_FILE_ASSERT(stream->context != NULL);
 
-    if (fclose((FILE*)stream->context) < 0) {
+    if (fclose(((sl_file_t*)stream->context)->file) < 0) {
         return -1;
     }
-    free(stream);
+    sl_file_free_(stream);
 
     return 0;
 }
@@ -75,58 +227,669 @@ int sl_fclose(streamlike_t *stream)
 int sl_fclose2(streamlike_t *stream)
 {
     SL_FILE_ASSERT(stream != NULL);
-    free(stream);
+    sl_file_free_(stream);
     return 0;
 }
 
+/* Gives data read ahead by input back to stdio, so that its offset is the
+ * one seen by the caller. */
+static
+void sl_file_unread_(sl_file_t *context)
+{
+    off_t ahead = context->input_len - context->input_pos;
+
+    if (context->input_len == 0) {
+        return;
+    }
+    context->input_pos = 0;
+    context->input_len = 0;
+    if (ahead > 0 && fseeko(context->file, -ahead, SEEK_CUR) == 0) {
+        context->pos -= ahead;
+        /* Range of data known may be ahead now. */
+        context->data_end = -1;
+    }
+}
+
+/* Takes offset from stdio after it may have moved untracked. Holes known
+ * ahead may be behind it now. */
+static
+void sl_file_sync_(sl_file_t *context)
+{
+    off_t pos;
+
+    sl_file_unread_(context);
+    pos = ftello(context->file);
+
+    context->pos = (pos > 0 ? pos : 0);
+    context->once_dropped = context->pos - context->pos % context->page_size;
+    context->once_ahead = context->pos;
+    context->data_end = -1;
+    context->wb_prev = context->pos;
+    context->wb_start = context->pos;
+}
+
+/* Modes tracking offset. */
+static
+int sl_file_tracked_(const sl_file_t *context)
+{
+    return context->once_window || context->skip_holes
+           || context->prealloc_chunk || context->wb_window;
+}
+
+/* Reserves extents a chunk at a time ahead of writes, keeping file size, so
+ * that appending doesn't allocate piecemeal and fragment the file. */
+static
+void sl_file_prealloc_(sl_file_t *context, off_t end)
+{
+    off_t start;
+
+    if (end <= context->prealloc_end) {
+        return;
+    }
+    start = (context->prealloc_end > context->pos ? context->prealloc_end
+                                                  : context->pos);
+    end = (end + context->prealloc_chunk - 1) / context->prealloc_chunk
+          * context->prealloc_chunk;
+    if (fallocate(fileno(context->file), FALLOC_FL_KEEP_SIZE, start,
+                  end - start) != 0 && errno == EOPNOTSUPP) {
+        /* Writes allocate as usual. */
+        context->prealloc_chunk = 0;
+        return;
+    }
+    context->prealloc_end = end;
+}
+
+/* Starts writing back each window as it fills, and waits for the one before
+ * it, so that dirty pages don't pile up for the final sync. */
+static
+void sl_file_writeback_(sl_file_t *context)
+{
+    int fd = fileno(context->file);
+
+    if (context->pos - context->wb_start < context->wb_window
+            || fflush(context->file) != 0) {
+        return;
+    }
+    if (context->wb_prev < context->wb_start) {
+        sync_file_range(fd, context->wb_prev,
+                        context->wb_start - context->wb_prev,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+                        | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    sync_file_range(fd, context->wb_start, context->pos - context->wb_start,
+                    SYNC_FILE_RANGE_WRITE);
+    context->wb_prev = context->wb_start;
+    context->wb_start = context->pos;
+}
+
+/* Follows data written by size bytes. */
+static
+void sl_file_written_(sl_file_t *context, size_t size)
+{
+    context->pos += size;
+    /* Holes may be filled. */
+    context->data_end = -1;
+    if (context->wb_window) {
+        sl_file_writeback_(context);
+    }
+}
+
+/* Drops whole pages consumed a window at a time, so that calls are few, and
+ * keeps reading ahead two windows. Data buffered by stdio has been read, so
+ * it isn't needed in cache either. */
+static
+void sl_file_once_advance_(sl_file_t *context)
+{
+    int fd = fileno(context->file);
+    off_t end;
+
+    if (context->pos - context->once_dropped >= context->once_window) {
+        end = context->pos - context->pos % context->page_size;
+        posix_fadvise(fd, context->once_dropped, end - context->once_dropped,
+                      POSIX_FADV_DONTNEED);
+        context->once_dropped = end;
+    }
+    if (context->once_ahead - context->pos < context->once_window) {
+        end = context->pos + 2 * context->once_window;
+        posix_fadvise(fd, context->once_ahead, end - context->once_ahead,
+                      POSIX_FADV_WILLNEED);
+        context->once_ahead = end;
+    }
+}
+
+/* Finds data from current offset. Without any, the rest is read as is. */
+static
+void sl_file_map_holes_(sl_file_t *context)
+{
+    int fd = fileno(context->file);
+    sl_range_t range;
+    struct stat s;
+    int count;
+
+    count = holes_data_map(fd, context->pos, 0, &range, 1);
+    if (count == 1) {
+        context->data_off = range.offset;
+        context->data_end = range.offset + range.length;
+        return;
+    }
+    context->data_off = context->pos;
+    context->data_end = SL_FILE_OFF_MAX;
+    if (count == 0 && fstat(fd, &s) == 0 && s.st_size > context->pos) {
+        /* Only a hole is left. */
+        context->data_off = s.st_size;
+    }
+}
+
+/* Reads data, and fills holes with zeros without reading them. */
+static
+size_t sl_file_read_sparse_(sl_file_t *context, void *buffer, size_t size)
+{
+    size_t read = 0;
+    size_t part;
+    size_t done;
+
+    while (read < size) {
+        if (context->data_end < 0 || context->pos >= context->data_end) {
+            sl_file_map_holes_(context);
+        }
+        part = size - read;
+        if (context->pos < context->data_off) {
+            part = (context->data_off - context->pos < (off_t)part ?
+                    (size_t)(context->data_off - context->pos) : part);
+            memset((char*)buffer + read, 0, part);
+            context->pos += part;
+            read += part;
+            /* Stdio moves over the hole too. */
+            if (fseeko(context->file, context->pos, SEEK_SET) != 0) {
+                break;
+            }
+            continue;
+        }
+        part = (context->data_end - context->pos < (off_t)part ?
+                (size_t)(context->data_end - context->pos) : part);
+        done = fread((char*)buffer + read, 1, part, context->file);
+        context->pos += done;
+        read += done;
+        if (done < part) {
+            break;
+        }
+    }
+    return read;
+}
+
+int sl_fset_read_once(streamlike_t *stream, size_t window)
+{
+    sl_file_t *context;
+
+    SL_FILE_ASSERT(stream != NULL);
+    SL_FILE_ASSERT(stream->context != NULL);
+
+    context = stream->context;
+    if (fileno(context->file) < 0) {
+        return -1;
+    }
+    context->once_window = (window + context->page_size - 1)
+                           / context->page_size * context->page_size;
+    sl_file_sync_(context);
+    return 0;
+}
+
+int sl_fset_skip_holes(streamlike_t *stream, int skip)
+{
+    sl_file_t *context;
+
+    SL_FILE_ASSERT(stream != NULL);
+    SL_FILE_ASSERT(stream->context != NULL);
+
+    context = stream->context;
+    if (fileno(context->file) < 0) {
+        return -1;
+    }
+    context->skip_holes = skip;
+    sl_file_sync_(context);
+    return 0;
+}
+
+int sl_fset_prealloc(streamlike_t *stream, size_t chunk)
+{
+    sl_file_t *context;
+
+    SL_FILE_ASSERT(stream != NULL);
+    SL_FILE_ASSERT(stream->context != NULL);
+
+    context = stream->context;
+    if (fileno(context->file) < 0) {
+        return -1;
+    }
+    context->prealloc_chunk = chunk;
+    context->prealloc_end = 0;
+    sl_file_sync_(context);
+    return 0;
+}
+
+int sl_fset_writeback(streamlike_t *stream, size_t window)
+{
+    sl_file_t *context;
+
+    SL_FILE_ASSERT(stream != NULL);
+    SL_FILE_ASSERT(stream->context != NULL);
+
+    context = stream->context;
+    if (fileno(context->file) < 0) {
+        return -1;
+    }
+    context->wb_window = window;
+    sl_file_sync_(context);
+    return 0;
+}
+
+int sl_fsync_group(streamlike_t *stream)
+{
+    sl_file_t *context;
+    unsigned long ticket;
+    unsigned long target;
+    int ret;
+
+    SL_FILE_ASSERT(stream != NULL);
+    SL_FILE_ASSERT(stream->context != NULL);
+
+    context = stream->context;
+    if (fflush(context->file) != 0 || fileno(context->file) < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&context->sync_mutex);
+    ticket = ++context->sync_requested;
+    while (context->sync_done < ticket && !context->sync_failed) {
+        if (context->syncing) {
+            pthread_cond_wait(&context->sync_cond, &context->sync_mutex);
+            continue;
+        }
+        /* Lead one sync for everyone waiting so far. Those coming meanwhile
+         * wait for the next one. */
+        context->syncing = 1;
+        target = context->sync_requested;
+        pthread_mutex_unlock(&context->sync_mutex);
+        ret = fdatasync(fileno(context->file));
+        pthread_mutex_lock(&context->sync_mutex);
+        context->syncing = 0;
+        if (ret == 0) {
+            context->sync_done = target;
+        } else {
+            context->sync_failed = 1;
+        }
+        pthread_cond_broadcast(&context->sync_cond);
+    }
+    ret = (context->sync_failed ? -1 : 0);
+    pthread_mutex_unlock(&context->sync_mutex);
+    return ret;
+}
+
+static
+size_t sl_file_read_(sl_file_t *file, void *buffer, size_t size)
+{
+    size_t read;
+
+    if (file->skip_holes) {
+        read = sl_file_read_sparse_(file, buffer, size);
+    } else {
+        read = fread(buffer, 1, size, file->file);
+        file->pos += read;
+    }
+    if (file->once_window) {
+        sl_file_once_advance_(file);
+    }
+    return read;
+}
+
 size_t sl_fread_cb(void *context, void *buffer, size_t size)
 {
-    return fread(buffer, 1, size, (FILE*)context);
+    sl_file_t *file = context;
+
+    sl_file_unread_(file);
+    return sl_file_read_(file, buffer, size);
+}
+
+size_t sl_finput_cb(void *context, const void **buffer, size_t size)
+{
+    /* A whole block is read at once, which stdio reads straight into it
+     * instead of copying through its own buffer. */
+    sl_file_t *file = context;
+    size_t part;
+
+    if (size == 0) {
+        return 0;
+    }
+    if (file->input_pos == file->input_len) {
+        file->input_pos = 0;
+        file->input_len = 0;
+        if (!file->input_block) {
+            if (posix_memalign((void**)&file->input_block, file->page_size,
+                               SL_FILE_INPUT_BLOCK_SIZE) != 0) {
+                file->input_block = NULL;
+                return 0;
+            }
+            file->input_ahead = (ftello(file->file) >= 0);
+        }
+        part = (file->input_ahead || size > SL_FILE_INPUT_BLOCK_SIZE ?
+                SL_FILE_INPUT_BLOCK_SIZE : size);
+        file->input_len = sl_file_read_(file, file->input_block, part);
+        if (file->input_len == 0) {
+            return 0;
+        }
+    }
+    part = file->input_len - file->input_pos;
+    part = (part < size ? part : size);
+    *buffer = file->input_block + file->input_pos;
+    file->input_pos += part;
+    return part;
+}
+
+size_t sl_fread_at_cb(void *context, void *buffer, size_t size, off_t offset)
+{
+    /* Bypasses stdio buffer, so writes still in it go out first. */
+    FILE *file = ((sl_file_t*)context)->file;
+    int fd = fileno(file);
+    size_t total = 0;
+    ssize_t ret;
+
+    if (fd < 0 || (__fpending(file) > 0 && fflush(file) != 0)) {
+        return 0;
+    }
+    while (total < size) {
+        ret = pread(fd, (char*)buffer + total, size - total, offset + total);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+int sl_fread_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = sl_fread_at_cb(context, extents[i].buffer,
+                                         extents[i].length, extents[i].offset);
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+static
+void* sl_file_aio_create_(sl_aio_t *aio)
+{
+    sl_file_aio_t *engine;
+
+    engine = malloc(sizeof(sl_file_aio_t));
+    if (!engine) {
+        return NULL;
+    }
+    engine->ring = uring_init(SL_FILE_AIO_ENTRIES);
+    if (!engine->ring) {
+        free(engine);
+        return NULL;
+    }
+    if (pthread_mutex_init(&engine->lock, NULL) != 0) {
+        uring_destroy(engine->ring);
+        free(engine);
+        return NULL;
+    }
+    engine->aio = aio;
+    engine->pending = 0;
+    return engine;
+}
+
+static
+void sl_file_aio_destroy_(void *state)
+{
+    sl_file_aio_t *engine = state;
+    pthread_mutex_destroy(&engine->lock);
+    uring_destroy(engine->ring);
+    free(engine);
+}
+
+/* Submits the rest of the read. Must be called with the engine locked. */
+static
+int sl_file_aio_submit_op_(sl_file_aio_t *engine, sl_file_aio_op_t *op)
+{
+    const sl_aio_request_t *req = op->request;
+    size_t left = req->size - op->done;
+
+    return uring_submit_read(engine->ring, op->fd, (char*)req->buffer + op->done,
+                             (left < INT_MAX ? left : INT_MAX),
+                             req->offset + op->done, (uintptr_t)op);
+}
+
+static
+int sl_file_aio_poll_(void *state, int timeout_ms)
+{
+    sl_file_aio_t *engine = state;
+    sl_file_aio_op_t *op;
+    uint64_t user_data;
+    int res;
+    int pending;
+
+    pthread_mutex_lock(&engine->lock);
+    pending = engine->pending;
+    pthread_mutex_unlock(&engine->lock);
+    if (pending == 0) {
+        return 0;
+    }
+    uring_wait(engine->ring, timeout_ms);
+
+    pthread_mutex_lock(&engine->lock);
+    while (uring_reap(engine->ring, &user_data, &res)) {
+        op = (sl_file_aio_op_t*)(uintptr_t)user_data;
+        if (res > 0) {
+            op->done += res;
+        }
+        if ((res > 0 && op->done < op->request->size)
+                || res == -EINTR || res == -EAGAIN) {
+            /* Short read before end-of-file. Read the rest synchronously if
+             * the ring is full. */
+            if (sl_file_aio_submit_op_(engine, op) == 0) {
+                continue;
+            }
+            op->done += sl_fread_at_cb(op->file,
+                                       (char*)op->request->buffer + op->done,
+                                       op->request->size - op->done,
+                                       op->request->offset + op->done);
+        }
+        engine->pending--;
+        /* Read failing before any data is an error, not end-of-file. */
+        sl_aio_complete(engine->aio, op->request,
+                        (res < 0 && res != -EINTR && res != -EAGAIN
+                         && op->done == 0 ? -1 : (ssize_t)op->done));
+        free(op);
+    }
+    pending = engine->pending;
+    pthread_mutex_unlock(&engine->lock);
+    return pending;
+}
+
+int sl_faio_submit_cb(void *context, sl_aio_t *aio,
+                      const sl_aio_request_t *request)
+{
+    /* Only positional reads go to io_uring. Reads and seeks use stdio buffer,
+     * so they are left to the thread pool. */
+    sl_file_t *file = context;
+    sl_file_aio_t *engine;
+    sl_file_aio_op_t *op;
+    int fd = fileno(file->file);
+    int ret;
+
+    if (request->op != SL_AIO_READ_AT || fd < 0 || request->offset < 0
+            || request->size == 0) {
+        return 1;
+    }
+    engine = sl_aio_engine(aio, &sl_file_aio_engine_);
+    if (!engine) {
+        return 1;
+    }
+    op = malloc(sizeof(sl_file_aio_op_t));
+    if (!op) {
+        return 1;
+    }
+    op->request = request;
+    op->file = file;
+    op->fd = fd;
+    op->done = 0;
+
+    pthread_mutex_lock(&engine->lock);
+    ret = sl_file_aio_submit_op_(engine, op);
+    if (ret == 0) {
+        engine->pending++;
+    }
+    pthread_mutex_unlock(&engine->lock);
+    if (ret != 0) {
+        free(op);
+        return 1;
+    }
+    sl_aio_kick(aio, &sl_file_aio_engine_);
+    return 0;
+}
+
+size_t sl_freadv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    /* Goes through stdio buffer to keep stream offset consistent. Locks the
+     * stream once instead of once per buffer. */
+    sl_file_t *file = context;
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    sl_file_unread_(file);
+    flockfile(file->file);
+    for (i = 0; i < iovcnt; i++) {
+        if (file->skip_holes) {
+            read = sl_file_read_sparse_(file, iov[i].iov_base,
+                                        iov[i].iov_len);
+        } else {
+            read = fread_unlocked(iov[i].iov_base, 1, iov[i].iov_len,
+                                  file->file);
+            file->pos += read;
+        }
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    funlockfile(file->file);
+    if (file->once_window) {
+        sl_file_once_advance_(file);
+    }
+    return total;
+}
+
+size_t sl_fwritev_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    sl_file_t *file = context;
+    size_t total = 0;
+    size_t size = 0;
+    size_t written;
+    int i;
+
+    sl_file_unread_(file);
+    if (file->prealloc_chunk) {
+        for (i = 0; i < iovcnt; i++) {
+            size += iov[i].iov_len;
+        }
+        sl_file_prealloc_(file, file->pos + size);
+    }
+    flockfile(file->file);
+    for (i = 0; i < iovcnt; i++) {
+        written = fwrite_unlocked(iov[i].iov_base, 1, iov[i].iov_len,
+                                  file->file);
+        total += written;
+        if (written < iov[i].iov_len) {
+            break;
+        }
+    }
+    funlockfile(file->file);
+    sl_file_written_(file, total);
+    return total;
 }
 
 size_t sl_fwrite_cb(void *context, const void *buffer, size_t size)
 {
-    return fwrite(buffer, 1, size, (FILE*)context);
+    sl_file_t *file = context;
+    size_t written;
+
+    sl_file_unread_(file);
+    if (file->prealloc_chunk) {
+        sl_file_prealloc_(file, file->pos + size);
+    }
+    written = fwrite(buffer, 1, size, file->file);
+    sl_file_written_(file, written);
+    return written;
 }
 
 int sl_fflush_cb(void *context)
 {
-    return fflush((FILE*)context);
+    sl_file_unread_(context);
+    return fflush(((sl_file_t*)context)->file);
 }
 
 int sl_fseek_cb(void *context, off_t offset, int whence)
 {
+    sl_file_t *file = context;
+    int ret;
+
+    sl_file_unread_(file);
     switch(whence)
     {
         case SL_SEEK_SET:
-            return fseek((FILE*)context, offset, SEEK_SET);
+            whence = SEEK_SET;
+            break;
         case SL_SEEK_CUR:
-            return fseek((FILE*)context, offset, SEEK_CUR);
+            whence = SEEK_CUR;
+            break;
         case SL_SEEK_END:
-            return fseek((FILE*)context, offset, SEEK_END);
+            whence = SEEK_END;
+            break;
     }
-    return fseek((FILE*)context, offset, whence);
+    ret = fseek(file->file, offset, whence);
+    if (ret == 0 && sl_file_tracked_(file)) {
+        sl_file_sync_(file);
+    }
+    return ret;
 }
 
 off_t sl_ftell_cb(void *context)
 {
-    return ftello((FILE*)context);
+    sl_file_t *file = context;
+    off_t pos = ftello(file->file);
+
+    return (pos < 0 ? pos : pos - (off_t)(file->input_len - file->input_pos));
 }
 
 int sl_feof_cb(void *context)
 {
-    return feof((FILE*)context);
+    sl_file_t *file = context;
+
+    if (file->input_pos < file->input_len) {
+        return 0;
+    }
+    return feof(file->file);
 }
 
 int sl_ferror_cb(void *context)
 {
-    return ferror((FILE*)context);
+    return ferror(((sl_file_t*)context)->file);
 }
 
 off_t sl_flength_cb(void *context)
 {
     struct stat s;
-    int fd = fileno((FILE*)context);
+    int fd = fileno(((sl_file_t*)context)->file);
 
     if (fd < 0) {
         return -1;
@@ -137,6 +900,129 @@ off_t sl_flength_cb(void *context)
     return s.st_size;
 }
 
+int sl_fadvise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    /* Kernel page cache takes the advice. WILLNEED starts read-ahead of the
+     * range without blocking. */
+    int fd = fileno(((sl_file_t*)context)->file);
+
+    if (fd < 0) {
+        return -1;
+    }
+    switch (advice) {
+        case SL_ADVICE_NORMAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NORMAL);
+        case SL_ADVICE_SEQUENTIAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+        case SL_ADVICE_RANDOM:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_RANDOM);
+        case SL_ADVICE_WILLNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+        case SL_ADVICE_DONTNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        case SL_ADVICE_NOREUSE:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NOREUSE);
+    }
+    return -1;
+}
+
+streamlike_t* sl_fclone_cb(void *context)
+{
+    /* Reopening the descriptor through procfs gives a new open file
+     * description, which has its own offset unlike a dup()ed one. */
+    FILE *file = ((sl_file_t*)context)->file;
+    FILE *clone_file;
+    streamlike_t *clone;
+    char path[64];
+    const char *mode;
+    int fd = fileno(file);
+    int clone_fd;
+    int flags;
+    off_t offset;
+
+    if (fd < 0 || (flags = fcntl(fd, F_GETFL)) < 0) {
+        return NULL;
+    }
+    offset = sl_ftell_cb(context);
+    if (offset < 0) {
+        return NULL;
+    }
+    switch (flags & O_ACCMODE) {
+        case O_RDONLY:
+            mode = "rb";
+            break;
+        case O_WRONLY:
+            mode = (flags & O_APPEND ? "ab" : "wb");
+            break;
+        default:
+            mode = (flags & O_APPEND ? "a+b" : "r+b");
+            break;
+    }
+    /* Clone should see data written so far. */
+    if ((flags & O_ACCMODE) != O_RDONLY && fflush(file) != 0) {
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    clone_fd = open(path, (flags & (O_ACCMODE | O_APPEND)) | O_CLOEXEC);
+    if (clone_fd < 0) {
+        return NULL;
+    }
+    clone_file = fdopen(clone_fd, mode);
+    if (!clone_file) {
+        close(clone_fd);
+        return NULL;
+    }
+    if (fseeko(clone_file, offset, SEEK_SET) != 0
+            || !(clone = sl_fopen2(clone_file))) {
+        fclose(clone_file);
+        return NULL;
+    }
+    if (((sl_file_t*)context)->once_window) {
+        sl_fset_read_once(clone, ((sl_file_t*)context)->once_window);
+    }
+    if (((sl_file_t*)context)->skip_holes) {
+        sl_fset_skip_holes(clone, 1);
+    }
+    if (((sl_file_t*)context)->prealloc_chunk) {
+        sl_fset_prealloc(clone, ((sl_file_t*)context)->prealloc_chunk);
+    }
+    if (((sl_file_t*)context)->wb_window) {
+        sl_fset_writeback(clone, ((sl_file_t*)context)->wb_window);
+    }
+    return clone;
+}
+
+int sl_fdata_map_cb(void *context, off_t offset, off_t length,
+                    sl_range_t *ranges, int max)
+{
+    /* Data written should be flushed first. */
+    int fd = fileno(((sl_file_t*)context)->file);
+
+    if (fd < 0) {
+        return -1;
+    }
+    return holes_data_map(fd, offset, length, ranges, max);
+}
+
+int sl_fdescriptor_cb(void *context)
+{
+    FILE *file = ((sl_file_t*)context)->file;
+
+    sl_file_unread_(context);
+    if (fflush(file) != 0) {
+        return -1;
+    }
+    return fileno(file);
+}
+
+off_t sl_fseek_cost_cb(void *context, off_t offset)
+{
+    /* Seeking costs a system call at most. Reading through would cost copying
+     * the gap, so it is never cheaper. */
+    return 0;
+}
+
 sl_seekable_t sl_fseekable_cb(void *context)
 {
     return SL_SEEKING_SUPPORTED;
@@ -9,14 +9,69 @@ streamlike_t* sl_fopen2(FILE *file);
 int sl_fclose(streamlike_t *stream);
 int sl_fclose2(streamlike_t *stream);
 
+#define SL_FILE_READ_ONCE_WINDOW (8 * 1024 * 1024)
+#define SL_FILE_PREALLOC_CHUNK   (64 * 1024 * 1024)
+#define SL_FILE_WRITEBACK_WINDOW (8 * 1024 * 1024)
+#define SL_FILE_INPUT_BLOCK_SIZE (256 * 1024)
+
+/* Read once mode for one-pass scans. As the stream is read, page cache is
+ * dropped behind it and read ahead of it, a window at a time, so that the
+ * file takes up about three windows of cache whatever its size. Zero window
+ * turns it off. It follows whoever reads the stream, so it should be set
+ * before wrapping the stream, e.g. by sl_buffer, whose filler drives it. */
+int sl_fset_read_once(streamlike_t *stream, size_t window);
+/* Skip holes mode for sparse files. Reads fill holes with zeros instead of
+ * reading them. Holes are found with sl_fdata_map_cb(), so they are only
+ * skipped if the file system reports them. Readers can also skip holes
+ * themselves through sl_data_map(). */
+int sl_fset_skip_holes(streamlike_t *stream, int skip);
+/* Preallocation for appending writers. Extents are reserved with fallocate()
+ * a chunk at a time ahead of writes, without changing file length, so that
+ * the file isn't fragmented by allocating as it grows. Reserved blocks past
+ * the end stay allocated until the file is truncated. Zero chunk turns it
+ * off, as does a file system without support. */
+int sl_fset_prealloc(streamlike_t *stream, size_t chunk);
+/* Background writeback. Each window written is flushed and written back
+ * with sync_file_range() without waiting, while the window before is waited
+ * for, so that at most two windows are dirty and a final sync is short. It
+ * doesn't make data durable, as metadata isn't written. Zero window turns it
+ * off. Modes above follow a single writer. */
+int sl_fset_writeback(streamlike_t *stream, size_t window);
+/* Group commit. Flushes and makes data durable with fdatasync(), like an
+ * fsync per call, but calls from several threads meanwhile are covered by a
+ * single sync. Thread-safe. Once a sync fails, later calls fail too. */
+int sl_fsync_group(streamlike_t *stream);
+
 size_t sl_fread_cb(void *context, void *buffer, size_t size);
+/* Reads a block at a time into an aligned block reused by the stream, which
+ * stays valid until the next call. Data read ahead is given back to stdio
+ * before other calls, so input mixes with reads and seeks. */
+size_t sl_finput_cb(void *context, const void **buffer, size_t size);
+/* Reads the descriptor directly, flushing writes still buffered by stdio
+ * first. Doesn't move the stream position. */
+size_t sl_fread_at_cb(void *context, void *buffer, size_t size, off_t offset);
 size_t sl_fwrite_cb(void *context, const void *buffer, size_t size);
+int sl_fread_multi_cb(void *context, sl_extent_t *extents, int count);
+int sl_faio_submit_cb(void *context, sl_aio_t *aio,
+                      const sl_aio_request_t *request);
+size_t sl_freadv_cb(void *context, const struct iovec *iov, int iovcnt);
+size_t sl_fwritev_cb(void *context, const struct iovec *iov, int iovcnt);
 int sl_fflush_cb(void *context);
 int sl_fseek_cb(void *context, off_t offset, int whence);
 off_t sl_ftell_cb(void *context);
 int sl_feof_cb(void *context);
 int sl_ferror_cb(void *context);
 off_t sl_flength_cb(void *context);
+int sl_fadvise_cb(void *context, off_t offset, off_t length, int advice);
+off_t sl_fseek_cost_cb(void *context, off_t offset);
+/* Linux only. Clone owns its FILE, so it is closed by sl_fclose(). */
+streamlike_t* sl_fclone_cb(void *context);
+/* Data written should be flushed first. Moves descriptor offset meanwhile, so
+ * it shouldn't run along with reads from other threads. */
+int sl_fdata_map_cb(void *context, off_t offset, off_t length,
+                    sl_range_t *ranges, int max);
+/* Flushes, so that the descriptor holds data written. */
+int sl_fdescriptor_cb(void *context);
 sl_seekable_t sl_fseekable_cb(void *context);
 
 #endif /* STREAMLIKE_FILE_H */
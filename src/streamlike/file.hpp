@@ -15,6 +15,11 @@ class StreamlikeFile : public Streamlike {
         StreamlikeFile(StreamlikeFile&& old) = default;
         StreamlikeFile& operator=(StreamlikeFile&&) = default;
         ~StreamlikeFile();
+
+        StreamlikeFile clone() const;
+
+    private:
+        explicit StreamlikeFile(self_type self);
 };
 
 } // namespace streamlike
@@ -24,10 +24,21 @@ StreamlikeFile::StreamlikeFile(FILE* fp)
     }
 }
 
+StreamlikeFile::StreamlikeFile(self_type self)
+        : Streamlike(self) {
+    if (!self) {
+        throw std::runtime_error("Couldn't clone file stream");
+    }
+}
+
 StreamlikeFile::~StreamlikeFile() {
     if (self) {
         sl_fclose(self);
     }
 }
 
+StreamlikeFile StreamlikeFile::clone() const {
+    return StreamlikeFile(sl_clone(self));
+}
+
 } // namespace streamlike
@@ -23,12 +23,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <pthread.h>
 #include <curl/curl.h>
 
+/* Largest gap between extents merged into one range request. */
+#define SL_HTTP_MERGE_GAP (64 * 1024)
+/* Most connections opened in parallel for a batch of range requests. */
+#define SL_HTTP_MULTI_CONNECTIONS (8)
+/* Size of each range requested while stream is read randomly. */
+#define SL_HTTP_RANDOM_RANGE (256 * 1024)
+/* Seek cost assumed until request latency and throughput are measured. */
+#define SL_HTTP_SEEK_COST (128 * 1024)
+/* curl_multi_poll() can be woken up since curl 7.68.0. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+# define SL_HTTP_AIO_WAKEUP
+#endif
+
+/* Connection cache can be shared since curl 7.57.0. */
+#if LIBCURL_VERSION_NUM >= 0x073900
+# define SL_HTTP_SHARE_CONNECT
+#endif
+
 static pthread_mutex_t curl_global_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int curl_global_init_done = 0;
 
+/* State shared by a stream and its clones. Handles of sequential and
+ * synchronous positional reads reuse connections and DNS entries through it.
+ * Freed when the last stream using it is closed. */
+typedef struct sl_http_share_s
+{
+    CURLSH *curlsh;
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+    pthread_mutex_t ref_lock;
+    int refs;
+} sl_http_share_t;
+
 typedef struct sl_http_s
 {
     off_t http_off;
@@ -41,6 +71,24 @@ typedef struct sl_http_s
     } http_range_allowed;
     CURL *curl;
     CURLM *curlm;
+    sl_http_share_t *share;
+    char *uri;
+    long read_timeout_ms;
+    int error;
+    /* Access pattern advice. Requested range ends at range_end, or goes till
+     * end-of-file if it's negative. */
+    int advice;
+    off_t range_end;
+    off_t willneed_off;
+    off_t willneed_end;
+    /* Measurements for seek cost. Latency is smoothed over requests, it is
+     * negative until the first request gets data. Throughput is bytes read
+     * over time spent in reads, excluding request latency. */
+    int latency_pending;
+    double latency_us;
+    double latency_sample_us;
+    double read_bytes;
+    double read_us;
 
     size_t curlbuf_off;
     size_t outbuf_off;
@@ -55,6 +103,46 @@ typedef struct sl_http_s
     } state;
 } sl_http_t;
 
+typedef struct sl_http_read_at_s
+{
+    CURL *curl;
+    char *buffer;
+    size_t size;
+    size_t off;
+    off_t skip;
+    int status_checked;
+} sl_http_read_at_t;
+
+typedef struct sl_http_aio_op_s
+{
+    sl_http_read_at_t req;
+    const sl_aio_request_t *request;
+    struct sl_http_aio_op_s *next;
+} sl_http_aio_op_t;
+
+typedef struct sl_http_aio_s
+{
+    sl_aio_t *aio;
+    CURLM *curlm;
+    pthread_mutex_t lock;
+    /* Handles submitted but not added to curlm yet, since curlm is only
+     * touched by the driver thread. */
+    sl_http_aio_op_t *incoming;
+    int pending;
+} sl_http_aio_t;
+
+typedef struct sl_http_run_s
+{
+    CURL *curl;
+    sl_extent_t **extents;
+    int count;
+    int first;
+    off_t begin;
+    off_t end;
+    off_t pos;
+    int status_checked;
+} sl_http_run_t;
+
 static
 void sl_http_set_state_(sl_http_t *http, int state)
 {
@@ -91,6 +179,21 @@ size_t sl_http_write_cb_(void *curlbuf, size_t ignore_this, size_t curlbuf_size,
     size_t curlbuf_avail = curlbuf_size - http->curlbuf_off;
     void *inp = http->outbuf + http->outbuf_off;
     void *outp = curlbuf + http->curlbuf_off;
+    double start_s = 0;
+
+    if (http->latency_pending) {
+        /* First data of a request. curl measures the latency from the start
+         * of transfer, so time between a seek and the next read isn't
+         * included. */
+        http->latency_pending = 0;
+        curl_easy_getinfo(http->curl, CURLINFO_STARTTRANSFER_TIME, &start_s);
+        http->latency_sample_us = start_s * 1e6;
+        http->latency_us = (http->latency_us < 0 ? http->latency_sample_us :
+                            (3 * http->latency_us + http->latency_sample_us)
+                            / 4);
+        SL_HTTP_LOG("Request latency %.0f us, smoothed %.0f us.",
+                    http->latency_sample_us, http->latency_us);
+    }
 
     if (http->state == SL_HTTP_ABORT_REQUESTED) {
         sl_http_set_state_(http, SL_HTTP_ABORTED);
@@ -352,13 +455,91 @@ void sl_http_library_cleanup()
     pthread_mutex_unlock(&curl_global_init_mutex);
 }
 
-int sl_http_open(streamlike_t *stream, const char *uri)
+static
+void sl_http_share_lock_(CURL *curl, curl_lock_data data,
+                         curl_lock_access access, void *context)
 {
-    sl_http_t *http;
+    sl_http_share_t *share = context;
+    pthread_mutex_lock(&share->locks[data]);
+}
 
-    if (!stream) {
-        return 2;
+static
+void sl_http_share_unlock_(CURL *curl, curl_lock_data data, void *context)
+{
+    sl_http_share_t *share = context;
+    pthread_mutex_unlock(&share->locks[data]);
+}
+
+static
+sl_http_share_t* sl_http_share_create_()
+{
+    sl_http_share_t *share;
+    int i;
+
+    share = malloc(sizeof(sl_http_share_t));
+    if (!share) {
+        return NULL;
+    }
+    share->curlsh = curl_share_init();
+    if (!share->curlsh) {
+        free(share);
+        return NULL;
+    }
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share->locks[i], NULL);
+    }
+    pthread_mutex_init(&share->ref_lock, NULL);
+    share->refs = 1;
+
+    curl_share_setopt(share->curlsh, CURLSHOPT_LOCKFUNC, sl_http_share_lock_);
+    curl_share_setopt(share->curlsh, CURLSHOPT_UNLOCKFUNC,
+                      sl_http_share_unlock_);
+    curl_share_setopt(share->curlsh, CURLSHOPT_USERDATA, share);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE,
+                      CURL_LOCK_DATA_SSL_SESSION);
+#ifdef SL_HTTP_SHARE_CONNECT
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    return share;
+}
+
+static
+void sl_http_share_acquire_(sl_http_share_t *share)
+{
+    pthread_mutex_lock(&share->ref_lock);
+    share->refs++;
+    pthread_mutex_unlock(&share->ref_lock);
+}
+
+/* Handles using the share should be cleaned up before. */
+static
+void sl_http_share_release_(sl_http_share_t *share)
+{
+    int refs;
+    int i;
+
+    pthread_mutex_lock(&share->ref_lock);
+    refs = --share->refs;
+    pthread_mutex_unlock(&share->ref_lock);
+    if (refs > 0) {
+        return;
     }
+    curl_share_cleanup(share->curlsh);
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&share->locks[i]);
+    }
+    pthread_mutex_destroy(&share->ref_lock);
+    free(share);
+}
+
+/* Takes over a reference to the share on success. */
+static
+int sl_http_open_(streamlike_t *stream, const char *uri,
+                  sl_http_share_t *share)
+{
+    sl_http_t *http;
+
     http = malloc(sizeof(sl_http_t));
     if (!http) {
         return 2;
@@ -374,6 +555,13 @@ int sl_http_open(streamlike_t *stream, const char *uri)
         free(http);
         return 2;
     }
+    http->uri = strdup(uri);
+    if (!http->uri) {
+        curl_multi_cleanup(http->curlm);
+        curl_easy_cleanup(http->curl);
+        free(http);
+        return 2;
+    }
     curl_multi_add_handle(http->curlm, http->curl);
 
     curl_easy_setopt(http->curl, CURLOPT_URL, uri);
@@ -381,6 +569,8 @@ int sl_http_open(streamlike_t *stream, const char *uri)
     curl_easy_setopt(http->curl, CURLOPT_WRITEDATA, http);
     curl_easy_setopt(http->curl, CURLOPT_HEADERFUNCTION, sl_http_header_cb_);
     curl_easy_setopt(http->curl, CURLOPT_HEADERDATA, http);
+    curl_easy_setopt(http->curl, CURLOPT_SHARE, share->curlsh);
+    http->share = share;
 #ifdef STREAMLIKE_DEBUG
     /* curl_easy_setopt(http->curl, CURLOPT_VERBOSE, 1); */
 #endif
@@ -389,6 +579,19 @@ int sl_http_open(streamlike_t *stream, const char *uri)
     http->http_status = 0;
     http->http_range_allowed = SL_HTTP_RANGE_UNKNOWN;
     http->curlbuf_off = 0;
+    http->read_timeout_ms = 0;
+    http->error = 0;
+    http->advice = SL_ADVICE_NORMAL;
+    http->range_end = -1;
+    http->willneed_off = 0;
+    http->willneed_end = 0;
+    http->outbuf_off = 0;
+    http->outbuf_size = 0;
+    http->latency_pending = 1;
+    http->latency_us = -1;
+    http->latency_sample_us = 0;
+    http->read_bytes = 0;
+    http->read_us = 0;
     http->state = SL_HTTP_READY;
 
     stream->context = http;
@@ -408,6 +611,44 @@ int sl_http_open(streamlike_t *stream, const char *uri)
     stream->ckp_offset   = NULL;
     stream->ckp_metadata = NULL;
 
+    stream->read_at = sl_http_read_at_cb;
+
+    stream->readv  = NULL;
+    stream->writev = NULL;
+
+    stream->read_multi = sl_http_read_multi_cb;
+
+    stream->aio_submit = sl_http_aio_submit_cb;
+
+    stream->advise    = sl_http_advise_cb;
+    stream->seek_cost = sl_http_seek_cost_cb;
+
+    stream->clone = sl_http_clone_cb;
+
+    stream->data_map = NULL;
+
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream);
+
+    return 0;
+}
+
+int sl_http_open(streamlike_t *stream, const char *uri)
+{
+    sl_http_share_t *share;
+
+    if (!stream) {
+        return 2;
+    }
+    share = sl_http_share_create_();
+    if (!share) {
+        return 2;
+    }
+    if (sl_http_open_(stream, uri, share) != 0) {
+        sl_http_share_release_(share);
+        return 2;
+    }
     return 0;
 }
 
@@ -441,8 +682,13 @@ int sl_http_close(streamlike_t *stream)
     if (!http->curlm) {
         return 2;
     }
+    /* Connection of an unfinished transfer is closed on removal. Otherwise it
+     * would be left in the shared cache with data pending. */
+    curl_multi_remove_handle(http->curlm, http->curl);
     curl_easy_cleanup(http->curl);
     curl_multi_cleanup(http->curlm);
+    sl_http_share_release_(http->share);
+    free(http->uri);
     free(http);
     return 0;
 }
@@ -458,15 +704,103 @@ int sl_http_destroy(streamlike_t *stream)
     return 0;
 }
 
-size_t sl_http_read_cb(void *context, void *buffer, size_t len)
+int sl_http_set_read_timeout(streamlike_t *stream, long timeout_ms)
+{
+    sl_http_t *http;
+    if (!stream) {
+        return 2;
+    }
+    http = stream->context;
+    if (!http) {
+        return 2;
+    }
+    http->read_timeout_ms = (timeout_ms > 0 ? timeout_ms : 0);
+    return 0;
+}
+
+static
+long sl_http_now_ms_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static
+double sl_http_now_us_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Restarts transfer from given offset. Transfer should be cancelled or done.
+ * Range is bounded while reading randomly, so that the rest of the stream isn't
+ * requested on each seek. */
+static
+void sl_http_request_range_(sl_http_t *http, off_t offset)
+{
+    char range_str[128];
+    off_t end = -1;
+
+    if (http->advice == SL_ADVICE_RANDOM) {
+        end = offset + SL_HTTP_RANDOM_RANGE;
+        /* Range advised to be needed is requested as a whole. */
+        if (offset >= http->willneed_off
+                && (offset < http->willneed_end || http->willneed_end < 0)) {
+            end = (http->willneed_end < 0 || http->willneed_end > end ?
+                   http->willneed_end : end);
+        }
+    }
+    if (end >= 0) {
+        snprintf(range_str, sizeof(range_str), "%jd-%jd", (intmax_t)offset,
+                 (intmax_t)(end - 1));
+    } else {
+        snprintf(range_str, sizeof(range_str), "%jd-", (intmax_t)offset);
+    }
+    SL_HTTP_LOG("Requesting range '%s'", range_str);
+
+    curl_easy_setopt(http->curl, CURLOPT_RANGE, range_str);
+    http->range_end = end;
+    http->http_off = offset;
+    http->curlbuf_off = 0;
+    http->latency_pending = 1;
+    curl_multi_remove_handle(http->curlm, http->curl);
+    curl_multi_add_handle(http->curlm, http->curl);
+}
+
+/* Forgets buffer of the last read, which may be left partly filled by a short
+ * read. Data received outside of reads then stays in curl buffer. */
+static
+void sl_http_drop_outbuf_(sl_http_t *http)
+{
+    http->outbuf = NULL;
+    http->outbuf_off = 0;
+    http->outbuf_size = 0;
+}
+
+/* Whether transfer stopped at the end of a bounded range before end-of-file. */
+static
+int sl_http_range_ended_(sl_http_t *http)
+{
+    return http->range_end >= 0 && http->http_off == http->range_end
+        && (http->http_len < 0 || http->http_off < http->http_len);
+}
+
+static
+size_t sl_http_read_(sl_http_t *http, void *buffer, size_t len)
 {
-    sl_http_t *http = context;
     CURLMcode curl_mret;
     http->outbuf = buffer;
     http->outbuf_off = 0;
     http->outbuf_size = len;
     int count = 1;
+    long deadline = 0;
     SL_HTTP_LOG("Attempting to read %zu bytes...", len);
+    http->error = 0;
+    if (http->read_timeout_ms > 0) {
+        deadline = sl_http_now_ms_() + http->read_timeout_ms;
+    }
     if (http->state == SL_HTTP_PAUSED) {
         curl_easy_pause(http->curl, CURLPAUSE_CONT);
     }
@@ -476,6 +810,12 @@ size_t sl_http_read_cb(void *context, void *buffer, size_t len)
             return http->outbuf_off;
         }
         curl_mret = curl_multi_perform(http->curlm, &count);
+        if (curl_mret == CURLM_OK && !count && sl_http_range_ended_(http)) {
+            /* Bounded range is done before end-of-file. Request the next. */
+            sl_http_set_state_(http, SL_HTTP_READY);
+            sl_http_request_range_(http, http->http_off);
+            continue;
+        }
         if (curl_mret != CURLM_OK || !count) {
             #ifdef SL_DEBUG
             if (curl_mret != CURLM_OK) {
@@ -508,6 +848,13 @@ size_t sl_http_read_cb(void *context, void *buffer, size_t len)
                 sl_http_set_state_(http, SL_HTTP_WORKING);
             }
         }
+        /* Transfer goes on with the next read. */
+        if (deadline && http->outbuf_off < http->outbuf_size
+                && sl_http_now_ms_() >= deadline) {
+            SL_HTTP_LOG("Timed out after %zu bytes.", http->outbuf_off);
+            http->error = SL_ERROR_TIMEDOUT;
+            return http->outbuf_off;
+        }
     }
     /* if (http->state == SL_HTTP_WORKING) { */
     /*     curl_easy_pause(http->curl, CURLPAUSE_ALL); */
@@ -515,28 +862,466 @@ size_t sl_http_read_cb(void *context, void *buffer, size_t len)
     return http->outbuf_off;
 }
 
+size_t sl_http_read_cb(void *context, void *buffer, size_t len)
+{
+    sl_http_t *http = context;
+    double start_us = sl_http_now_us_();
+    double elapsed_us;
+    size_t read;
+
+    http->latency_sample_us = 0;
+    read = sl_http_read_(http, buffer, len);
+    if (read > 0) {
+        /* Time waiting for a new request is counted as latency instead. */
+        elapsed_us = sl_http_now_us_() - start_us - http->latency_sample_us;
+        http->read_bytes += read;
+        http->read_us += (elapsed_us > 0 ? elapsed_us : 0);
+    }
+    return read;
+}
+
+static
+size_t sl_http_read_at_write_cb_(void *curlbuf, size_t ignore_this,
+                                 size_t curlbuf_size, void *context)
+{
+    sl_http_read_at_t *req = context;
+    const char *data = curlbuf;
+    size_t len = curlbuf_size;
+    size_t avail;
+    long status = 0;
+
+    if (!req->status_checked) {
+        curl_easy_getinfo(req->curl, CURLINFO_RESPONSE_CODE, &status);
+        SL_HTTP_LOG("Positional read got HTTP status %ld.", status);
+        if (status == 206) {
+            req->skip = 0;
+        } else if (status != 200) {
+            return 0;
+        }
+        req->status_checked = 1;
+    }
+
+    /* Server ignored range. Skip up to the offset. */
+    if (req->skip > 0) {
+        avail = ((off_t)len < req->skip ? len : (size_t)req->skip);
+        data += avail;
+        len -= avail;
+        req->skip -= avail;
+    }
+
+    avail = req->size - req->off;
+    if (len > avail) {
+        len = avail;
+    }
+    memcpy(req->buffer + req->off, data, len);
+    req->off += len;
+
+    /* Abort the rest of transfer once buffer is full. */
+    return (req->off == req->size ? 0 : curlbuf_size);
+}
+
+/* Sets up a handle for a positional read. Returns nonzero on error. */
+static
+int sl_http_read_at_init_(sl_http_t *http, sl_http_read_at_t *req,
+                          void *buffer, size_t size, off_t offset)
+{
+    char range_str[128];
+
+    req->curl = curl_easy_init();
+    if (!req->curl) {
+        return 1;
+    }
+    req->buffer = buffer;
+    req->size = size;
+    req->off = 0;
+    req->skip = offset;
+    req->status_checked = 0;
+
+    snprintf(range_str, sizeof(range_str), "%jd-%jd", (intmax_t)offset,
+             (intmax_t)(offset + size - 1));
+    SL_HTTP_LOG("Requesting range '%s' for positional read.", range_str);
+
+    curl_easy_setopt(req->curl, CURLOPT_URL, http->uri);
+    curl_easy_setopt(req->curl, CURLOPT_RANGE, range_str);
+    curl_easy_setopt(req->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION,
+                     sl_http_read_at_write_cb_);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, req);
+    return 0;
+}
+
+size_t sl_http_read_at_cb(void *context, void *buffer, size_t size,
+                          off_t offset)
+{
+    /* Uses its own handle, so that it doesn't interfere with the transfer of
+     * sequential reads nor with other positional reads. */
+    sl_http_t *http = context;
+    sl_http_read_at_t req;
+    CURLcode ret;
+
+    if (size == 0 || offset < 0) {
+        return 0;
+    }
+    if (sl_http_read_at_init_(http, &req, buffer, size, offset) != 0) {
+        return 0;
+    }
+    /* Asynchronous reads may outlive the share, so only synchronous ones use
+     * it. */
+    curl_easy_setopt(req.curl, CURLOPT_SHARE, http->share->curlsh);
+
+    ret = curl_easy_perform(req.curl);
+    if (ret != CURLE_OK && ret != CURLE_WRITE_ERROR) {
+        SL_HTTP_LOG("Positional read failed: %s (%d)",
+                    curl_easy_strerror(ret), ret);
+    }
+    curl_easy_cleanup(req.curl);
+
+    return req.off;
+}
+
+static
+void* sl_http_aio_create_(sl_aio_t *aio)
+{
+    sl_http_aio_t *engine;
+
+    engine = malloc(sizeof(sl_http_aio_t));
+    if (!engine) {
+        return NULL;
+    }
+    engine->curlm = curl_multi_init();
+    if (!engine->curlm) {
+        free(engine);
+        return NULL;
+    }
+    if (pthread_mutex_init(&engine->lock, NULL) != 0) {
+        curl_multi_cleanup(engine->curlm);
+        free(engine);
+        return NULL;
+    }
+    curl_multi_setopt(engine->curlm, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                      (long)SL_HTTP_MULTI_CONNECTIONS);
+    engine->aio = aio;
+    engine->incoming = NULL;
+    engine->pending = 0;
+    return engine;
+}
+
+static
+int sl_http_aio_poll_(void *state, int timeout_ms)
+{
+    sl_http_aio_t *engine = state;
+    sl_http_aio_op_t *op;
+    sl_http_aio_op_t *next;
+    CURLMsg *msg;
+    int running;
+    int left;
+    int pending;
+
+    pthread_mutex_lock(&engine->lock);
+    op = engine->incoming;
+    engine->incoming = NULL;
+    pending = engine->pending;
+    pthread_mutex_unlock(&engine->lock);
+    if (pending == 0) {
+        return 0;
+    }
+    for (; op; op = next) {
+        next = op->next;
+        curl_multi_add_handle(engine->curlm, op->req.curl);
+    }
+
+    curl_multi_perform(engine->curlm, &running);
+    while ((msg = curl_multi_info_read(engine->curlm, &left))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&op);
+        if (msg->data.result != CURLE_OK
+                && msg->data.result != CURLE_WRITE_ERROR) {
+            SL_HTTP_LOG("Asynchronous positional read failed: %s (%d)",
+                        curl_easy_strerror(msg->data.result),
+                        msg->data.result);
+        }
+        curl_multi_remove_handle(engine->curlm, op->req.curl);
+        curl_easy_cleanup(op->req.curl);
+        sl_aio_complete(engine->aio, op->request, op->req.off);
+        free(op);
+
+        pthread_mutex_lock(&engine->lock);
+        engine->pending--;
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    pending = engine->pending;
+    pthread_mutex_unlock(&engine->lock);
+    if (pending > 0) {
+#ifdef SL_HTTP_AIO_WAKEUP
+        curl_multi_poll(engine->curlm, NULL, 0, timeout_ms, NULL);
+#else
+        /* Can't be woken up. Keep it short for new submissions. */
+        curl_multi_wait(engine->curlm, NULL, 0,
+                        (timeout_ms < 10 ? timeout_ms : 10), NULL);
+#endif
+    }
+    return pending;
+}
+
+static
+void sl_http_aio_wake_(void *state)
+{
+#ifdef SL_HTTP_AIO_WAKEUP
+    sl_http_aio_t *engine = state;
+    curl_multi_wakeup(engine->curlm);
+#endif
+}
+
+static
+void sl_http_aio_destroy_(void *state)
+{
+    sl_http_aio_t *engine = state;
+    pthread_mutex_destroy(&engine->lock);
+    curl_multi_cleanup(engine->curlm);
+    free(engine);
+}
+
+static const sl_aio_engine_t sl_http_aio_engine_ = {
+    sl_http_aio_create_, sl_http_aio_poll_, sl_http_aio_wake_,
+    sl_http_aio_destroy_
+};
+
+int sl_http_aio_submit_cb(void *context, sl_aio_t *aio,
+                          const sl_aio_request_t *request)
+{
+    /* Positional reads are performed on the multi handle of the completion
+     * queue. Reads and seeks share the transfer of the stream, so they are
+     * left to the thread pool. */
+    sl_http_t *http = context;
+    sl_http_aio_t *engine;
+    sl_http_aio_op_t *op;
+
+    if (request->op != SL_AIO_READ_AT) {
+        return 1;
+    }
+    if (request->size == 0 || request->offset < 0) {
+        sl_aio_complete(aio, request, 0);
+        return 0;
+    }
+    engine = sl_aio_engine(aio, &sl_http_aio_engine_);
+    if (!engine) {
+        return 1;
+    }
+    op = malloc(sizeof(sl_http_aio_op_t));
+    if (!op) {
+        return 1;
+    }
+    if (sl_http_read_at_init_(http, &op->req, request->buffer, request->size,
+                              request->offset) != 0) {
+        free(op);
+        return 1;
+    }
+    curl_easy_setopt(op->req.curl, CURLOPT_PRIVATE, op);
+    op->request = request;
+
+    pthread_mutex_lock(&engine->lock);
+    op->next = engine->incoming;
+    engine->incoming = op;
+    engine->pending++;
+    pthread_mutex_unlock(&engine->lock);
+
+    sl_aio_kick(aio, &sl_http_aio_engine_);
+    return 0;
+}
+
+static
+int sl_http_compare_extents_(const void *lhs, const void *rhs)
+{
+    const sl_extent_t *l = *(const sl_extent_t* const*)lhs;
+    const sl_extent_t *r = *(const sl_extent_t* const*)rhs;
+    /* Empty extents first, so that they can be skipped. */
+    if ((l->length == 0) != (r->length == 0)) {
+        return (l->length == 0 ? -1 : 1);
+    }
+    return (l->offset > r->offset) - (l->offset < r->offset);
+}
+
+static
+size_t sl_http_run_write_cb_(void *curlbuf, size_t ignore_this,
+                             size_t curlbuf_size, void *context)
+{
+    sl_http_run_t *run = context;
+    const char *data = curlbuf;
+    off_t chunk_end;
+    off_t from;
+    off_t to;
+    sl_extent_t *extent;
+    long status = 0;
+    int i;
+
+    if (!run->status_checked) {
+        curl_easy_getinfo(run->curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status == 206) {
+            run->pos = run->begin;
+        } else if (status == 200) {
+            /* Server ignored range. Whole content is coming. */
+            run->pos = 0;
+        } else {
+            return 0;
+        }
+        run->status_checked = 1;
+    }
+
+    /* Scatter the chunk into extents overlapping it. Extents are sorted by
+     * offset, but may overlap each other. */
+    chunk_end = run->pos + curlbuf_size;
+    for (i = run->first; i < run->count; i++) {
+        extent = run->extents[i];
+        if (extent->offset >= chunk_end) {
+            break;
+        }
+        from = (extent->offset > run->pos ? extent->offset : run->pos);
+        to = extent->offset + extent->length;
+        to = (to < chunk_end ? to : chunk_end);
+        if (from < to) {
+            memcpy((char*)extent->buffer + (from - extent->offset),
+                   data + (from - run->pos), to - from);
+            extent->read = to - extent->offset;
+        }
+    }
+    while (run->first < run->count
+            && run->extents[run->first]->offset
+                + (off_t)run->extents[run->first]->length <= chunk_end) {
+        run->first++;
+    }
+    run->pos = chunk_end;
+
+    /* Abort the rest of transfer once the range is done. */
+    return (run->pos >= run->end ? 0 : curlbuf_size);
+}
+
+int sl_http_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    /* Merges neighbouring extents into range requests, and performs them in
+     * parallel on their own handles. */
+    sl_http_t *http = context;
+    sl_extent_t **sorted = NULL;
+    sl_http_run_t *runs = NULL;
+    CURLM *curlm = NULL;
+    char range_str[128];
+    off_t end;
+    int run_count = 0;
+    int running = 1;
+    int incomplete = 0;
+    int i;
+
+    if (count <= 0) {
+        return 0;
+    }
+    sorted = malloc(sizeof(sl_extent_t*) * count);
+    runs = malloc(sizeof(sl_http_run_t) * count);
+    curlm = curl_multi_init();
+    if (!sorted || !runs || !curlm) {
+        incomplete = -1;
+        goto cleanup;
+    }
+    curl_multi_setopt(curlm, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                      (long)SL_HTTP_MULTI_CONNECTIONS);
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = 0;
+        sorted[i] = &extents[i];
+    }
+    qsort(sorted, count, sizeof(sl_extent_t*), sl_http_compare_extents_);
+
+    for (i = 0; i < count; i++) {
+        if (sorted[i]->length == 0) {
+            continue;
+        }
+        end = sorted[i]->offset + sorted[i]->length;
+        if (run_count > 0
+                && sorted[i]->offset - runs[run_count - 1].end
+                    <= SL_HTTP_MERGE_GAP) {
+            if (runs[run_count - 1].end < end) {
+                runs[run_count - 1].end = end;
+            }
+            runs[run_count - 1].count++;
+            continue;
+        }
+        runs[run_count].curl = NULL;
+        runs[run_count].extents = &sorted[i];
+        runs[run_count].count = 1;
+        runs[run_count].first = 0;
+        runs[run_count].begin = sorted[i]->offset;
+        runs[run_count].end = end;
+        runs[run_count].pos = 0;
+        runs[run_count].status_checked = 0;
+        run_count++;
+    }
+
+    for (i = 0; i < run_count; i++) {
+        runs[i].curl = curl_easy_init();
+        if (!runs[i].curl) {
+            incomplete = -1;
+            goto cleanup;
+        }
+        snprintf(range_str, sizeof(range_str), "%jd-%jd",
+                 (intmax_t)runs[i].begin, (intmax_t)(runs[i].end - 1));
+        SL_HTTP_LOG("Requesting range '%s' for %d extents.", range_str,
+                    runs[i].count);
+        curl_easy_setopt(runs[i].curl, CURLOPT_URL, http->uri);
+        curl_easy_setopt(runs[i].curl, CURLOPT_RANGE, range_str);
+        curl_easy_setopt(runs[i].curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(runs[i].curl, CURLOPT_WRITEFUNCTION,
+                         sl_http_run_write_cb_);
+        curl_easy_setopt(runs[i].curl, CURLOPT_WRITEDATA, &runs[i]);
+        curl_easy_setopt(runs[i].curl, CURLOPT_SHARE, http->share->curlsh);
+        curl_multi_add_handle(curlm, runs[i].curl);
+    }
+
+    while (running > 0) {
+        if (curl_multi_perform(curlm, &running) != CURLM_OK) {
+            break;
+        }
+        if (running > 0
+                && curl_multi_wait(curlm, NULL, 0, 100, NULL) != CURLM_OK) {
+            break;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+
+cleanup:
+    for (i = 0; runs && i < run_count; i++) {
+        if (runs[i].curl) {
+            curl_multi_remove_handle(curlm, runs[i].curl);
+            curl_easy_cleanup(runs[i].curl);
+        }
+    }
+    if (curlm) {
+        curl_multi_cleanup(curlm);
+    }
+    free(runs);
+    free(sorted);
+    return incomplete;
+}
+
 int sl_http_seek_cb(void *context, off_t offset, int whence)
 {
     /* TODO: Implement seek_cur and seek_end. */
     /* TODO: Offset/whence sanity check. */
     /* TODO: Check if stream supports seeking. */
-    char range_str[128];
-
     if (offset < 0 && whence == SL_SEEK_SET) {
         return -1;
     }
 
-    snprintf(range_str, sizeof(range_str), "%jd-", (intmax_t)offset);
-    SL_HTTP_LOG("Requesting range '%s'", range_str);
-
     sl_http_t *http = context;
     sl_cancel_transfer_(http);
-    curl_easy_setopt(http->curl, CURLOPT_RANGE, range_str);
-
-    http->http_off = offset;
-    http->curlbuf_off = 0;
-    curl_multi_remove_handle(http->curlm, http->curl);
-    curl_multi_add_handle(http->curlm, http->curl);
+    sl_http_drop_outbuf_(http);
+    sl_http_request_range_(http, offset);
 
     return 0;
 }
@@ -555,8 +1340,9 @@ int sl_http_eof_cb(void *context)
 
 int sl_http_error_cb(void *context)
 {
-    /* TODO: Implement error handling. */
-    return 0;
+    /* TODO: Implement error handling other than timeouts. */
+    sl_http_t *http = context;
+    return http->error;
 }
 
 off_t sl_http_length_cb(void *context)
@@ -565,6 +1351,94 @@ off_t sl_http_length_cb(void *context)
     return http->http_len;
 }
 
+int sl_http_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    sl_http_t *http = context;
+    int count;
+
+    switch (advice) {
+        case SL_ADVICE_NORMAL:
+        case SL_ADVICE_SEQUENTIAL:
+        case SL_ADVICE_RANDOM:
+            http->advice = advice;
+            /* Applies to the next request. Restart if none is going on. */
+            if (http->state == SL_HTTP_READY) {
+                sl_http_request_range_(http, http->http_off);
+            }
+            return 0;
+        case SL_ADVICE_WILLNEED:
+            http->willneed_off = offset;
+            http->willneed_end = (length > 0 ? offset + length : -1);
+            /* Prefetch by starting the request right away if the range is
+             * going to be read next. Data received is held until read. */
+            if (http->state == SL_HTTP_READY && offset == http->http_off) {
+                sl_http_drop_outbuf_(http);
+                sl_http_request_range_(http, offset);
+                if (curl_multi_perform(http->curlm, &count) == CURLM_OK
+                        && count && http->state == SL_HTTP_READY) {
+                    sl_http_set_state_(http, SL_HTTP_WORKING);
+                }
+            }
+            return 0;
+        case SL_ADVICE_DONTNEED:
+        case SL_ADVICE_NOREUSE:
+            /* Nothing is cached. */
+            return 0;
+    }
+    return -1;
+}
+
+streamlike_t* sl_http_clone_cb(void *context)
+{
+    sl_http_t *http = context;
+    sl_http_t *clone;
+    streamlike_t *stream;
+
+    stream = malloc(sizeof(streamlike_t));
+    if (!stream) {
+        return NULL;
+    }
+    sl_http_share_acquire_(http->share);
+    if (sl_http_open_(stream, http->uri, http->share) != 0) {
+        sl_http_share_release_(http->share);
+        free(stream);
+        return NULL;
+    }
+
+    /* What is known about the server so far holds for the clone too. */
+    clone = stream->context;
+    clone->http_len = http->http_len;
+    clone->http_range_allowed = http->http_range_allowed;
+    clone->read_timeout_ms = http->read_timeout_ms;
+    clone->latency_us = http->latency_us;
+    clone->read_bytes = http->read_bytes;
+    clone->read_us = http->read_us;
+    if (http->http_off != 0) {
+        sl_http_request_range_(clone, http->http_off);
+    }
+    return stream;
+}
+
+off_t sl_http_seek_cost_cb(void *context, off_t offset)
+{
+    sl_http_t *http = context;
+    off_t cost;
+
+    if (offset == http->http_off) {
+        return 0;
+    }
+    if (http->latency_us < 0 || http->read_us <= 0) {
+        return SL_HTTP_SEEK_COST;
+    }
+    /* Bytes which could be read while waiting for a new request. */
+    cost = http->latency_us * (http->read_bytes / http->read_us);
+    if (http->http_range_allowed == SL_HTTP_RANGE_NO) {
+        /* Server sends the stream from its beginning. */
+        cost += offset;
+    }
+    return cost;
+}
+
 sl_seekable_t sl_http_seekable_cb(void *context)
 {
     /* TODO: Send HEAD request if http_range_allowed is unknown. */
@@ -88,6 +88,20 @@ streamlike_t* sl_http_create(const char *uri);
  */
 int sl_http_destroy(streamlike_t *stream);
 
+/**
+ * Sets a deadline for each read on given stream.
+ *
+ * A read taking longer than timeout returns whatever is received so far, and
+ * sl_error() gives #SL_ERROR_TIMEDOUT until the next read. The transfer is
+ * resumed by the next read.
+ *
+ * \param stream     Stream to set timeout of.
+ * \param timeout_ms Timeout in milliseconds. Zero disables it.
+ *
+ * \return Zero on success. Nonzero if stream is not open.
+ */
+int sl_http_set_read_timeout(streamlike_t *stream, long timeout_ms);
+
 /** @} */ // Streamlike HTTP Functions
 
 /**
@@ -103,6 +117,70 @@ int sl_http_destroy(streamlike_t *stream);
  */
 size_t sl_http_read_cb(void *context, void *buffer, size_t len);
 
+/**
+ * Positional read callback.
+ *
+ * Each call makes a separate request for the range being read.
+ *
+ * \see sl_read_at_cb_t
+ */
+size_t sl_http_read_at_cb(void *context, void *buffer, size_t size,
+                          off_t offset);
+
+/**
+ * Batched read callback.
+ *
+ * Neighbouring extents are merged into one range request, and requests are
+ * made in parallel.
+ *
+ * \see sl_read_multi_cb_t
+ */
+int sl_http_read_multi_cb(void *context, sl_extent_t *extents, int count);
+
+/**
+ * Asynchronous request callback.
+ *
+ * Takes positional reads only. They are performed in parallel on a curl multi
+ * handle shared by all streams on the same completion queue.
+ *
+ * \see sl_aio_submit_cb_t
+ */
+int sl_http_aio_submit_cb(void *context, sl_aio_t *aio,
+                          const sl_aio_request_t *request);
+
+/**
+ * Advisory callback.
+ *
+ * While stream is advised to be read randomly, each seek requests a bounded
+ * range instead of the rest of the stream. A range advised to be needed is
+ * requested as a whole, and its request is started right away if it is going
+ * to be read next.
+ *
+ * \see sl_advise_cb_t
+ */
+int sl_http_advise_cb(void *context, off_t offset, off_t length, int advice);
+
+/**
+ * Clone callback.
+ *
+ * Clone reuses connections of the stream and knows length of the stream and
+ * whether the server takes range requests, if they are found out already. It
+ * is closed by sl_http_destroy().
+ *
+ * \see sl_clone_cb_t
+ */
+streamlike_t* sl_http_clone_cb(void *context);
+
+/**
+ * Seek cost callback.
+ *
+ * Cost is estimated from latency of earlier requests and throughput of earlier
+ * reads. A fixed guess is given until both are measured.
+ *
+ * \see sl_seek_cost_cb_t
+ */
+off_t sl_http_seek_cost_cb(void *context, off_t offset);
+
 /**
  * Seek callback.
  *
@@ -14,6 +14,11 @@ class StreamlikeHttp : public Streamlike {
         StreamlikeHttp(StreamlikeHttp&&) = default;
         StreamlikeHttp& operator=(StreamlikeHttp&&) = default;
         ~StreamlikeHttp();
+
+        StreamlikeHttp clone() const;
+
+    private:
+        explicit StreamlikeHttp(self_type self);
 };
 
 } // namespace streamlike
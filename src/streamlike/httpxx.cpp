@@ -16,10 +16,21 @@ StreamlikeHttp::StreamlikeHttp(const char *url)
 StreamlikeHttp::StreamlikeHttp(const std::string& url)
     : StreamlikeHttp(url.c_str()) {}
 
+StreamlikeHttp::StreamlikeHttp(self_type self)
+        : Streamlike(self) {
+    if (!self) {
+        throw std::runtime_error("Couldn't clone http stream");
+    }
+}
+
 StreamlikeHttp::~StreamlikeHttp() {
     if (self) {
         sl_http_destroy(self);
     }
 }
 
+StreamlikeHttp StreamlikeHttp::clone() const {
+    return StreamlikeHttp(sl_clone(self));
+}
+
 } // namespace streamlike
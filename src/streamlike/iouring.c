@@ -0,0 +1,627 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* O_DIRECT */
+#endif
+#ifdef SL_DEBUG
+#include "debug.h"
+#endif
+
+#ifndef SL_IOURING_ASSERT
+# ifdef SL_ASSERT
+#  define SL_IOURING_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_IOURING_ASSERT(...) ((void)0)
+# endif
+#endif
+#include "iouring.h"
+#include "util/holes.h"
+#include "util/uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/* Most milliseconds to block at once while waiting for a block. */
+#define SL_IOURING_WAIT_MS (1000)
+
+typedef enum sl_iouring_state_e
+{
+    SL_IOURING_PENDING,
+    SL_IOURING_DONE,
+    SL_IOURING_FAILED
+} sl_iouring_state_t;
+
+typedef struct sl_iouring_slot_s
+{
+    char *buffer;
+    off_t offset;
+    /* Bytes read so far. Less than block size only at end-of-file. */
+    size_t len;
+    sl_iouring_state_t state;
+} sl_iouring_slot_t;
+
+typedef struct sl_iouring_s
+{
+    uring_t *ring;
+    int fd;
+    /* Descriptor for positional reads, reopened without O_DIRECT if needed. */
+    int pread_fd;
+    int flags;
+    int fixed_file;
+    int fixed_buffers;
+    unsigned depth;
+    size_t block_size;
+    char *blocks;
+    /* Slots hold consecutive blocks from head_off, starting at head. */
+    sl_iouring_slot_t *slots;
+    unsigned head;
+    off_t head_off;
+    int started;
+    unsigned pending;
+    off_t length;
+    off_t pos;
+    int eof;
+    int error;
+} sl_iouring_t;
+
+streamlike_t* sl_iouring_open(const char *path, int flags)
+{
+    streamlike_t *stream;
+    int fd;
+
+    SL_IOURING_ASSERT(path != NULL);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC
+                    | (flags & SL_IOURING_DIRECT ? O_DIRECT : 0));
+    if (fd < 0) {
+        return NULL;
+    }
+    stream = sl_iouring_open2(fd, SL_IOURING_DEFAULT_DEPTH,
+                              SL_IOURING_DEFAULT_BLOCK_SIZE, flags);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+static
+size_t sl_iouring_pread_(int fd, void *buffer, size_t size, off_t offset,
+                         int *error)
+{
+    size_t total = 0;
+    ssize_t ret;
+
+    while (total < size) {
+        ret = pread(fd, (char*)buffer + total, size - total, offset + total);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            *error = 1;
+            break;
+        }
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+/* Submits the rest of the block in slot idx. Reads synchronously if it can't
+ * be queued, in which case no completion follows. Block may be unaligned then,
+ * so it is read without O_DIRECT. */
+static
+void sl_iouring_submit_(sl_iouring_t *file, unsigned idx)
+{
+    sl_iouring_slot_t *slot = &file->slots[idx];
+    size_t left = file->block_size - slot->len;
+    int error = 0;
+
+    if (slot->offset + (off_t)slot->len >= file->length) {
+        slot->state = SL_IOURING_DONE;
+        return;
+    }
+    if (uring_submit_read2(file->ring, (file->fixed_file ? 0 : file->fd),
+                           slot->buffer + slot->len, left,
+                           slot->offset + slot->len,
+                           (file->fixed_buffers ? (int)idx : -1),
+                           (file->fixed_file ? URING_FIXED_FILE : 0),
+                           idx) == 0) {
+        slot->state = SL_IOURING_PENDING;
+        file->pending++;
+        return;
+    }
+    slot->len += sl_iouring_pread_(file->pread_fd, slot->buffer + slot->len,
+                                   left,
+                                   slot->offset + slot->len, &error);
+    slot->state = (error ? SL_IOURING_FAILED : SL_IOURING_DONE);
+}
+
+static
+void sl_iouring_load_(sl_iouring_t *file, unsigned idx, off_t offset)
+{
+    file->slots[idx].offset = offset;
+    file->slots[idx].len = 0;
+    sl_iouring_submit_(file, idx);
+}
+
+static
+void sl_iouring_reap_(sl_iouring_t *file)
+{
+    sl_iouring_slot_t *slot;
+    uint64_t user_data;
+    int res;
+
+    while (uring_reap(file->ring, &user_data, &res)) {
+        slot = &file->slots[user_data];
+        file->pending--;
+        if (res == -EINTR || res == -EAGAIN) {
+            sl_iouring_submit_(file, user_data);
+        } else if (res < 0) {
+            slot->state = SL_IOURING_FAILED;
+        } else {
+            slot->len += res;
+            /* Short reads before end-of-file go on. */
+            if (res > 0 && slot->len < file->block_size) {
+                sl_iouring_submit_(file, user_data);
+            } else {
+                slot->state = SL_IOURING_DONE;
+            }
+        }
+    }
+}
+
+static
+sl_iouring_state_t sl_iouring_wait_(sl_iouring_t *file, unsigned idx)
+{
+    sl_iouring_reap_(file);
+    while (file->slots[idx].state == SL_IOURING_PENDING) {
+        if (uring_wait(file->ring, SL_IOURING_WAIT_MS) != 0) {
+            return SL_IOURING_FAILED;
+        }
+        sl_iouring_reap_(file);
+    }
+    return file->slots[idx].state;
+}
+
+/* Waits for all reads, so that their buffers can be reused. */
+static
+int sl_iouring_drain_(sl_iouring_t *file)
+{
+    sl_iouring_reap_(file);
+    while (file->pending > 0) {
+        if (uring_wait(file->ring, SL_IOURING_WAIT_MS) != 0) {
+            return -1;
+        }
+        sl_iouring_reap_(file);
+    }
+    return 0;
+}
+
+/* Brings the block holding current offset to head, recycling blocks behind it
+ * for reads further ahead, or starting over if it isn't among them. */
+static
+int sl_iouring_position_(sl_iouring_t *file)
+{
+    off_t block_off = file->pos - file->pos % file->block_size;
+    off_t end = file->head_off + (off_t)(file->depth * file->block_size);
+    unsigned i;
+
+    if (!file->started || block_off < file->head_off || block_off >= end) {
+        if (sl_iouring_drain_(file) != 0) {
+            return -1;
+        }
+        file->started = 1;
+        file->head = 0;
+        file->head_off = block_off;
+        for (i = 0; i < file->depth; i++) {
+            sl_iouring_load_(file, i, block_off + i * file->block_size);
+        }
+        return 0;
+    }
+    while (file->head_off < block_off) {
+        sl_iouring_wait_(file, file->head);
+        if (file->slots[file->head].state == SL_IOURING_PENDING) {
+            return -1;
+        }
+        sl_iouring_load_(file, file->head,
+                         file->head_off + file->depth * file->block_size);
+        file->head = (file->head + 1) % file->depth;
+        file->head_off += file->block_size;
+    }
+    return 0;
+}
+
+/* Gives the head block holding current offset. NULL at end-of-file, or on an
+ * error. */
+static
+sl_iouring_slot_t* sl_iouring_current_(sl_iouring_t *file)
+{
+    sl_iouring_slot_t *slot;
+
+    if (file->pos >= file->length) {
+        file->eof = 1;
+        return NULL;
+    }
+    if (sl_iouring_position_(file) != 0
+            || sl_iouring_wait_(file, file->head) != SL_IOURING_DONE) {
+        file->error = 1;
+        return NULL;
+    }
+    slot = &file->slots[file->head];
+    if (file->pos >= slot->offset + (off_t)slot->len) {
+        /* File was truncated. */
+        file->eof = 1;
+        return NULL;
+    }
+    return slot;
+}
+
+streamlike_t* sl_iouring_open2(int fd, unsigned depth, size_t block_size,
+                               int flags)
+{
+    streamlike_t *stream = NULL;
+    sl_iouring_t *file = NULL;
+    struct iovec *iov = NULL;
+    struct stat s;
+    char path[64];
+    int fd_flags;
+    unsigned i;
+
+    SL_IOURING_ASSERT(fd >= 0);
+
+    fd_flags = fcntl(fd, F_GETFL);
+    if (fd_flags < 0 || fstat(fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+        return NULL;
+    }
+    depth = (depth > 0 ? depth : SL_IOURING_DEFAULT_DEPTH);
+    block_size = (block_size > 0 ? block_size : SL_IOURING_DEFAULT_BLOCK_SIZE);
+    block_size = (block_size + SL_IOURING_ALIGNMENT - 1)
+                 / SL_IOURING_ALIGNMENT * SL_IOURING_ALIGNMENT;
+
+    file = malloc(sizeof(sl_iouring_t));
+    if (!file) {
+        return NULL;
+    }
+    file->fd       = fd;
+    file->pread_fd = fd;
+    file->ring     = NULL;
+    file->blocks   = NULL;
+    file->slots    = malloc(depth * sizeof(sl_iouring_slot_t));
+    if (!file->slots) {
+        goto fail;
+    }
+    if (fd_flags & O_DIRECT) {
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+        file->pread_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (file->pread_fd < 0) {
+            goto fail;
+        }
+    }
+    file->ring = uring_init(depth);
+    if (!file->ring) {
+        goto fail;
+    }
+    if (posix_memalign((void**)&file->blocks, SL_IOURING_ALIGNMENT,
+                       depth * block_size) != 0) {
+        file->blocks = NULL;
+        goto fail;
+    }
+    iov = malloc(depth * sizeof(struct iovec));
+    if (!iov) {
+        goto fail;
+    }
+    for (i = 0; i < depth; i++) {
+        file->slots[i].buffer = file->blocks + i * block_size;
+        file->slots[i].offset = 0;
+        file->slots[i].len    = 0;
+        file->slots[i].state  = SL_IOURING_DONE;
+        iov[i].iov_base = file->slots[i].buffer;
+        iov[i].iov_len  = block_size;
+    }
+    /* Both are optional. Buffers may exceed locked memory limit. */
+    file->fixed_buffers = (uring_register_buffers(file->ring, iov, depth) == 0);
+    file->fixed_file    = ((flags & SL_IOURING_FIXED_FILE)
+                           && uring_register_files(file->ring, &fd, 1) == 0);
+    free(iov);
+
+    file->flags      = flags;
+    file->depth      = depth;
+    file->block_size = block_size;
+    file->head       = 0;
+    file->head_off   = 0;
+    file->started    = 0;
+    file->pending    = 0;
+    file->length     = s.st_size;
+    file->pos        = lseek(fd, 0, SEEK_CUR);
+    file->pos        = (file->pos > 0 ? file->pos : 0);
+    file->eof        = 0;
+    file->error      = 0;
+
+    stream = malloc(sizeof(streamlike_t));
+    if (!stream) {
+        goto fail;
+    }
+
+    stream->context = file;
+    stream->read    = sl_iouring_read_cb;
+    stream->input   = sl_iouring_input_cb;
+    stream->write   = NULL;
+    stream->flush   = NULL;
+    stream->seek    = sl_iouring_seek_cb;
+    stream->tell    = sl_iouring_tell_cb;
+    stream->eof     = sl_iouring_eof_cb;
+    stream->error   = sl_iouring_error_cb;
+    stream->length  = sl_iouring_length_cb;
+
+    stream->seekable     = sl_iouring_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = sl_iouring_read_at_cb;
+
+    stream->readv  = sl_iouring_readv_cb;
+    stream->writev = NULL;
+
+    stream->read_multi = sl_iouring_read_multi_cb;
+
+    stream->aio_submit = NULL;
+
+    stream->advise    = sl_iouring_advise_cb;
+    stream->seek_cost = sl_iouring_seek_cost_cb;
+
+    stream->clone = sl_iouring_clone_cb;
+
+    stream->data_map = sl_iouring_data_map_cb;
+
+    /* Queued reads and writes would race kernel transfers. */
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY | SL_CAP_CHEAP_SEEK;
+
+    return stream;
+
+fail:
+    if (file->ring) {
+        uring_destroy(file->ring);
+    }
+    if (file->pread_fd != fd && file->pread_fd >= 0) {
+        close(file->pread_fd);
+    }
+    free(file->blocks);
+    free(file->slots);
+    free(file);
+    return NULL;
+}
+
+int sl_iouring_close(streamlike_t *stream)
+{
+    int fd;
+
+    SL_IOURING_ASSERT(stream != NULL);
+    SL_IOURING_ASSERT(stream->context != NULL);
+
+    fd = ((sl_iouring_t*)stream->context)->fd;
+    sl_iouring_close2(stream);
+    return (close(fd) < 0 ? -1 : 0);
+}
+
+int sl_iouring_close2(streamlike_t *stream)
+{
+    sl_iouring_t *file;
+
+    SL_IOURING_ASSERT(stream != NULL);
+    file = stream->context;
+    /* Kernel may still be writing into blocks otherwise. */
+    sl_iouring_drain_(file);
+    uring_destroy(file->ring);
+    if (file->pread_fd != file->fd) {
+        close(file->pread_fd);
+    }
+    free(file->blocks);
+    free(file->slots);
+    free(file);
+    free(stream);
+    return 0;
+}
+
+size_t sl_iouring_read_cb(void *context, void *buffer, size_t size)
+{
+    sl_iouring_t *file = context;
+    sl_iouring_slot_t *slot;
+    size_t read = 0;
+    size_t part;
+
+    while (read < size && (slot = sl_iouring_current_(file))) {
+        part = slot->offset + slot->len - file->pos;
+        part = (part < size - read ? part : size - read);
+        memcpy((char*)buffer + read, slot->buffer + (file->pos - slot->offset),
+               part);
+        file->pos += part;
+        read += part;
+    }
+    return read;
+}
+
+size_t sl_iouring_input_cb(void *context, const void **buffer, size_t size)
+{
+    sl_iouring_t *file = context;
+    sl_iouring_slot_t *slot;
+    size_t part;
+
+    if (size == 0 || !(slot = sl_iouring_current_(file))) {
+        return 0;
+    }
+    part = slot->offset + slot->len - file->pos;
+    part = (part < size ? part : size);
+    *buffer = slot->buffer + (file->pos - slot->offset);
+    file->pos += part;
+    return part;
+}
+
+size_t sl_iouring_read_at_cb(void *context, void *buffer, size_t size,
+                             off_t offset)
+{
+    sl_iouring_t *file = context;
+    int error = 0;
+
+    return sl_iouring_pread_(file->pread_fd, buffer, size, offset, &error);
+}
+
+int sl_iouring_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = sl_iouring_read_at_cb(context, extents[i].buffer,
+                                                extents[i].length,
+                                                extents[i].offset);
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+size_t sl_iouring_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        read = sl_iouring_read_cb(context, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int sl_iouring_seek_cb(void *context, off_t offset, int whence)
+{
+    sl_iouring_t *file = context;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += file->pos;
+            break;
+        case SL_SEEK_END:
+            offset += file->length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    file->pos = offset;
+    file->eof = 0;
+    return 0;
+}
+
+off_t sl_iouring_tell_cb(void *context)
+{
+    return ((sl_iouring_t*)context)->pos;
+}
+
+int sl_iouring_eof_cb(void *context)
+{
+    return ((sl_iouring_t*)context)->eof;
+}
+
+int sl_iouring_error_cb(void *context)
+{
+    return ((sl_iouring_t*)context)->error;
+}
+
+off_t sl_iouring_length_cb(void *context)
+{
+    return ((sl_iouring_t*)context)->length;
+}
+
+int sl_iouring_advise_cb(void *context, off_t offset, off_t length,
+                         int advice)
+{
+    int fd = ((sl_iouring_t*)context)->pread_fd;
+
+    switch (advice) {
+        case SL_ADVICE_NORMAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NORMAL);
+        case SL_ADVICE_SEQUENTIAL:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+        case SL_ADVICE_RANDOM:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_RANDOM);
+        case SL_ADVICE_WILLNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+        case SL_ADVICE_DONTNEED:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        case SL_ADVICE_NOREUSE:
+            return posix_fadvise(fd, offset, length, POSIX_FADV_NOREUSE);
+    }
+    return -1;
+}
+
+int sl_iouring_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max)
+{
+    return holes_data_map(((sl_iouring_t*)context)->fd, offset, length, ranges, max);
+}
+
+off_t sl_iouring_seek_cost_cb(void *context, off_t offset)
+{
+    /* Free among blocks read ahead. Elsewhere the next read waits for a block
+     * without any read ahead. */
+    sl_iouring_t *file = context;
+
+    if (file->started && offset >= file->head_off
+            && offset < file->head_off
+                        + (off_t)(file->depth * file->block_size)) {
+        return 0;
+    }
+    return file->block_size;
+}
+
+streamlike_t* sl_iouring_clone_cb(void *context)
+{
+    sl_iouring_t *file = context;
+    streamlike_t *clone;
+    char path[64];
+    int clone_fd;
+    int flags;
+
+    flags = fcntl(file->fd, F_GETFL);
+    if (flags < 0) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", file->fd);
+    clone_fd = open(path, (flags & (O_ACCMODE | O_DIRECT)) | O_CLOEXEC);
+    if (clone_fd < 0) {
+        return NULL;
+    }
+    clone = sl_iouring_open2(clone_fd, file->depth, file->block_size,
+                             file->flags);
+    if (!clone) {
+        close(clone_fd);
+        return NULL;
+    }
+    ((sl_iouring_t*)clone->context)->pos = file->pos;
+    return clone;
+}
+
+sl_seekable_t sl_iouring_seekable_cb(void *context)
+{
+    return SL_SEEKING_SUPPORTED;
+}
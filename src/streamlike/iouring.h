@@ -0,0 +1,55 @@
+#ifndef STREAMLIKE_IOURING_H
+#define STREAMLIKE_IOURING_H
+
+#include "../streamlike.h"
+
+#define SL_IOURING_DEFAULT_DEPTH      (8)
+#define SL_IOURING_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define SL_IOURING_ALIGNMENT          (4096)
+
+/* Open with O_DIRECT, bypassing page cache. */
+#define SL_IOURING_DIRECT     (1 << 0)
+/* Register the descriptor with io_uring, saving a lookup per read. */
+#define SL_IOURING_FIXED_FILE (1 << 1)
+
+/* Read-only Linux file stream keeping depth reads of block_size bytes in
+ * flight on io_uring ahead of current offset. Blocks are aligned, registered
+ * with io_uring where memory locking limits allow, and sl_input() points into
+ * them. Descriptors opened with O_DIRECT are read directly, in which case
+ * block_size should be a multiple of the logical block size of the device.
+ * Length is read when opened, so data appended later isn't seen. Opening fails
+ * if io_uring isn't available. */
+streamlike_t* sl_iouring_open(const char *path, int flags);
+streamlike_t* sl_iouring_open2(int fd, unsigned depth, size_t block_size,
+                               int flags);
+/* Closes the descriptor, while sl_iouring_close2() leaves it open. */
+int sl_iouring_close(streamlike_t *stream);
+int sl_iouring_close2(streamlike_t *stream);
+
+size_t sl_iouring_read_cb(void *context, void *buffer, size_t size);
+/* Points into a block, which stays valid until the next read or input. */
+size_t sl_iouring_input_cb(void *context, const void **buffer, size_t size);
+/* Synchronous and thread-safe, using a descriptor reopened without O_DIRECT
+ * if needed, so that there are no alignment requirements. */
+size_t sl_iouring_read_at_cb(void *context, void *buffer, size_t size,
+                             off_t offset);
+int sl_iouring_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_iouring_readv_cb(void *context, const struct iovec *iov,
+                           int iovcnt);
+/* Lazy. Blocks in flight are kept if the next read falls among them. */
+int sl_iouring_seek_cb(void *context, off_t offset, int whence);
+off_t sl_iouring_tell_cb(void *context);
+int sl_iouring_eof_cb(void *context);
+int sl_iouring_error_cb(void *context);
+off_t sl_iouring_length_cb(void *context);
+int sl_iouring_advise_cb(void *context, off_t offset, off_t length,
+                         int advice);
+off_t sl_iouring_seek_cost_cb(void *context, off_t offset);
+/* Maps the file as it is now, since the stream never writes to it. */
+int sl_iouring_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max);
+/* Clone reopens the file, and is closed by sl_iouring_close(). */
+streamlike_t* sl_iouring_clone_cb(void *context);
+sl_seekable_t sl_iouring_seekable_cb(void *context);
+
+#endif /* STREAMLIKE_IOURING_H */
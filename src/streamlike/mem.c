@@ -0,0 +1,565 @@
+#ifdef SL_DEBUG
+#include "debug.h"
+#endif
+
+#ifndef SL_MEM_ASSERT
+# ifdef SL_ASSERT
+#  define SL_MEM_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_MEM_ASSERT(...) ((void)0)
+# endif
+#endif
+#include "mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Chunks are laid out back to back, and only the last one may have room
+ * left. */
+typedef struct sl_mem_chunk_s
+{
+    char *data;
+    /* Offset of the chunk in the stream. */
+    off_t off;
+    size_t len;
+    size_t size;
+} sl_mem_chunk_t;
+
+typedef struct sl_mem_s
+{
+    sl_mem_chunk_t *chunks;
+    int count;
+    int capacity;
+    /* Whether chunks belong to the stream, i.e. it is written. */
+    int owned;
+    size_t chunk_size;
+    off_t length;
+    off_t pos;
+    /* Chunk holding offset of the last access, as the next one is likely in
+     * it or after it. */
+    int cur;
+    int eof;
+    int error;
+} sl_mem_t;
+
+static
+streamlike_t* sl_mem_new_(sl_mem_t *mem)
+{
+    streamlike_t *stream;
+
+    stream = malloc(sizeof(streamlike_t));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->context = mem;
+    stream->read    = sl_mem_read_cb;
+    stream->input   = sl_mem_input_cb;
+    stream->write   = (mem->owned ? sl_mem_write_cb : NULL);
+    stream->flush   = (mem->owned ? sl_mem_flush_cb : NULL);
+    stream->seek    = sl_mem_seek_cb;
+    stream->tell    = sl_mem_tell_cb;
+    stream->eof     = sl_mem_eof_cb;
+    stream->error   = sl_mem_error_cb;
+    stream->length  = sl_mem_length_cb;
+
+    stream->seekable     = sl_mem_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = sl_mem_read_at_cb;
+
+    stream->readv  = sl_mem_readv_cb;
+    stream->writev = (mem->owned ? sl_mem_writev_cb : NULL);
+
+    stream->read_multi = sl_mem_read_multi_cb;
+
+    stream->aio_submit = NULL;
+
+    stream->advise    = NULL;
+    stream->seek_cost = sl_mem_seek_cost_cb;
+
+    /* Written chunks can't be shared. */
+    stream->clone = (mem->owned ? NULL : sl_mem_clone_cb);
+
+    stream->data_map = NULL;
+
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY | SL_CAP_CHEAP_SEEK;
+
+    return stream;
+}
+
+streamlike_t* sl_mem_open(const void *data, size_t size)
+{
+    streamlike_t *stream;
+    sl_mem_t *mem;
+
+    SL_MEM_ASSERT(data != NULL || size == 0);
+
+    mem = malloc(sizeof(sl_mem_t));
+    if (!mem) {
+        return NULL;
+    }
+    mem->chunks = malloc(sizeof(sl_mem_chunk_t));
+    if (!mem->chunks) {
+        free(mem);
+        return NULL;
+    }
+
+    mem->chunks[0].data = (char*)data;
+    mem->chunks[0].off  = 0;
+    mem->chunks[0].len  = size;
+    mem->chunks[0].size = size;
+    mem->count      = (size ? 1 : 0);
+    mem->capacity   = 1;
+    mem->owned      = 0;
+    mem->chunk_size = 0;
+    mem->length     = size;
+    mem->pos        = 0;
+    mem->cur        = 0;
+    mem->eof        = 0;
+    mem->error      = 0;
+
+    stream = sl_mem_new_(mem);
+    if (!stream) {
+        free(mem->chunks);
+        free(mem);
+    }
+    return stream;
+}
+
+streamlike_t* sl_mem_create(void)
+{
+    return sl_mem_create2(SL_MEM_DEFAULT_CHUNK_SIZE);
+}
+
+streamlike_t* sl_mem_create2(size_t chunk_size)
+{
+    streamlike_t *stream;
+    sl_mem_t *mem;
+
+    SL_MEM_ASSERT(chunk_size > 0);
+
+    mem = malloc(sizeof(sl_mem_t));
+    if (!mem) {
+        return NULL;
+    }
+
+    mem->chunks     = NULL;
+    mem->count      = 0;
+    mem->capacity   = 0;
+    mem->owned      = 1;
+    mem->chunk_size = chunk_size;
+    mem->length     = 0;
+    mem->pos        = 0;
+    mem->cur        = 0;
+    mem->eof        = 0;
+    mem->error      = 0;
+
+    stream = sl_mem_new_(mem);
+    if (!stream) {
+        free(mem);
+    }
+    return stream;
+}
+
+int sl_mem_close(streamlike_t *stream)
+{
+    sl_mem_t *mem;
+    int i;
+
+    SL_MEM_ASSERT(stream != NULL);
+    SL_MEM_ASSERT(stream->context != NULL);
+
+    mem = stream->context;
+    if (mem->owned) {
+        for (i = 0; i < mem->count; i++) {
+            free(mem->chunks[i].data);
+        }
+    }
+    free(mem->chunks);
+    free(mem);
+    free(stream);
+    return 0;
+}
+
+int sl_mem_iov(const streamlike_t *stream, struct iovec *iov, int max)
+{
+    sl_mem_t *mem;
+    int i;
+
+    SL_MEM_ASSERT(stream != NULL);
+    SL_MEM_ASSERT(stream->context != NULL);
+    SL_MEM_ASSERT(iov != NULL || max == 0);
+
+    mem = stream->context;
+    for (i = 0; i < mem->count && i < max; i++) {
+        iov[i].iov_base = mem->chunks[i].data;
+        iov[i].iov_len  = mem->chunks[i].len;
+    }
+    return mem->count;
+}
+
+const void* sl_mem_contiguous(streamlike_t *stream, size_t *size)
+{
+    static const char empty;
+    sl_mem_t *mem;
+    char *data;
+    int i;
+
+    SL_MEM_ASSERT(stream != NULL);
+    SL_MEM_ASSERT(stream->context != NULL);
+    SL_MEM_ASSERT(size != NULL);
+
+    mem = stream->context;
+    *size = mem->length;
+    if (mem->count == 0) {
+        return &empty;
+    }
+    if (mem->count == 1) {
+        return mem->chunks[0].data;
+    }
+    data = malloc(mem->length);
+    if (!data) {
+        return NULL;
+    }
+    for (i = 0; i < mem->count; i++) {
+        memcpy(data + mem->chunks[i].off, mem->chunks[i].data,
+               mem->chunks[i].len);
+        free(mem->chunks[i].data);
+    }
+    /* Full, so that writes append new chunks after it. */
+    mem->chunks[0].data = data;
+    mem->chunks[0].off  = 0;
+    mem->chunks[0].len  = mem->length;
+    mem->chunks[0].size = mem->length;
+    mem->count = 1;
+    mem->cur = 0;
+    return data;
+}
+
+/* Finds chunk holding offset, which should be before end. Tries the hint and
+ * the chunk after it before searching. */
+static
+int sl_mem_find_(const sl_mem_t *mem, off_t offset, int hint)
+{
+    const sl_mem_chunk_t *chunks = mem->chunks;
+    int low = 0;
+    int high = mem->count - 1;
+    int mid;
+
+    SL_MEM_ASSERT(offset < mem->length);
+    if (hint < mem->count && offset >= chunks[hint].off) {
+        if (offset < chunks[hint].off + (off_t)chunks[hint].len) {
+            return hint;
+        }
+        if (hint + 1 < mem->count
+                && offset < chunks[hint + 1].off
+                            + (off_t)chunks[hint + 1].len) {
+            return hint + 1;
+        }
+        low = hint + 1;
+    }
+    while (low < high) {
+        mid = low + (high - low + 1) / 2;
+        if (chunks[mid].off <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+/* Copies from offset, updating the hint. */
+static
+size_t sl_mem_copy_(const sl_mem_t *mem, void *buffer, size_t size,
+                    off_t offset, int *hint)
+{
+    const sl_mem_chunk_t *chunk;
+    size_t copied = 0;
+    size_t part;
+
+    while (copied < size && offset < mem->length) {
+        *hint = sl_mem_find_(mem, offset, *hint);
+        chunk = &mem->chunks[*hint];
+        part = chunk->off + chunk->len - offset;
+        part = (part < size - copied ? part : size - copied);
+        memcpy((char*)buffer + copied, chunk->data + (offset - chunk->off),
+               part);
+        offset += part;
+        copied += part;
+    }
+    return copied;
+}
+
+/* Adds a chunk at the end, growing with the stream. Only the list of chunks
+ * is reallocated, never their data. */
+static
+int sl_mem_grow_(sl_mem_t *mem)
+{
+    sl_mem_chunk_t *chunks;
+    size_t size = mem->chunk_size;
+    char *data;
+    int capacity;
+
+    if (mem->count == mem->capacity) {
+        capacity = (mem->capacity ? 2 * mem->capacity : 8);
+        chunks = realloc(mem->chunks, capacity * sizeof(sl_mem_chunk_t));
+        if (!chunks) {
+            return -1;
+        }
+        mem->chunks = chunks;
+        mem->capacity = capacity;
+    }
+    if (mem->length > (off_t)size && size < SL_MEM_MAX_CHUNK_SIZE) {
+        size = (mem->length < SL_MEM_MAX_CHUNK_SIZE ? (size_t)mem->length
+                                                    : SL_MEM_MAX_CHUNK_SIZE);
+    }
+    data = malloc(size);
+    if (!data) {
+        return -1;
+    }
+    mem->chunks[mem->count].data = data;
+    mem->chunks[mem->count].off  = mem->length;
+    mem->chunks[mem->count].len  = 0;
+    mem->chunks[mem->count].size = size;
+    mem->count++;
+    return 0;
+}
+
+/* Appends data, or zeros if data is NULL. */
+static
+size_t sl_mem_append_(sl_mem_t *mem, const char *data, size_t size)
+{
+    sl_mem_chunk_t *last;
+    size_t appended = 0;
+    size_t part;
+
+    while (appended < size) {
+        last = (mem->count ? &mem->chunks[mem->count - 1] : NULL);
+        if (!last || last->len == last->size) {
+            if (sl_mem_grow_(mem) != 0) {
+                mem->error = 1;
+                break;
+            }
+            continue;
+        }
+        part = last->size - last->len;
+        part = (part < size - appended ? part : size - appended);
+        if (data) {
+            memcpy(last->data + last->len, data + appended, part);
+        } else {
+            memset(last->data + last->len, 0, part);
+        }
+        last->len += part;
+        mem->length += part;
+        appended += part;
+    }
+    return appended;
+}
+
+size_t sl_mem_read_cb(void *context, void *buffer, size_t size)
+{
+    sl_mem_t *mem = context;
+    size_t read;
+
+    read = sl_mem_copy_(mem, buffer, size, mem->pos, &mem->cur);
+    mem->pos += read;
+    if (read < size) {
+        mem->eof = 1;
+    }
+    return read;
+}
+
+size_t sl_mem_input_cb(void *context, const void **buffer, size_t size)
+{
+    sl_mem_t *mem = context;
+    const sl_mem_chunk_t *chunk;
+    size_t part;
+
+    if (size == 0) {
+        return 0;
+    }
+    if (mem->pos >= mem->length) {
+        mem->eof = 1;
+        return 0;
+    }
+    mem->cur = sl_mem_find_(mem, mem->pos, mem->cur);
+    chunk = &mem->chunks[mem->cur];
+    part = chunk->off + chunk->len - mem->pos;
+    part = (part < size ? part : size);
+    *buffer = chunk->data + (mem->pos - chunk->off);
+    mem->pos += part;
+    return part;
+}
+
+size_t sl_mem_read_at_cb(void *context, void *buffer, size_t size,
+                         off_t offset)
+{
+    int hint = 0;
+
+    if (offset < 0) {
+        return 0;
+    }
+    return sl_mem_copy_(context, buffer, size, offset, &hint);
+}
+
+int sl_mem_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int hint = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = (extents[i].offset < 0 ? 0 :
+                           sl_mem_copy_(context, extents[i].buffer,
+                                        extents[i].length, extents[i].offset,
+                                        &hint));
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+size_t sl_mem_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        read = sl_mem_read_cb(context, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+size_t sl_mem_write_cb(void *context, const void *buffer, size_t size)
+{
+    sl_mem_t *mem = context;
+    sl_mem_chunk_t *chunk;
+    size_t written = 0;
+    size_t part;
+
+    if (mem->pos > mem->length
+            && sl_mem_append_(mem, NULL, mem->pos - mem->length)
+                < (size_t)(mem->pos - mem->length)) {
+        return 0;
+    }
+    /* Overwrite, then append the rest. */
+    while (written < size && mem->pos < mem->length) {
+        mem->cur = sl_mem_find_(mem, mem->pos, mem->cur);
+        chunk = &mem->chunks[mem->cur];
+        part = chunk->off + chunk->len - mem->pos;
+        part = (part < size - written ? part : size - written);
+        memcpy(chunk->data + (mem->pos - chunk->off),
+               (const char*)buffer + written, part);
+        mem->pos += part;
+        written += part;
+    }
+    if (written < size) {
+        part = sl_mem_append_(mem, (const char*)buffer + written,
+                              size - written);
+        mem->pos += part;
+        written += part;
+    }
+    return written;
+}
+
+size_t sl_mem_writev_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    size_t written;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        written = sl_mem_write_cb(context, iov[i].iov_base, iov[i].iov_len);
+        total += written;
+        if (written < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int sl_mem_flush_cb(void *context)
+{
+    return 0;
+}
+
+int sl_mem_seek_cb(void *context, off_t offset, int whence)
+{
+    sl_mem_t *mem = context;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += mem->pos;
+            break;
+        case SL_SEEK_END:
+            offset += mem->length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    mem->pos = offset;
+    mem->eof = 0;
+    return 0;
+}
+
+off_t sl_mem_tell_cb(void *context)
+{
+    return ((sl_mem_t*)context)->pos;
+}
+
+int sl_mem_eof_cb(void *context)
+{
+    return ((sl_mem_t*)context)->eof;
+}
+
+int sl_mem_error_cb(void *context)
+{
+    return ((sl_mem_t*)context)->error;
+}
+
+off_t sl_mem_length_cb(void *context)
+{
+    return ((sl_mem_t*)context)->length;
+}
+
+off_t sl_mem_seek_cost_cb(void *context, off_t offset)
+{
+    return 0;
+}
+
+streamlike_t* sl_mem_clone_cb(void *context)
+{
+    sl_mem_t *mem = context;
+    streamlike_t *clone;
+
+    clone = sl_mem_open((mem->count ? mem->chunks[0].data : NULL),
+                        mem->length);
+    if (!clone) {
+        return NULL;
+    }
+    ((sl_mem_t*)clone->context)->pos = mem->pos;
+    return clone;
+}
+
+sl_seekable_t sl_mem_seekable_cb(void *context)
+{
+    return SL_SEEKING_SUPPORTED;
+}
@@ -0,0 +1,62 @@
+#ifndef STREAMLIKE_MEM_H
+#define STREAMLIKE_MEM_H
+
+#include <sys/uio.h>
+#include "../streamlike.h"
+
+/* Chunks of a written stream start at SL_MEM_DEFAULT_CHUNK_SIZE bytes unless
+ * given, and grow with the stream up to SL_MEM_MAX_CHUNK_SIZE, so that there
+ * are few of them. */
+#define SL_MEM_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define SL_MEM_MAX_CHUNK_SIZE     (16 * 1024 * 1024)
+
+/* Read-only stream over size bytes of memory, which isn't copied, so it should
+ * outlive the stream. Reads and seeks are memory copies and pointer
+ * arithmetic, while sl_input() points into the memory. */
+streamlike_t* sl_mem_open(const void *data, size_t size);
+/* Stream over memory owned by it, which grows as it is written. Data is kept
+ * in a list of chunks, so growing never moves or copies data written before.
+ * It can be read back, sought and overwritten like a file. Writing past the
+ * end fills the gap with zeros. */
+streamlike_t* sl_mem_create(void);
+streamlike_t* sl_mem_create2(size_t chunk_size);
+/* Frees chunks of written streams, but not memory given to sl_mem_open(). */
+int sl_mem_close(streamlike_t *stream);
+
+/* Chunks holding contents in order, without copying. Fills at most max of
+ * them, and gives the number of chunks. They stay valid until the stream is
+ * closed or sl_mem_contiguous() merges them, though writing may change their
+ * contents or add more. */
+int sl_mem_iov(const streamlike_t *stream, struct iovec *iov, int max);
+/* Contents as one buffer held by the stream. Chunks of a written stream are
+ * merged into one first if needed, which copies them once and frees them, so
+ * pointers given by sl_mem_iov() or sl_input() before go stale. Buffer stays
+ * valid until a later call merges it with chunks written after it. NULL if
+ * merging fails. */
+const void* sl_mem_contiguous(streamlike_t *stream, size_t *size);
+
+size_t sl_mem_read_cb(void *context, void *buffer, size_t size);
+/* Points into a chunk, giving less than asked at the end of it. Valid as long
+ * as the chunk, see sl_mem_iov(). */
+size_t sl_mem_input_cb(void *context, const void **buffer, size_t size);
+/* Doesn't touch stream state, so it can be called from any thread as long as
+ * nothing writes meanwhile. */
+size_t sl_mem_read_at_cb(void *context, void *buffer, size_t size,
+                         off_t offset);
+int sl_mem_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_mem_readv_cb(void *context, const struct iovec *iov, int iovcnt);
+size_t sl_mem_write_cb(void *context, const void *buffer, size_t size);
+size_t sl_mem_writev_cb(void *context, const struct iovec *iov, int iovcnt);
+int sl_mem_flush_cb(void *context);
+int sl_mem_seek_cb(void *context, off_t offset, int whence);
+off_t sl_mem_tell_cb(void *context);
+int sl_mem_eof_cb(void *context);
+int sl_mem_error_cb(void *context);
+off_t sl_mem_length_cb(void *context);
+off_t sl_mem_seek_cost_cb(void *context, off_t offset);
+/* Only for streams from sl_mem_open(). Clone reads the same memory, and is
+ * closed by sl_mem_close(). */
+streamlike_t* sl_mem_clone_cb(void *context);
+sl_seekable_t sl_mem_seekable_cb(void *context);
+
+#endif /* STREAMLIKE_MEM_H */
@@ -0,0 +1,448 @@
+#ifdef SL_DEBUG
+#include "debug.h"
+#endif
+
+#ifndef SL_MMAP_ASSERT
+# ifdef SL_ASSERT
+#  define SL_MMAP_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_MMAP_ASSERT(...) ((void)0)
+# endif
+#endif
+#include "mmap.h"
+#include "util/holes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+typedef struct sl_mmap_s
+{
+    int fd;
+    int flags;
+    /* Access pattern given to madvise() for each mapping. */
+    int madvice;
+    /* Zero if whole file is mapped. */
+    size_t window_size;
+    /* Mapping holds map_len bytes from map_off. */
+    const char *map;
+    off_t map_off;
+    size_t map_len;
+    off_t length;
+    off_t pos;
+    int eof;
+    int error;
+} sl_mmap_t;
+
+streamlike_t* sl_mmap_open(const char *path, int flags)
+{
+    streamlike_t *stream;
+    int fd;
+
+    SL_MMAP_ASSERT(path != NULL);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    stream = sl_mmap_open2(fd, 0, flags);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+static
+void sl_mmap_unmap_(sl_mmap_t *file)
+{
+    if (file->map) {
+        munmap((void*)file->map, file->map_len);
+    }
+    file->map = NULL;
+    file->map_off = 0;
+    file->map_len = 0;
+}
+
+/* Maps the window holding offset, which should be before end-of-file. */
+static
+int sl_mmap_map_(sl_mmap_t *file, off_t offset)
+{
+    void *map;
+    off_t start = 0;
+    size_t len = file->length;
+
+    SL_MMAP_ASSERT(offset < file->length);
+    if (file->window_size) {
+        start = offset - offset % file->window_size;
+        len = (file->length - start < (off_t)file->window_size ?
+               (size_t)(file->length - start) : file->window_size);
+    }
+    sl_mmap_unmap_(file);
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED
+               | (file->flags & SL_MMAP_POPULATE ? MAP_POPULATE : 0),
+               file->fd, start);
+    if (map == MAP_FAILED) {
+        file->error = 1;
+        return -1;
+    }
+    if (file->madvice != MADV_NORMAL) {
+        madvise(map, len, file->madvice);
+    }
+    file->map = map;
+    file->map_off = start;
+    file->map_len = len;
+    return 0;
+}
+
+/* Makes sure current offset is mapped. Fails at end-of-file. */
+static inline
+int sl_mmap_cover_(sl_mmap_t *file)
+{
+    if (file->pos >= file->map_off
+            && file->pos < file->map_off + (off_t)file->map_len) {
+        return 0;
+    }
+    if (file->pos >= file->length) {
+        return -1;
+    }
+    return sl_mmap_map_(file, file->pos);
+}
+
+streamlike_t* sl_mmap_open2(int fd, size_t window_size, int flags)
+{
+    streamlike_t *stream;
+    sl_mmap_t *file;
+    struct stat s;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    SL_MMAP_ASSERT(fd >= 0);
+
+    if (fstat(fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+        return NULL;
+    }
+    if (window_size == 0 && (uintmax_t)s.st_size > SL_MMAP_MAX_MAP_SIZE) {
+        window_size = SL_MMAP_LARGE_WINDOW_SIZE;
+    }
+    /* Windows start at multiples of their size, which should be aligned. */
+    window_size = (window_size + page_size - 1) / page_size * page_size;
+
+    file = malloc(sizeof(sl_mmap_t));
+    if (!file) {
+        return NULL;
+    }
+    file->fd          = fd;
+    file->flags       = flags;
+    file->madvice     = MADV_NORMAL;
+    file->window_size = window_size;
+    file->map         = NULL;
+    file->map_off     = 0;
+    file->map_len     = 0;
+    file->length      = s.st_size;
+    file->pos         = 0;
+    file->eof         = 0;
+    file->error       = 0;
+
+    /* Mapped right away, so that pre-faulting happens here. Empty files can't
+     * be mapped. */
+    if (file->length > 0 && sl_mmap_map_(file, 0) != 0) {
+        free(file);
+        return NULL;
+    }
+
+    stream = malloc(sizeof(streamlike_t));
+    if (!stream) {
+        sl_mmap_unmap_(file);
+        free(file);
+        return NULL;
+    }
+
+    stream->context = file;
+    stream->read    = sl_mmap_read_cb;
+    stream->input   = sl_mmap_input_cb;
+    stream->write   = NULL;
+    stream->flush   = NULL;
+    stream->seek    = sl_mmap_seek_cb;
+    stream->tell    = sl_mmap_tell_cb;
+    stream->eof     = sl_mmap_eof_cb;
+    stream->error   = sl_mmap_error_cb;
+    stream->length  = sl_mmap_length_cb;
+
+    stream->seekable     = sl_mmap_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = sl_mmap_read_at_cb;
+
+    stream->readv  = sl_mmap_readv_cb;
+    stream->writev = NULL;
+
+    stream->read_multi = sl_mmap_read_multi_cb;
+
+    stream->aio_submit = NULL;
+
+    stream->advise    = sl_mmap_advise_cb;
+    stream->seek_cost = sl_mmap_seek_cost_cb;
+
+    stream->clone = sl_mmap_clone_cb;
+
+    stream->data_map = sl_mmap_data_map_cb;
+
+    /* Mapping and length would go stale under kernel transfers. */
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY | SL_CAP_CHEAP_SEEK;
+
+    return stream;
+}
+
+int sl_mmap_close(streamlike_t *stream)
+{
+    SL_MMAP_ASSERT(stream != NULL);
+    SL_MMAP_ASSERT(stream->context != NULL);
+
+    if (close(((sl_mmap_t*)stream->context)->fd) < 0) {
+        return -1;
+    }
+    return sl_mmap_close2(stream);
+}
+
+int sl_mmap_close2(streamlike_t *stream)
+{
+    SL_MMAP_ASSERT(stream != NULL);
+    sl_mmap_unmap_(stream->context);
+    free(stream->context);
+    free(stream);
+    return 0;
+}
+
+size_t sl_mmap_read_cb(void *context, void *buffer, size_t size)
+{
+    sl_mmap_t *file = context;
+    size_t read = 0;
+    size_t part;
+
+    while (read < size && sl_mmap_cover_(file) == 0) {
+        part = file->map_off + file->map_len - file->pos;
+        part = (part < size - read ? part : size - read);
+        memcpy((char*)buffer + read, file->map + (file->pos - file->map_off),
+               part);
+        file->pos += part;
+        read += part;
+    }
+    if (read < size && !file->error) {
+        file->eof = 1;
+    }
+    return read;
+}
+
+size_t sl_mmap_input_cb(void *context, const void **buffer, size_t size)
+{
+    sl_mmap_t *file = context;
+    size_t part;
+
+    if (size == 0) {
+        return 0;
+    }
+    if (sl_mmap_cover_(file) != 0) {
+        file->eof = !file->error;
+        return 0;
+    }
+    part = file->map_off + file->map_len - file->pos;
+    part = (part < size ? part : size);
+    *buffer = file->map + (file->pos - file->map_off);
+    file->pos += part;
+    return part;
+}
+
+size_t sl_mmap_read_at_cb(void *context, void *buffer, size_t size,
+                          off_t offset)
+{
+    sl_mmap_t *file = context;
+    size_t total = 0;
+    ssize_t ret;
+
+    if (offset < 0 || offset >= file->length) {
+        return 0;
+    }
+    size = (file->length - offset < (off_t)size ?
+            (size_t)(file->length - offset) : size);
+    if (!file->window_size) {
+        memcpy(buffer, file->map + offset, size);
+        return size;
+    }
+    /* Window belongs to the cursor, so read around it. */
+    while (total < size) {
+        ret = pread(file->fd, (char*)buffer + total, size - total,
+                    offset + total);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+int sl_mmap_read_multi_cb(void *context, sl_extent_t *extents, int count)
+{
+    int incomplete = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].read = sl_mmap_read_at_cb(context, extents[i].buffer,
+                                             extents[i].length,
+                                             extents[i].offset);
+        if (extents[i].read < extents[i].length) {
+            incomplete = 1;
+        }
+    }
+    return incomplete;
+}
+
+size_t sl_mmap_readv_cb(void *context, const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    size_t read;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        read = sl_mmap_read_cb(context, iov[i].iov_base, iov[i].iov_len);
+        total += read;
+        if (read < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int sl_mmap_seek_cb(void *context, off_t offset, int whence)
+{
+    sl_mmap_t *file = context;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += file->pos;
+            break;
+        case SL_SEEK_END:
+            offset += file->length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+    file->pos = offset;
+    file->eof = 0;
+    return 0;
+}
+
+off_t sl_mmap_tell_cb(void *context)
+{
+    return ((sl_mmap_t*)context)->pos;
+}
+
+int sl_mmap_eof_cb(void *context)
+{
+    return ((sl_mmap_t*)context)->eof;
+}
+
+int sl_mmap_error_cb(void *context)
+{
+    return ((sl_mmap_t*)context)->error;
+}
+
+off_t sl_mmap_length_cb(void *context)
+{
+    return ((sl_mmap_t*)context)->length;
+}
+
+int sl_mmap_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    sl_mmap_t *file = context;
+    int madvice;
+    int fadvice;
+
+    switch (advice) {
+        case SL_ADVICE_NORMAL:
+            madvice = MADV_NORMAL;
+            fadvice = POSIX_FADV_NORMAL;
+            break;
+        case SL_ADVICE_SEQUENTIAL:
+            madvice = MADV_SEQUENTIAL;
+            fadvice = POSIX_FADV_SEQUENTIAL;
+            break;
+        case SL_ADVICE_RANDOM:
+            madvice = MADV_RANDOM;
+            fadvice = POSIX_FADV_RANDOM;
+            break;
+        case SL_ADVICE_WILLNEED:
+            return posix_fadvise(file->fd, offset, length, POSIX_FADV_WILLNEED);
+        case SL_ADVICE_DONTNEED:
+            return posix_fadvise(file->fd, offset, length, POSIX_FADV_DONTNEED);
+        case SL_ADVICE_NOREUSE:
+            return posix_fadvise(file->fd, offset, length, POSIX_FADV_NOREUSE);
+        default:
+            return -1;
+    }
+    /* Page faults read ahead according to the mapping, not the range. */
+    file->madvice = madvice;
+    if (file->map && madvise((void*)file->map, file->map_len, madvice) != 0) {
+        return -1;
+    }
+    return posix_fadvise(file->fd, offset, length, fadvice);
+}
+
+int sl_mmap_data_map_cb(void *context, off_t offset, off_t length,
+                        sl_range_t *ranges, int max)
+{
+    return holes_data_map(((sl_mmap_t*)context)->fd, offset, length, ranges, max);
+}
+
+off_t sl_mmap_seek_cost_cb(void *context, off_t offset)
+{
+    /* Free, as there is nothing to seek. Windows are remapped either way. */
+    return 0;
+}
+
+streamlike_t* sl_mmap_clone_cb(void *context)
+{
+    sl_mmap_t *file = context;
+    sl_mmap_t *clone_file;
+    streamlike_t *clone;
+    int clone_fd;
+
+    clone_fd = fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+    if (clone_fd < 0) {
+        return NULL;
+    }
+    clone = sl_mmap_open2(clone_fd, file->window_size, file->flags);
+    if (!clone) {
+        close(clone_fd);
+        return NULL;
+    }
+    clone_file = clone->context;
+    clone_file->pos = file->pos;
+    clone_file->madvice = file->madvice;
+    if (clone_file->map && file->madvice != MADV_NORMAL) {
+        madvise((void*)clone_file->map, clone_file->map_len, file->madvice);
+    }
+    return clone;
+}
+
+sl_seekable_t sl_mmap_seekable_cb(void *context)
+{
+    return SL_SEEKING_SUPPORTED;
+}
@@ -0,0 +1,53 @@
+#ifndef STREAMLIKE_MMAP_H
+#define STREAMLIKE_MMAP_H
+
+#include "../streamlike.h"
+
+/* Pre-fault mappings, trading slower opening for no page faults later. */
+#define SL_MMAP_POPULATE (1 << 0)
+
+/* Files larger than this are mapped in windows of SL_MMAP_LARGE_WINDOW_SIZE
+ * bytes even if no window size is given, to save address space. */
+#define SL_MMAP_MAX_MAP_SIZE      ((size_t)1 << (sizeof(size_t) * 8 - 2))
+#define SL_MMAP_LARGE_WINDOW_SIZE (256 * 1024 * 1024)
+
+/* Read-only stream over a memory mapped file. Reads and seeks are memory
+ * copies and pointer arithmetic, while sl_input() points into the mapping.
+ * Whole file is mapped, unless window_size is given, in which case a window
+ * of that many bytes around current offset is mapped at a time. Pointers from
+ * sl_input() stay valid until the stream is closed, or in windowed mode until
+ * the next read moving the window. Length is fixed when opened, and the file
+ * shouldn't be truncated while mapped. */
+streamlike_t* sl_mmap_open(const char *path, int flags);
+streamlike_t* sl_mmap_open2(int fd, size_t window_size, int flags);
+/* Closes the descriptor, while sl_mmap_close2() leaves it open. */
+int sl_mmap_close(streamlike_t *stream);
+int sl_mmap_close2(streamlike_t *stream);
+
+size_t sl_mmap_read_cb(void *context, void *buffer, size_t size);
+size_t sl_mmap_input_cb(void *context, const void **buffer, size_t size);
+/* Doesn't touch stream state in either mode, so it can be called from any
+ * thread. Windowed streams read with pread() instead. */
+size_t sl_mmap_read_at_cb(void *context, void *buffer, size_t size,
+                          off_t offset);
+int sl_mmap_read_multi_cb(void *context, sl_extent_t *extents, int count);
+size_t sl_mmap_readv_cb(void *context, const struct iovec *iov, int iovcnt);
+int sl_mmap_seek_cb(void *context, off_t offset, int whence);
+off_t sl_mmap_tell_cb(void *context);
+int sl_mmap_eof_cb(void *context);
+int sl_mmap_error_cb(void *context);
+off_t sl_mmap_length_cb(void *context);
+/* Access patterns go to madvise(), and are kept for windows mapped later.
+ * Other advice goes to the page cache with posix_fadvise(). */
+int sl_mmap_advise_cb(void *context, off_t offset, off_t length, int advice);
+off_t sl_mmap_seek_cost_cb(void *context, off_t offset);
+/* Holes read as zeros through the mapping too, but skipping them saves
+ * faulting pages in. */
+int sl_mmap_data_map_cb(void *context, off_t offset, off_t length,
+                        sl_range_t *ranges, int max);
+/* Clone maps the file again with a duplicate descriptor, which is closed by
+ * sl_mmap_close(). */
+streamlike_t* sl_mmap_clone_cb(void *context);
+sl_seekable_t sl_mmap_seekable_cb(void *context);
+
+#endif /* STREAMLIKE_MMAP_H */
@@ -0,0 +1,27 @@
+#ifndef STREAMLIKE_MMAP_HPP
+#define STREAMLIKE_MMAP_HPP
+
+#include <string>
+
+#include "../streamlike.hpp"
+
+namespace streamlike {
+
+class StreamlikeMmap : public Streamlike {
+    public:
+        StreamlikeMmap(const char *path, int flags = 0);
+        StreamlikeMmap(const std::string& path, int flags = 0);
+        StreamlikeMmap(int fd, size_t window_size, int flags = 0);
+        StreamlikeMmap(StreamlikeMmap&& old) = default;
+        StreamlikeMmap& operator=(StreamlikeMmap&&) = default;
+        ~StreamlikeMmap();
+
+        StreamlikeMmap clone() const;
+
+    private:
+        explicit StreamlikeMmap(self_type self);
+};
+
+} // namespace streamlike
+
+#endif /* STREAMLIKE_MMAP_HPP */
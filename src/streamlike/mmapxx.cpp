@@ -0,0 +1,43 @@
+extern "C" {
+#include "mmap.h"
+}
+#include "mmap.hpp"
+#include <stdexcept>
+
+namespace streamlike {
+
+StreamlikeMmap::StreamlikeMmap(const char *path, int flags)
+        : Streamlike(sl_mmap_open(path, flags)) {
+    if (!self) {
+        throw std::runtime_error("Couldn't create mmap stream");
+    }
+}
+
+StreamlikeMmap::StreamlikeMmap(const std::string& path, int flags)
+    : StreamlikeMmap(path.c_str(), flags) {}
+
+StreamlikeMmap::StreamlikeMmap(int fd, size_t window_size, int flags)
+        : Streamlike(sl_mmap_open2(fd, window_size, flags)) {
+    if (!self) {
+        throw std::runtime_error("Couldn't create mmap stream");
+    }
+}
+
+StreamlikeMmap::StreamlikeMmap(self_type self)
+        : Streamlike(self) {
+    if (!self) {
+        throw std::runtime_error("Couldn't clone mmap stream");
+    }
+}
+
+StreamlikeMmap::~StreamlikeMmap() {
+    if (self) {
+        sl_mmap_close(self);
+    }
+}
+
+StreamlikeMmap StreamlikeMmap::clone() const {
+    return StreamlikeMmap(sl_clone(self));
+}
+
+} // namespace streamlike
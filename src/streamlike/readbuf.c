@@ -0,0 +1,402 @@
+#ifdef SL_DEBUG
+# include "debug.h"
+#endif
+
+#ifndef SL_READBUF_ASSERT
+# ifdef SL_ASSERT
+#  define SL_READBUF_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_READBUF_ASSERT(...) ((void)0)
+# endif
+#endif
+#ifndef SL_READBUF_LOG
+# ifdef SL_LOG
+#  define SL_READBUF_LOG(...) SL_LOG(__VA_ARGS__)
+# else
+#  define SL_READBUF_LOG(...) ((void)0)
+# endif
+#endif
+#include "readbuf.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sl_readbuf_s
+{
+    streamlike_t *inner_stream;
+    /* Block holds block_len bytes read from block_off. */
+    char *block;
+    size_t block_size;
+    off_t block_off;
+    size_t block_len;
+    /* Offset of the consumer, and of inner stream. Consumer may be ahead of
+     * inner stream until a lazy forward seek is done. */
+    off_t pos;
+    off_t inner_pos;
+    int eof;
+} sl_readbuf_t;
+
+streamlike_t* sl_readbuf_create(streamlike_t *inner_stream)
+{
+    return sl_readbuf_create2(inner_stream, SL_READBUF_DEFAULT_BLOCK_SIZE);
+}
+
+streamlike_t* sl_readbuf_create2(streamlike_t *inner_stream, size_t block_size)
+{
+    streamlike_t *stream = NULL;
+    sl_readbuf_t *context = NULL;
+
+    if (inner_stream == NULL || inner_stream->read == NULL) {
+        SL_READBUF_LOG("ERROR: Inner stream should be readable.");
+        return NULL;
+    }
+    if (block_size == 0) {
+        SL_READBUF_LOG("ERROR: Block size should be positive.");
+        return NULL;
+    }
+
+    context = malloc(sizeof(sl_readbuf_t));
+    if (context == NULL) {
+        SL_READBUF_LOG("ERROR: Couldn't allocate read buffer context.");
+        goto fail;
+    }
+    /* Aligned, so that reads into it suit inner streams bypassing caches. */
+    if (posix_memalign((void**)&context->block, SL_READBUF_ALIGNMENT,
+                       block_size) != 0) {
+        SL_READBUF_LOG("ERROR: Couldn't allocate block of size %zu.",
+                       block_size);
+        context->block = NULL;
+        goto fail;
+    }
+
+    stream = malloc(sizeof(streamlike_t));
+    if (stream == NULL) {
+        SL_READBUF_LOG("ERROR: Couldn't allocate read buffer stream.");
+        goto fail;
+    }
+
+    context->inner_stream = inner_stream;
+    context->block_size   = block_size;
+    context->pos          = (inner_stream->tell ? sl_tell(inner_stream) : 0);
+    context->pos          = (context->pos > 0 ? context->pos : 0);
+    context->inner_pos    = context->pos;
+    context->block_off    = context->pos;
+    context->block_len    = 0;
+    context->eof          = 0;
+
+    stream->context = context;
+    stream->read    = sl_readbuf_read_cb;
+    stream->input   = sl_readbuf_input_cb;
+    stream->write   = NULL;
+    stream->flush   = NULL;
+    stream->seek    = sl_readbuf_seek_cb;
+    stream->tell    = sl_readbuf_tell_cb;
+    stream->eof     = sl_readbuf_eof_cb;
+    stream->error   = sl_readbuf_error_cb;
+    stream->length  = sl_readbuf_length_cb;
+
+    stream->seekable     = sl_readbuf_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    /* Positional reads don't touch the block, so they go to inner stream. */
+    stream->read_at = (inner_stream->read_at ? sl_readbuf_read_at_cb : NULL);
+
+    stream->readv  = NULL;
+    stream->writev = NULL;
+
+    stream->read_multi = NULL;
+
+    stream->aio_submit = NULL;
+
+    stream->advise    = (inner_stream->advise ? sl_readbuf_advise_cb : NULL);
+    stream->seek_cost = sl_readbuf_seek_cost_cb;
+
+    stream->clone = NULL;
+
+    stream->data_map = (inner_stream->data_map ? sl_readbuf_data_map_cb
+                                               : NULL);
+
+    /* Block would go stale under kernel transfers. */
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                 | (inner_stream->caps & SL_CAP_CHEAP_SEEK);
+
+    return stream;
+
+fail:
+    if (context) {
+        free(context->block);
+    }
+    free(context);
+    return NULL;
+}
+
+int sl_readbuf_destroy(streamlike_t *readbuf_stream)
+{
+    sl_readbuf_t *context;
+
+    if (readbuf_stream == NULL) {
+        return 0;
+    }
+    context = readbuf_stream->context;
+    if (context) {
+        free(context->block);
+        free(context);
+    }
+    free(readbuf_stream);
+    return 0;
+}
+
+static
+off_t inner_seek_cost(sl_readbuf_t *context, off_t offset)
+{
+    return sl_seek_cost(context->inner_stream, offset);
+}
+
+/* Whether offset is reached sooner by reading forward from inner offset than
+ * by seeking inner stream. Anything within a block is read anyway. */
+static
+int should_read_through(sl_readbuf_t *context, off_t offset)
+{
+    off_t gap = offset - context->inner_pos;
+
+    if (gap < 0) {
+        return 0;
+    }
+    return gap < (off_t)context->block_size
+        || gap <= inner_seek_cost(context, offset);
+}
+
+/* Fills block from inner offset until it covers pos. Returns -1 if inner
+ * stream ends before. */
+static
+int refill(sl_readbuf_t *context)
+{
+    streamlike_t *inner = context->inner_stream;
+    size_t want;
+    size_t got;
+
+    SL_READBUF_ASSERT(context->pos >= context->inner_pos);
+    do {
+        context->block_off = context->inner_pos;
+        context->block_len = 0;
+        do {
+            want = context->block_size - context->block_len;
+            got = sl_read(inner, context->block + context->block_len, want);
+            context->block_len += got;
+            /* Short reads go on, unless inner stream says it has ended. */
+        } while (got > 0 && context->block_len < context->block_size
+                 && !(got < want && inner->eof && sl_eof(inner)));
+        context->inner_pos += context->block_len;
+    } while (context->pos >= context->inner_pos
+             && context->block_len == context->block_size);
+    return (context->pos < context->inner_pos ? 0 : -1);
+}
+
+size_t sl_readbuf_read_cb(void *context, void *buffer, size_t len)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    streamlike_t *inner = stream->inner_stream;
+    size_t read = 0;
+    size_t part;
+    size_t got;
+
+    while (read < len) {
+        if (stream->pos >= stream->block_off
+                && stream->pos < stream->block_off + (off_t)stream->block_len) {
+            part = stream->block_off + stream->block_len - stream->pos;
+            part = (part < len - read ? part : len - read);
+            memcpy((char*)buffer + read,
+                   stream->block + (stream->pos - stream->block_off), part);
+            stream->pos += part;
+            read += part;
+            continue;
+        }
+        if (stream->pos == stream->inner_pos
+                && len - read >= stream->block_size) {
+            /* Whole blocks bypass the block. */
+            part = (len - read) - (len - read) % stream->block_size;
+            got = sl_read(inner, (char*)buffer + read, part);
+            stream->inner_pos += got;
+            stream->pos += got;
+            read += got;
+            if (got < part) {
+                stream->eof = (inner->eof ? sl_eof(inner) : 1);
+                break;
+            }
+            continue;
+        }
+        if (refill(stream) != 0) {
+            stream->eof = (inner->eof ? sl_eof(inner) : 1);
+            break;
+        }
+    }
+    return read;
+}
+
+size_t sl_readbuf_input_cb(void *context, const void **buffer, size_t len)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    streamlike_t *inner = stream->inner_stream;
+    size_t part;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (!(stream->pos >= stream->block_off
+          && stream->pos < stream->block_off + (off_t)stream->block_len)
+            && refill(stream) != 0) {
+        stream->eof = (inner->eof ? sl_eof(inner) : 1);
+        return 0;
+    }
+    part = stream->block_off + stream->block_len - stream->pos;
+    part = (part < len ? part : len);
+    *buffer = stream->block + (stream->pos - stream->block_off);
+    stream->pos += part;
+    return part;
+}
+
+size_t sl_readbuf_read_at_cb(void *context, void *buffer, size_t len,
+                             off_t offset)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    return sl_read_at(stream->inner_stream, buffer, len, offset);
+}
+
+int sl_readbuf_seek_cb(void *context, off_t offset, int whence)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    streamlike_t *inner = stream->inner_stream;
+    off_t length;
+    off_t start;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += stream->pos;
+            break;
+        case SL_SEEK_END:
+            length = sl_readbuf_length_cb(context);
+            if (length < 0) {
+                return -1;
+            }
+            offset += length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+
+    /* Within the block, or close ahead. Reading gets there. */
+    if ((offset >= stream->block_off
+         && offset < stream->block_off + (off_t)stream->block_len)
+            || should_read_through(stream, offset)) {
+        stream->pos = offset;
+        stream->eof = 0;
+        return 0;
+    }
+
+    /* Seek inner stream to the beginning of the block holding offset. */
+    start = offset - offset % (off_t)stream->block_size;
+    if (!inner->seek || sl_seek(inner, start, SL_SEEK_SET) != 0) {
+        SL_READBUF_LOG("ERROR: Couldn't seek inner stream to %jd.",
+                       (intmax_t)start);
+        return -1;
+    }
+    stream->inner_pos = start;
+    stream->block_off = start;
+    stream->block_len = 0;
+    stream->pos       = offset;
+    stream->eof       = 0;
+    return 0;
+}
+
+off_t sl_readbuf_tell_cb(void *context)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    return stream->pos;
+}
+
+int sl_readbuf_eof_cb(void *context)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    return stream->eof;
+}
+
+int sl_readbuf_error_cb(void *context)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    if (!stream->inner_stream->error) {
+        return 0;
+    }
+    return sl_error(stream->inner_stream);
+}
+
+off_t sl_readbuf_length_cb(void *context)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    if (!stream->inner_stream->length) {
+        return -1;
+    }
+    return sl_length(stream->inner_stream);
+}
+
+sl_seekable_t sl_readbuf_seekable_cb(void *context)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    if (!stream->inner_stream->seekable) {
+        return SL_SEEKING_NOT_SUPPORTED;
+    }
+    return sl_seekable(stream->inner_stream);
+}
+
+int sl_readbuf_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    return sl_data_map(stream->inner_stream, offset, length, ranges, max);
+}
+
+int sl_readbuf_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    return sl_advise(stream->inner_stream, offset, length, advice);
+}
+
+off_t sl_readbuf_seek_cost_cb(void *context, off_t offset)
+{
+    SL_READBUF_ASSERT(context);
+    sl_readbuf_t *stream = context;
+    off_t inner_cost;
+    off_t gap;
+
+    if (offset >= stream->block_off
+            && offset < stream->block_off + (off_t)stream->block_len) {
+        return 0;
+    }
+    inner_cost = inner_seek_cost(stream, offset);
+    gap = offset - stream->inner_pos;
+    if (gap >= 0 && (gap < (off_t)stream->block_size || gap < inner_cost)) {
+        return gap;
+    }
+    return inner_cost;
+}
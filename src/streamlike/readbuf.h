@@ -0,0 +1,38 @@
+#ifndef STREAMLIKE_READBUF_H
+#define STREAMLIKE_READBUF_H
+
+#include "../streamlike.h"
+#define SL_READBUF_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define SL_READBUF_ALIGNMENT          (4096)
+
+/* Synchronous read buffer for many small reads from one thread, unlike
+ * sl_buffer which reads ahead in a thread. Small reads are served from a block
+ * of block_size bytes aligned to SL_READBUF_ALIGNMENT. Block is refilled from
+ * inner stream at offsets aligned to block_size, while reads of a whole block
+ * or more go straight into caller memory. Inner stream isn't destroyed along
+ * with the decorator. */
+streamlike_t* sl_readbuf_create(streamlike_t *inner_stream);
+streamlike_t* sl_readbuf_create2(streamlike_t *inner_stream,
+                                 size_t block_size);
+int sl_readbuf_destroy(streamlike_t *readbuf_stream);
+
+size_t sl_readbuf_read_cb(void *context, void *buffer, size_t len);
+/* Points into the block without copying. Gives at most the rest of it. */
+size_t sl_readbuf_input_cb(void *context, const void **buffer, size_t len);
+size_t sl_readbuf_read_at_cb(void *context, void *buffer, size_t len,
+                             off_t offset);
+/* Free within the block, and ahead while reading through costs less than
+ * seeking inner stream. */
+int sl_readbuf_seek_cb(void *context, off_t offset, int whence);
+off_t sl_readbuf_tell_cb(void *context);
+int sl_readbuf_eof_cb(void *context);
+int sl_readbuf_error_cb(void *context);
+off_t sl_readbuf_length_cb(void *context);
+sl_seekable_t sl_readbuf_seekable_cb(void *context);
+int sl_readbuf_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max);
+int sl_readbuf_advise_cb(void *context, off_t offset, off_t length,
+                         int advice);
+off_t sl_readbuf_seek_cost_cb(void *context, off_t offset);
+
+#endif /* STREAMLIKE_READBUF_H */
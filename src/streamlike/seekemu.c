@@ -0,0 +1,434 @@
+#ifdef SL_DEBUG
+# include "debug.h"
+#endif
+
+#ifndef SL_SEEKEMU_ASSERT
+# ifdef SL_ASSERT
+#  define SL_SEEKEMU_ASSERT(...) SL_ASSERT(__VA_ARGS__)
+# else
+#  define SL_SEEKEMU_ASSERT(...) ((void)0)
+# endif
+#endif
+#ifndef SL_SEEKEMU_LOG
+# ifdef SL_LOG
+#  define SL_SEEKEMU_LOG(...) SL_LOG(__VA_ARGS__)
+# else
+#  define SL_SEEKEMU_LOG(...) ((void)0)
+# endif
+#endif
+#include "seekemu.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sl_seekemu_s
+{
+    streamlike_t *inner_stream;
+    /* Offset of the consumer, and of inner stream. Consumer is behind while
+     * replaying, and ahead until a lazy forward seek is done. */
+    off_t pos;
+    off_t inner_pos;
+    int eof;
+    /* Replay cache holding bytes just before inner_pos. cache_head is where the
+     * next byte goes. */
+    char *cache;
+    size_t cache_size;
+    size_t cache_len;
+    size_t cache_head;
+    char *scratch;
+} sl_seekemu_t;
+
+streamlike_t* sl_seekemu_create(streamlike_t *inner_stream)
+{
+    return sl_seekemu_create2(inner_stream, SL_SEEKEMU_DEFAULT_CACHE_SIZE);
+}
+
+streamlike_t* sl_seekemu_create2(streamlike_t *inner_stream, size_t cache_size)
+{
+    streamlike_t *stream = NULL;
+    sl_seekemu_t *context = NULL;
+
+    if (inner_stream == NULL || inner_stream->read == NULL) {
+        SL_SEEKEMU_LOG("ERROR: Inner stream should be readable.");
+        return NULL;
+    }
+
+    context = malloc(sizeof(sl_seekemu_t));
+    if (context == NULL) {
+        SL_SEEKEMU_LOG("ERROR: Couldn't allocate seek emulation context.");
+        goto fail;
+    }
+    context->cache   = NULL;
+    context->scratch = NULL;
+    if (cache_size > 0) {
+        context->cache = malloc(cache_size);
+        if (context->cache == NULL) {
+            SL_SEEKEMU_LOG("ERROR: Couldn't allocate cache of size %zu.",
+                           cache_size);
+            goto fail;
+        }
+    }
+    context->scratch = malloc(SL_SEEKEMU_SCRATCH_SIZE);
+    if (context->scratch == NULL) {
+        SL_SEEKEMU_LOG("ERROR: Couldn't allocate scratch buffer.");
+        goto fail;
+    }
+
+    stream = malloc(sizeof(streamlike_t));
+    if (stream == NULL) {
+        SL_SEEKEMU_LOG("ERROR: Couldn't allocate seek emulation stream.");
+        goto fail;
+    }
+
+    context->inner_stream = inner_stream;
+    context->pos          = (inner_stream->tell ? sl_tell(inner_stream) : 0);
+    context->pos          = (context->pos > 0 ? context->pos : 0);
+    context->inner_pos    = context->pos;
+    context->eof          = 0;
+    context->cache_size   = cache_size;
+    context->cache_len    = 0;
+    context->cache_head   = 0;
+
+    stream->context = context;
+    stream->read    = sl_seekemu_read_cb;
+    stream->input   = NULL;
+    stream->write   = NULL;
+    stream->flush   = NULL;
+    stream->seek    = sl_seekemu_seek_cb;
+    stream->tell    = sl_seekemu_tell_cb;
+    stream->eof     = sl_seekemu_eof_cb;
+    stream->error   = sl_seekemu_error_cb;
+    stream->length  = sl_seekemu_length_cb;
+
+    stream->seekable     = sl_seekemu_seekable_cb;
+    stream->ckp_count    = NULL;
+    stream->ckp          = NULL;
+    stream->ckp_offset   = NULL;
+    stream->ckp_metadata = NULL;
+
+    stream->read_at = NULL;
+
+    stream->readv  = NULL;
+    stream->writev = NULL;
+
+    stream->read_multi = NULL;
+
+    stream->aio_submit = NULL;
+
+    stream->advise    = (inner_stream->advise ? sl_seekemu_advise_cb : NULL);
+    stream->seek_cost = sl_seekemu_seek_cost_cb;
+
+    /* Clones would need to replay each other's data. */
+    stream->clone = NULL;
+
+    stream->data_map = (inner_stream->data_map ? sl_seekemu_data_map_cb
+                                               : NULL);
+
+    /* Cache would go stale under kernel transfers. */
+    stream->descriptor = NULL;
+
+    stream->caps = sl_probe_caps(stream);
+
+    return stream;
+
+fail:
+    if (context) {
+        free(context->cache);
+        free(context->scratch);
+    }
+    free(context);
+    return NULL;
+}
+
+int sl_seekemu_destroy(streamlike_t *seekemu_stream)
+{
+    sl_seekemu_t *context;
+
+    if (seekemu_stream == NULL) {
+        return 0;
+    }
+    context = seekemu_stream->context;
+    if (context) {
+        free(context->cache);
+        free(context->scratch);
+        free(context);
+    }
+    free(seekemu_stream);
+    return 0;
+}
+
+/* Keeps the last bytes read from inner stream. */
+static
+void cache_append(sl_seekemu_t *context, const char *data, size_t len)
+{
+    size_t part;
+
+    if (context->cache_size == 0) {
+        return;
+    }
+    if (len >= context->cache_size) {
+        memcpy(context->cache, data + len - context->cache_size,
+               context->cache_size);
+        context->cache_head = 0;
+        context->cache_len  = context->cache_size;
+        return;
+    }
+    part = context->cache_size - context->cache_head;
+    part = (part < len ? part : len);
+    memcpy(context->cache + context->cache_head, data, part);
+    memcpy(context->cache, data + part, len - part);
+    context->cache_head = (context->cache_head + len) % context->cache_size;
+    context->cache_len += len;
+    if (context->cache_len > context->cache_size) {
+        context->cache_len = context->cache_size;
+    }
+}
+
+/* Copies cached bytes from pos up to inner_pos. */
+static
+size_t cache_replay(sl_seekemu_t *context, char *buffer, size_t len)
+{
+    size_t back = context->inner_pos - context->pos;
+    size_t start;
+    size_t part;
+
+    SL_SEEKEMU_ASSERT(back <= context->cache_len);
+    len = (len < back ? len : back);
+    start = (context->cache_head + context->cache_size - back)
+            % context->cache_size;
+    part = context->cache_size - start;
+    part = (part < len ? part : len);
+    memcpy(buffer, context->cache + start, part);
+    memcpy(buffer + part, context->cache, len - part);
+    return len;
+}
+
+static
+int inner_seekable(sl_seekemu_t *context)
+{
+    streamlike_t *inner = context->inner_stream;
+    return inner->seek && inner->seekable
+        && sl_seekable(inner) == SL_SEEKING_SUPPORTED;
+}
+
+/* Whether seeking inner stream natively to pos is cheaper than reading
+ * through. Unknown cost is taken to be more than a scratch buffer. */
+static
+int should_seek_inner(sl_seekemu_t *context)
+{
+    off_t gap = context->pos - context->inner_pos;
+    off_t cost;
+
+    if (!inner_seekable(context)) {
+        return 0;
+    }
+    cost = sl_seek_cost(context->inner_stream, context->pos);
+    if (cost < 0) {
+        return gap > SL_SEEKEMU_SCRATCH_SIZE;
+    }
+    return cost < gap;
+}
+
+static
+int seek_inner(sl_seekemu_t *context, off_t offset)
+{
+    if (!context->inner_stream->seek
+            || sl_seek(context->inner_stream, offset, SL_SEEK_SET) != 0) {
+        return -1;
+    }
+    context->inner_pos  = offset;
+    context->cache_len  = 0;
+    context->cache_head = 0;
+    return 0;
+}
+
+/* Brings inner stream up to pos, by reading and discarding unless it is
+ * cheaper to seek. Stops early at end-of-file. */
+static
+void catch_up(sl_seekemu_t *context)
+{
+    streamlike_t *inner = context->inner_stream;
+    const void *data;
+    off_t gap;
+    size_t len;
+    size_t got;
+
+    if (context->pos > context->inner_pos && should_seek_inner(context)
+            && seek_inner(context, context->pos) == 0) {
+        SL_SEEKEMU_LOG("Seeked inner stream to %jd.", (intmax_t)context->pos);
+        return;
+    }
+    while ((gap = context->pos - context->inner_pos) > 0) {
+        len = (gap < SL_SEEKEMU_SCRATCH_SIZE ? (size_t)gap
+                                             : SL_SEEKEMU_SCRATCH_SIZE);
+        got = 0;
+        if (sl_has_caps(inner, SL_CAP_INPUT)) {
+            got = sl_input(inner, &data, len);
+        }
+        /* Input may give nothing without being at end-of-file, such as for
+         * buffers not handing out blocks. */
+        if (got == 0 && (!inner->eof || !sl_eof(inner))) {
+            got = sl_read(inner, context->scratch, len);
+            data = context->scratch;
+        }
+        if (got == 0) {
+            break;
+        }
+        cache_append(context, data, got);
+        context->inner_pos += got;
+    }
+}
+
+size_t sl_seekemu_read_cb(void *context, void *buffer, size_t len)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    size_t read = 0;
+    size_t got;
+
+    catch_up(stream);
+    if (stream->pos > stream->inner_pos) {
+        /* Seeked beyond end-of-file. */
+        stream->eof = 1;
+        return 0;
+    }
+    if (stream->pos < stream->inner_pos) {
+        read = cache_replay(stream, buffer, len);
+        stream->pos += read;
+    }
+    if (read < len) {
+        got = sl_read(stream->inner_stream, (char*)buffer + read, len - read);
+        cache_append(stream, (char*)buffer + read, got);
+        stream->inner_pos += got;
+        stream->pos += got;
+        if (got < len - read) {
+            stream->eof = (stream->inner_stream->eof ?
+                           sl_eof(stream->inner_stream) : 1);
+        }
+        read += got;
+    }
+    return read;
+}
+
+int sl_seekemu_seek_cb(void *context, off_t offset, int whence)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    off_t length;
+
+    switch (whence) {
+        case SL_SEEK_SET:
+            break;
+        case SL_SEEK_CUR:
+            offset += stream->pos;
+            break;
+        case SL_SEEK_END:
+            length = sl_seekemu_length_cb(context);
+            if (length < 0) {
+                return -1;
+            }
+            offset += length;
+            break;
+        default:
+            return -1;
+    }
+    if (offset < 0) {
+        return -1;
+    }
+
+    /* Cached or ahead. Reading catches up. */
+    if (offset >= stream->inner_pos - (off_t)stream->cache_len) {
+        stream->pos = offset;
+        stream->eof = 0;
+        return 0;
+    }
+
+    /* Too far back. Seek natively or restart from the beginning. */
+    if (!(inner_seekable(stream) && seek_inner(stream, offset) == 0)
+            && seek_inner(stream, 0) != 0) {
+        SL_SEEKEMU_LOG("ERROR: Couldn't go back to %jd.", (intmax_t)offset);
+        return -1;
+    }
+    SL_SEEKEMU_LOG("Restarted inner stream at %jd for %jd.",
+                   (intmax_t)stream->inner_pos, (intmax_t)offset);
+    stream->pos = offset;
+    stream->eof = 0;
+    return 0;
+}
+
+off_t sl_seekemu_tell_cb(void *context)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    return stream->pos;
+}
+
+int sl_seekemu_eof_cb(void *context)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    return stream->eof;
+}
+
+int sl_seekemu_error_cb(void *context)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    if (!stream->inner_stream->error) {
+        return 0;
+    }
+    return sl_error(stream->inner_stream);
+}
+
+off_t sl_seekemu_length_cb(void *context)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    if (!stream->inner_stream->length) {
+        return -1;
+    }
+    return sl_length(stream->inner_stream);
+}
+
+sl_seekable_t sl_seekemu_seekable_cb(void *context)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    return (inner_seekable(stream) ? SL_SEEKING_SUPPORTED
+                                   : SL_SEEKING_EMULATED);
+}
+
+int sl_seekemu_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    return sl_data_map(stream->inner_stream, offset, length, ranges, max);
+}
+
+int sl_seekemu_advise_cb(void *context, off_t offset, off_t length, int advice)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    return sl_advise(stream->inner_stream, offset, length, advice);
+}
+
+off_t sl_seekemu_seek_cost_cb(void *context, off_t offset)
+{
+    SL_SEEKEMU_ASSERT(context);
+    sl_seekemu_t *stream = context;
+    off_t inner_cost = -1;
+    off_t cost;
+
+    if (offset >= stream->inner_pos - (off_t)stream->cache_len
+            && offset <= stream->inner_pos) {
+        return 0;
+    }
+    /* Bytes read through, from inner offset or from the beginning. */
+    cost = (offset > stream->inner_pos ? offset - stream->inner_pos : offset);
+    if (inner_seekable(stream)) {
+        inner_cost = sl_seek_cost(stream->inner_stream, offset);
+    }
+    return (inner_cost >= 0 && inner_cost < cost ? inner_cost : cost);
+}
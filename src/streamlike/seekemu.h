@@ -0,0 +1,35 @@
+#ifndef STREAMLIKE_SEEKEMU_H
+#define STREAMLIKE_SEEKEMU_H
+
+#include "../streamlike.h"
+#define SL_SEEKEMU_DEFAULT_CACHE_SIZE (1024 * 1024)
+#define SL_SEEKEMU_SCRATCH_SIZE       (64 * 1024)
+
+/* Decorator emulating seeks over a stream which can't seek, e.g. a pipe or an
+ * HTTP server ignoring ranges. Forward seeks read and discard, unless inner
+ * stream seeks natively for less, as estimated by its seek cost. Last
+ * cache_size bytes read are kept, so that seeking back into them replays them.
+ * Seeking back further restarts inner stream by seeking it to the beginning,
+ * which even such streams may support, and reads forward again. Inner stream
+ * isn't destroyed along with the decorator. */
+streamlike_t* sl_seekemu_create(streamlike_t *inner_stream);
+streamlike_t* sl_seekemu_create2(streamlike_t *inner_stream,
+                                 size_t cache_size);
+int sl_seekemu_destroy(streamlike_t *seekemu_stream);
+
+size_t sl_seekemu_read_cb(void *context, void *buffer, size_t len);
+/* Forward seeks are done lazily by the next read. */
+int sl_seekemu_seek_cb(void *context, off_t offset, int whence);
+off_t sl_seekemu_tell_cb(void *context);
+int sl_seekemu_eof_cb(void *context);
+int sl_seekemu_error_cb(void *context);
+off_t sl_seekemu_length_cb(void *context);
+/* Native seeking of inner stream is reported as is, emulated otherwise. */
+sl_seekable_t sl_seekemu_seekable_cb(void *context);
+int sl_seekemu_data_map_cb(void *context, off_t offset, off_t length,
+                           sl_range_t *ranges, int max);
+int sl_seekemu_advise_cb(void *context, off_t offset, off_t length,
+                         int advice);
+off_t sl_seekemu_seek_cost_cb(void *context, off_t offset);
+
+#endif /* STREAMLIKE_SEEKEMU_H */
@@ -0,0 +1,254 @@
+#include "blockq.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+struct blockq_s
+{
+    void *data;
+    size_t *lens;
+    size_t block_size;
+    size_t stride;
+    size_t count;
+    size_t widx;
+    size_t ridx;
+    volatile size_t filled;
+    volatile int wdone;
+    volatile int rdone;
+    pthread_mutex_t lock;
+    pthread_cond_t  wcond;
+    pthread_cond_t  rcond;
+    /* Time blocked, each updated only by its own side. */
+    volatile uint64_t read_wait_ns;
+    volatile uint64_t write_wait_ns;
+};
+
+static
+uint64_t now_ns_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+blockq_t* blockq_init(size_t block_size, size_t block_count, size_t alignment)
+{
+    blockq_t *bq;
+    pthread_condattr_t attr;
+
+    if (block_size == 0 || block_count == 0 || alignment == 0
+            || (alignment & (alignment - 1)) != 0
+            || alignment % sizeof(void*) != 0) {
+        return NULL;
+    }
+    bq = malloc(sizeof(blockq_t));
+    if (!bq) {
+        return NULL;
+    }
+    /* Round block stride up so that each block is aligned. */
+    bq->stride = (block_size + alignment - 1) & ~(alignment - 1);
+    if (bq->stride < block_size || SIZE_MAX / bq->stride < block_count) {
+        free(bq);
+        return NULL;
+    }
+    if (posix_memalign(&bq->data, alignment, bq->stride * block_count) != 0) {
+        free(bq);
+        return NULL;
+    }
+    bq->lens = malloc(sizeof(size_t) * block_count);
+    if (!bq->lens) {
+        goto fail;
+    }
+    if (pthread_mutex_init(&bq->lock, NULL) != 0) {
+        goto fail;
+    }
+    /* Consumer waits on wcond until deadlines measured by monotonic clock. */
+    if (pthread_condattr_init(&attr) != 0) {
+        pthread_mutex_destroy(&bq->lock);
+        goto fail;
+    }
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0
+            || pthread_cond_init(&bq->wcond, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&bq->lock);
+        goto fail;
+    }
+    pthread_condattr_destroy(&attr);
+    if (pthread_cond_init(&bq->rcond, NULL) != 0) {
+        pthread_mutex_destroy(&bq->lock);
+        pthread_cond_destroy(&bq->wcond);
+        goto fail;
+    }
+    bq->block_size = block_size;
+    bq->count      = block_count;
+    bq->read_wait_ns  = 0;
+    bq->write_wait_ns = 0;
+    blockq_reset(bq);
+
+    return bq;
+
+fail:
+    free(bq->lens);
+    free(bq->data);
+    free(bq);
+    return NULL;
+}
+
+void blockq_destroy(blockq_t *bq)
+{
+    pthread_mutex_destroy(&bq->lock);
+    pthread_cond_destroy(&bq->wcond);
+    pthread_cond_destroy(&bq->rcond);
+    free(bq->lens);
+    free(bq->data);
+    free(bq);
+}
+
+void blockq_reset(blockq_t *bq)
+{
+    bq->widx   = 0;
+    bq->ridx   = 0;
+    bq->filled = 0;
+    bq->wdone  = 0;
+    bq->rdone  = 0;
+}
+
+size_t blockq_get_block_size(const blockq_t *bq)
+{
+    return bq->block_size;
+}
+
+size_t blockq_get_length(const blockq_t *bq)
+{
+    return bq->filled;
+}
+
+void blockq_get_wait_ns(const blockq_t *bq, uint64_t *read_wait_ns,
+                        uint64_t *write_wait_ns)
+{
+    if (read_wait_ns) {
+        *read_wait_ns = bq->read_wait_ns;
+    }
+    if (write_wait_ns) {
+        *write_wait_ns = bq->write_wait_ns;
+    }
+}
+
+int blockq_is_read_closed(const blockq_t *bq)
+{
+    return bq->rdone;
+}
+
+int blockq_is_write_closed(const blockq_t *bq)
+{
+    return bq->wdone;
+}
+
+void* blockq_acquire(blockq_t *bq)
+{
+    void *block = NULL;
+    uint64_t start = 0;
+
+    pthread_mutex_lock(&bq->lock);
+    while (bq->filled == bq->count && !bq->rdone) {
+        if (!start) {
+            start = now_ns_();
+        }
+        pthread_cond_wait(&bq->rcond, &bq->lock);
+    }
+    if (start) {
+        bq->write_wait_ns += now_ns_() - start;
+    }
+    if (!bq->rdone) {
+        block = (char*)bq->data + bq->widx * bq->stride;
+    }
+    pthread_mutex_unlock(&bq->lock);
+    return block;
+}
+
+void blockq_commit(blockq_t *bq, size_t len)
+{
+    pthread_mutex_lock(&bq->lock);
+    bq->lens[bq->widx] = (len < bq->block_size ? len : bq->block_size);
+    bq->widx = (bq->widx + 1) % bq->count;
+    bq->filled++;
+    pthread_cond_signal(&bq->wcond);
+    pthread_mutex_unlock(&bq->lock);
+}
+
+size_t blockq_read(blockq_t *bq, const void **block)
+{
+    return blockq_read_timed(bq, block, NULL, NULL);
+}
+
+size_t blockq_read_timed(blockq_t *bq, const void **block,
+                         const struct timespec *abstime, char *timed_out)
+{
+    size_t len = 0;
+    int ret = 0;
+    uint64_t start = 0;
+
+    pthread_mutex_lock(&bq->lock);
+    while (bq->filled == 0 && !bq->wdone && ret != ETIMEDOUT) {
+        if (!start) {
+            start = now_ns_();
+        }
+        if (abstime) {
+            ret = pthread_cond_timedwait(&bq->wcond, &bq->lock, abstime);
+        } else {
+            pthread_cond_wait(&bq->wcond, &bq->lock);
+        }
+    }
+    if (start) {
+        bq->read_wait_ns += now_ns_() - start;
+    }
+    if (bq->filled > 0) {
+        *block = (char*)bq->data + bq->ridx * bq->stride;
+        len = bq->lens[bq->ridx];
+    } else if (!bq->wdone && timed_out) {
+        *timed_out = 1;
+    }
+    pthread_mutex_unlock(&bq->lock);
+    return len;
+}
+
+void blockq_release(blockq_t *bq)
+{
+    pthread_mutex_lock(&bq->lock);
+    if (bq->filled > 0) {
+        bq->ridx = (bq->ridx + 1) % bq->count;
+        bq->filled--;
+        pthread_cond_signal(&bq->rcond);
+    }
+    pthread_mutex_unlock(&bq->lock);
+}
+
+int blockq_close_read(blockq_t *bq)
+{
+    if (bq->rdone) {
+        return -1;
+    }
+
+    /* Update bq->rdone and signal producer. */
+    pthread_mutex_lock(&bq->lock);
+    bq->rdone = 1;
+    pthread_cond_signal(&bq->rcond);
+    pthread_mutex_unlock(&bq->lock);
+    return 0;
+}
+
+int blockq_close_write(blockq_t *bq)
+{
+    if (bq->wdone) {
+        return -1;
+    }
+
+    /* Update bq->wdone and signal consumer. */
+    pthread_mutex_lock(&bq->lock);
+    bq->wdone = 1;
+    pthread_cond_signal(&bq->wcond);
+    pthread_mutex_unlock(&bq->lock);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * \file
+ * Block queue.
+ *
+ * A threaded queue of fixed-size, aligned blocks for one producer and one
+ * consumer. Blocks are handed over as a whole between the producer and the
+ * consumer without copying.
+ */
+#ifndef BLOCKQ_H
+#define BLOCKQ_H
+#include<stddef.h>
+#include<stdint.h>
+#include<time.h>
+
+/**
+ * Opaque type for block queue.
+ */
+typedef struct blockq_s blockq_t;
+
+/**
+ * Initializes a block queue.
+ *
+ * Each block starts at an address aligned to given alignment. Block size is
+ * not required to be a multiple of alignment.
+ *
+ * \param   block_size  Number of bytes in each block.
+ * \param   block_count Number of blocks.
+ * \param   alignment   Alignment of blocks. Should be a power of two and a
+ *                      multiple of `sizeof(void*)`.
+ *
+ * \return  Pointer to newly created block queue. NULL if any of parameters is
+ *          invalid or memory allocations fail.
+ *
+ * \see     blockq_destroy()
+ */
+blockq_t* blockq_init(size_t block_size, size_t block_count, size_t alignment);
+
+/**
+ * Releases all sources (including pointer itself) used by the block queue.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \see     blockq_init()
+ */
+void blockq_destroy(blockq_t *bq);
+
+/**
+ * Resets block queue.
+ *
+ * This function effectively disposes all blocks in the queue, including the
+ * ones acquired but not committed or released.
+ *
+ * It is undefined behavior to call this function if the producer or the
+ * consumer is accessing the queue concurrent with this call.
+ *
+ * \param   bq      Pointer to the block queue.
+ */
+void blockq_reset(blockq_t *bq);
+
+/**
+ * Gives the size of each block.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Block size.
+ */
+size_t blockq_get_block_size(const blockq_t *bq);
+
+/**
+ * Gives the number of blocks committed by the producer and not released by the
+ * consumer yet.
+ *
+ * The value returned by this function may not be reliable if the queue is
+ * being modified concurrently.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Number of filled blocks.
+ */
+size_t blockq_get_length(const blockq_t *bq);
+
+/**
+ * Gives total time the consumer and the producer spent blocked.
+ *
+ * Consumer blocks while there are no filled blocks, and producer blocks while
+ * there are no free ones. Totals are kept since initialization, including
+ * across resets.
+ *
+ * \param   bq              Pointer to the block queue.
+ * \param   read_wait_ns    Output for nanoseconds consumer spent blocked.
+ *                          Ignored if it is NULL.
+ * \param   write_wait_ns   Output for nanoseconds producer spent blocked.
+ *                          Ignored if it is NULL.
+ */
+void blockq_get_wait_ns(const blockq_t *bq, uint64_t *read_wait_ns,
+                        uint64_t *write_wait_ns);
+
+/**
+ * Returns whether consumer closed reading.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Zero if read is not closed.
+ */
+int blockq_is_read_closed(const blockq_t *bq);
+
+/**
+ * Returns whether producer closed writing.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Zero if write is not closed.
+ */
+int blockq_is_write_closed(const blockq_t *bq);
+
+/**
+ * Gets the next free block for the producer with blocking if necessary.
+ *
+ * Blocks until a block is released by the consumer or reading is closed. The
+ * block is owned by the producer until it is committed.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Pointer to the block. NULL if reading is closed.
+ *
+ * \see     blockq_commit()
+ */
+void* blockq_acquire(blockq_t *bq);
+
+/**
+ * Hands over the block acquired by the producer to the consumer.
+ *
+ * \param   bq      Pointer to the block queue.
+ * \param   len     Number of bytes filled in the block.
+ *
+ * \see     blockq_acquire()
+ */
+void blockq_commit(blockq_t *bq, size_t len);
+
+/**
+ * Gets the next filled block for the consumer with blocking if necessary.
+ *
+ * Blocks until a block is committed by the producer or writing is closed. The
+ * block is owned by the consumer until it is released.
+ *
+ * \param   bq      Pointer to the block queue.
+ * \param   block   Output pointer to store the pointer to the block.
+ *
+ * \return  Number of bytes in the block. Zero if writing is closed and there
+ *          are no blocks left.
+ *
+ * \see     blockq_release()
+ */
+size_t blockq_read(blockq_t *bq, const void **block);
+
+/**
+ * Gets the next filled block for the consumer with blocking until a deadline.
+ *
+ * Same as blockq_read(), except that it stops blocking once abstime passes.
+ *
+ * \param   bq        Pointer to the block queue.
+ * \param   block     Output pointer to store the pointer to the block.
+ * \param   abstime   Deadline measured by `CLOCK_MONOTONIC`. Blocks without a
+ *                    deadline if it is NULL.
+ * \param   timed_out Output flag set if the deadline passed before a block is
+ *                    committed. Ignored if it is NULL.
+ *
+ * \return  Number of bytes in the block. Zero if writing is closed and there
+ *          are no blocks left, or if the deadline passed.
+ *
+ * \see     blockq_read()
+ */
+size_t blockq_read_timed(blockq_t *bq, const void **block,
+                         const struct timespec *abstime, char *timed_out);
+
+/**
+ * Hands the block read by the consumer back to the producer.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \see     blockq_read()
+ */
+void blockq_release(blockq_t *bq);
+
+/**
+ * Closes reading and signals the producer.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Zero on success. Error if already closed.
+ */
+int blockq_close_read(blockq_t *bq);
+
+/**
+ * Closes writing and signals the consumer.
+ *
+ * \param   bq      Pointer to the block queue.
+ *
+ * \return  Zero on success. Error if already closed.
+ */
+int blockq_close_write(blockq_t *bq);
+
+#endif /* BLOCKQ_H */
@@ -1,5 +1,6 @@
 #include "circbuf.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,11 +18,23 @@ struct circbuf_s
     volatile int rdone;
     pthread_mutex_t rlock;
     pthread_cond_t  rcond;
+    /* Time blocked, each updated only by its own side. */
+    volatile uint64_t read_wait_ns;
+    volatile uint64_t write_wait_ns;
 };
 
+static
+uint64_t now_ns_()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 circbuf_t* circbuf_init(size_t cbuf_size)
 {
     circbuf_t* cbuf;
+    pthread_condattr_t attr;
 
     if (cbuf_size == 0) {
         return NULL;
@@ -42,10 +55,18 @@ circbuf_t* circbuf_init(size_t cbuf_size)
     if (pthread_cond_init(&cbuf->rcond, NULL) != 0) {
         goto fail;
     }
-    if (pthread_cond_init(&cbuf->wcond, NULL) != 0) {
+    /* Consumer waits on wcond until deadlines measured by monotonic clock. */
+    if (pthread_condattr_init(&attr) != 0) {
         pthread_cond_destroy(&cbuf->rcond);
         goto fail;
     }
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0
+            || pthread_cond_init(&cbuf->wcond, &attr) != 0) {
+        pthread_condattr_destroy(&attr);
+        pthread_cond_destroy(&cbuf->rcond);
+        goto fail;
+    }
+    pthread_condattr_destroy(&attr);
     if (pthread_mutex_init(&cbuf->rlock, NULL) != 0) {
         pthread_cond_destroy(&cbuf->rcond);
         pthread_cond_destroy(&cbuf->wcond);
@@ -62,6 +83,8 @@ circbuf_t* circbuf_init(size_t cbuf_size)
     cbuf->woff  = 0;
     cbuf->roff  = 0;
     cbuf->size  = cbuf_size;
+    cbuf->read_wait_ns  = 0;
+    cbuf->write_wait_ns = 0;
 
     return (circbuf_t*)cbuf;
 
@@ -102,6 +125,17 @@ size_t circbuf_get_length(const circbuf_t* cbuf)
     return cbuf->size - roff + woff;
 }
 
+void circbuf_get_wait_ns(const circbuf_t *cbuf, uint64_t *read_wait_ns,
+                         uint64_t *write_wait_ns)
+{
+    if (read_wait_ns) {
+        *read_wait_ns = cbuf->read_wait_ns;
+    }
+    if (write_wait_ns) {
+        *write_wait_ns = cbuf->write_wait_ns;
+    }
+}
+
 int circbuf_is_read_closed(const circbuf_t* cbuf)
 {
     return cbuf->rdone;
@@ -172,13 +206,56 @@ size_t circbuf_read_some(circbuf_t *cbuf, void *buf, size_t buf_len)
 size_t circbuf_read(circbuf_t *cbuf, void *buf, size_t buf_len)
 {
     size_t read = 0;
+    uint64_t start;
 
     while (read < buf_len && (cbuf->roff != cbuf->woff || !cbuf->wdone)) {
+        start = 0;
         pthread_mutex_lock(&cbuf->wlock);
         while (cbuf->roff == cbuf->woff && !cbuf->wdone) {
+            if (!start) {
+                start = now_ns_();
+            }
             pthread_cond_wait(&cbuf->wcond, &cbuf->wlock);
         }
         pthread_mutex_unlock(&cbuf->wlock);
+        if (start) {
+            cbuf->read_wait_ns += now_ns_() - start;
+        }
+        read += circbuf_read_some(cbuf, buf + read, buf_len - read);
+    }
+    return read;
+}
+
+size_t circbuf_read_timed(circbuf_t *cbuf, void *buf, size_t buf_len,
+                          const struct timespec *abstime, char *timed_out)
+{
+    size_t read = 0;
+    int ret = 0;
+    uint64_t start;
+
+    if (!abstime) {
+        return circbuf_read(cbuf, buf, buf_len);
+    }
+    while (read < buf_len && (cbuf->roff != cbuf->woff || !cbuf->wdone)) {
+        start = 0;
+        pthread_mutex_lock(&cbuf->wlock);
+        while (cbuf->roff == cbuf->woff && !cbuf->wdone && ret != ETIMEDOUT) {
+            if (!start) {
+                start = now_ns_();
+            }
+            ret = pthread_cond_timedwait(&cbuf->wcond, &cbuf->wlock, abstime);
+        }
+        pthread_mutex_unlock(&cbuf->wlock);
+        if (start) {
+            cbuf->read_wait_ns += now_ns_() - start;
+        }
+        /* Deadline passed with nothing left to read. */
+        if (cbuf->roff == cbuf->woff && !cbuf->wdone) {
+            if (timed_out) {
+                *timed_out = 1;
+            }
+            break;
+        }
         read += circbuf_read_some(cbuf, buf + read, buf_len - read);
     }
     return read;
@@ -288,18 +365,26 @@ size_t circbuf_write_some(circbuf_t *cbuf, const void *buf, size_t buf_len)
 size_t circbuf_write(circbuf_t *cbuf, const void *buf, size_t buf_len)
 {
     size_t written = 0;
+    uint64_t start;
 
     if (cbuf->rdone) {
         return 0;
     }
     while (written < buf_len && !cbuf->rdone) {
+        start = 0;
         pthread_mutex_lock(&cbuf->rlock);
         while ((cbuf->woff + 1 == cbuf->roff
                     || (cbuf->woff + 1 == cbuf->size && cbuf->roff == 0))
                && !cbuf->rdone) {
+            if (!start) {
+                start = now_ns_();
+            }
             pthread_cond_wait(&cbuf->rcond, &cbuf->rlock);
         }
         pthread_mutex_unlock(&cbuf->rlock);
+        if (start) {
+            cbuf->write_wait_ns += now_ns_() - start;
+        }
         if (!cbuf->rdone) {
             written += circbuf_write_some(cbuf, buf + written,
                                           buf_len - written);
@@ -402,18 +487,26 @@ size_t circbuf_write2(circbuf_t *cbuf, circbuf_write_cb_t writer, void *context,
 {
     char eof = 0;
     size_t written = 0;
+    uint64_t start;
 
     if (cbuf->rdone) {
         return 0;
     }
     while (written < len && !cbuf->rdone && !eof) {
+        start = 0;
         pthread_mutex_lock(&cbuf->rlock);
         while ((cbuf->woff + 1 == cbuf->roff
                     || (cbuf->woff + 1 == cbuf->size && cbuf->roff == 0))
                && !cbuf->rdone) {
+            if (!start) {
+                start = now_ns_();
+            }
             pthread_cond_wait(&cbuf->rcond, &cbuf->rlock);
         }
         pthread_mutex_unlock(&cbuf->rlock);
+        if (start) {
+            cbuf->write_wait_ns += now_ns_() - start;
+        }
         if (!cbuf->rdone) {
             written += circbuf_write_some2(cbuf, writer, context, len - written,
                                            &eof);
@@ -7,6 +7,8 @@
 #ifndef CIRCBUF_H
 #define CIRCBUF_H
 #include<stddef.h>
+#include<stdint.h>
+#include<time.h>
 
 /**
  * Opaque type for circular buffer.
@@ -91,6 +93,21 @@ size_t circbuf_get_size(const circbuf_t* cbuf);
  */
 size_t circbuf_get_length(const circbuf_t* cbuf);
 
+/**
+ * Gives total time the consumer and the producer spent blocked.
+ *
+ * Consumer blocks on an empty buffer, and producer blocks on a full one.
+ * Totals are kept since initialization, including across resets.
+ *
+ * \param   cbuf            Pointer to the circular buffer.
+ * \param   read_wait_ns    Output for nanoseconds consumer spent blocked.
+ *                          Ignored if it is NULL.
+ * \param   write_wait_ns   Output for nanoseconds producer spent blocked.
+ *                          Ignored if it is NULL.
+ */
+void circbuf_get_wait_ns(const circbuf_t *cbuf, uint64_t *read_wait_ns,
+                         uint64_t *write_wait_ns);
+
 /**
  * Returns whether consumer closed reading.
  *
@@ -142,6 +159,27 @@ size_t circbuf_read_some(circbuf_t *cbuf, void *buf, size_t buf_len);
  */
 size_t circbuf_read(circbuf_t *cbuf, void *buf, size_t buf_len);
 
+/**
+ * Reads buf_len bytes from the circular buffer with blocking until a deadline.
+ *
+ * Same as circbuf_read(), except that it stops blocking and returns whatever
+ * is read so far once abstime passes.
+ *
+ * \param   cbuf      Pointer to the circular buffer.
+ * \param   buf       Pointer to the buffer for reading into.
+ * \param   buf_len   Length of space available in buf.
+ * \param   abstime   Deadline measured by `CLOCK_MONOTONIC`. Blocks without a
+ *                    deadline if it is NULL.
+ * \param   timed_out Output flag set if the deadline passed before buf is
+ *                    full. Ignored if it is NULL.
+ *
+ * \return  Number of bytes read.
+ *
+ * \see     circbuf_read()
+ */
+size_t circbuf_read_timed(circbuf_t *cbuf, void *buf, size_t buf_len,
+                          const struct timespec *abstime, char *timed_out);
+
 /**
  * Gets a pointer to the next data sequence up to given length.
  *
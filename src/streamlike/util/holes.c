@@ -0,0 +1,63 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* SEEK_DATA and SEEK_HOLE */
+#endif
+#include "holes.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+int holes_data_map(int fd, off_t offset, off_t length, sl_range_t *ranges,
+                   int max)
+{
+    struct stat s;
+    off_t saved;
+    off_t end;
+    off_t data;
+    off_t hole;
+    int count = 0;
+
+    if (fstat(fd, &s) < 0 || offset < 0) {
+        return -1;
+    }
+    end = (length > 0 && offset + length < s.st_size ? offset + length
+                                                     : s.st_size);
+    saved = lseek(fd, 0, SEEK_CUR);
+    if (saved < 0) {
+        return -1;
+    }
+    while (offset < end && count < max) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        data = lseek(fd, offset, SEEK_DATA);
+        if (data < 0 && errno == ENXIO) {
+            /* Only holes are left. */
+            break;
+        }
+        if (data < 0 && errno != EINVAL) {
+            count = -1;
+            break;
+        }
+        if (data < 0) {
+            /* File system doesn't tell, so all of it is data. */
+            data = offset;
+            hole = end;
+        } else if (data >= end) {
+            break;
+        } else if ((hole = lseek(fd, data, SEEK_HOLE)) < 0) {
+            count = -1;
+            break;
+        }
+#else
+        data = offset;
+        hole = end;
+#endif
+        ranges[count].offset = data;
+        ranges[count].length = (hole < end ? hole : end) - data;
+        count++;
+        offset = hole;
+    }
+    if (lseek(fd, saved, SEEK_SET) < 0) {
+        return -1;
+    }
+    return count;
+}
@@ -0,0 +1,33 @@
+/**
+ * \file
+ * Hole detection in sparse files.
+ *
+ * Maps data of a file through `SEEK_DATA` and `SEEK_HOLE`, which are answered
+ * by the file system without reading. Where they aren't supported, the whole
+ * file is mapped as data.
+ */
+#ifndef HOLES_H
+#define HOLES_H
+#include<sys/types.h>
+
+#include "../../streamlike.h"
+
+/**
+ * Maps ranges holding data in a part of a file, like sl_data_map_cb_t().
+ *
+ * Descriptor offset is moved while mapping, and put back afterwards. So this
+ * shouldn't race with reads using descriptor offset, e.g. through stdio.
+ *
+ * \param   fd      File descriptor of a regular file.
+ * \param   offset  Offset of the part to map.
+ * \param   length  Number of bytes in the part. Zero means till end-of-file.
+ * \param   ranges  Output for ranges holding data.
+ * \param   max     Most ranges to give.
+ *
+ * \return  Number of ranges given. If it is `max`, there may be more ranges
+ *          after the last one. Negative on error.
+ */
+int holes_data_map(int fd, off_t offset, off_t length, sl_range_t *ranges,
+                   int max);
+
+#endif /* HOLES_H */
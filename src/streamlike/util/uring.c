@@ -0,0 +1,277 @@
+#include "uring.h"
+
+#include <stdlib.h>
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+# endif
+#endif
+
+#ifdef IORING_FEAT_EXT_ARG
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+struct uring_s
+{
+    int fd;
+    unsigned sq_entries;
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static
+int enter_(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+           void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+uring_t* uring_init(unsigned entries)
+{
+    struct io_uring_params p;
+    uring_t *ring;
+
+    ring = malloc(sizeof(uring_t));
+    if (!ring) {
+        return NULL;
+    }
+    memset(&p, 0, sizeof(p));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    ring->sq_ring = MAP_FAILED;
+    ring->cq_ring = MAP_FAILED;
+    ring->sqes    = MAP_FAILED;
+    /* Timed waits need extended arguments of io_uring_enter (Linux 5.11). */
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        goto fail;
+    }
+
+    ring->sq_entries   = p.sq_entries;
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes
+                         + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size    = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED
+            || ring->sqes == MAP_FAILED) {
+        goto fail;
+    }
+    ring->sq_head  = (unsigned*)((char*)ring->sq_ring + p.sq_off.head);
+    ring->sq_tail  = (unsigned*)((char*)ring->sq_ring + p.sq_off.tail);
+    ring->sq_mask  = (unsigned*)((char*)ring->sq_ring + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)((char*)ring->sq_ring + p.sq_off.array);
+    ring->cq_head  = (unsigned*)((char*)ring->cq_ring + p.cq_off.head);
+    ring->cq_tail  = (unsigned*)((char*)ring->cq_ring + p.cq_off.tail);
+    ring->cq_mask  = (unsigned*)((char*)ring->cq_ring + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ring + p.cq_off.cqes);
+    return ring;
+
+fail:
+    uring_destroy(ring);
+    return NULL;
+}
+
+void uring_destroy(uring_t *ring)
+{
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != MAP_FAILED) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+int uring_submit_read(uring_t *ring, int fd, void *buffer, unsigned size,
+                      off_t offset, uint64_t user_data)
+{
+    return uring_submit_read2(ring, fd, buffer, size, offset, -1, 0,
+                              user_data);
+}
+
+int uring_submit_read2(uring_t *ring, int fd, void *buffer, unsigned size,
+                       off_t offset, int buf_index, unsigned flags,
+                       uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned head;
+    unsigned tail;
+    unsigned idx;
+    int ret;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    tail = *ring->sq_tail;
+    if (tail - head >= ring->sq_entries) {
+        return -1;
+    }
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = (buf_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ);
+    sqe->flags     = (flags & URING_FIXED_FILE ? IOSQE_FIXED_FILE : 0);
+    sqe->fd        = fd;
+    sqe->addr      = (uintptr_t)buffer;
+    sqe->len       = size;
+    sqe->off       = offset;
+    sqe->user_data = user_data;
+    if (buf_index >= 0) {
+        sqe->buf_index = buf_index;
+    }
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    do {
+        ret = enter_(ring->fd, 1, 0, 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    /* Entry stays queued if the kernel is busy. Next submission or wait takes
+     * it along, and its completion follows. */
+    if (ret >= 0 || errno == EAGAIN || errno == EBUSY) {
+        return 0;
+    }
+    /* Entry isn't consumed on other errors. Take it back, so that it isn't
+     * submitted later with its buffer gone. */
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if ((int)(tail - head) < 0) {
+        return 0;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    return -1;
+}
+
+int uring_register_buffers(uring_t *ring, const struct iovec *iov,
+                           unsigned count)
+{
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                   iov, count) < 0;
+}
+
+int uring_register_files(uring_t *ring, const int *fds, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES,
+                   fds, count) < 0;
+}
+
+int uring_wait(uring_t *ring, int timeout_ms)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned queued;
+    int ret;
+
+    ts.tv_sec  = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uintptr_t)&ts;
+
+    queued = __atomic_load_n(ring->sq_tail, __ATOMIC_ACQUIRE)
+             - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    ret = enter_(ring->fd, queued, 1,
+                 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                 sizeof(arg));
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN
+            && errno != EBUSY) {
+        return -1;
+    }
+    return 0;
+}
+
+int uring_reap(uring_t *ring, uint64_t *user_data, int *res)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head;
+
+    head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    cqe = &ring->cqes[head & *ring->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#else /* IORING_FEAT_EXT_ARG */
+
+struct uring_s
+{
+    int unused;
+};
+
+uring_t* uring_init(unsigned entries)
+{
+    return NULL;
+}
+
+void uring_destroy(uring_t *ring)
+{
+    free(ring);
+}
+
+int uring_submit_read(uring_t *ring, int fd, void *buffer, unsigned size,
+                      off_t offset, uint64_t user_data)
+{
+    return -1;
+}
+
+int uring_submit_read2(uring_t *ring, int fd, void *buffer, unsigned size,
+                       off_t offset, int buf_index, unsigned flags,
+                       uint64_t user_data)
+{
+    return -1;
+}
+
+int uring_register_buffers(uring_t *ring, const struct iovec *iov,
+                           unsigned count)
+{
+    return -1;
+}
+
+int uring_register_files(uring_t *ring, const int *fds, unsigned count)
+{
+    return -1;
+}
+
+int uring_wait(uring_t *ring, int timeout_ms)
+{
+    return -1;
+}
+
+int uring_reap(uring_t *ring, uint64_t *user_data, int *res)
+{
+    return 0;
+}
+
+#endif /* IORING_FEAT_EXT_ARG */
@@ -0,0 +1,141 @@
+/**
+ * \file
+ * Minimal io_uring wrapper.
+ *
+ * Sets up an io_uring through raw system calls, so that it doesn't depend on
+ * liburing. Only the operations used by the library are provided. Submission
+ * and reaping are not thread-safe themselves: callers should serialize
+ * submissions with each other and reaping with each other. A submission and a
+ * wait may run concurrently.
+ */
+#ifndef URING_H
+#define URING_H
+#include<stddef.h>
+#include<stdint.h>
+#include<sys/types.h>
+
+struct iovec;
+
+/**
+ * Opaque type for io_uring.
+ */
+typedef struct uring_s uring_t;
+
+/**
+ * Flag of uring_submit_read2() telling that `fd` is an index into files
+ * registered by uring_register_files().
+ */
+#define URING_FIXED_FILE (1u << 0)
+
+/**
+ * Sets up an io_uring.
+ *
+ * \param   entries Number of submission queue entries.
+ *
+ * \return  Pointer to the io_uring. NULL if io_uring isn't supported by the
+ *          system or the setup fails.
+ *
+ * \see     uring_destroy()
+ */
+uring_t* uring_init(unsigned entries);
+
+/**
+ * Releases all sources (including pointer itself) used by the io_uring.
+ *
+ * \param   ring    Pointer to the io_uring.
+ *
+ * \see     uring_init()
+ */
+void uring_destroy(uring_t *ring);
+
+/**
+ * Submits a read like `pread(fd, buffer, size, offset)`.
+ *
+ * \param   ring      Pointer to the io_uring.
+ * \param   fd        File descriptor to read from.
+ * \param   buffer    Buffer to read into.
+ * \param   size      Number of bytes to read.
+ * \param   offset    Offset to read from.
+ * \param   user_data Value passed back with the completion.
+ *
+ * \return  Zero if the read is queued, in which case a completion follows even
+ *          if the read fails. Nonzero if nothing is queued, because the
+ *          submission queue is full or the submission fails.
+ */
+int uring_submit_read(uring_t *ring, int fd, void *buffer, unsigned size,
+                      off_t offset, uint64_t user_data);
+
+/**
+ * Submits a read like uring_submit_read(), optionally into a registered buffer
+ * or from a registered file, which saves the kernel from mapping the buffer or
+ * looking up the file on each read.
+ *
+ * \param   ring      Pointer to the io_uring.
+ * \param   fd        File descriptor to read from, or index of a registered
+ *                    file with #URING_FIXED_FILE.
+ * \param   buffer    Buffer to read into.
+ * \param   size      Number of bytes to read.
+ * \param   offset    Offset to read from.
+ * \param   buf_index Index of the registered buffer holding the whole of
+ *                    `buffer`, or negative if it isn't registered.
+ * \param   flags     Zero or #URING_FIXED_FILE.
+ * \param   user_data Value passed back with the completion.
+ *
+ * \return  Zero if the read is queued, nonzero if not, as for
+ *          uring_submit_read().
+ *
+ * \see     uring_register_buffers(), uring_register_files()
+ */
+int uring_submit_read2(uring_t *ring, int fd, void *buffer, unsigned size,
+                       off_t offset, int buf_index, unsigned flags,
+                       uint64_t user_data);
+
+/**
+ * Registers buffers for reads, which pins their memory until the io_uring is
+ * destroyed. Can be done once per io_uring.
+ *
+ * \param   ring    Pointer to the io_uring.
+ * \param   iov     Buffers to register. Their indices are used as `buf_index`.
+ * \param   count   Number of buffers.
+ *
+ * \return  Zero on success. Nonzero on error, e.g. if the memory can't be
+ *          locked.
+ */
+int uring_register_buffers(uring_t *ring, const struct iovec *iov,
+                           unsigned count);
+
+/**
+ * Registers files for reads. Can be done once per io_uring.
+ *
+ * \param   ring    Pointer to the io_uring.
+ * \param   fds     File descriptors to register. Their indices are used
+ *                  instead of them with #URING_FIXED_FILE.
+ * \param   count   Number of files.
+ *
+ * \return  Zero on success. Nonzero on error.
+ */
+int uring_register_files(uring_t *ring, const int *fds, unsigned count);
+
+/**
+ * Blocks until there is a completion or timeout passes.
+ *
+ * \param   ring       Pointer to the io_uring.
+ * \param   timeout_ms Most milliseconds to block.
+ *
+ * \return  Zero on success or timeout. Nonzero on error.
+ */
+int uring_wait(uring_t *ring, int timeout_ms);
+
+/**
+ * Takes a completion without blocking.
+ *
+ * \param   ring      Pointer to the io_uring.
+ * \param   user_data Output for the value given on submission.
+ * \param   res       Output for the result, which is the number of bytes read
+ *                    or a negated `errno` value.
+ *
+ * \return  Nonzero if a completion is taken.
+ */
+int uring_reap(uring_t *ring, uint64_t *user_data, int *res);
+
+#endif /* URING_H */
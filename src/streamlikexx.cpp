@@ -61,6 +61,26 @@ size_t Streamlike::ckp_metadata(const sl_ckp_t* ckp, const void** result) const
     return sl_ckp_metadata(self, ckp, result);
 }
 
+size_t Streamlike::read_at(void *buffer, size_t size, off_t offset) const {
+    return sl_read_at(self, buffer, size, offset);
+}
+
+size_t Streamlike::readv(const struct iovec *iov, int iovcnt) {
+    return sl_readv(self, iov, iovcnt);
+}
+
+size_t Streamlike::writev(const struct iovec *iov, int iovcnt) {
+    return sl_writev(self, iov, iovcnt);
+}
+
+int Streamlike::read_multi(sl_extent_t *extents, int count) {
+    return sl_read_multi(self, extents, count);
+}
+
+off_t Streamlike::seek_cost(off_t offset) const {
+    return sl_seek_cost(self, offset);
+}
+
 bool Streamlike::hasRead() const {
     return self->read;
 }
@@ -97,6 +117,30 @@ bool Streamlike::hasLength() const {
     return self->length;
 }
 
+bool Streamlike::hasReadAt() const {
+    return self->read_at;
+}
+
+bool Streamlike::hasReadv() const {
+    return self->readv;
+}
+
+bool Streamlike::hasWritev() const {
+    return self->writev;
+}
+
+bool Streamlike::hasReadMulti() const {
+    return self->read_multi;
+}
+
+unsigned Streamlike::caps() const {
+    return sl_caps(self);
+}
+
+bool Streamlike::hasCaps(unsigned caps) const {
+    return sl_has_caps(self, caps);
+}
+
 Streamlike::Streamlike(Streamlike&& old) {
     self = old.self;
     old.self = nullptr;
@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <check.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "streamlike/util/blockq.h"
+
+#define BLOCK_SIZE (4000)
+#define BLOCK_COUNT (4)
+#define BLOCK_ALIGNMENT (4096)
+#define DATA_SIZE (1000*BLOCK_SIZE + 123)
+
+char data[DATA_SIZE];
+blockq_t *bq;
+
+void setup_random_data()
+{
+    int i;
+    srand(0);
+    for(i = 0; i < DATA_SIZE; i++) {
+        data[i] = (char) rand();
+    }
+}
+
+void setup_global()
+{
+    bq = blockq_init(BLOCK_SIZE, BLOCK_COUNT, BLOCK_ALIGNMENT);
+    ck_assert_ptr_nonnull(bq);
+}
+
+void teardown_global()
+{
+    blockq_destroy(bq);
+}
+
+START_TEST(test_init_failures)
+{
+    ck_assert_ptr_eq(blockq_init(0, BLOCK_COUNT, BLOCK_ALIGNMENT), NULL);
+    ck_assert_ptr_eq(blockq_init(BLOCK_SIZE, 0, BLOCK_ALIGNMENT), NULL);
+    ck_assert_ptr_eq(blockq_init(BLOCK_SIZE, BLOCK_COUNT, 0), NULL);
+    ck_assert_ptr_eq(blockq_init(BLOCK_SIZE, BLOCK_COUNT, 3000), NULL);
+}
+END_TEST
+
+START_TEST(test_sequential)
+{
+    void *blocks[BLOCK_COUNT];
+    const void *block;
+    int i;
+
+    ck_assert_uint_eq(blockq_get_block_size(bq), BLOCK_SIZE);
+    ck_assert_uint_eq(blockq_get_length(bq), 0);
+
+    for (i = 0; i < BLOCK_COUNT; i++) {
+        blocks[i] = blockq_acquire(bq);
+        ck_assert_ptr_nonnull(blocks[i]);
+        ck_assert_uint_eq((uintptr_t)blocks[i] % BLOCK_ALIGNMENT, 0);
+        memcpy(blocks[i], data + i * BLOCK_SIZE, BLOCK_SIZE);
+        blockq_commit(bq, BLOCK_SIZE - i);
+        ck_assert_uint_eq(blockq_get_length(bq), i + 1);
+    }
+
+    for (i = 0; i < BLOCK_COUNT; i++) {
+        ck_assert_uint_eq(blockq_read(bq, &block), BLOCK_SIZE - i);
+        ck_assert_ptr_eq(block, blocks[i]);
+        ck_assert_mem_eq(block, data + i * BLOCK_SIZE, BLOCK_SIZE - i);
+        blockq_release(bq);
+    }
+    ck_assert_uint_eq(blockq_get_length(bq), 0);
+
+    /* Blocks are reused in the same order. */
+    ck_assert_ptr_eq(blockq_acquire(bq), blocks[0]);
+    blockq_commit(bq, 10);
+
+    ck_assert_int_eq(blockq_close_write(bq), 0);
+    ck_assert_int_ne(blockq_close_write(bq), 0);
+    ck_assert_int_ne(blockq_is_write_closed(bq), 0);
+
+    ck_assert_uint_eq(blockq_read(bq, &block), 10);
+    blockq_release(bq);
+    ck_assert_uint_eq(blockq_read(bq, &block), 0);
+
+    ck_assert_int_eq(blockq_close_read(bq), 0);
+    ck_assert_ptr_eq(blockq_acquire(bq), NULL);
+
+    blockq_reset(bq);
+    ck_assert_int_eq(blockq_is_read_closed(bq), 0);
+    ck_assert_int_eq(blockq_is_write_closed(bq), 0);
+    ck_assert_ptr_eq(blockq_acquire(bq), blocks[0]);
+}
+END_TEST
+
+START_TEST(test_read_timed)
+{
+    struct timespec deadline;
+    const void *block;
+    char timed_out = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += 20000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    ck_assert_uint_eq(blockq_read_timed(bq, &block, &deadline, &timed_out), 0);
+    ck_assert_int_ne(timed_out, 0);
+
+    timed_out = 0;
+    ck_assert_ptr_nonnull(blockq_acquire(bq));
+    blockq_commit(bq, 10);
+    ck_assert_uint_eq(blockq_read_timed(bq, &block, &deadline, &timed_out), 10);
+    ck_assert_int_eq(timed_out, 0);
+    blockq_release(bq);
+
+    blockq_close_write(bq);
+    ck_assert_uint_eq(blockq_read_timed(bq, &block, &deadline, &timed_out), 0);
+    ck_assert_int_eq(timed_out, 0);
+}
+END_TEST
+
+void* producer(void *arg)
+{
+    size_t off = 0;
+    size_t len;
+    void *block;
+
+    while (off < DATA_SIZE) {
+        block = blockq_acquire(bq);
+        if (block == NULL) {
+            return NULL;
+        }
+        len = DATA_SIZE - off < BLOCK_SIZE ? DATA_SIZE - off : BLOCK_SIZE;
+        memcpy(block, data + off, len);
+        blockq_commit(bq, len);
+        off += len;
+        if (arg && rand() % 8 == 0) {
+            usleep(100);
+        }
+    }
+    blockq_close_write(bq);
+    return NULL;
+}
+
+START_TEST(test_concurrent)
+{
+    pthread_t thread;
+    const void *block;
+    size_t off = 0;
+    size_t len;
+
+    ck_assert_int_eq(pthread_create(&thread, NULL, producer,
+                                    _i ? (void*)1 : NULL), 0);
+    while ((len = blockq_read(bq, &block)) > 0) {
+        ck_assert_uint_le(off + len, DATA_SIZE);
+        ck_assert_mem_eq(block, data + off, len);
+        ck_assert(len == BLOCK_SIZE || off + len == DATA_SIZE);
+        off += len;
+        blockq_release(bq);
+    }
+    ck_assert_uint_eq(off, DATA_SIZE);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+}
+END_TEST
+
+START_TEST(test_concurrent_early_close)
+{
+    pthread_t thread;
+    const void *block;
+    size_t off = 0;
+    size_t len;
+
+    ck_assert_int_eq(pthread_create(&thread, NULL, producer, NULL), 0);
+    while (off < DATA_SIZE / 2 && (len = blockq_read(bq, &block)) > 0) {
+        ck_assert_mem_eq(block, data + off, len);
+        off += len;
+        blockq_release(bq);
+    }
+    ck_assert_int_eq(blockq_close_read(bq), 0);
+    ck_assert_int_eq(pthread_join(thread, NULL), 0);
+}
+END_TEST
+
+Suite* blockq_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    setup_random_data();
+
+    s = suite_create("Block Queue");
+
+    tc = tcase_create("Sequential Tests");
+    tcase_add_checked_fixture(tc, setup_global, teardown_global);
+    tcase_add_test(tc, test_init_failures);
+    tcase_add_test(tc, test_sequential);
+    tcase_add_test(tc, test_read_timed);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Concurrent Tests");
+    tcase_add_checked_fixture(tc, setup_global, teardown_global);
+    tcase_add_loop_test(tc, test_concurrent, 0, 2);
+    tcase_add_test(tc, test_concurrent_early_close);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    sr = srunner_create(blockq_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <check.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -345,6 +346,39 @@ START_TEST(test_sequential_read_around_write2)
 }
 END_TEST
 
+START_TEST(test_sequential_read_timed)
+{
+    struct timespec deadline;
+    char timed_out = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += 20000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    /* Returns what is available once the deadline passes. */
+    ck_assert_uint_eq(data_write(50), 50);
+    roffset = roffset_next;
+    ck_assert_uint_eq(circbuf_read_timed(cbuf, buf, 60, &deadline, &timed_out),
+                      50);
+    roffset_next += 50;
+    ck_verify_read_(50);
+    ck_assert_int_ne(timed_out, 0);
+
+    /* Doesn't time out at end of data. */
+    timed_out = 0;
+    ck_assert_uint_eq(data_write(50), 50);
+    circbuf_close_write(cbuf);
+    roffset = roffset_next;
+    ck_assert_uint_eq(circbuf_read_timed(cbuf, buf, 60, &deadline, &timed_out),
+                      50);
+    ck_verify_read_(50);
+    ck_assert_int_eq(timed_out, 0);
+}
+END_TEST
+
 void* serial_read(void* argument)
 {
     int (*continue_callback)() = argument;
@@ -702,6 +736,7 @@ Suite* circbuf_suite()
     tcase_add_test(tc, test_sequential_write2);
     tcase_add_test(tc, test_sequential_fill_write2);
     tcase_add_test(tc, test_sequential_read_around_write2);
+    tcase_add_test(tc, test_sequential_read_timed);
 
     suite_add_tcase(s, tc);
 
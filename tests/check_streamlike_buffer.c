@@ -1,6 +1,9 @@
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <check.h>
 
 #include "streamlike/buffer.h"
@@ -13,6 +16,7 @@
 #define TEST_DATA_RANDOM_SEED (0)
 #define TEST_BUFFER_SIZE (1021)
 #define TEST_BUFFER_STEP_SIZE (509)
+#define TEST_BUFFER_BLOCK_COUNT (3)
 
 const char *temp_file_path;
 streamlike_t *file_stream;
@@ -41,6 +45,16 @@ START_TEST(test_stream_integrity)
     ck_assert_ptr_eq(stream->ckp, sl_buffer_ckp_cb);
     ck_assert_ptr_eq(stream->ckp_offset, sl_buffer_ckp_offset_cb);
     ck_assert_ptr_eq(stream->ckp_metadata, sl_buffer_ckp_metadata_cb);
+
+    ck_assert_ptr_eq(stream->read_at, sl_buffer_read_at_cb);
+    ck_assert_ptr_eq(stream->readv, sl_buffer_readv_cb);
+    ck_assert_ptr_eq(stream->read_multi, sl_buffer_read_multi_cb);
+    ck_assert_ptr_eq(stream->advise, sl_buffer_advise_cb);
+    ck_assert_ptr_eq(stream->seek_cost, sl_buffer_seek_cost_cb);
+
+    /* Input isn't supported except in block mode. */
+    ck_assert_uint_eq(sl_caps(stream), sl_probe_caps(stream) & ~SL_CAP_INPUT);
+    ck_assert(!sl_has_caps(stream, SL_CAP_CHEAP_SEEK));
 }
 END_TEST
 
@@ -65,6 +79,335 @@ void teardown_file()
     file_stream = NULL;
 }
 
+void setup_file_blocks()
+{
+    ck_assert_ptr_nonnull(temp_file_path);
+
+    file_stream = sl_fopen(temp_file_path, "rb");
+    ck_assert_ptr_nonnull(file_stream);
+
+    buffer_stream = sl_buffer_create_blocks(file_stream, TEST_BUFFER_STEP_SIZE,
+                                            TEST_BUFFER_BLOCK_COUNT);
+    ck_assert_ptr_nonnull(buffer_stream);
+}
+
+START_TEST(test_next_block)
+{
+    const void *block;
+    const void *input;
+    char buffer[100];
+    size_t read = 0;
+    size_t len;
+
+    ck_assert(sl_has_caps(buffer_stream, SL_CAP_INPUT | SL_CAP_ZERO_COPY));
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+
+    /* Partially consume first block through read and input. */
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, sizeof(buffer)),
+                      sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data, sizeof(buffer));
+    ck_assert_uint_eq(sl_input(buffer_stream, &input, sizeof(buffer)),
+                      sizeof(buffer));
+    ck_assert_mem_eq(input, test_data + sizeof(buffer), sizeof(buffer));
+    read = 2 * sizeof(buffer);
+
+    /* Then the rest of it... */
+    len = sl_buffer_next_block(buffer_stream, &block);
+    ck_assert_uint_eq(len, TEST_BUFFER_STEP_SIZE - read);
+    ck_assert_mem_eq(block, test_data + read, len);
+    read += len;
+
+    /* ...and whole blocks. */
+    while ((len = sl_buffer_next_block(buffer_stream, &block)) > 0) {
+        ck_assert_uint_eq((uintptr_t)block % SL_BUFFER_BLOCK_ALIGNMENT, 0);
+        ck_assert(len == TEST_BUFFER_STEP_SIZE
+                    || read + len == TEST_DATA_LENGTH);
+        ck_assert_mem_eq(block, test_data + read, len);
+        read += len;
+        ck_assert_int_eq(sl_tell(buffer_stream), read);
+    }
+    ck_assert_uint_eq(read, TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_eof(buffer_stream), 1);
+
+    /* Block boundaries start over from the seek offset. */
+    ck_assert_int_eq(sl_seek(buffer_stream, 1000, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_buffer_next_block(buffer_stream, &block),
+                      TEST_BUFFER_STEP_SIZE);
+    ck_assert_mem_eq(block, test_data + 1000, TEST_BUFFER_STEP_SIZE);
+}
+END_TEST
+
+START_TEST(test_read_at)
+{
+    char buffer[1000];
+    char buffer_at[1000];
+    off_t offset = TEST_DATA_LENGTH / 3;
+
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+
+    /* Served by inner stream while filler reads ahead. */
+    ck_assert_uint_eq(sl_read_at(buffer_stream, buffer_at, sizeof(buffer_at),
+                                 offset), sizeof(buffer_at));
+    ck_assert_mem_eq(buffer_at, test_data + offset, sizeof(buffer_at));
+
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, sizeof(buffer)),
+                      sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data, sizeof(buffer));
+}
+END_TEST
+
+START_TEST(test_readv)
+{
+    char header[100];
+    char *payload;
+    struct iovec iov[2];
+    size_t payload_len = TEST_DATA_LENGTH;
+
+    payload = malloc(payload_len);
+    ck_assert_ptr_nonnull(payload);
+
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+
+    iov[0].iov_base = header;
+    iov[0].iov_len  = sizeof(header);
+    iov[1].iov_base = payload;
+    iov[1].iov_len  = payload_len;
+    ck_assert_uint_eq(sl_readv(buffer_stream, iov, 2), TEST_DATA_LENGTH);
+    ck_assert_mem_eq(header, test_data, sizeof(header));
+    ck_assert_mem_eq(payload, test_data + sizeof(header),
+                     TEST_DATA_LENGTH - sizeof(header));
+    ck_assert_int_eq(sl_tell(buffer_stream), TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_eof(buffer_stream), 1);
+
+    free(payload);
+}
+END_TEST
+
+START_TEST(test_read_timeout)
+{
+    char buffer[100];
+
+    ck_assert_int_eq(sl_buffer_set_read_timeout(buffer_stream, 20), 0);
+
+    /* Nothing is buffered before filling starts. */
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, sizeof(buffer)), 0);
+    ck_assert_int_eq(sl_error(buffer_stream), SL_ERROR_TIMEDOUT);
+    ck_assert_int_eq(sl_eof(buffer_stream), 0);
+    ck_assert_int_eq(sl_tell(buffer_stream), 0);
+
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, sizeof(buffer)),
+                      sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data, sizeof(buffer));
+    ck_assert_int_eq(sl_error(buffer_stream), 0);
+}
+END_TEST
+
+START_TEST(test_stats)
+{
+    sl_buffer_stats_t stats;
+    char *buffer;
+    uint64_t steps = 0;
+    int i;
+
+    buffer = malloc(TEST_DATA_LENGTH);
+    ck_assert_ptr_nonnull(buffer);
+
+    ck_assert_int_eq(sl_buffer_get_stats(buffer_stream, &stats), 0);
+    ck_assert_uint_eq(stats.inner_read_count, 0);
+    ck_assert_uint_eq(stats.seek_count, 0);
+
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, TEST_DATA_LENGTH),
+                      TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_seek(buffer_stream, 1000, SL_SEEK_SET), 0);
+
+    ck_assert_int_eq(sl_buffer_get_stats(buffer_stream, &stats), 0);
+    ck_assert_uint_gt(stats.inner_read_count, 0);
+    ck_assert_uint_gt(stats.inner_read_ns, 0);
+    ck_assert_uint_eq(stats.seek_count, 1);
+    ck_assert_uint_gt(stats.seek_ns, 0);
+    for (i = 0; i < SL_BUFFER_STATS_BUCKETS; i++) {
+        steps += stats.occupancy[i];
+    }
+    ck_assert_uint_ge(steps, TEST_DATA_LENGTH / TEST_BUFFER_STEP_SIZE);
+    /* Buffer is much smaller than data, so one side had to wait. */
+    ck_assert_uint_gt(stats.consumer_wait_ns + stats.producer_wait_ns, 0);
+
+    ck_assert_int_eq(sl_buffer_reset_stats(buffer_stream), 0);
+    ck_assert_int_eq(sl_buffer_get_stats(buffer_stream, &stats), 0);
+    ck_assert_uint_eq(stats.seek_count, 0);
+    ck_assert_uint_eq(stats.seek_ns, 0);
+
+    free(buffer);
+}
+END_TEST
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t limit;
+    size_t calls;
+    int ended;
+} test_sink_t;
+
+static
+size_t test_sink_cb(void *sink_context, const void *data, size_t len)
+{
+    test_sink_t *sink = sink_context;
+
+    ck_assert_int_eq(sink->ended, 0);
+    if (len == 0) {
+        sink->ended = 1;
+        return 0;
+    }
+    if (sink->len >= sink->limit) {
+        return SL_BUFFER_SINK_STOP;
+    }
+    /* Push back now and then. */
+    switch (sink->calls++ % 3) {
+        case 0:
+            return 0;
+        case 1:
+            len = (len + 1) / 2;
+            break;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+    return len;
+}
+
+START_TEST(test_sink)
+{
+    test_sink_t sink = {0};
+
+    sink.data = malloc(TEST_DATA_LENGTH);
+    ck_assert_ptr_nonnull(sink.data);
+    sink.limit = (_i == 0 ? TEST_DATA_LENGTH : TEST_DATA_LENGTH / 3);
+
+    ck_assert_int_eq(sl_buffer_set_sink(buffer_stream, test_sink_cb, &sink), 0);
+
+    /* Returns when sink is done, since there is no consumer. */
+    ck_assert_int_eq(sl_buffer_blocking_fill_buffer(buffer_stream), 0);
+
+    if (_i == 0) {
+        ck_assert_int_eq(sink.ended, 1);
+        ck_assert_uint_eq(sink.len, TEST_DATA_LENGTH);
+    } else {
+        ck_assert_int_eq(sink.ended, 0);
+        ck_assert_uint_ge(sink.len, sink.limit);
+        ck_assert_uint_lt(sink.len, TEST_DATA_LENGTH);
+    }
+    ck_assert_mem_eq(sink.data, test_data, sink.len);
+
+    free(sink.data);
+}
+END_TEST
+
+typedef struct
+{
+    struct timespec until;
+    size_t len;
+    size_t refused;
+} test_slow_sink_t;
+
+/* Refuses everything for a while, then takes everything. */
+static
+size_t test_slow_sink_cb(void *sink_context, const void *data, size_t len)
+{
+    test_slow_sink_t *sink = sink_context;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (len > 0 && (now.tv_sec < sink->until.tv_sec
+                    || (now.tv_sec == sink->until.tv_sec
+                        && now.tv_nsec < sink->until.tv_nsec))) {
+        sink->refused++;
+        return 0;
+    }
+    sink->len += len;
+    return len;
+}
+
+START_TEST(test_sink_backoff)
+{
+    test_slow_sink_t sink = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &sink.until);
+    sink.until.tv_nsec += 200 * 1000000L;
+    sink.until.tv_sec += sink.until.tv_nsec / 1000000000L;
+    sink.until.tv_nsec %= 1000000000L;
+    ck_assert_int_eq(sl_buffer_set_sink(buffer_stream, test_slow_sink_cb,
+                                        &sink), 0);
+    ck_assert_int_eq(sl_buffer_blocking_fill_buffer(buffer_stream), 0);
+
+    /* Filler waits for the sink instead of offering data over and over. */
+    ck_assert_uint_eq(sink.len, TEST_DATA_LENGTH);
+    ck_assert_uint_gt(sink.refused, 0);
+    ck_assert_uint_lt(sink.refused, 100);
+}
+END_TEST
+
+#ifdef SL_BUFFER_LZ4
+void setup_file_lz4()
+{
+    ck_assert_ptr_nonnull(temp_file_path);
+
+    file_stream = sl_fopen(temp_file_path, "rb");
+    ck_assert_ptr_nonnull(file_stream);
+
+    buffer_stream = sl_buffer_create_lz4(file_stream, TEST_BUFFER_SIZE,
+                                         TEST_BUFFER_STEP_SIZE);
+    ck_assert_ptr_nonnull(buffer_stream);
+}
+
+START_TEST(test_lz4_compressible)
+{
+    const char line[] = "2018-06-01 12:00:00 INFO request served in 12ms\n";
+    const size_t data_len = TEST_DATA_LENGTH;
+    char *data = malloc(data_len);
+    char *buffer = malloc(data_len);
+    FILE *fp;
+    streamlike_t *stream;
+
+    ck_assert_ptr_nonnull(data);
+    ck_assert_ptr_nonnull(buffer);
+    for (size_t i = 0; i < data_len; i++) {
+        data[i] = line[i % (sizeof(line) - 1)];
+    }
+
+    fp = tmpfile();
+    ck_assert_ptr_nonnull(fp);
+    ck_assert_uint_eq(fwrite(data, 1, data_len, fp), data_len);
+    rewind(fp);
+
+    file_stream = sl_fopen2(fp);
+    ck_assert_ptr_nonnull(file_stream);
+    stream = sl_buffer_create_lz4(file_stream, TEST_BUFFER_SIZE,
+                                  TEST_BUFFER_STEP_SIZE * 8);
+    ck_assert_ptr_nonnull(stream);
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(stream), 0);
+
+    ck_assert_uint_eq(sl_read(stream, buffer, data_len), data_len);
+    ck_assert_mem_eq(buffer, data, data_len);
+    ck_assert_uint_eq(sl_read(stream, buffer, data_len), 0);
+    ck_assert_int_eq(sl_eof(stream), 1);
+    ck_assert_int_eq(sl_error(stream), 0);
+
+    ck_assert_int_eq(sl_seek(stream, 12345, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, 1000), 1000);
+    ck_assert_mem_eq(buffer, data + 12345, 1000);
+
+    ck_assert_int_eq(sl_buffer_destroy(stream), 0);
+    ck_assert_int_eq(sl_fclose(file_stream), 0);
+    file_stream = NULL;
+    free(data);
+    free(buffer);
+}
+END_TEST
+#endif
+
 void setup_server()
 {
     test_server = test_server_run(test_data, TEST_DATA_LENGTH);
@@ -281,6 +624,77 @@ START_TEST(test_seek)
 }
 END_TEST
 
+START_TEST(test_advise)
+{
+    const off_t offsets[] = {TEST_DATA_LENGTH / 2, 1000, 300 * 1024,
+                             TEST_DATA_LENGTH - 100};
+    char *buffer = malloc(TEST_DATA_LENGTH);
+    size_t expected_len;
+    size_t i;
+
+    ck_assert_ptr_nonnull(buffer);
+
+    /* Forwarded to inner stream by filler. Data read is the same. */
+    ck_assert_int_eq(sl_advise(buffer_stream, 0, 0, SL_ADVICE_RANDOM), 0);
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+    ck_assert_int_eq(sl_advise(buffer_stream, offsets[0], 5000,
+                               SL_ADVICE_WILLNEED), 0);
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        expected_len = TEST_DATA_LENGTH - offsets[i];
+        if (expected_len > 5000) {
+            expected_len = 5000;
+        }
+        ck_assert_uint_eq(seek_and_read(buffer_stream, offsets[i], buffer,
+                                        5000), expected_len);
+        ck_assert_mem_eq(buffer, test_data + offsets[i], expected_len);
+    }
+
+    /* Reading goes on across ranges. */
+    ck_assert_int_eq(sl_advise(buffer_stream, 0, 0, SL_ADVICE_SEQUENTIAL), 0);
+    ck_assert_uint_eq(seek_and_read(buffer_stream, 0, buffer,
+                                    TEST_DATA_LENGTH), TEST_DATA_LENGTH);
+    ck_assert_mem_eq(buffer, test_data, TEST_DATA_LENGTH);
+    free(buffer);
+}
+END_TEST
+
+START_TEST(test_read_through)
+{
+    char buffer[100];
+    sl_buffer_stats_t stats;
+
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+    ck_assert_uint_eq(sl_read(buffer_stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data, 100);
+
+    /* Wait until the gap is buffered. */
+    while (sl_seek_cost(buffer_stream, 300) != 0) {
+        sched_yield();
+    }
+
+    /* Skipping buffered data doesn't seek inner stream. */
+    ck_assert_uint_eq(seek_and_read(buffer_stream, 300, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 300, 100);
+    ck_assert_int_eq(sl_buffer_get_stats(buffer_stream, &stats), 0);
+    ck_assert_uint_eq(stats.seek_count, 1);
+    ck_assert_uint_eq(stats.skip_count, 1);
+
+    /* Seeking a file is cheaper than reading beyond the buffer. */
+    ck_assert_int_eq(sl_seek_cost(buffer_stream, TEST_DATA_LENGTH / 2), 0);
+    ck_assert_uint_eq(seek_and_read(buffer_stream, TEST_DATA_LENGTH / 2,
+                                    buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + TEST_DATA_LENGTH / 2, 100);
+
+    /* Going backwards discards the buffer. */
+    ck_assert_uint_eq(seek_and_read(buffer_stream, 10, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 10, 100);
+    ck_assert_int_eq(sl_buffer_get_stats(buffer_stream, &stats), 0);
+    ck_assert_uint_eq(stats.seek_count, 3);
+    ck_assert_uint_eq(stats.skip_count, 1);
+}
+END_TEST
+
 Suite* streamlike_buffer_suite()
 {
     Suite *s;
@@ -295,11 +709,47 @@ Suite* streamlike_buffer_suite()
     tcase_add_test(tc, test_read_chunks);
     tcase_add_test(tc, test_read_uneven_chunks);
     tcase_add_test(tc, test_seek);
+    tcase_add_test(tc, test_read_through);
+    tcase_add_loop_test(tc, test_sink, 0, 2);
+    tcase_add_test(tc, test_sink_backoff);
+    tcase_add_test(tc, test_read_at);
+    tcase_add_test(tc, test_advise);
+    tcase_add_test(tc, test_readv);
+    tcase_add_test(tc, test_read_timeout);
+    tcase_add_test(tc, test_stats);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("File Blocks");
+    tcase_add_checked_fixture(tc, setup_file_blocks, teardown_file);
+    tcase_add_test(tc, test_read_whole);
+    tcase_add_test(tc, test_read_chunks);
+    tcase_add_test(tc, test_read_uneven_chunks);
+    tcase_add_test(tc, test_seek);
+    tcase_add_test(tc, test_next_block);
+    tcase_add_test(tc, test_readv);
+    tcase_add_test(tc, test_read_timeout);
+    tcase_add_test(tc, test_stats);
+    suite_add_tcase(s, tc);
+
+#ifdef SL_BUFFER_LZ4
+    tc = tcase_create("File LZ4");
+    tcase_add_checked_fixture(tc, setup_file_lz4, teardown_file);
+    tcase_add_test(tc, test_read_whole);
+    tcase_add_test(tc, test_read_chunks);
+    tcase_add_test(tc, test_read_uneven_chunks);
+    tcase_add_test(tc, test_seek);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("LZ4");
+    tcase_add_test(tc, test_lz4_compressible);
     suite_add_tcase(s, tc);
+#endif
 
     tc = tcase_create("HTTP");
     tcase_add_checked_fixture(tc, setup_server, teardown_server);
     tcase_add_test(tc, test_http_content_verification);
+    tcase_add_test(tc, test_read_at);
+    tcase_add_test(tc, test_advise);
     tcase_add_test(tc, test_read_whole);
     tcase_add_test(tc, test_read_chunks);
     tcase_add_test(tc, test_read_uneven_chunks);
@@ -0,0 +1,328 @@
+#define _GNU_SOURCE /* O_DIRECT */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "streamlike/direct.h"
+#include "util/util.h"
+
+#define TEMP_FILE_NAME        "test_direct.tmp"
+#define TEST_DATA_LENGTH      (64 * 1024 + 100)
+#define TEST_DATA_RANDOM_SEED (0)
+#define TEST_BLOCK_SIZE       (8192)
+
+streamlike_t *stream;
+char test_data[TEST_DATA_LENGTH];
+
+void verify_stream_integrity(streamlike_t *stream)
+{
+    ck_assert(stream != NULL);
+
+    ck_assert(stream->context != NULL);
+    ck_assert(stream->read    == sl_direct_read_cb);
+    ck_assert(stream->input   == sl_direct_input_cb);
+    ck_assert(stream->write   == sl_direct_write_cb);
+    ck_assert(stream->flush   == sl_direct_flush_cb);
+    ck_assert(stream->seek    == sl_direct_seek_cb);
+    ck_assert(stream->tell    == sl_direct_tell_cb);
+    ck_assert(stream->eof     == sl_direct_eof_cb);
+    ck_assert(stream->error   == sl_direct_error_cb);
+    ck_assert(stream->length  == sl_direct_length_cb);
+
+    ck_assert(stream->seekable   == sl_direct_seekable_cb);
+    ck_assert(stream->read_at    == sl_direct_read_at_cb);
+    ck_assert(stream->readv      == sl_direct_readv_cb);
+    ck_assert(stream->writev     == sl_direct_writev_cb);
+    ck_assert(stream->read_multi == sl_direct_read_multi_cb);
+    ck_assert(stream->aio_submit == NULL);
+    ck_assert(stream->advise     == NULL);
+    ck_assert(stream->seek_cost  == sl_direct_seek_cost_cb);
+    ck_assert(stream->clone      == sl_direct_clone_cb);
+    ck_assert(stream->data_map   == sl_direct_data_map_cb);
+    ck_assert(stream->descriptor == NULL);
+
+    ck_assert(stream->caps == (sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                               | SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_seekable(stream) == SL_SEEKING_SUPPORTED);
+}
+
+/* Compares file contents through stdio, so through page cache. */
+void verify_file(const char *expected, size_t length)
+{
+    char *buf = malloc(length + 1);
+    FILE *fp;
+
+    fp = fopen(TEMP_FILE_NAME, "rb");
+    ck_assert(fp != NULL);
+    ck_assert_uint_eq(fread(buf, 1, length + 1, fp), length);
+    ck_assert(memcmp(buf, expected, length) == 0);
+    ck_assert(fclose(fp) == 0);
+    free(buf);
+}
+
+void setup_stream()
+{
+    FILE *fp;
+    int fd;
+
+    /* Created here, since temporary file systems may not support O_DIRECT. */
+    fp = fopen(TEMP_FILE_NAME, "wb");
+    ck_assert(fp != NULL);
+    ck_assert(fwrite(test_data, 1, TEST_DATA_LENGTH, fp) == TEST_DATA_LENGTH);
+    ck_assert(fclose(fp) == 0);
+
+    fd = open(TEMP_FILE_NAME, O_RDWR);
+    ck_assert(fd >= 0);
+    stream = sl_direct_open2(fd, TEST_BLOCK_SIZE);
+    ck_assert_msg(stream != NULL, "File system doesn't support O_DIRECT");
+    verify_stream_integrity(stream);
+}
+
+void teardown_stream()
+{
+    ck_assert(sl_direct_close(stream) == 0);
+    stream = NULL;
+    ck_assert(remove(TEMP_FILE_NAME) == 0);
+}
+
+START_TEST(test_read_seek)
+{
+    char buf[10000];
+    off_t offset = 0;
+    size_t read;
+
+    ck_assert(sl_length(stream) == TEST_DATA_LENGTH);
+    while ((read = sl_read(stream, buf, 3001)) > 0) {
+        ck_assert(memcmp(buf, test_data + offset, read) == 0);
+        offset += read;
+        ck_assert(sl_tell(stream) == offset);
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+    ck_assert(!sl_error(stream));
+
+    ck_assert(sl_seek(stream, -100, SL_SEEK_END) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == 100);
+    ck_assert(memcmp(buf, test_data + TEST_DATA_LENGTH - 100, 100) == 0);
+
+    ck_assert(sl_seek(stream, 5000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, 10) == 10);
+    ck_assert(sl_seek_cost(stream, 6000) == 0);
+    ck_assert(sl_seek_cost(stream, 40000) > 0);
+    ck_assert(sl_seek(stream, -4010, SL_SEEK_CUR) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 1000, sizeof(buf)) == 0);
+    ck_assert(sl_seek(stream, -1, SL_SEEK_SET) != 0);
+
+    ck_assert(sl_seek(stream, TEST_DATA_LENGTH + 10, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, 10) == 0);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+START_TEST(test_read_aligned)
+{
+    const size_t size = 5 * SL_DIRECT_ALIGNMENT;
+    char *buf;
+    off_t offset = 0;
+    size_t read;
+
+    /* Aligned reads bypass the block, except for the tail. */
+    ck_assert(posix_memalign((void**)&buf, SL_DIRECT_ALIGNMENT, size) == 0);
+    while ((read = sl_read(stream, buf, size)) > 0) {
+        ck_assert(memcmp(buf, test_data + offset, read) == 0);
+        offset += read;
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+
+    /* Unaligned start goes through the block until aligned. */
+    ck_assert(sl_seek(stream, 100, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf + 100, size - 100) == size - 100);
+    ck_assert(memcmp(buf + 100, test_data + 100, size - 100) == 0);
+
+    ck_assert(sl_read_at(stream, buf, size, 2 * SL_DIRECT_ALIGNMENT) == size);
+    ck_assert(memcmp(buf, test_data + 2 * SL_DIRECT_ALIGNMENT, size) == 0);
+    ck_assert(sl_read_at(stream, buf, size, TEST_DATA_LENGTH - 100) == 100);
+    ck_assert(memcmp(buf, test_data + TEST_DATA_LENGTH - 100, 100) == 0);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_input)
+{
+    const void *data;
+    off_t offset = 0;
+    size_t len;
+
+    while ((len = sl_input(stream, &data, TEST_DATA_LENGTH)) > 0) {
+        ck_assert(len <= TEST_BLOCK_SIZE);
+        ck_assert(memcmp(data, test_data + offset, len) == 0);
+        offset += len;
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+START_TEST(test_read_at_multi)
+{
+    const off_t offsets[] = {40000, 0, 4000, TEST_DATA_LENGTH - 10,
+                             TEST_DATA_LENGTH + 10};
+    const size_t lengths[] = {500, 100, 20000, 20, 10};
+    const int count = sizeof(offsets) / sizeof(offsets[0]);
+    sl_extent_t extents[sizeof(offsets) / sizeof(offsets[0])];
+    size_t expected;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].offset = offsets[i];
+        extents[i].length = lengths[i];
+        extents[i].buffer = malloc(lengths[i]);
+    }
+    ck_assert(sl_read_multi(stream, extents, count) != 0);
+    for (i = 0; i < count; i++) {
+        expected = (offsets[i] >= TEST_DATA_LENGTH ? 0 :
+                    TEST_DATA_LENGTH - offsets[i] < lengths[i] ?
+                        TEST_DATA_LENGTH - offsets[i] : lengths[i]);
+        ck_assert_uint_eq(extents[i].read, expected);
+        ck_assert(memcmp(extents[i].buffer, test_data + offsets[i],
+                         expected) == 0);
+        free(extents[i].buffer);
+    }
+    ck_assert(sl_tell(stream) == 0);
+}
+END_TEST
+
+START_TEST(test_write)
+{
+    const size_t extended = TEST_DATA_LENGTH + 5000;
+    char *expected = malloc(extended);
+    char *aligned;
+    char buf[3000];
+
+    memcpy(expected, test_data, TEST_DATA_LENGTH);
+    fill_random_data(expected + TEST_DATA_LENGTH, extended - TEST_DATA_LENGTH,
+                     TEST_DATA_RANDOM_SEED + 1);
+
+    /* Unaligned overwrite across blocks, read back before flushing. */
+    fill_random_data(expected + 3000, 10000, TEST_DATA_RANDOM_SEED + 2);
+    ck_assert(sl_seek(stream, 3000, SL_SEEK_SET) == 0);
+    ck_assert(sl_write(stream, expected + 3000, 10000) == 10000);
+    ck_assert(sl_seek(stream, 12000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, expected + 12000, sizeof(buf)) == 0);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), 2000) == sizeof(buf));
+    ck_assert(memcmp(buf, expected + 2000, sizeof(buf)) == 0);
+
+    /* Aligned one bypasses the block. */
+    ck_assert(posix_memalign((void**)&aligned, SL_DIRECT_ALIGNMENT,
+                             2 * SL_DIRECT_ALIGNMENT) == 0);
+    fill_random_data(aligned, 2 * SL_DIRECT_ALIGNMENT,
+                     TEST_DATA_RANDOM_SEED + 3);
+    memcpy(expected + 8 * SL_DIRECT_ALIGNMENT, aligned,
+           2 * SL_DIRECT_ALIGNMENT);
+    ck_assert(sl_seek(stream, 8 * SL_DIRECT_ALIGNMENT, SL_SEEK_SET) == 0);
+    ck_assert(sl_write(stream, aligned, 2 * SL_DIRECT_ALIGNMENT)
+                == 2 * SL_DIRECT_ALIGNMENT);
+    free(aligned);
+
+    /* Unaligned tail past end-of-file. */
+    ck_assert(sl_seek(stream, TEST_DATA_LENGTH - 50, SL_SEEK_SET) == 0);
+    ck_assert(sl_write(stream, expected + TEST_DATA_LENGTH - 50,
+                       extended - TEST_DATA_LENGTH + 50)
+                == extended - TEST_DATA_LENGTH + 50);
+    ck_assert(sl_length(stream) == (off_t)extended);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), extended - 2000) == 2000);
+    ck_assert(memcmp(buf, expected + extended - 2000, 2000) == 0);
+    ck_assert(sl_flush(stream) == 0);
+    ck_assert(!sl_error(stream));
+    verify_file(expected, extended);
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, expected, sizeof(buf)) == 0);
+    free(expected);
+}
+END_TEST
+
+START_TEST(test_close_flags)
+{
+    streamlike_t *other;
+    int fd;
+
+    fd = open(TEMP_FILE_NAME, O_RDONLY);
+    ck_assert(fd >= 0);
+    other = sl_direct_open2(fd, TEST_BLOCK_SIZE);
+    ck_assert(other != NULL);
+    ck_assert(fcntl(fd, F_GETFL) & O_DIRECT);
+    ck_assert(sl_direct_close2(other) == 0);
+    ck_assert(!(fcntl(fd, F_GETFL) & O_DIRECT));
+    ck_assert(close(fd) == 0);
+}
+END_TEST
+
+START_TEST(test_clone)
+{
+    streamlike_t *clone;
+    char buf[100];
+
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    ck_assert(sl_write(stream, "cloned", 6) == 6);
+    clone = sl_clone(stream);
+    verify_stream_integrity(clone);
+    ck_assert(sl_tell(clone) == 1006);
+    ck_assert(sl_seek(clone, 1000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(clone, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, "cloned", 6) == 0);
+    ck_assert(memcmp(buf + 6, test_data + 1006, sizeof(buf) - 6) == 0);
+    ck_assert(sl_direct_close(clone) == 0);
+
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 1006, sizeof(buf)) == 0);
+}
+END_TEST
+
+Suite* streamlike_direct_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike Direct");
+
+    tc = tcase_create("Core");
+    tcase_add_checked_fixture(tc, setup_stream, teardown_stream);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_read_aligned);
+    tcase_add_test(tc, test_input);
+    tcase_add_test(tc, test_read_at_multi);
+    tcase_add_test(tc, test_write);
+    tcase_add_test(tc, test_close_flags);
+    tcase_add_test(tc, test_clone);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_direct_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,422 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "streamlike/fd.h"
+
+#define TEMP_FILE_NAME "test_fd.tmp"
+
+streamlike_t *stream;
+FILE *tmpf;
+
+void verify_stream_integrity(streamlike_t *stream)
+{
+    ck_assert(stream != NULL);
+
+    ck_assert(stream->context != NULL);
+    ck_assert(stream->read    == sl_fd_read_cb);
+    ck_assert(stream->input   == NULL);
+    ck_assert(stream->write   == sl_fd_write_cb);
+    ck_assert(stream->flush   == sl_fd_flush_cb);
+    ck_assert(stream->seek    == sl_fd_seek_cb);
+    ck_assert(stream->tell    == sl_fd_tell_cb);
+    ck_assert(stream->eof     == sl_fd_eof_cb);
+    ck_assert(stream->error   == sl_fd_error_cb);
+    ck_assert(stream->length  == sl_fd_length_cb);
+
+    ck_assert(stream->seekable     == sl_fd_seekable_cb);
+    ck_assert(stream->ckp_count    == NULL);
+    ck_assert(stream->ckp          == NULL);
+    ck_assert(stream->ckp_offset   == NULL);
+    ck_assert(stream->ckp_metadata == NULL);
+
+    ck_assert(stream->read_at == sl_fd_read_at_cb);
+
+    ck_assert(stream->readv  == sl_fd_readv_cb);
+    ck_assert(stream->writev == sl_fd_writev_cb);
+
+    ck_assert(stream->read_multi == sl_fd_read_multi_cb);
+
+    ck_assert(stream->aio_submit == NULL);
+
+    ck_assert(stream->advise == sl_fd_advise_cb);
+    ck_assert(stream->seek_cost == sl_fd_seek_cost_cb);
+    ck_assert(stream->clone == sl_fd_clone_cb);
+    ck_assert(stream->data_map == sl_fd_data_map_cb);
+    ck_assert(stream->descriptor == sl_fd_descriptor_cb);
+
+    ck_assert(stream->caps == (sl_probe_caps(stream) | SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_seek_cost(stream, 12345) == 0);
+}
+
+START_TEST(test_create_destroy)
+{
+    streamlike_t *stream = sl_fd_open(TEMP_FILE_NAME,
+                                      O_WRONLY | O_CREAT | O_TRUNC);
+    verify_stream_integrity(stream);
+    ck_assert(sl_fd_close(stream) == 0);
+    ck_assert(remove(TEMP_FILE_NAME) == 0);
+
+    ck_assert(sl_fd_open(TEMP_FILE_NAME, O_RDONLY) == NULL);
+}
+END_TEST
+
+void setup_stream()
+{
+    ck_assert(stream == NULL);
+
+    tmpf = tmpfile();
+    ck_assert(tmpf);
+
+    stream = sl_fd_open2(fileno(tmpf));
+    ck_assert(stream);
+}
+
+void teardown_stream()
+{
+    ck_assert(sl_fd_close2(stream) == 0);
+    stream = NULL;
+    ck_assert(fclose(tmpf) == 0);
+}
+
+START_TEST(test_read_write_seek_length)
+{
+    const char data[] = "\0Test data \0to write\n\r\b\t.\0";
+    char buf[sizeof(data)];
+
+    ck_assert(sl_tell(stream) == 0);
+    ck_assert(sl_length(stream) == 0);
+    ck_assert(sl_write(stream, data, sizeof(data)) == sizeof(data));
+    ck_assert(sl_tell(stream) == sizeof(data));
+    ck_assert(sl_flush(stream) == 0);
+
+    /* Cached length grows with writes through the stream. */
+    ck_assert(sl_length(stream) == sizeof(data));
+
+    /* Descriptor offset isn't moved. */
+    ck_assert(lseek(fileno(tmpf), 0, SEEK_CUR) == 0);
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(data)) == sizeof(data));
+    ck_assert(memcmp(data, buf, sizeof(data)) == 0);
+    ck_assert(sl_tell(stream) == sizeof(data));
+
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(data)) == 0);
+    ck_assert(sl_eof(stream));
+    ck_assert(!sl_error(stream));
+
+    ck_assert(sl_seek(stream, -4, SL_SEEK_END) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(data)) == 4);
+    ck_assert(memcmp(data + sizeof(data) - 4, buf, 4) == 0);
+    ck_assert(sl_seek(stream, -100, SL_SEEK_CUR) != 0);
+
+    ck_assert(sl_seekable(stream) == SL_SEEKING_SUPPORTED);
+}
+END_TEST
+
+START_TEST(test_length_invalidate)
+{
+    const char data[] = "Written behind the back of the stream";
+
+    ck_assert(sl_length(stream) == 0);
+    ck_assert(pwrite(fileno(tmpf), data, sizeof(data), 0) == sizeof(data));
+
+    /* Stale until invalidated. */
+    ck_assert(sl_length(stream) == 0);
+    sl_fd_invalidate(stream);
+    ck_assert(sl_length(stream) == sizeof(data));
+    ck_assert(sl_seek(stream, -1, SL_SEEK_END) == 0);
+    ck_assert(sl_tell(stream) == sizeof(data) - 1);
+}
+END_TEST
+
+START_TEST(test_readv_writev)
+{
+    const char header[] = "HDR:";
+    const char payload[] = "\0Payload \0to write\n";
+    char header_buf[sizeof(header)];
+    char payload_buf[sizeof(payload)];
+    struct iovec iov[3];
+
+    iov[0].iov_base = (void*)header;
+    iov[0].iov_len  = sizeof(header);
+    iov[1].iov_base = NULL;
+    iov[1].iov_len  = 0;
+    iov[2].iov_base = (void*)payload;
+    iov[2].iov_len  = sizeof(payload);
+    ck_assert(sl_writev(stream, iov, 3) == sizeof(header) + sizeof(payload));
+    ck_assert(sl_tell(stream) == sizeof(header) + sizeof(payload));
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    iov[0].iov_base = header_buf;
+    iov[2].iov_base = payload_buf;
+    ck_assert(sl_readv(stream, iov, 3) == sizeof(header) + sizeof(payload));
+    ck_assert(memcmp(header_buf, header, sizeof(header)) == 0);
+    ck_assert(memcmp(payload_buf, payload, sizeof(payload)) == 0);
+
+    /* Short read stops at end of file. */
+    ck_assert(sl_seek(stream, 2, SL_SEEK_SET) == 0);
+    ck_assert(sl_readv(stream, iov, 3) == sizeof(header) + sizeof(payload) - 2);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+#define READ_AT_THREADS (4)
+#define READ_AT_DATA_SIZE (64*1024)
+
+char read_at_data[READ_AT_DATA_SIZE];
+
+void* read_at_worker(void *arg)
+{
+    size_t idx = (size_t)arg;
+    char buf[1000];
+    size_t expected;
+    off_t offset;
+    int i;
+
+    /* Each thread reads a different stride of offsets. */
+    for (i = 0; i < 200; i++) {
+        offset = (idx * 7919 + i * 4093) % READ_AT_DATA_SIZE;
+        expected = (READ_AT_DATA_SIZE - offset < sizeof(buf) ?
+                    READ_AT_DATA_SIZE - offset : sizeof(buf));
+        if (sl_read_at(stream, buf, sizeof(buf), offset) != expected
+                || memcmp(buf, read_at_data + offset, expected)) {
+            return (void*)1;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_read_at)
+{
+    pthread_t threads[READ_AT_THREADS];
+    void *result;
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 31 + i / 251);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 10, SL_SEEK_SET) == 0);
+
+    for (i = 0; i < READ_AT_THREADS; i++) {
+        ck_assert(pthread_create(&threads[i], NULL, read_at_worker,
+                                 (void*)i) == 0);
+    }
+    for (i = 0; i < READ_AT_THREADS; i++) {
+        ck_assert(pthread_join(threads[i], &result) == 0);
+        ck_assert(result == NULL);
+    }
+
+    /* Current offset is neither used nor moved. */
+    ck_assert(sl_tell(stream) == 10);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), READ_AT_DATA_SIZE - 10)
+                == 10);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), READ_AT_DATA_SIZE) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 10, sizeof(buf)) == 0);
+}
+END_TEST
+
+START_TEST(test_clone)
+{
+    streamlike_t *clone;
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 7 + i / 13);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    clone = sl_clone(stream);
+    ck_assert(clone != NULL);
+    ck_assert(sl_tell(clone) == 1000);
+    ck_assert(sl_length(clone) == READ_AT_DATA_SIZE);
+
+    /* Cursors move independently. */
+    ck_assert(sl_seek(clone, 5000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(clone, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 5000, sizeof(buf)) == 0);
+    ck_assert(sl_tell(stream) == 1000);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1000, sizeof(buf)) == 0);
+
+    ck_assert(sl_fd_close(clone) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1100, sizeof(buf)) == 0);
+}
+END_TEST
+
+static
+size_t short_write_cb(void *context, const void *buffer, size_t size)
+{
+    return (size < 1000 ? size : 1000);
+}
+
+START_TEST(test_copy)
+{
+    static char buf[READ_AT_DATA_SIZE];
+    streamlike_t plain;
+    streamlike_t sink;
+    streamlike_t *copy;
+    streamlike_t *reader;
+    streamlike_t *writer;
+    sl_copy_path_t path;
+    FILE *copyf;
+    size_t i;
+    int fds[2];
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 13 + i / 5);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 100, SL_SEEK_SET) == 0);
+    copyf = tmpfile();
+    ck_assert(copyf);
+    copy = sl_fd_open2(fileno(copyf));
+    ck_assert(copy);
+    ck_assert(sl_write(copy, "head", 4) == 4);
+
+    /* Files are copied in kernel, and both streams move past data. */
+    ck_assert(sl_copy(stream, copy, 5000, &path) == 5000);
+    ck_assert(path == SL_COPY_FILE_RANGE || path == SL_COPY_SENDFILE);
+    ck_assert(sl_tell(stream) == 5100);
+    ck_assert(sl_tell(copy) == 5004);
+    ck_assert(sl_length(copy) == 5004);
+
+    /* Streams without descriptors go through user space. */
+    plain = *stream;
+    plain.descriptor = NULL;
+    ck_assert(sl_copy(&plain, copy, 0, &path) == READ_AT_DATA_SIZE - 5100);
+    ck_assert(path == SL_COPY_PUMP);
+    ck_assert(sl_tell(stream) == READ_AT_DATA_SIZE);
+    ck_assert(sl_read_at(copy, buf, READ_AT_DATA_SIZE, 4)
+                == READ_AT_DATA_SIZE - 100);
+    ck_assert(memcmp(buf, read_at_data + 100, READ_AT_DATA_SIZE - 100) == 0);
+
+    /* Pipes on either side. */
+    ck_assert(pipe(fds) == 0);
+    reader = sl_fd_open2(fds[0]);
+    writer = sl_fd_open2(fds[1]);
+    ck_assert(reader != NULL && writer != NULL);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy(stream, writer, 1000, &path) == 1000);
+    ck_assert(path == SL_COPY_SENDFILE || path == SL_COPY_SPLICE);
+    ck_assert(sl_tell(stream) == 1000);
+    ck_assert(sl_fd_close(writer) == 0);
+    ck_assert(sl_seek(copy, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy(reader, copy, 0, &path) == 1000);
+    ck_assert(path == SL_COPY_SPLICE);
+    ck_assert(sl_tell(copy) == 1000);
+    ck_assert(sl_read_at(copy, buf, 1000, 0) == 1000);
+    ck_assert(memcmp(buf, read_at_data, 1000) == 0);
+    ck_assert(sl_fd_close(reader) == 0);
+
+    /* Appending destination gets data at its end, wherever it was. */
+    ck_assert(fcntl(fileno(copyf), F_SETFL,
+                    fcntl(fileno(copyf), F_GETFL) | O_APPEND) == 0);
+    ck_assert(sl_seek(copy, 10, SL_SEEK_SET) == 0);
+    ck_assert(sl_seek(stream, 2000, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy(stream, copy, 1000, &path) == 1000);
+    ck_assert(sl_length(copy) == READ_AT_DATA_SIZE - 96 + 1000);
+    ck_assert(sl_read_at(copy, buf, 1000, READ_AT_DATA_SIZE - 96) == 1000);
+    ck_assert(memcmp(buf, read_at_data + 2000, 1000) == 0);
+
+    /* Failing after some data reports what was copied. */
+    sink = *copy;
+    sink.write = short_write_cb;
+    sink.descriptor = NULL;
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy(stream, &sink, 0, &path) == 1000);
+    ck_assert(path == SL_COPY_PUMP);
+
+    ck_assert(sl_fd_close2(copy) == 0);
+    ck_assert(fclose(copyf) == 0);
+}
+END_TEST
+
+START_TEST(test_pipe)
+{
+    const char data[] = "Through a pipe";
+    streamlike_t *reader;
+    streamlike_t *writer;
+    char buf[sizeof(data) + 10];
+    int fds[2];
+
+    ck_assert(pipe(fds) == 0);
+    reader = sl_fd_open2(fds[0]);
+    writer = sl_fd_open2(fds[1]);
+    ck_assert(reader != NULL && writer != NULL);
+
+    /* Neither seeking nor positional reads. */
+    ck_assert(sl_seekable(reader) == SL_SEEKING_NOT_SUPPORTED);
+    ck_assert(reader->read_at == NULL);
+    ck_assert(reader->clone == NULL);
+    ck_assert(reader->data_map == NULL);
+    ck_assert(!sl_has_caps(reader, SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_seek(reader, 0, SL_SEEK_SET) != 0);
+    ck_assert(sl_length(reader) < 0);
+
+    ck_assert(sl_write(writer, data, sizeof(data)) == sizeof(data));
+    ck_assert(sl_fd_close(writer) == 0);
+    ck_assert(sl_read(reader, buf, sizeof(buf)) == sizeof(data));
+    ck_assert(memcmp(buf, data, sizeof(data)) == 0);
+    ck_assert(sl_tell(reader) == sizeof(data));
+    ck_assert(sl_eof(reader));
+    ck_assert(sl_fd_close(reader) == 0);
+}
+END_TEST
+
+Suite* streamlike_fd_suite()
+{
+    Suite *s;
+    TCase *tc_create_destroy;
+    TCase *tc_read_write;
+
+    s = suite_create("Streamlike File Descriptor");
+
+    tc_create_destroy = tcase_create("Create Destroy");
+    tcase_add_test(tc_create_destroy, test_create_destroy);
+    tcase_add_test(tc_create_destroy, test_pipe);
+    suite_add_tcase(s, tc_create_destroy);
+
+    tc_read_write = tcase_create("Read Write");
+    tcase_add_checked_fixture(tc_read_write, setup_stream, teardown_stream);
+    tcase_add_test(tc_read_write, test_read_write_seek_length);
+    tcase_add_test(tc_read_write, test_length_invalidate);
+    tcase_add_test(tc_read_write, test_readv_writev);
+    tcase_add_test(tc_read_write, test_read_at);
+    tcase_add_test(tc_read_write, test_clone);
+    tcase_add_test(tc_read_write, test_copy);
+    suite_add_tcase(s, tc_read_write);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    sr = srunner_create(streamlike_fd_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
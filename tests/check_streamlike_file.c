@@ -1,6 +1,10 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <check.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "streamlike/file.h"
 #include "streamlike/test.h"
@@ -16,7 +20,7 @@ void verify_stream_integrity(streamlike_t *stream)
 
     ck_assert(stream->context != NULL);
     ck_assert(stream->read    == sl_fread_cb);
-    ck_assert(stream->input   == NULL);
+    ck_assert(stream->input   == sl_finput_cb);
     ck_assert(stream->write   == sl_fwrite_cb);
     ck_assert(stream->flush   == sl_fflush_cb);
     ck_assert(stream->seek    == sl_fseek_cb);
@@ -30,6 +34,31 @@ void verify_stream_integrity(streamlike_t *stream)
     ck_assert(stream->ckp          == NULL);
     ck_assert(stream->ckp_offset   == NULL);
     ck_assert(stream->ckp_metadata == NULL);
+
+    ck_assert(stream->read_at == sl_fread_at_cb);
+
+    ck_assert(stream->readv  == sl_freadv_cb);
+    ck_assert(stream->writev == sl_fwritev_cb);
+
+    ck_assert(stream->read_multi == sl_fread_multi_cb);
+
+    ck_assert(stream->aio_submit == sl_faio_submit_cb);
+
+    ck_assert(stream->advise == sl_fadvise_cb);
+    ck_assert(stream->seek_cost == sl_fseek_cost_cb);
+    ck_assert(stream->clone == sl_fclone_cb);
+
+    ck_assert(stream->data_map == sl_fdata_map_cb);
+    ck_assert(stream->descriptor == sl_fdescriptor_cb);
+
+    ck_assert(stream->caps == (sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                                                    | SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_has_caps(stream, SL_CAP_READ | SL_CAP_READ_AT | SL_CAP_AIO));
+    ck_assert(sl_has_caps(stream, SL_CAP_INPUT | SL_CAP_ZERO_COPY));
+
+    /* Seeking a file is never worth reading through. */
+    ck_assert(sl_has_caps(stream, SL_CAP_SEEK_COST));
+    ck_assert(sl_seek_cost(stream, 12345) == 0);
 }
 
 START_TEST(test_create_destroy)
@@ -110,6 +139,648 @@ START_TEST(test_read_write_seek_length)
 }
 END_TEST
 
+START_TEST(test_readv_writev)
+{
+    const char header[] = "HDR:";
+    const char payload[] = "\0Payload \0to write\n";
+    char header_buf[sizeof(header)];
+    char payload_buf[sizeof(payload)];
+    struct iovec iov[2];
+
+    iov[0].iov_base = (void*)header;
+    iov[0].iov_len  = sizeof(header);
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len  = sizeof(payload);
+    ck_assert(sl_writev(stream, iov, 2) == sizeof(header) + sizeof(payload));
+    ck_assert(sl_tell(stream) == sizeof(header) + sizeof(payload));
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    iov[0].iov_base = header_buf;
+    iov[1].iov_base = payload_buf;
+    ck_assert(sl_readv(stream, iov, 2) == sizeof(header) + sizeof(payload));
+    ck_assert(memcmp(header_buf, header, sizeof(header)) == 0);
+    ck_assert(memcmp(payload_buf, payload, sizeof(payload)) == 0);
+
+    /* Short read stops at end of file. */
+    ck_assert(sl_seek(stream, 2, SL_SEEK_SET) == 0);
+    ck_assert(sl_readv(stream, iov, 2) == sizeof(header) + sizeof(payload) - 2);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+#define READ_AT_THREADS (4)
+#define READ_AT_DATA_SIZE (64*1024)
+
+char read_at_data[READ_AT_DATA_SIZE];
+
+void* read_at_worker(void *arg)
+{
+    size_t idx = (size_t)arg;
+    char buf[1000];
+    off_t offset;
+    int i;
+
+    /* Each thread reads a different stride of offsets. */
+    for (i = 0; i < 200; i++) {
+        offset = (idx * 7919 + i * 4093) % READ_AT_DATA_SIZE;
+        if (sl_read_at(stream, buf, sizeof(buf), offset)
+                != (READ_AT_DATA_SIZE - offset < sizeof(buf) ?
+                        READ_AT_DATA_SIZE - offset : sizeof(buf))
+                || memcmp(buf, read_at_data + offset,
+                          READ_AT_DATA_SIZE - offset < sizeof(buf) ?
+                              READ_AT_DATA_SIZE - offset : sizeof(buf))) {
+            return (void*)1;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_read_at)
+{
+    pthread_t threads[READ_AT_THREADS];
+    void *result;
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 31 + i / 251);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_flush(stream) == 0);
+    ck_assert(sl_seek(stream, 10, SL_SEEK_SET) == 0);
+
+    for (i = 0; i < READ_AT_THREADS; i++) {
+        ck_assert(pthread_create(&threads[i], NULL, read_at_worker,
+                                 (void*)i) == 0);
+    }
+    for (i = 0; i < READ_AT_THREADS; i++) {
+        ck_assert(pthread_join(threads[i], &result) == 0);
+        ck_assert(result == NULL);
+    }
+
+    /* Current offset is neither used nor moved. */
+    ck_assert(sl_tell(stream) == 10);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), READ_AT_DATA_SIZE - 10)
+                == 10);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), READ_AT_DATA_SIZE) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 10, sizeof(buf)) == 0);
+
+    /* Writes still buffered by stdio are seen. */
+    ck_assert(sl_seek(stream, 0, SL_SEEK_END) == 0);
+    ck_assert(sl_write(stream, read_at_data, 10) == 10);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), READ_AT_DATA_SIZE) == 10);
+    ck_assert(memcmp(buf, read_at_data, 10) == 0);
+    ck_assert(sl_tell(stream) == READ_AT_DATA_SIZE + 10);
+}
+END_TEST
+
+START_TEST(test_read_multi)
+{
+    /* Unordered, adjacent, overlapping, far apart and past the end. */
+    const off_t offsets[] = {40000, 0, 100, 150, 1000, READ_AT_DATA_SIZE - 10,
+                             READ_AT_DATA_SIZE + 10, 120};
+    const size_t lengths[] = {500, 100, 100, 300, 0, 20, 10, 200};
+    const int count = sizeof(offsets) / sizeof(offsets[0]);
+    sl_extent_t extents[sizeof(offsets) / sizeof(offsets[0])];
+    size_t expected;
+    size_t i;
+    int j;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 31 + i / 251);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_flush(stream) == 0);
+
+    /* Once natively, then through the generic fallback. */
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < count; i++) {
+            extents[i].offset = offsets[i];
+            extents[i].length = lengths[i];
+            extents[i].buffer = malloc(lengths[i] + 1);
+            extents[i].read   = 12345;
+        }
+        if (j == 0) {
+            ck_assert(sl_read_multi(stream, extents, count) != 0);
+            ck_assert(sl_tell(stream) == READ_AT_DATA_SIZE);
+        } else {
+            ck_assert(sl_generic_read_multi(stream, extents, count) != 0);
+        }
+        for (i = 0; i < count; i++) {
+            expected = (offsets[i] >= READ_AT_DATA_SIZE ? 0 :
+                        READ_AT_DATA_SIZE - offsets[i] < lengths[i] ?
+                            READ_AT_DATA_SIZE - offsets[i] : lengths[i]);
+            ck_assert_uint_eq(extents[i].read, expected);
+            ck_assert(memcmp(extents[i].buffer, read_at_data + offsets[i],
+                             expected) == 0);
+            free(extents[i].buffer);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_advise)
+{
+    const int advice[] = {SL_ADVICE_SEQUENTIAL, SL_ADVICE_RANDOM,
+                          SL_ADVICE_WILLNEED, SL_ADVICE_NOREUSE,
+                          SL_ADVICE_DONTNEED, SL_ADVICE_NORMAL};
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 13);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_flush(stream) == 0);
+
+    for (i = 0; i < sizeof(advice) / sizeof(advice[0]); i++) {
+        ck_assert_int_eq(sl_advise(stream, 1000, 4096, advice[i]), 0);
+        ck_assert(sl_read_at(stream, buf, sizeof(buf), 1000 + i)
+                    == sizeof(buf));
+        ck_assert(memcmp(buf, read_at_data + 1000 + i, sizeof(buf)) == 0);
+    }
+    ck_assert_int_ne(sl_advise(stream, 0, 0, 12345), 0);
+}
+END_TEST
+
+START_TEST(test_input)
+{
+    const void *ptr;
+    char buf[3000];
+    off_t offset = 0;
+    size_t read;
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 19 + i / 11);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+
+    /* Pointers stay valid until the next call. */
+    while ((read = sl_input(stream, &ptr, 777)) > 0) {
+        ck_assert(read <= 777);
+        ck_assert(memcmp(ptr, read_at_data + offset, read) == 0);
+        offset += read;
+        ck_assert(sl_tell(stream) == offset);
+    }
+    ck_assert(offset == READ_AT_DATA_SIZE);
+    ck_assert(sl_eof(stream));
+
+    /* Data read ahead by input is seen by other calls. */
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    ck_assert(sl_input(stream, &ptr, 100) == 100);
+    ck_assert(memcmp(ptr, read_at_data + 1000, 100) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1100, sizeof(buf)) == 0);
+    ck_assert(sl_input(stream, &ptr, 100) == 100);
+    ck_assert(memcmp(ptr, read_at_data + 4100, 100) == 0);
+    ck_assert(sl_seek(stream, 100, SL_SEEK_CUR) == 0);
+    ck_assert(sl_tell(stream) == 4300);
+    ck_assert(sl_input(stream, &ptr, 100) == 100);
+    ck_assert(memcmp(ptr, read_at_data + 4300, 100) == 0);
+
+    /* Writing goes where input left off. */
+    ck_assert(sl_write(stream, "xyz", 3) == 3);
+    ck_assert(sl_tell(stream) == 4403);
+    ck_assert(sl_read_at(stream, buf, 5, 4399) == 5);
+    ck_assert(sl_flush(stream) == 0);
+    ck_assert(sl_read_at(stream, buf, 5, 4399) == 5);
+    ck_assert(buf[0] == read_at_data[4399]);
+    ck_assert(memcmp(buf + 1, "xyz", 3) == 0);
+    ck_assert(buf[4] == read_at_data[4403]);
+}
+END_TEST
+
+START_TEST(test_read_once)
+{
+    char buf[3000];
+    struct iovec iov[2];
+    off_t offset = 0;
+    size_t read;
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 11 + i / 7);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+
+    /* Dropping cache doesn't change what is read. */
+    ck_assert_int_eq(sl_fset_read_once(stream, 4096), 0);
+    while ((read = sl_read(stream, buf, sizeof(buf))) > 0) {
+        ck_assert(memcmp(buf, read_at_data + offset, read) == 0);
+        offset += read;
+    }
+    ck_assert(offset == READ_AT_DATA_SIZE);
+
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    iov[0].iov_base = buf;
+    iov[0].iov_len  = 1000;
+    iov[1].iov_base = buf + 1000;
+    iov[1].iov_len  = 2000;
+    ck_assert(sl_readv(stream, iov, 2) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1000, sizeof(buf)) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 4000, sizeof(buf)) == 0);
+
+    ck_assert_int_eq(sl_fset_read_once(stream, 0), 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 7000, sizeof(buf)) == 0);
+}
+END_TEST
+
+#define SPARSE_DATA_OFFSET (2 * 1024 * 1024)
+#define SPARSE_LENGTH      (6 * 1024 * 1024)
+
+static
+int sparse_covered(const sl_range_t *ranges, int count, off_t offset,
+                   off_t length)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (ranges[i].offset <= offset
+                && ranges[i].offset + ranges[i].length >= offset + length) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+START_TEST(test_sparse)
+{
+    char *expected;
+    char *buf;
+    sl_range_t ranges[8];
+    struct iovec iov[2];
+    streamlike_t *copy;
+    streamlike_t no_length;
+    FILE *copyf;
+    struct stat s;
+    off_t offset;
+    size_t read;
+    int count;
+    int i;
+
+    expected = calloc(SPARSE_LENGTH, 1);
+    buf = malloc(SPARSE_LENGTH);
+    ck_assert(expected && buf);
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 5 + i / 3 + 1);
+    }
+    memcpy(expected, read_at_data, READ_AT_DATA_SIZE);
+    memcpy(expected + SPARSE_DATA_OFFSET, read_at_data, READ_AT_DATA_SIZE);
+
+    /* Holes before data in the middle and at the end. */
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, SPARSE_DATA_OFFSET, SL_SEEK_SET) == 0);
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_flush(stream) == 0);
+    ck_assert(ftruncate(fileno(tmpf), SPARSE_LENGTH) == 0);
+
+    /* File systems may map holes as data, but never data as holes. */
+    count = sl_data_map(stream, 0, 0, ranges, 8);
+    ck_assert(count >= 1 && count <= 8);
+    for (i = 0; i < count; i++) {
+        ck_assert(ranges[i].length > 0);
+        ck_assert(ranges[i].offset + ranges[i].length <= SPARSE_LENGTH);
+        ck_assert(i == 0 || ranges[i].offset
+                            > ranges[i - 1].offset + ranges[i - 1].length);
+    }
+    ck_assert(sparse_covered(ranges, count, 0, READ_AT_DATA_SIZE));
+    ck_assert(sparse_covered(ranges, count, SPARSE_DATA_OFFSET,
+                             READ_AT_DATA_SIZE));
+
+    /* Parts are mapped within bounds. */
+    count = sl_data_map(stream, SPARSE_DATA_OFFSET + 100, 1000, ranges, 8);
+    ck_assert_int_eq(count, 1);
+    ck_assert(ranges[0].offset == SPARSE_DATA_OFFSET + 100);
+    ck_assert(ranges[0].length == 1000);
+    ck_assert_int_eq(sl_data_map(stream, SPARSE_LENGTH, 0, ranges, 8), 0);
+
+    /* Holes are read as zeros, crossing into data at odd offsets. */
+    ck_assert_int_eq(sl_fset_skip_holes(stream, 1), 0);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    offset = 0;
+    while ((read = sl_read(stream, buf, 99999)) > 0) {
+        ck_assert(memcmp(buf, expected + offset, read) == 0);
+        offset += read;
+        ck_assert(sl_tell(stream) == offset);
+    }
+    ck_assert(offset == SPARSE_LENGTH);
+    ck_assert(sl_eof(stream));
+
+    ck_assert(sl_seek(stream, SPARSE_DATA_OFFSET - 1000, SL_SEEK_SET) == 0);
+    iov[0].iov_base = buf;
+    iov[0].iov_len  = 500;
+    iov[1].iov_base = buf + 500;
+    iov[1].iov_len  = 2000;
+    ck_assert(sl_readv(stream, iov, 2) == 2500);
+    ck_assert(memcmp(buf, expected + SPARSE_DATA_OFFSET - 1000, 2500) == 0);
+
+    /* Copy keeps holes where the source has them. */
+    copyf = tmpfile();
+    ck_assert(copyf);
+    copy = sl_fopen2(copyf);
+    ck_assert(copy);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy_sparse(stream, copy, 0) == SPARSE_LENGTH);
+    ck_assert(sl_flush(copy) == 0);
+    ck_assert(sl_length(copy) == SPARSE_LENGTH);
+    ck_assert(sl_seek(copy, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(copy, buf, SPARSE_LENGTH) == SPARSE_LENGTH);
+    ck_assert(memcmp(buf, expected, SPARSE_LENGTH) == 0);
+    ck_assert(fstat(fileno(tmpf), &s) == 0);
+    if (s.st_blocks * 512 < SPARSE_LENGTH) {
+        ck_assert(fstat(fileno(copyf), &s) == 0);
+        ck_assert(s.st_blocks * 512 < SPARSE_LENGTH);
+    }
+    ck_assert(sl_fclose(copy) == 0);
+
+    /* Source of unknown length is copied whole. */
+    no_length = *stream;
+    no_length.length = NULL;
+    copyf = tmpfile();
+    ck_assert(copyf);
+    copy = sl_fopen2(copyf);
+    ck_assert(copy);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_copy_sparse(&no_length, copy, 0) == SPARSE_LENGTH);
+    ck_assert(sl_seek(copy, 0, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(copy, buf, SPARSE_LENGTH) == SPARSE_LENGTH);
+    ck_assert(memcmp(buf, expected, SPARSE_LENGTH) == 0);
+    ck_assert(sl_fclose(copy) == 0);
+
+    free(expected);
+    free(buf);
+}
+END_TEST
+
+START_TEST(test_prealloc_writeback)
+{
+    char buf[3000];
+    struct stat s;
+    off_t offset;
+    size_t read;
+    int i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 3 + i / 17);
+    }
+    ck_assert_int_eq(sl_fset_prealloc(stream, 1024 * 1024), 0);
+    ck_assert_int_eq(sl_fset_writeback(stream, 16 * 1024), 0);
+    for (offset = 0; offset < READ_AT_DATA_SIZE; offset += 1000) {
+        ck_assert(sl_write(stream, read_at_data + offset,
+                           (READ_AT_DATA_SIZE - offset < 1000 ?
+                            READ_AT_DATA_SIZE - offset : 1000))
+                    > 0);
+    }
+    ck_assert(sl_flush(stream) == 0);
+
+    /* Reserved extents don't show up in length. */
+    ck_assert(sl_length(stream) == READ_AT_DATA_SIZE);
+    ck_assert(fstat(fileno(tmpf), &s) == 0);
+    ck_assert(s.st_size == READ_AT_DATA_SIZE);
+    ck_assert(s.st_blocks * 512 >= 1024 * 1024);
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    offset = 0;
+    while ((read = sl_read(stream, buf, sizeof(buf))) > 0) {
+        ck_assert(memcmp(buf, read_at_data + offset, read) == 0);
+        offset += read;
+    }
+    ck_assert(offset == READ_AT_DATA_SIZE);
+
+    ck_assert_int_eq(sl_fset_prealloc(stream, 0), 0);
+    ck_assert_int_eq(sl_fset_writeback(stream, 0), 0);
+}
+END_TEST
+
+#define GROUP_SYNC_THREADS (8)
+#define GROUP_SYNC_RECORDS (50)
+#define GROUP_SYNC_RECORD_SIZE (100)
+
+void* group_sync_worker(void *arg)
+{
+    char record[GROUP_SYNC_RECORD_SIZE];
+    int i;
+
+    memset(record, 'a' + (int)(size_t)arg, sizeof(record));
+    for (i = 0; i < GROUP_SYNC_RECORDS; i++) {
+        if (sl_write(stream, record, sizeof(record)) != sizeof(record)
+                || sl_fsync_group(stream) != 0) {
+            return (void*)1;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(test_group_sync)
+{
+    pthread_t threads[GROUP_SYNC_THREADS];
+    char record[GROUP_SYNC_RECORD_SIZE];
+    void *result;
+    size_t i;
+    size_t j;
+
+    ck_assert_int_eq(sl_fsync_group(stream), 0);
+    for (i = 0; i < GROUP_SYNC_THREADS; i++) {
+        ck_assert(pthread_create(&threads[i], NULL, group_sync_worker,
+                                 (void*)i) == 0);
+    }
+    for (i = 0; i < GROUP_SYNC_THREADS; i++) {
+        ck_assert(pthread_join(threads[i], &result) == 0);
+        ck_assert(result == NULL);
+    }
+
+    /* Records aren't torn. */
+    ck_assert(sl_length(stream) == GROUP_SYNC_THREADS * GROUP_SYNC_RECORDS
+                                   * GROUP_SYNC_RECORD_SIZE);
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    for (i = 0; i < GROUP_SYNC_THREADS * GROUP_SYNC_RECORDS; i++) {
+        ck_assert(sl_read(stream, record, sizeof(record)) == sizeof(record));
+        for (j = 1; j < sizeof(record); j++) {
+            ck_assert(record[j] == record[0]);
+        }
+    }
+}
+END_TEST
+
+#define AIO_READS (32)
+#define AIO_READ_SIZE (1000)
+
+START_TEST(test_clone)
+{
+    streamlike_t *clone;
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 7 + i / 13);
+    }
+    /* Data written but not flushed is seen by the clone. */
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    clone = sl_clone(stream);
+    ck_assert(clone != NULL);
+    ck_assert(sl_tell(clone) == 1000);
+    ck_assert(sl_length(clone) == READ_AT_DATA_SIZE);
+
+    /* Cursors move independently. */
+    ck_assert(sl_seek(clone, 5000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(clone, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 5000, sizeof(buf)) == 0);
+    ck_assert(sl_tell(stream) == 1000);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1000, sizeof(buf)) == 0);
+    ck_assert(sl_tell(clone) == 5000 + sizeof(buf));
+
+    /* Either can be closed first. */
+    ck_assert(sl_fclose(clone) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, read_at_data + 1100, sizeof(buf)) == 0);
+}
+END_TEST
+
+static
+size_t failing_read_at_cb(void *context, void *buffer, size_t size,
+                          off_t offset)
+{
+    return 0;
+}
+
+static
+int failing_error_cb(void *context)
+{
+    return 1;
+}
+
+START_TEST(test_aio)
+{
+    /* Positional reads on io_uring, or on the pool without native support.
+     * Seek and reads in between keep their order on the pool. */
+    char bufs[AIO_READS + 3][AIO_READ_SIZE];
+    sl_aio_completion_t completions[8];
+    sl_aio_request_t req;
+    streamlike_t pool_stream = *stream;
+    streamlike_t failing_stream;
+    const streamlike_t *target = (_i ? &pool_stream : stream);
+    sl_aio_t *aio;
+    off_t offset;
+    size_t expected;
+    int done = 0;
+    int seen[AIO_READS + 3] = { 0 };
+    int n;
+    int i;
+
+    pool_stream.aio_submit = NULL;
+    for (i = 0; i < READ_AT_DATA_SIZE; i++) {
+        read_at_data[i] = (char)(i * 17 + i / 509);
+    }
+    ck_assert(sl_write(stream, read_at_data, READ_AT_DATA_SIZE)
+                == READ_AT_DATA_SIZE);
+    ck_assert(sl_flush(stream) == 0);
+
+    aio = sl_aio_create(2);
+    ck_assert_ptr_nonnull(aio);
+    ck_assert_int_eq(sl_aio_poll(aio, completions, 8), 0);
+
+    memset(&req, 0, sizeof(req));
+    req.op = SL_AIO_SEEK;
+    req.offset = 1000;
+    req.whence = SL_SEEK_SET;
+    req.tag = (void*)(intptr_t)AIO_READS;
+    ck_assert_int_eq(sl_aio_submit(aio, target, &req), 0);
+    for (i = 0; i < 2; i++) {
+        req.op = SL_AIO_READ;
+        req.buffer = bufs[AIO_READS + 1 + i];
+        req.size = AIO_READ_SIZE;
+        req.tag = (void*)(intptr_t)(AIO_READS + 1 + i);
+        ck_assert_int_eq(sl_aio_submit(aio, target, &req), 0);
+    }
+    for (i = 0; i < AIO_READS; i++) {
+        req.op = SL_AIO_READ_AT;
+        req.buffer = bufs[i];
+        req.size = AIO_READ_SIZE;
+        req.offset = (i * 7919) % READ_AT_DATA_SIZE;
+        req.tag = (void*)(intptr_t)i;
+        ck_assert_int_eq(sl_aio_submit(aio, target, &req), 0);
+    }
+
+    while (done < AIO_READS + 3) {
+        n = sl_aio_wait(aio, completions, 8, -1);
+        ck_assert_int_gt(n, 0);
+        for (i = 0; i < n; i++) {
+            intptr_t tag = (intptr_t)completions[i].tag;
+            ck_assert_int_le(tag, AIO_READS + 2);
+            ck_assert_int_eq(seen[tag], 0);
+            seen[tag] = 1;
+            if (tag == AIO_READS) {
+                ck_assert_int_eq(completions[i].op, SL_AIO_SEEK);
+                ck_assert_int_eq(completions[i].result, 0);
+                continue;
+            }
+            if (tag < AIO_READS) {
+                ck_assert_int_eq(completions[i].op, SL_AIO_READ_AT);
+                offset = (tag * 7919) % READ_AT_DATA_SIZE;
+            } else {
+                ck_assert_int_eq(completions[i].op, SL_AIO_READ);
+                offset = 1000 + (tag - AIO_READS - 1) * AIO_READ_SIZE;
+            }
+            expected = (READ_AT_DATA_SIZE - offset < AIO_READ_SIZE ?
+                        READ_AT_DATA_SIZE - offset : AIO_READ_SIZE);
+            ck_assert_int_eq(completions[i].result, expected);
+            ck_assert(memcmp(bufs[tag], read_at_data + offset, expected) == 0);
+        }
+        done += n;
+    }
+    ck_assert_int_eq(sl_aio_wait(aio, completions, 8, -1), 0);
+    ck_assert_int_eq(sl_aio_wait(aio, completions, 8, 10), 0);
+
+    /* Failing read is told apart from end-of-file. */
+    failing_stream = pool_stream;
+    failing_stream.read_at = failing_read_at_cb;
+    failing_stream.error   = failing_error_cb;
+    req.op = SL_AIO_READ_AT;
+    req.buffer = bufs[0];
+    req.size = AIO_READ_SIZE;
+    req.offset = 0;
+    req.tag = &failing_stream;
+    ck_assert_int_eq(sl_aio_submit(aio, &failing_stream, &req), 0);
+    req.offset = READ_AT_DATA_SIZE;
+    req.tag = NULL;
+    ck_assert_int_eq(sl_aio_submit(aio, &pool_stream, &req), 0);
+    for (done = 0; done < 2; done += n) {
+        n = sl_aio_wait(aio, completions + done, 2 - done, -1);
+        ck_assert_int_gt(n, 0);
+    }
+    for (i = 0; i < 2; i++) {
+        ck_assert_int_eq(completions[i].result,
+                         (completions[i].tag == (void*)&failing_stream ? -1
+                                                                       : 0));
+    }
+
+    /* Unsupported operation is refused. */
+    pool_stream.read_at = NULL;
+    req.op = SL_AIO_READ_AT;
+    ck_assert_int_ne(sl_aio_submit(aio, &pool_stream, &req), 0);
+
+    sl_aio_destroy(aio);
+}
+END_TEST
+
 Suite* streamlike_file_suite()
 {
     Suite *s;
@@ -129,6 +800,17 @@ Suite* streamlike_file_suite()
     tcase_add_checked_fixture(tc2, setup_stream, teardown_stream);
 
     tcase_add_test(tc2, test_read_write_seek_length);
+    tcase_add_test(tc2, test_read_at);
+    tcase_add_test(tc2, test_readv_writev);
+    tcase_add_test(tc2, test_read_multi);
+    tcase_add_test(tc2, test_advise);
+    tcase_add_test(tc2, test_input);
+    tcase_add_test(tc2, test_read_once);
+    tcase_add_test(tc2, test_sparse);
+    tcase_add_test(tc2, test_prealloc_writeback);
+    tcase_add_test(tc2, test_group_sync);
+    tcase_add_test(tc2, test_clone);
+    tcase_add_loop_test(tc2, test_aio, 0, 2);
     suite_add_tcase(s, tc2);
 
     return s;
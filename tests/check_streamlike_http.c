@@ -1,4 +1,6 @@
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <check.h>
 #include <pthread.h>
@@ -189,6 +191,261 @@ START_TEST(test_multiple_seek_and_read2)
 }
 END_TEST
 
+START_TEST(test_read_at)
+{
+    const off_t offsets[] = {0, 1000, TEST_DATA_LENGTH / 2,
+                             TEST_DATA_LENGTH - 100, TEST_DATA_LENGTH};
+    char buffer[512];
+    size_t expected_len;
+    size_t len;
+    size_t i;
+
+    /* Sequential reading is not disturbed by positional reads. */
+    ck_assert_uint_eq(sl_read(stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data, 100);
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        expected_len = TEST_DATA_LENGTH - offsets[i];
+        if (expected_len > sizeof(buffer)) {
+            expected_len = sizeof(buffer);
+        }
+        len = sl_read_at(stream, buffer, sizeof(buffer), offsets[i]);
+        ck_assert_uint_eq(len, expected_len);
+        ck_assert_mem_eq(buffer, test_data + offsets[i], len);
+    }
+
+    ck_assert_int_eq(sl_tell(stream), 100);
+    ck_assert_uint_eq(sl_read(stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 100, 100);
+}
+END_TEST
+
+START_TEST(test_readv)
+{
+    char header[100];
+    char payload[1000];
+    struct iovec iov[2];
+
+    /* Falls back to reading each buffer. */
+    ck_assert_ptr_eq(stream->readv, NULL);
+    iov[0].iov_base = header;
+    iov[0].iov_len  = sizeof(header);
+    iov[1].iov_base = payload;
+    iov[1].iov_len  = sizeof(payload);
+    ck_assert_uint_eq(sl_readv(stream, iov, 2), sizeof(header)
+                                                + sizeof(payload));
+    ck_assert_mem_eq(header, test_data, sizeof(header));
+    ck_assert_mem_eq(payload, test_data + sizeof(header), sizeof(payload));
+}
+END_TEST
+
+START_TEST(test_read_multi)
+{
+    /* Unordered, adjacent, overlapping, far apart and past the end. */
+    const off_t offsets[] = {900000, 0, 100, 150, 500000, 3000,
+                             TEST_DATA_LENGTH - 10, TEST_DATA_LENGTH + 10, 120};
+    const size_t lengths[] = {5000, 100, 100, 300, 70000, 0, 20, 10, 200};
+    const int count = sizeof(offsets) / sizeof(offsets[0]);
+    sl_extent_t extents[sizeof(offsets) / sizeof(offsets[0])];
+    size_t expected;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].offset = offsets[i];
+        extents[i].length = lengths[i];
+        extents[i].buffer = malloc(lengths[i] + 1);
+        ck_assert_ptr_nonnull(extents[i].buffer);
+    }
+    ck_assert_int_ne(sl_read_multi(stream, extents, count), 0);
+    for (i = 0; i < count; i++) {
+        expected = (offsets[i] >= TEST_DATA_LENGTH ? 0 :
+                    TEST_DATA_LENGTH - offsets[i] < lengths[i] ?
+                        TEST_DATA_LENGTH - offsets[i] : lengths[i]);
+        ck_assert_uint_eq(extents[i].read, expected);
+        ck_assert_mem_eq(extents[i].buffer, test_data + offsets[i], expected);
+        free(extents[i].buffer);
+    }
+    ck_assert_int_eq(sl_tell(stream), 0);
+}
+END_TEST
+
+START_TEST(test_advise)
+{
+    const off_t offsets[] = {TEST_DATA_LENGTH / 2, 1000, TEST_DATA_LENGTH - 100,
+                             300 * 1024};
+    char *buffer = malloc(TEST_DATA_LENGTH);
+    size_t expected_len;
+    size_t i;
+
+    ck_assert_ptr_nonnull(buffer);
+    ck_assert_int_eq(sl_advise(stream, 0, 0, SL_ADVICE_RANDOM), 0);
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        expected_len = TEST_DATA_LENGTH - offsets[i];
+        if (expected_len > 1000) {
+            expected_len = 1000;
+        }
+        ck_assert_int_eq(sl_seek(stream, offsets[i], SL_SEEK_SET), 0);
+        ck_assert_uint_eq(sl_read(stream, buffer, 1000), expected_len);
+        ck_assert_mem_eq(buffer, test_data + offsets[i], expected_len);
+    }
+
+    /* Bounded ranges follow each other till end-of-file. */
+    ck_assert_int_eq(sl_seek(stream, 0, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, TEST_DATA_LENGTH),
+                      TEST_DATA_LENGTH);
+    ck_assert_mem_eq(buffer, test_data, TEST_DATA_LENGTH);
+    ck_assert_int_ne(sl_eof(stream), 0);
+
+    /* Prefetched range is started before reading it. */
+    ck_assert_int_eq(sl_seek(stream, 5000, SL_SEEK_SET), 0);
+    ck_assert_int_eq(sl_advise(stream, 5000, 600 * 1024, SL_ADVICE_WILLNEED),
+                     0);
+    ck_assert_uint_eq(sl_read(stream, buffer, 600 * 1024), 600 * 1024);
+    ck_assert_mem_eq(buffer, test_data + 5000, 600 * 1024);
+
+    ck_assert_int_eq(sl_advise(stream, 0, 0, SL_ADVICE_SEQUENTIAL), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, 1000), 1000);
+    ck_assert_mem_eq(buffer, test_data + 5000 + 600 * 1024, 1000);
+
+    /* Prefetch after a short read doesn't fill the buffer of that read. */
+    ck_assert_int_eq(sl_seek(stream, TEST_DATA_LENGTH - 100, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, 1000), 100);
+    memset(buffer, 0, 1000);
+    ck_assert_int_eq(sl_seek(stream, 2000, SL_SEEK_SET), 0);
+    ck_assert_int_eq(sl_advise(stream, 2000, 0, SL_ADVICE_WILLNEED), 0);
+    ck_assert_int_eq(buffer[100], 0);
+    ck_assert_uint_eq(sl_read(stream, buffer + 1000, 1000), 1000);
+    ck_assert_mem_eq(buffer + 1000, test_data + 2000, 1000);
+    free(buffer);
+}
+END_TEST
+
+START_TEST(test_seek_cost)
+{
+    char *buffer = malloc(TEST_DATA_LENGTH);
+    off_t guess;
+    off_t cost;
+
+    ck_assert_ptr_nonnull(buffer);
+    ck_assert(sl_has_caps(stream, SL_CAP_SEEK_COST));
+
+    /* Nothing is measured yet. There is a guess for other offsets. */
+    ck_assert_int_eq(sl_seek_cost(stream, 0), 0);
+    guess = sl_seek_cost(stream, 1000);
+    ck_assert_int_gt(guess, 0);
+
+    /* Measured after requests get data and reads take time. */
+    ck_assert_uint_eq(sl_read(stream, buffer, 1000), 1000);
+    ck_assert_int_eq(sl_seek(stream, 300 * 1024, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, TEST_DATA_LENGTH / 2),
+                      TEST_DATA_LENGTH / 2);
+    ck_assert_mem_eq(buffer, test_data + 300 * 1024, TEST_DATA_LENGTH / 2);
+
+    ck_assert_int_eq(sl_seek_cost(stream, sl_tell(stream)), 0);
+    cost = sl_seek_cost(stream, 0);
+    ck_assert_int_ge(cost, 0);
+    ck_assert_int_eq(sl_seek_cost(stream, TEST_DATA_LENGTH - 1), cost);
+    free(buffer);
+}
+END_TEST
+
+START_TEST(test_clone)
+{
+    streamlike_t *clone;
+    char buffer[1000];
+
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    clone = sl_clone(stream);
+    ck_assert_ptr_nonnull(clone);
+    ck_assert(sl_has_caps(clone, SL_CAP_CLONE));
+
+    /* Length is known without a request. */
+    ck_assert_int_eq(sl_tell(clone), sizeof(buffer));
+    ck_assert_int_eq(sl_length(clone), TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_seekable(clone), SL_SEEKING_SUPPORTED);
+
+    /* Cursors move independently. */
+    ck_assert_uint_eq(sl_read(clone, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 1000, sizeof(buffer));
+    ck_assert_int_eq(sl_seek(clone, 500000, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(clone, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 500000, sizeof(buffer));
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 1000, sizeof(buffer));
+
+    /* Shared state outlives the clone. */
+    ck_assert_int_eq(sl_http_destroy(clone), 0);
+    ck_assert_int_eq(sl_seek(stream, 700000, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 700000, sizeof(buffer));
+    ck_assert_uint_eq(sl_read_at(stream, buffer, sizeof(buffer), 10),
+                      sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 10, sizeof(buffer));
+}
+END_TEST
+
+START_TEST(test_aio)
+{
+    const off_t offsets[] = {0, 1000, TEST_DATA_LENGTH / 2,
+                             TEST_DATA_LENGTH - 100, TEST_DATA_LENGTH, 5000};
+    const int count = sizeof(offsets) / sizeof(offsets[0]);
+    char buffers[sizeof(offsets) / sizeof(offsets[0]) + 1][512];
+    sl_aio_completion_t completions[4];
+    sl_aio_request_t req;
+    sl_aio_t *aio;
+    size_t expected_len;
+    int done = 0;
+    int n;
+    int i;
+
+    aio = sl_aio_create(1);
+    ck_assert_ptr_nonnull(aio);
+
+    /* Positional reads go to the multi handle, while sequential read goes to
+     * the pool. */
+    req.op = SL_AIO_READ;
+    req.buffer = buffers[count];
+    req.size = sizeof(buffers[count]);
+    req.tag = (void*)(intptr_t)count;
+    ck_assert_int_eq(sl_aio_submit(aio, stream, &req), 0);
+    for (i = 0; i < count; i++) {
+        req.op = SL_AIO_READ_AT;
+        req.buffer = buffers[i];
+        req.size = sizeof(buffers[i]);
+        req.offset = offsets[i];
+        req.tag = (void*)(intptr_t)i;
+        ck_assert_int_eq(sl_aio_submit(aio, stream, &req), 0);
+    }
+
+    while (done < count + 1) {
+        n = sl_aio_wait(aio, completions, 4, -1);
+        ck_assert_int_gt(n, 0);
+        for (i = 0; i < n; i++) {
+            intptr_t tag = (intptr_t)completions[i].tag;
+            if (tag == count) {
+                ck_assert_int_eq(completions[i].op, SL_AIO_READ);
+                ck_assert_int_eq(completions[i].result, sizeof(buffers[tag]));
+                ck_assert_mem_eq(buffers[tag], test_data, sizeof(buffers[tag]));
+                continue;
+            }
+            ck_assert_int_eq(completions[i].op, SL_AIO_READ_AT);
+            expected_len = TEST_DATA_LENGTH - offsets[tag];
+            if (expected_len > sizeof(buffers[tag])) {
+                expected_len = sizeof(buffers[tag]);
+            }
+            ck_assert_int_eq(completions[i].result, expected_len);
+            ck_assert_mem_eq(buffers[tag], test_data + offsets[tag],
+                             expected_len);
+        }
+        done += n;
+    }
+
+    sl_aio_destroy(aio);
+    ck_assert_int_eq(sl_tell(stream), sizeof(buffers[count]));
+}
+END_TEST
+
 Suite* streamlike_http_suite()
 {
     Suite *s;
@@ -208,6 +465,13 @@ Suite* streamlike_http_suite()
     tcase_add_test(tc, test_single_seek_and_read);
     tcase_add_test(tc, test_multiple_seek_and_read);
     tcase_add_test(tc, test_multiple_seek_and_read2);
+    tcase_add_test(tc, test_read_at);
+    tcase_add_test(tc, test_readv);
+    tcase_add_test(tc, test_read_multi);
+    tcase_add_test(tc, test_advise);
+    tcase_add_test(tc, test_seek_cost);
+    tcase_add_test(tc, test_clone);
+    tcase_add_test(tc, test_aio);
     suite_add_tcase(s, tc);
 
     return s;
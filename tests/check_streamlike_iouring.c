@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "streamlike/iouring.h"
+#include "util/util.h"
+
+#define TEMP_FILE_NAME        "test_iouring.tmp"
+#define TEST_DATA_LENGTH      (64 * 1024 + 100)
+#define TEST_DATA_RANDOM_SEED (0)
+#define TEST_DEPTH            (4)
+#define TEST_BLOCK_SIZE       (4096)
+
+streamlike_t *stream;
+char test_data[TEST_DATA_LENGTH];
+int flags;
+
+void verify_stream_integrity(streamlike_t *stream)
+{
+    ck_assert(stream != NULL);
+
+    ck_assert(stream->context != NULL);
+    ck_assert(stream->read    == sl_iouring_read_cb);
+    ck_assert(stream->input   == sl_iouring_input_cb);
+    ck_assert(stream->write   == NULL);
+    ck_assert(stream->seek    == sl_iouring_seek_cb);
+    ck_assert(stream->tell    == sl_iouring_tell_cb);
+    ck_assert(stream->eof     == sl_iouring_eof_cb);
+    ck_assert(stream->error   == sl_iouring_error_cb);
+    ck_assert(stream->length  == sl_iouring_length_cb);
+
+    ck_assert(stream->seekable   == sl_iouring_seekable_cb);
+    ck_assert(stream->read_at    == sl_iouring_read_at_cb);
+    ck_assert(stream->readv      == sl_iouring_readv_cb);
+    ck_assert(stream->read_multi == sl_iouring_read_multi_cb);
+    ck_assert(stream->aio_submit == NULL);
+    ck_assert(stream->advise     == sl_iouring_advise_cb);
+    ck_assert(stream->seek_cost  == sl_iouring_seek_cost_cb);
+    ck_assert(stream->clone      == sl_iouring_clone_cb);
+    ck_assert(stream->data_map   == sl_iouring_data_map_cb);
+    ck_assert(stream->descriptor == NULL);
+
+    ck_assert(stream->caps == (sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                               | SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_seekable(stream) == SL_SEEKING_SUPPORTED);
+}
+
+void setup_stream()
+{
+    FILE *fp;
+    int fd;
+
+    /* Created here, since temporary file systems may not support O_DIRECT. */
+    fp = fopen(TEMP_FILE_NAME, "wb");
+    ck_assert(fp != NULL);
+    ck_assert(fwrite(test_data, 1, TEST_DATA_LENGTH, fp) == TEST_DATA_LENGTH);
+    ck_assert(fclose(fp) == 0);
+
+    fd = open(TEMP_FILE_NAME, O_RDONLY);
+    ck_assert(fd >= 0);
+    stream = sl_iouring_open2(fd, TEST_DEPTH, TEST_BLOCK_SIZE, flags);
+    verify_stream_integrity(stream);
+}
+
+void setup_buffered()
+{
+    flags = 0;
+    setup_stream();
+}
+
+void setup_fixed_file()
+{
+    flags = SL_IOURING_FIXED_FILE;
+    setup_stream();
+}
+
+void teardown_stream()
+{
+    ck_assert(sl_iouring_close(stream) == 0);
+    stream = NULL;
+    ck_assert(remove(TEMP_FILE_NAME) == 0);
+}
+
+START_TEST(test_read_seek)
+{
+    char buf[10000];
+    off_t offset = 0;
+    size_t read;
+
+    ck_assert(sl_length(stream) == TEST_DATA_LENGTH);
+    while ((read = sl_read(stream, buf, 3000)) > 0) {
+        ck_assert(memcmp(buf, test_data + offset, read) == 0);
+        offset += read;
+        ck_assert(sl_tell(stream) == offset);
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+    ck_assert(!sl_error(stream));
+
+    /* Back before blocks read ahead, and among them. */
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, 100) == 100);
+    ck_assert(memcmp(buf, test_data + 1000, 100) == 0);
+    ck_assert(sl_seek_cost(stream, 3 * TEST_BLOCK_SIZE) == 0);
+    ck_assert(sl_seek_cost(stream, 40000) > 0);
+    ck_assert(sl_seek(stream, 3 * TEST_BLOCK_SIZE + 10, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 3 * TEST_BLOCK_SIZE + 10,
+                     sizeof(buf)) == 0);
+
+    /* Far ahead, and the unaligned tail. */
+    ck_assert(sl_seek(stream, -100, SL_SEEK_END) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == 100);
+    ck_assert(memcmp(buf, test_data + TEST_DATA_LENGTH - 100, 100) == 0);
+    ck_assert(sl_eof(stream));
+
+    ck_assert(sl_seek(stream, TEST_DATA_LENGTH + 10, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, 10) == 0);
+    ck_assert(sl_eof(stream));
+    ck_assert(sl_seek(stream, -1, SL_SEEK_SET) != 0);
+}
+END_TEST
+
+START_TEST(test_input)
+{
+    const void *data;
+    const void *first;
+    off_t offset = 0;
+    size_t len;
+
+    ck_assert(sl_input(stream, &first, 100) == 100);
+    ck_assert(memcmp(first, test_data, 100) == 0);
+    ck_assert(sl_input(stream, &data, TEST_DATA_LENGTH) == TEST_BLOCK_SIZE - 100);
+    ck_assert(data == (const char*)first + 100);
+
+    while ((len = sl_input(stream, &data, TEST_DATA_LENGTH)) > 0) {
+        ck_assert(memcmp(data, test_data + TEST_BLOCK_SIZE + offset, len) == 0);
+        offset += len;
+    }
+    ck_assert(offset == TEST_DATA_LENGTH - TEST_BLOCK_SIZE);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+START_TEST(test_read_at_clone)
+{
+    streamlike_t *clone;
+    char buf[1000];
+
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), 20000) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 20000, sizeof(buf)) == 0);
+    ck_assert(sl_read_at(stream, buf, sizeof(buf), TEST_DATA_LENGTH - 10)
+                == 10);
+    ck_assert(sl_tell(stream) == 0);
+
+    ck_assert(sl_seek(stream, 5000, SL_SEEK_SET) == 0);
+    clone = sl_clone(stream);
+    verify_stream_integrity(clone);
+    ck_assert(sl_tell(clone) == 5000);
+    ck_assert(sl_seek(clone, 50000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(clone, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 50000, sizeof(buf)) == 0);
+    ck_assert(sl_iouring_close(clone) == 0);
+
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 5000, sizeof(buf)) == 0);
+    ck_assert_int_eq(sl_advise(stream, 0, 0, SL_ADVICE_SEQUENTIAL), 0);
+}
+END_TEST
+
+START_TEST(test_direct)
+{
+    streamlike_t *direct;
+    char buf[3000];
+    off_t offset = 0;
+    size_t read;
+
+    direct = sl_iouring_open(TEMP_FILE_NAME, SL_IOURING_DIRECT);
+    if (direct == NULL) {
+        /* File system doesn't support O_DIRECT. */
+        return;
+    }
+    verify_stream_integrity(direct);
+    while ((read = sl_read(direct, buf, sizeof(buf))) > 0) {
+        ck_assert(memcmp(buf, test_data + offset, read) == 0);
+        offset += read;
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(!sl_error(direct));
+
+    /* Unaligned positional reads too. */
+    ck_assert(sl_read_at(direct, buf, 33, 12345) == 33);
+    ck_assert(memcmp(buf, test_data + 12345, 33) == 0);
+    ck_assert(sl_iouring_close(direct) == 0);
+}
+END_TEST
+
+Suite* streamlike_iouring_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike io_uring");
+
+    tc = tcase_create("Buffered");
+    tcase_add_checked_fixture(tc, setup_buffered, teardown_stream);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_input);
+    tcase_add_test(tc, test_read_at_clone);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Fixed File");
+    tcase_add_checked_fixture(tc, setup_fixed_file, teardown_stream);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_direct);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+/* Whether io_uring can be set up, which isn't the case on older kernels or
+ * when it is filtered out. */
+static
+int iouring_available()
+{
+    streamlike_t *probe;
+    FILE *fp;
+
+    fp = tmpfile();
+    if (fp == NULL) {
+        return 0;
+    }
+    probe = sl_iouring_open2(fileno(fp), TEST_DEPTH, TEST_BLOCK_SIZE, 0);
+    if (probe != NULL) {
+        sl_iouring_close2(probe);
+    }
+    fclose(fp);
+    return (probe != NULL);
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    if (!iouring_available()) {
+        fprintf(stderr, "io_uring isn't available, skipping.\n");
+        return 77;
+    }
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_iouring_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
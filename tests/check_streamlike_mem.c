@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "streamlike/mem.h"
+#include "util/util.h"
+
+#define TEST_DATA_LENGTH      (256 * 1024 + 100)
+#define TEST_DATA_RANDOM_SEED (0)
+#define TEST_CHUNK_SIZE       (4096)
+
+char test_data[TEST_DATA_LENGTH];
+
+START_TEST(test_stream_integrity)
+{
+    streamlike_t *reader = sl_mem_open(test_data, TEST_DATA_LENGTH);
+    streamlike_t *writer = sl_mem_create();
+
+    ck_assert_ptr_nonnull(reader);
+    ck_assert_ptr_eq(reader->read, sl_mem_read_cb);
+    ck_assert_ptr_eq(reader->input, sl_mem_input_cb);
+    ck_assert_ptr_eq(reader->read_at, sl_mem_read_at_cb);
+    ck_assert_ptr_eq(reader->readv, sl_mem_readv_cb);
+    ck_assert_ptr_eq(reader->read_multi, sl_mem_read_multi_cb);
+    ck_assert_ptr_eq(reader->seek, sl_mem_seek_cb);
+    ck_assert_ptr_eq(reader->clone, sl_mem_clone_cb);
+    ck_assert_ptr_null(reader->write);
+    ck_assert_ptr_null(reader->writev);
+    ck_assert_uint_eq(reader->caps, sl_probe_caps(reader) | SL_CAP_ZERO_COPY
+                                    | SL_CAP_CHEAP_SEEK);
+    ck_assert_int_eq(sl_seekable(reader), SL_SEEKING_SUPPORTED);
+    ck_assert_int_eq(sl_length(reader), TEST_DATA_LENGTH);
+
+    ck_assert_ptr_nonnull(writer);
+    ck_assert_ptr_eq(writer->write, sl_mem_write_cb);
+    ck_assert_ptr_eq(writer->writev, sl_mem_writev_cb);
+    ck_assert_ptr_eq(writer->flush, sl_mem_flush_cb);
+    ck_assert_ptr_null(writer->clone);
+    ck_assert(sl_has_caps(writer, SL_CAP_READ | SL_CAP_INPUT | SL_CAP_WRITE
+                                  | SL_CAP_ZERO_COPY));
+    ck_assert_int_eq(sl_length(writer), 0);
+
+    ck_assert_int_eq(sl_mem_close(reader), 0);
+    ck_assert_int_eq(sl_mem_close(writer), 0);
+}
+END_TEST
+
+START_TEST(test_read_seek)
+{
+    streamlike_t *stream = sl_mem_open(test_data, TEST_DATA_LENGTH);
+    streamlike_t *clone;
+    const void *ptr;
+    char buffer[1000];
+
+    ck_assert_ptr_nonnull(stream);
+
+    /* Input points into the memory given. */
+    ck_assert_uint_eq(sl_input(stream, &ptr, 100), 100);
+    ck_assert_ptr_eq(ptr, test_data);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 100, sizeof(buffer));
+
+    ck_assert_int_eq(sl_seek(stream, -50, SL_SEEK_END), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), 50);
+    ck_assert_mem_eq(buffer, test_data + TEST_DATA_LENGTH - 50, 50);
+    ck_assert(sl_eof(stream));
+    ck_assert_uint_eq(sl_input(stream, &ptr, 100), 0);
+
+    ck_assert_int_eq(sl_seek(stream, 5000, SL_SEEK_SET), 0);
+    ck_assert(!sl_eof(stream));
+    clone = sl_clone(stream);
+    ck_assert_ptr_nonnull(clone);
+    ck_assert_int_eq(sl_tell(clone), 5000);
+    ck_assert_uint_eq(sl_input(clone, &ptr, 10), 10);
+    ck_assert_ptr_eq(ptr, test_data + 5000);
+    ck_assert_int_eq(sl_tell(stream), 5000);
+    ck_assert_int_eq(sl_mem_close(clone), 0);
+
+    ck_assert_int_eq(sl_seek(stream, TEST_DATA_LENGTH + 10, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, 10), 0);
+    ck_assert_int_eq(sl_mem_close(stream), 0);
+}
+END_TEST
+
+START_TEST(test_write_chunks)
+{
+    streamlike_t *stream = sl_mem_create2(TEST_CHUNK_SIZE);
+    struct iovec iov[64];
+    const void *ptr;
+    const void *first;
+    char buffer[3000];
+    off_t offset = 0;
+    size_t size;
+    size_t got;
+    int count;
+    int i;
+
+    ck_assert_ptr_nonnull(stream);
+    for (offset = 0; offset < TEST_DATA_LENGTH; offset += size) {
+        size = (TEST_DATA_LENGTH - offset < 777 ? TEST_DATA_LENGTH - offset
+                                                 : 777);
+        ck_assert_uint_eq(sl_write(stream, test_data + offset, size), size);
+        if (offset == 0) {
+            sl_mem_iov(stream, iov, 1);
+            first = iov[0].iov_base;
+        }
+    }
+    ck_assert_int_eq(sl_length(stream), TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_tell(stream), TEST_DATA_LENGTH);
+
+    /* Chunks never move, and grow with the stream. */
+    count = sl_mem_iov(stream, iov, 64);
+    ck_assert_int_gt(count, 1);
+    ck_assert_int_lt(count, 64);
+    ck_assert_ptr_eq(iov[0].iov_base, first);
+    offset = 0;
+    for (i = 0; i < count; i++) {
+        ck_assert_mem_eq(iov[i].iov_base, test_data + offset, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+    ck_assert_int_eq(offset, TEST_DATA_LENGTH);
+    ck_assert_uint_gt(iov[count - 2].iov_len, iov[0].iov_len);
+
+    /* Reading back crosses chunks, while input stops at their ends. */
+    ck_assert_int_eq(sl_seek(stream, 0, SL_SEEK_SET), 0);
+    offset = 0;
+    while ((got = sl_read(stream, buffer, sizeof(buffer))) > 0) {
+        ck_assert_mem_eq(buffer, test_data + offset, got);
+        offset += got;
+    }
+    ck_assert_int_eq(offset, TEST_DATA_LENGTH);
+    ck_assert_int_eq(sl_seek(stream, TEST_CHUNK_SIZE - 10, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_input(stream, &ptr, 100), 10);
+    ck_assert_mem_eq(ptr, test_data + TEST_CHUNK_SIZE - 10, 10);
+    ck_assert_uint_eq(sl_input(stream, &ptr, 100), 100);
+    ck_assert_mem_eq(ptr, test_data + TEST_CHUNK_SIZE, 100);
+
+    /* Overwriting across chunks, and writing past the end. */
+    ck_assert_int_eq(sl_seek(stream, TEST_CHUNK_SIZE - 2, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_write(stream, "abcd", 4), 4);
+    ck_assert_int_eq(sl_length(stream), TEST_DATA_LENGTH);
+    ck_assert_uint_eq(sl_read_at(stream, buffer, 6, TEST_CHUNK_SIZE - 3), 6);
+    ck_assert_int_eq(buffer[0], test_data[TEST_CHUNK_SIZE - 3]);
+    ck_assert_mem_eq(buffer + 1, "abcd", 4);
+    ck_assert_int_eq(buffer[5], test_data[TEST_CHUNK_SIZE + 2]);
+    ck_assert_int_eq(sl_seek(stream, 10, SL_SEEK_END), 0);
+    ck_assert_uint_eq(sl_write(stream, "end", 3), 3);
+    ck_assert_int_eq(sl_length(stream), TEST_DATA_LENGTH + 13);
+    ck_assert_uint_eq(sl_read_at(stream, buffer, 100, TEST_DATA_LENGTH), 13);
+    ck_assert_mem_eq(buffer, "\0\0\0\0\0\0\0\0\0\0end", 13);
+
+    /* Merged once into one buffer. */
+    ptr = sl_mem_contiguous(stream, &size);
+    ck_assert_ptr_nonnull(ptr);
+    ck_assert_uint_eq(size, TEST_DATA_LENGTH + 13);
+    ck_assert_mem_eq(ptr, test_data, TEST_CHUNK_SIZE - 2);
+    ck_assert_mem_eq((const char*)ptr + TEST_CHUNK_SIZE + 2,
+                     test_data + TEST_CHUNK_SIZE + 2,
+                     TEST_DATA_LENGTH - TEST_CHUNK_SIZE - 2);
+    ck_assert_int_eq(sl_mem_iov(stream, iov, 64), 1);
+    ck_assert_ptr_eq(sl_mem_contiguous(stream, &size), ptr);
+    ck_assert_uint_eq(sl_write(stream, "more", 4), 4);
+    ck_assert_int_eq(sl_mem_iov(stream, iov, 64), 2);
+    ck_assert_ptr_eq(iov[0].iov_base, ptr);
+
+    ck_assert_int_eq(sl_mem_close(stream), 0);
+}
+END_TEST
+
+START_TEST(test_vectored_multi)
+{
+    streamlike_t *stream = sl_mem_create2(TEST_CHUNK_SIZE);
+    struct iovec iov[3];
+    sl_extent_t extents[3];
+    char buffers[3][5000];
+    int i;
+
+    ck_assert_ptr_nonnull(stream);
+    for (i = 0; i < 3; i++) {
+        iov[i].iov_base = test_data + i * 5000;
+        iov[i].iov_len  = 5000;
+    }
+    ck_assert_uint_eq(sl_writev(stream, iov, 3), 15000);
+    ck_assert_int_eq(sl_seek(stream, 0, SL_SEEK_SET), 0);
+    for (i = 0; i < 3; i++) {
+        iov[i].iov_base = buffers[i];
+    }
+    ck_assert_uint_eq(sl_readv(stream, iov, 3), 15000);
+    ck_assert_mem_eq(buffers[0], test_data, 5000);
+    ck_assert_mem_eq(buffers[2], test_data + 10000, 5000);
+
+    /* Out of order, and past the end. */
+    extents[0].offset = 9000;
+    extents[1].offset = 100;
+    extents[2].offset = 14000;
+    for (i = 0; i < 3; i++) {
+        extents[i].length = 5000;
+        extents[i].buffer = buffers[i];
+    }
+    ck_assert_int_eq(sl_read_multi(stream, extents, 3), 1);
+    ck_assert_uint_eq(extents[0].read, 5000);
+    ck_assert_mem_eq(buffers[0], test_data + 9000, 5000);
+    ck_assert_uint_eq(extents[1].read, 5000);
+    ck_assert_mem_eq(buffers[1], test_data + 100, 5000);
+    ck_assert_uint_eq(extents[2].read, 1000);
+    ck_assert_mem_eq(buffers[2], test_data + 14000, 1000);
+
+    ck_assert_int_eq(sl_mem_close(stream), 0);
+}
+END_TEST
+
+Suite* streamlike_mem_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike Memory");
+
+    tc = tcase_create("Memory");
+    tcase_add_test(tc, test_stream_integrity);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_write_chunks);
+    tcase_add_test(tc, test_vectored_multi);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_mem_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
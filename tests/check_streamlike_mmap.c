@@ -0,0 +1,275 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "streamlike/mmap.h"
+#include "util/util.h"
+
+#define TEMP_FILE_NAME        "test_mmap.tmp"
+#define TEST_DATA_LENGTH      (64 * 1024 + 100)
+#define TEST_DATA_RANDOM_SEED (0)
+
+FILE *tmpf;
+streamlike_t *stream;
+char test_data[TEST_DATA_LENGTH];
+size_t window_size;
+
+void verify_stream_integrity(streamlike_t *stream)
+{
+    ck_assert(stream != NULL);
+
+    ck_assert(stream->context != NULL);
+    ck_assert(stream->read    == sl_mmap_read_cb);
+    ck_assert(stream->input   == sl_mmap_input_cb);
+    ck_assert(stream->write   == NULL);
+    ck_assert(stream->flush   == NULL);
+    ck_assert(stream->seek    == sl_mmap_seek_cb);
+    ck_assert(stream->tell    == sl_mmap_tell_cb);
+    ck_assert(stream->eof     == sl_mmap_eof_cb);
+    ck_assert(stream->error   == sl_mmap_error_cb);
+    ck_assert(stream->length  == sl_mmap_length_cb);
+
+    ck_assert(stream->seekable     == sl_mmap_seekable_cb);
+    ck_assert(stream->ckp_count    == NULL);
+
+    ck_assert(stream->read_at    == sl_mmap_read_at_cb);
+    ck_assert(stream->readv      == sl_mmap_readv_cb);
+    ck_assert(stream->writev     == NULL);
+    ck_assert(stream->read_multi == sl_mmap_read_multi_cb);
+    ck_assert(stream->aio_submit == NULL);
+    ck_assert(stream->advise     == sl_mmap_advise_cb);
+    ck_assert(stream->seek_cost  == sl_mmap_seek_cost_cb);
+    ck_assert(stream->clone      == sl_mmap_clone_cb);
+    ck_assert(stream->data_map   == sl_mmap_data_map_cb);
+    ck_assert(stream->descriptor == NULL);
+
+    ck_assert(stream->caps == (sl_probe_caps(stream) | SL_CAP_ZERO_COPY
+                               | SL_CAP_CHEAP_SEEK));
+    ck_assert(sl_seekable(stream) == SL_SEEKING_SUPPORTED);
+}
+
+START_TEST(test_create_destroy)
+{
+    FILE *fp;
+
+    ck_assert(sl_mmap_open(TEMP_FILE_NAME, 0) == NULL);
+
+    /* Empty files can be opened, but have nothing to read. */
+    fp = fopen(TEMP_FILE_NAME, "wb");
+    ck_assert(fp != NULL);
+    ck_assert(fclose(fp) == 0);
+    stream = sl_mmap_open(TEMP_FILE_NAME, SL_MMAP_POPULATE);
+    verify_stream_integrity(stream);
+    ck_assert(sl_length(stream) == 0);
+    ck_assert(sl_read(stream, test_data, 10) == 0);
+    ck_assert(sl_eof(stream));
+    ck_assert(sl_mmap_close(stream) == 0);
+    stream = NULL;
+    ck_assert(remove(TEMP_FILE_NAME) == 0);
+}
+END_TEST
+
+void setup_stream()
+{
+    tmpf = tmpfile();
+    ck_assert(tmpf);
+    ck_assert(fwrite(test_data, 1, TEST_DATA_LENGTH, tmpf)
+                == TEST_DATA_LENGTH);
+    ck_assert(fflush(tmpf) == 0);
+
+    stream = sl_mmap_open2(fileno(tmpf), window_size, SL_MMAP_POPULATE);
+    verify_stream_integrity(stream);
+}
+
+void setup_whole()
+{
+    window_size = 0;
+    setup_stream();
+}
+
+void setup_windowed()
+{
+    /* Rounded up to a page. */
+    window_size = 1000;
+    setup_stream();
+}
+
+void teardown_stream()
+{
+    ck_assert(sl_mmap_close2(stream) == 0);
+    stream = NULL;
+    ck_assert(fclose(tmpf) == 0);
+}
+
+START_TEST(test_read_seek)
+{
+    char buf[10000];
+    off_t offset = 0;
+    size_t read;
+
+    ck_assert(sl_length(stream) == TEST_DATA_LENGTH);
+    while ((read = sl_read(stream, buf, 3000)) > 0) {
+        ck_assert(memcmp(buf, test_data + offset, read) == 0);
+        offset += read;
+        ck_assert(sl_tell(stream) == offset);
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+    ck_assert(!sl_error(stream));
+
+    ck_assert(sl_seek(stream, -100, SL_SEEK_END) == 0);
+    ck_assert(!sl_eof(stream));
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == 100);
+    ck_assert(memcmp(buf, test_data + TEST_DATA_LENGTH - 100, 100) == 0);
+
+    ck_assert(sl_seek(stream, 5000, SL_SEEK_SET) == 0);
+    ck_assert(sl_seek(stream, -4000, SL_SEEK_CUR) == 0);
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 1000, sizeof(buf)) == 0);
+    ck_assert(sl_seek(stream, -1, SL_SEEK_SET) != 0);
+
+    ck_assert(sl_seek(stream, TEST_DATA_LENGTH + 10, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(stream, buf, 10) == 0);
+    ck_assert(sl_eof(stream));
+}
+END_TEST
+
+START_TEST(test_input)
+{
+    const void *data;
+    const void *first;
+    off_t offset = 0;
+    size_t len;
+
+    ck_assert(sl_input(stream, &first, 100) == 100);
+    ck_assert(memcmp(first, test_data, 100) == 0);
+    ck_assert(sl_input(stream, &data, 100) == 100);
+    ck_assert(data == (const char*)first + 100);
+
+    ck_assert(sl_seek(stream, 0, SL_SEEK_SET) == 0);
+    while ((len = sl_input(stream, &data, TEST_DATA_LENGTH)) > 0) {
+        ck_assert(memcmp(data, test_data + offset, len) == 0);
+        offset += len;
+    }
+    ck_assert(offset == TEST_DATA_LENGTH);
+    ck_assert(sl_eof(stream));
+
+    /* Whole file comes at once unless mapped in windows. */
+    ck_assert(sl_seek(stream, 10, SL_SEEK_SET) == 0);
+    len = sl_input(stream, &data, TEST_DATA_LENGTH);
+    if (window_size) {
+        ck_assert(len < TEST_DATA_LENGTH - 10);
+    } else {
+        ck_assert(len == TEST_DATA_LENGTH - 10);
+    }
+}
+END_TEST
+
+START_TEST(test_read_at_multi)
+{
+    const off_t offsets[] = {40000, 0, 4000, TEST_DATA_LENGTH - 10,
+                             TEST_DATA_LENGTH + 10, -100};
+    const size_t lengths[] = {500, 100, 10000, 20, 10, 200};
+    const int count = sizeof(offsets) / sizeof(offsets[0]);
+    sl_extent_t extents[sizeof(offsets) / sizeof(offsets[0])];
+    size_t expected;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        extents[i].offset = offsets[i];
+        extents[i].length = lengths[i];
+        extents[i].buffer = malloc(lengths[i]);
+    }
+    ck_assert(sl_read_multi(stream, extents, count) != 0);
+    for (i = 0; i < count; i++) {
+        expected = (offsets[i] < 0 || offsets[i] >= TEST_DATA_LENGTH ? 0 :
+                    TEST_DATA_LENGTH - offsets[i] < lengths[i] ?
+                        TEST_DATA_LENGTH - offsets[i] : lengths[i]);
+        ck_assert_uint_eq(extents[i].read, expected);
+        ck_assert(expected == 0
+                  || memcmp(extents[i].buffer, test_data + offsets[i],
+                            expected) == 0);
+        free(extents[i].buffer);
+    }
+    ck_assert(sl_tell(stream) == 0);
+}
+END_TEST
+
+START_TEST(test_advise_clone)
+{
+    const int advice[] = {SL_ADVICE_SEQUENTIAL, SL_ADVICE_RANDOM,
+                          SL_ADVICE_WILLNEED, SL_ADVICE_NOREUSE,
+                          SL_ADVICE_DONTNEED, SL_ADVICE_NORMAL};
+    streamlike_t *clone;
+    char buf[100];
+    size_t i;
+
+    for (i = 0; i < sizeof(advice) / sizeof(advice[0]); i++) {
+        ck_assert_int_eq(sl_advise(stream, 0, 0, advice[i]), 0);
+    }
+    ck_assert_int_ne(sl_advise(stream, 0, 0, 12345), 0);
+
+    ck_assert(sl_seek(stream, 1000, SL_SEEK_SET) == 0);
+    clone = sl_clone(stream);
+    verify_stream_integrity(clone);
+    ck_assert(sl_tell(clone) == 1000);
+    ck_assert(sl_seek(clone, 50000, SL_SEEK_SET) == 0);
+    ck_assert(sl_read(clone, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 50000, sizeof(buf)) == 0);
+    ck_assert(sl_mmap_close(clone) == 0);
+
+    ck_assert(sl_read(stream, buf, sizeof(buf)) == sizeof(buf));
+    ck_assert(memcmp(buf, test_data + 1000, sizeof(buf)) == 0);
+}
+END_TEST
+
+Suite* streamlike_mmap_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike Mmap");
+
+    tc = tcase_create("Create Destroy");
+    tcase_add_test(tc, test_create_destroy);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Whole");
+    tcase_add_checked_fixture(tc, setup_whole, teardown_stream);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_input);
+    tcase_add_test(tc, test_read_at_multi);
+    tcase_add_test(tc, test_advise_clone);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Windowed");
+    tcase_add_checked_fixture(tc, setup_windowed, teardown_stream);
+    tcase_add_test(tc, test_read_seek);
+    tcase_add_test(tc, test_input);
+    tcase_add_test(tc, test_read_at_multi);
+    tcase_add_test(tc, test_advise_clone);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_mmap_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,214 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "streamlike/file.h"
+#include "streamlike/readbuf.h"
+#include "util/util.h"
+
+#define TEST_DATA_LENGTH      (256 * 1024 + 100)
+#define TEST_DATA_RANDOM_SEED (0)
+#define TEST_BLOCK_SIZE       (4096)
+
+FILE *tmpf;
+streamlike_t *file_stream;
+streamlike_t counting_stream;
+streamlike_t *readbuf_stream;
+char test_data[TEST_DATA_LENGTH];
+int inner_reads;
+
+/* Inner stream counting reads, to tell which reads are served by the block. */
+static
+size_t counting_read_cb(void *context, void *buffer, size_t len)
+{
+    inner_reads++;
+    return sl_fread_cb(context, buffer, len);
+}
+
+void setup()
+{
+    tmpf = tmpfile();
+    ck_assert_ptr_nonnull(tmpf);
+    ck_assert_uint_eq(fwrite(test_data, 1, TEST_DATA_LENGTH, tmpf),
+                      TEST_DATA_LENGTH);
+    rewind(tmpf);
+    file_stream = sl_fopen2(tmpf);
+    ck_assert_ptr_nonnull(file_stream);
+    counting_stream = *file_stream;
+    counting_stream.read = counting_read_cb;
+    inner_reads = 0;
+    readbuf_stream = sl_readbuf_create2(&counting_stream, TEST_BLOCK_SIZE);
+    ck_assert_ptr_nonnull(readbuf_stream);
+}
+
+void teardown()
+{
+    ck_assert_int_eq(sl_readbuf_destroy(readbuf_stream), 0);
+    readbuf_stream = NULL;
+    ck_assert_int_eq(sl_fclose(file_stream), 0);
+    file_stream = NULL;
+}
+
+START_TEST(test_stream_integrity)
+{
+    streamlike_t *stream = readbuf_stream;
+
+    ck_assert_ptr_eq(stream->read, sl_readbuf_read_cb);
+    ck_assert_ptr_eq(stream->input, sl_readbuf_input_cb);
+    ck_assert_ptr_eq(stream->read_at, sl_readbuf_read_at_cb);
+    ck_assert_ptr_eq(stream->seek, sl_readbuf_seek_cb);
+    ck_assert_ptr_eq(stream->seek_cost, sl_readbuf_seek_cost_cb);
+    ck_assert_ptr_null(stream->write);
+    ck_assert_ptr_null(stream->clone);
+    ck_assert(sl_has_caps(stream, sl_probe_caps(stream) | SL_CAP_ZERO_COPY));
+
+    ck_assert_int_eq(sl_seekable(stream), SL_SEEKING_SUPPORTED);
+    ck_assert_int_eq(sl_length(stream), TEST_DATA_LENGTH);
+}
+END_TEST
+
+START_TEST(test_small_reads)
+{
+    char buffer[100];
+    size_t got;
+    off_t offset = 0;
+
+    while ((got = sl_read(readbuf_stream, buffer, sizeof(buffer))) > 0) {
+        ck_assert_mem_eq(buffer, test_data + offset, got);
+        offset += got;
+        ck_assert_int_eq(sl_tell(readbuf_stream), offset);
+    }
+    ck_assert_int_eq(offset, TEST_DATA_LENGTH);
+    ck_assert(sl_eof(readbuf_stream));
+    /* One inner read per block, and a few more finding end-of-file. */
+    ck_assert_int_le(inner_reads, TEST_DATA_LENGTH / TEST_BLOCK_SIZE + 3);
+}
+END_TEST
+
+START_TEST(test_large_reads)
+{
+    char *buffer = malloc(3 * TEST_BLOCK_SIZE);
+
+    ck_assert_ptr_nonnull(buffer);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 10), 10);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 3 * TEST_BLOCK_SIZE),
+                      3 * TEST_BLOCK_SIZE);
+    ck_assert_mem_eq(buffer, test_data + 10, 3 * TEST_BLOCK_SIZE);
+
+    /* Rest of the block is copied, the whole block after it is read into
+     * caller memory, and only the tail refills the block. */
+    inner_reads = 0;
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 2 * TEST_BLOCK_SIZE),
+                      2 * TEST_BLOCK_SIZE);
+    ck_assert_mem_eq(buffer, test_data + 10 + 3 * TEST_BLOCK_SIZE,
+                     2 * TEST_BLOCK_SIZE);
+    ck_assert_int_eq(inner_reads, 2);
+
+    ck_assert_int_eq(sl_seek(readbuf_stream, -100, SL_SEEK_END), 0);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 3 * TEST_BLOCK_SIZE),
+                      100);
+    ck_assert_mem_eq(buffer, test_data + TEST_DATA_LENGTH - 100, 100);
+    ck_assert(sl_eof(readbuf_stream));
+    free(buffer);
+}
+END_TEST
+
+START_TEST(test_input)
+{
+    const void *data;
+    const void *first;
+
+    ck_assert(sl_has_caps(readbuf_stream, SL_CAP_ZERO_COPY));
+    ck_assert_uint_eq(sl_input(readbuf_stream, &first, 100), 100);
+    ck_assert_mem_eq(first, test_data, 100);
+
+    /* Consecutive inputs point into the same block. */
+    ck_assert_uint_eq(sl_input(readbuf_stream, &data, 100), 100);
+    ck_assert_ptr_eq(data, (const char*)first + 100);
+
+    /* Never more than the rest of the block. */
+    ck_assert_uint_eq(sl_input(readbuf_stream, &data, 2 * TEST_BLOCK_SIZE),
+                      TEST_BLOCK_SIZE - 200);
+    ck_assert_mem_eq(data, test_data + 200, TEST_BLOCK_SIZE - 200);
+    ck_assert_uint_eq(sl_input(readbuf_stream, &data, 2 * TEST_BLOCK_SIZE),
+                      TEST_BLOCK_SIZE);
+    ck_assert_mem_eq(data, test_data + TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    ck_assert_int_eq(inner_reads, 2);
+}
+END_TEST
+
+START_TEST(test_seek)
+{
+    char buffer[100];
+
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 100);
+    ck_assert_int_eq(inner_reads, 1);
+
+    /* Seeking within the block costs nothing and reads nothing. */
+    ck_assert_int_eq(sl_seek_cost(readbuf_stream, 3000), 0);
+    ck_assert_int_eq(sl_seek(readbuf_stream, 3000, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 3000, 100);
+    ck_assert_int_eq(sl_seek(readbuf_stream, -2000, SL_SEEK_CUR), 0);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 1100, 100);
+    ck_assert_int_eq(inner_reads, 1);
+
+    /* Far away refills the block holding the offset. */
+    ck_assert_int_eq(sl_seek(readbuf_stream, 100000, SL_SEEK_SET), 0);
+    ck_assert_int_eq(sl_tell(readbuf_stream), 100000);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 100000, 100);
+    ck_assert_int_eq(inner_reads, 2);
+    ck_assert_int_eq(sl_seek_cost(readbuf_stream,
+                                  100000 - 100000 % TEST_BLOCK_SIZE), 0);
+
+    ck_assert_int_eq(sl_seek(readbuf_stream, 10, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 100);
+    ck_assert_mem_eq(buffer, test_data + 10, 100);
+
+    ck_assert_int_eq(sl_seek(readbuf_stream, TEST_DATA_LENGTH + 10,
+                             SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(readbuf_stream, buffer, 100), 0);
+    ck_assert(sl_eof(readbuf_stream));
+    ck_assert_int_ne(sl_seek(readbuf_stream, -1, SL_SEEK_SET), 0);
+}
+END_TEST
+
+Suite* streamlike_readbuf_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike Read Buffer");
+
+    tc = tcase_create("File");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_stream_integrity);
+    tcase_add_test(tc, test_small_reads);
+    tcase_add_test(tc, test_large_reads);
+    tcase_add_test(tc, test_input);
+    tcase_add_test(tc, test_seek);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_readbuf_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
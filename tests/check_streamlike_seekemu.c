@@ -0,0 +1,265 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <check.h>
+
+#include "streamlike/buffer.h"
+#include "streamlike/fd.h"
+#include "streamlike/file.h"
+#include "streamlike/seekemu.h"
+#include "util/util.h"
+
+#define TEST_DATA_LENGTH      (256 * 1024)
+#define TEST_DATA_RANDOM_SEED (0)
+#define TEST_CACHE_SIZE       (4096)
+
+FILE *tmpf;
+streamlike_t *file_stream;
+streamlike_t pipe_stream;
+streamlike_t *seekemu_stream;
+char test_data[TEST_DATA_LENGTH];
+int restarts;
+int emulated;
+
+/* Inner stream seeking like a server ignoring ranges: only to the beginning. */
+static
+int pipe_seek_cb(void *context, off_t offset, int whence)
+{
+    if (offset != 0 || whence != SL_SEEK_SET) {
+        return -1;
+    }
+    restarts++;
+    return sl_fseek_cb(context, 0, SL_SEEK_SET);
+}
+
+static
+sl_seekable_t pipe_seekable_cb(void *context)
+{
+    return SL_SEEKING_NOT_SUPPORTED;
+}
+
+void setup_file()
+{
+    tmpf = tmpfile();
+    ck_assert_ptr_nonnull(tmpf);
+    ck_assert_uint_eq(fwrite(test_data, 1, TEST_DATA_LENGTH, tmpf),
+                      TEST_DATA_LENGTH);
+    rewind(tmpf);
+    file_stream = sl_fopen2(tmpf);
+    ck_assert_ptr_nonnull(file_stream);
+    restarts = 0;
+}
+
+void setup_native()
+{
+    setup_file();
+    emulated = 0;
+    seekemu_stream = sl_seekemu_create2(file_stream, TEST_CACHE_SIZE);
+    ck_assert_ptr_nonnull(seekemu_stream);
+}
+
+void setup_emulated()
+{
+    setup_file();
+    emulated = 1;
+    pipe_stream = *file_stream;
+    pipe_stream.seek      = pipe_seek_cb;
+    pipe_stream.seekable  = pipe_seekable_cb;
+    pipe_stream.read_at   = NULL;
+    pipe_stream.seek_cost = NULL;
+    pipe_stream.caps      = sl_probe_caps(&pipe_stream);
+    seekemu_stream = sl_seekemu_create2(&pipe_stream, TEST_CACHE_SIZE);
+    ck_assert_ptr_nonnull(seekemu_stream);
+}
+
+void teardown()
+{
+    ck_assert_int_eq(sl_seekemu_destroy(seekemu_stream), 0);
+    seekemu_stream = NULL;
+    ck_assert_int_eq(sl_fclose(file_stream), 0);
+    file_stream = NULL;
+}
+
+static
+void seek_and_check(off_t offset, size_t len)
+{
+    char buffer[1000];
+    size_t expected;
+
+    ck_assert_uint_le(len, sizeof(buffer));
+    expected = (offset >= TEST_DATA_LENGTH ? 0 :
+                TEST_DATA_LENGTH - offset < len ? TEST_DATA_LENGTH - offset :
+                len);
+    ck_assert_int_eq(sl_seek(seekemu_stream, offset, SL_SEEK_SET), 0);
+    ck_assert_int_eq(sl_tell(seekemu_stream), offset);
+    ck_assert_uint_eq(sl_read(seekemu_stream, buffer, len), expected);
+    ck_assert_mem_eq(buffer, test_data + offset, expected);
+    ck_assert_int_eq(sl_eof(seekemu_stream), expected < len);
+}
+
+START_TEST(test_stream_integrity)
+{
+    streamlike_t *stream = seekemu_stream;
+
+    ck_assert_ptr_eq(stream->read, sl_seekemu_read_cb);
+    ck_assert_ptr_eq(stream->seek, sl_seekemu_seek_cb);
+    ck_assert_ptr_eq(stream->tell, sl_seekemu_tell_cb);
+    ck_assert_ptr_eq(stream->seekable, sl_seekemu_seekable_cb);
+    ck_assert_ptr_eq(stream->seek_cost, sl_seekemu_seek_cost_cb);
+    ck_assert_ptr_null(stream->write);
+    ck_assert_ptr_null(stream->read_at);
+    ck_assert_ptr_null(stream->clone);
+    ck_assert_uint_eq(sl_caps(stream), sl_probe_caps(stream));
+
+    ck_assert_int_eq(sl_seekable(stream), (emulated ? SL_SEEKING_EMULATED
+                                                    : SL_SEEKING_SUPPORTED));
+    ck_assert_int_eq(sl_length(stream), TEST_DATA_LENGTH);
+}
+END_TEST
+
+START_TEST(test_seek)
+{
+    char buffer[1000];
+
+    /* Forward, back into the cache, far back, and forward again. */
+    seek_and_check(1000, 1000);
+    seek_and_check(50000, 1000);
+    seek_and_check(48000, 1000);
+    seek_and_check(50500, 1000);
+    seek_and_check(100, 1000);
+    seek_and_check(TEST_DATA_LENGTH - 500, 1000);
+    seek_and_check(TEST_DATA_LENGTH + 500, 1000);
+    seek_and_check(TEST_DATA_LENGTH / 2, 1000);
+
+    ck_assert_int_eq(sl_seek(seekemu_stream, 100, SL_SEEK_CUR), 0);
+    ck_assert_int_eq(sl_tell(seekemu_stream), TEST_DATA_LENGTH / 2 + 1100);
+    ck_assert_int_eq(sl_seek(seekemu_stream, -10, SL_SEEK_END), 0);
+    ck_assert_uint_eq(sl_read(seekemu_stream, buffer, sizeof(buffer)), 10);
+    ck_assert_mem_eq(buffer, test_data + TEST_DATA_LENGTH - 10, 10);
+    ck_assert_int_ne(sl_seek(seekemu_stream, -1, SL_SEEK_SET), 0);
+}
+END_TEST
+
+static
+void* pipe_writer(void *arg)
+{
+    int fd = *(int*)arg;
+    size_t written = 0;
+    ssize_t ret;
+
+    while (written < TEST_DATA_LENGTH) {
+        ret = write(fd, test_data + written, TEST_DATA_LENGTH - written);
+        if (ret <= 0) {
+            break;
+        }
+        written += ret;
+    }
+    close(fd);
+    return NULL;
+}
+
+/* Buffer has an input callback, which gives nothing outside blocks mode. */
+START_TEST(test_buffered_pipe)
+{
+    streamlike_t *fd_stream;
+    streamlike_t *buffer_stream;
+    streamlike_t *stream;
+    pthread_t writer;
+    char buffer[1000];
+    int fds[2];
+
+    ck_assert(pipe(fds) == 0);
+    ck_assert(pthread_create(&writer, NULL, pipe_writer, &fds[1]) == 0);
+    fd_stream = sl_fd_open2(fds[0]);
+    ck_assert_ptr_nonnull(fd_stream);
+    buffer_stream = sl_buffer_create(fd_stream);
+    ck_assert_ptr_nonnull(buffer_stream);
+    ck_assert(!sl_has_caps(buffer_stream, SL_CAP_INPUT));
+    ck_assert_int_eq(sl_buffer_threaded_fill_buffer(buffer_stream), 0);
+    stream = sl_seekemu_create2(buffer_stream, TEST_CACHE_SIZE);
+    ck_assert_ptr_nonnull(stream);
+
+    ck_assert_int_eq(sl_seek(stream, 0, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data, sizeof(buffer));
+    ck_assert_int_eq(sl_seek(stream, 100000, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), sizeof(buffer));
+    ck_assert_mem_eq(buffer, test_data + 100000, sizeof(buffer));
+    ck_assert_int_eq(sl_eof(stream), 0);
+    /* Drains the pipe, so that the writer is done. */
+    ck_assert_int_eq(sl_seek(stream, TEST_DATA_LENGTH - 10, SL_SEEK_SET), 0);
+    ck_assert_uint_eq(sl_read(stream, buffer, sizeof(buffer)), 10);
+    ck_assert_mem_eq(buffer, test_data + TEST_DATA_LENGTH - 10, 10);
+
+    ck_assert_int_eq(sl_seekemu_destroy(stream), 0);
+    ck_assert_int_eq(sl_buffer_destroy(buffer_stream), 0);
+    ck_assert_int_eq(sl_fd_close(fd_stream), 0);
+    ck_assert(pthread_join(writer, NULL) == 0);
+}
+END_TEST
+
+START_TEST(test_replay)
+{
+    seek_and_check(10000, 1000);
+    ck_assert_int_eq(restarts, 0);
+
+    /* Seeking within cached data is free and doesn't restart. */
+    ck_assert_int_eq(sl_seek_cost(seekemu_stream, 11000 - TEST_CACHE_SIZE), 0);
+    seek_and_check(11000 - TEST_CACHE_SIZE, 1000);
+    seek_and_check(10500, 1000);
+    ck_assert_int_eq(restarts, 0);
+
+    /* Going further back reads from the beginning again. */
+    ck_assert_int_eq(sl_seek_cost(seekemu_stream, 100), 100);
+    ck_assert_int_eq(sl_seek_cost(seekemu_stream, 21500), 10000);
+    seek_and_check(100, 1000);
+    ck_assert_int_eq(restarts, 1);
+}
+END_TEST
+
+Suite* streamlike_seekemu_suite()
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Streamlike Seek Emulation");
+
+    tc = tcase_create("Native");
+    tcase_add_checked_fixture(tc, setup_native, teardown);
+    tcase_add_test(tc, test_stream_integrity);
+    tcase_add_test(tc, test_seek);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Emulated");
+    tcase_add_checked_fixture(tc, setup_emulated, teardown);
+    tcase_add_test(tc, test_stream_integrity);
+    tcase_add_test(tc, test_seek);
+    tcase_add_test(tc, test_replay);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Buffered");
+    tcase_add_test(tc, test_buffered_pipe);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    SRunner *sr;
+    int num_failed;
+
+    fill_random_data(test_data, TEST_DATA_LENGTH, TEST_DATA_RANDOM_SEED);
+
+    sr = srunner_create(streamlike_seekemu_suite());
+
+    srunner_run_all(sr, CK_ENV);
+
+    num_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}